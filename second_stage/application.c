@@ -2,12 +2,13 @@
 
 #include "tuple.h"
 #include "libgpu/gpu_agg.h"
+#include "libcpu/cpu_agg.h"
 
 application_p application(
-    int pipeline_depth,
+    int pipeline_depth, int thread_num,
     query_p query,
     u_int8_t ** buffers, int buffer_size, int buffer_num,
-    u_int8_t * result) {
+    u_int8_t * result, long result_size) {
 
     application_p p = (application_p) malloc(sizeof(application_t));
 
@@ -17,16 +18,38 @@ application_p application(
     p->buffer_size = buffer_size;
     p->buffer_num = buffer_num;
 
-    /* TODO fix the tuple size */
-    /* Used as an output stream */
-    p->output = batch(6 * query->batch_size, 0, result, 6 * query->batch_size, TUPLE_SIZE);
+    /* Used as an output stream of result_size bytes, whatever the size of the output tuples */
+    p->output = batch(result_size, 0, result, result_size, 1);
 
-    /* Start GPU and compile the query program*/
-    gpu_init(query->operator_num, pipeline_depth, NULL);
-    query_setup(query);
+    /* The cost model estimates the selections on the first input buffer */
+    if (query->planning == QUERY_PLAN_COST || query->planning == QUERY_PLAN_ADAPTIVE) {
+        query_sample(query, buffers[0], buffer_size);
+    }
+
+    if (query->backend == BACKEND_CPU) {
+        /* Start the host workers and set up the operators. Host execution is synchronous, so there is
+           no output to be read in a later round and the pipeline has no depth */
+        cpu_init(thread_num);
+        query_setup(query);
+
+        pipeline_depth = 0;
+    } else {
+        /* Start GPU and compile the query program; an adaptive query also compiles a fused copy of some sinks */
+        gpu_init((query->planning == QUERY_PLAN_ADAPTIVE) ? 2 * query->operator_num : query->operator_num, 
+            pipeline_depth, NULL);
+        if (pipeline_depth == 0) {
+            gpu_set_completion_handler(scheduler_complete_task);
+        }
+
+        /* A hybrid query also needs the host workers */
+        if (query->backend == BACKEND_HYBRID) {
+            cpu_init(thread_num);
+        }
+        query_setup(query);
+    }
 
     /* Start scheduler */
-    p->scheduler = scheduler_init(pipeline_depth);
+    p->scheduler = scheduler_init(pipeline_depth, query->backend == BACKEND_HYBRID);
 
     /* Start throughput monitoring */
     p->manager = event_manager_init(query->operator_num);
@@ -54,7 +77,7 @@ void application_run(application_p p,
         while (1) {
             usleep(DISPATCHER_INSERT_TIMEOUT);
 
-            dispatcher_insert(p->dispatchers[0], p->buffers[b], p->buffer_size, event_get_mtime());
+            dispatcher_insert(p->dispatchers[0], p->buffers[b], p->buffer_size, TUPLE_SIZE, event_get_mtime());
 
             b = (b+1) % p->buffer_num;
         }
@@ -63,17 +86,32 @@ void application_run(application_p p,
         for (int i=0; i<workload; i++) {
             usleep(DISPATCHER_INSERT_TIMEOUT);
 
-            dispatcher_insert(p->dispatchers[0], p->buffers[b], p->buffer_size, event_get_mtime());
+            dispatcher_insert(p->dispatchers[0], p->buffers[b], p->buffer_size, TUPLE_SIZE, event_get_mtime());
 
             b = (b+1) % p->buffer_num;
         }
 
-        while (p->scheduler->queue_size != 0) {
-            sched_yield();
+        /* The last GPU tasks wait in the pipeline for tasks that no longer come */
+        scheduler_flush(p->scheduler);
+
+        while (! application_is_drained(p)) {
+            usleep(APPLICATION_DRAIN_TIMEOUT);
         }
+    }
+}
+
+bool application_is_drained(application_p p) {
+    /* Upstream first, as a stage only inserts into the next one before its batch counts as handled */
+    for (int i=0; i<p->query->operator_num; i++) {
+        dispatcher_p dispatcher = p->dispatchers[i];
 
-        exit(1);
+        long inserted = __atomic_load_n(&dispatcher->seq, __ATOMIC_RELAXED);
+        long handled = __atomic_load_n(&dispatcher->handler->next_seq, __ATOMIC_ACQUIRE);
+        if (handled != inserted) {
+            return false;
+        }
     }
+    return true;
 }
 
 void application_free(application_p p) {
@@ -82,7 +120,12 @@ void application_free(application_p p) {
 
     free(p->output);
 
-    gpu_free();
+    if (p->query->backend != BACKEND_GPU) {
+        cpu_free();
+    }
+    if (p->query->backend != BACKEND_CPU) {
+        gpu_free();
+    }
 
     free(p);
 }
\ No newline at end of file
@@ -6,10 +6,12 @@
 #include "monitor/event_manager.h"
 #include "scheduler/scheduler.h"
 
+#define APPLICATION_DRAIN_TIMEOUT 100 // us
+
 typedef struct application * application_p;
 typedef struct application {
     scheduler_p scheduler;
-    dispatcher_p dispatchers[2];
+    dispatcher_p dispatchers[QUERY_MAX_OPERATOR_NUM];
 
     query_p query;
 
@@ -24,14 +26,21 @@ typedef struct application {
 } application_t;
 
 application_p application(
-    int pipeline_depth,
+    int pipeline_depth, int thread_num,
     query_p query,
     u_int8_t ** buffers, int buffer_size, int buffer_num,
-    u_int8_t * result);
+    u_int8_t * result, long result_size);
 
+/* Inserts workload batches of the input buffers and waits until they are drained, or keeps inserting them if workload is 1 */
 void application_run(application_p p,
     int workload);
 
+/**
+ * Whether every batch inserted so far has been handled by every stage. Output that a stage holds back
+ * for a whole batch of the next one does not count, refer to fill_buffer
+ **/
+bool application_is_drained(application_p p);
+
 void application_free(application_p p);
 
 #endif
\ No newline at end of file
@@ -26,6 +26,10 @@ batch_p batch(int size, long start, u_int8_t * buffer, int buffer_size, int tupl
     batch->buffer = buffer;
     batch->buffer_size = buffer_size;
 
+    batch->previous_pane_id = -1;
+    batch->start_pointer = 0;
+    batch->unselected = false;
+
     struct timespec time;
     clock_gettime(CLOCK_MONOTONIC_RAW, &time);
     batch->timestamp = time.tv_sec * 1000000 + time.tv_nsec / 1000;
@@ -1,6 +1,7 @@
 #ifndef __BATCH_H_
 #define __BATCH_H_
 
+#include <stdbool.h>
 #include <stdlib.h>
 
 typedef struct batch * batch_p;
@@ -18,6 +19,13 @@ typedef struct batch {
     u_int8_t * buffer;
     int buffer_size;
 
+    /* Position of the batch in its stream, from the dispatcher; refer to dispatcher_insert */
+    long previous_pane_id; /* Pane of the last tuple of the previous batch, -1 for the first batch */
+    long start_pointer;    /* Bytes of the stream before this batch */
+
+    /* Holds tuples the selections of a fused stage have passed on without selecting, refer to query_adapt */
+    bool unselected;
+
     int closing_windows;
     int pending_windows;
     int complete_windows;
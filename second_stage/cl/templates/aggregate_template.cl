@@ -76,6 +76,389 @@ inline int jenkinsHash (__local uchar *key, int length, int initValue) {
 	return c;
 }
 
+/* The work group table is at the start of the scratch memory, the keys the threads pack follow it */
+#define LOCAL_TABLE_BYTES (LOCAL_TABLE_CAPACITY * sizeof(intermediate_t))
+
+/*
+ * Inserts the tuple at byte idx into a table, returns 0 if the table is full.
+ *
+ * The thread that claims an empty slot stores the key, and every thread (that one included)
+ * then updates the values atomically, so that no update is lost to a concurrent store.
+ */
+inline int insertf (__global uchar *table, int table_capacity, __global const uchar *input, int idx, __local uchar *scratch) {
+
+	int lidx = LOCAL_TABLE_BYTES + get_local_id (0) * sizeof(key_t);
+
+	__global input_t *p = (__global input_t *) &input[idx];
+	__local  key_t   *k = (__local  key_t   *) &scratch[lidx];
+
+	pack_key (k, p);
+
+	/* The capacity of a table is not a power of two, as the entries are not */
+	int h = (uint) jenkinsHash(&scratch[lidx], sizeof(key_t), 1) % table_capacity;
+
+	for (int attempt = 1; attempt <= table_capacity; ++attempt) {
+
+		__global intermediate_t *t = (__global intermediate_t *) &table[h * sizeof(intermediate_t)];
+
+		int old = atomic_cmpxchg((global int *) &(t->tuple.mark), -1, idx);
+		if (old == -1) {
+
+			/* Insert new tuple */
+			storef (t, p);
+			updatef (t, p);
+			return 1;
+		}
+
+		/* Check tuple at position `old` */
+		__global input_t *theOther = (__global input_t *) &input[old];
+
+		/* Compare keys */
+		if (comparef(k, theOther) == 1) {
+			updatef (t, p);
+			return 1;
+		}
+
+		/* Conflict; try next slot */
+		h = (h + 1 == table_capacity) ? 0 : h + 1;
+	}
+
+	return 0;
+}
+
+/* As insertf, into the table of the work group, which holds at most LOCAL_TABLE_CAPACITY groups */
+inline int local_insertf (__global const uchar *input, int idx, __local uchar *scratch) {
+
+	int lidx = LOCAL_TABLE_BYTES + get_local_id (0) * sizeof(key_t);
+
+	__global input_t *p = (__global input_t *) &input[idx];
+	__local  key_t   *k = (__local  key_t   *) &scratch[lidx];
+
+	pack_key (k, p);
+
+	int h = (uint) jenkinsHash(&scratch[lidx], sizeof(key_t), 1) % LOCAL_TABLE_CAPACITY;
+
+	for (int attempt = 1; attempt <= LOCAL_TABLE_CAPACITY; ++attempt) {
+
+		__local intermediate_t *t = (__local intermediate_t *) &scratch[h * sizeof(intermediate_t)];
+
+		int old = atomic_cmpxchg((local int *) &(t->tuple.mark), -1, idx);
+		if (old == -1) {
+			local_storef (t, p);
+			local_updatef (t, p);
+			return 1;
+		}
+
+		if (comparef(k, (__global input_t *) &input[old]) == 1) {
+			local_updatef (t, p);
+			return 1;
+		}
+
+		h = (h + 1 == LOCAL_TABLE_CAPACITY) ? 0 : h + 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Merges a group aggregated by the work group into a table, returns 0 if the table is full. The mark
+ * of the group is its first tuple, which the key is packed from again.
+ */
+inline int flush_entry (__global uchar *table, int table_capacity, __global const uchar *input, 
+	intermediate_t *entry, __local uchar *scratch) {
+
+	int lidx = LOCAL_TABLE_BYTES + get_local_id (0) * sizeof(key_t);
+
+	int idx = entry->tuple.mark;
+
+	__global input_t *p = (__global input_t *) &input[idx];
+	__local  key_t   *k = (__local  key_t   *) &scratch[lidx];
+
+	pack_key (k, p);
+
+	int h = (uint) jenkinsHash(&scratch[lidx], sizeof(key_t), 1) % table_capacity;
+
+	for (int attempt = 1; attempt <= table_capacity; ++attempt) {
+
+		__global intermediate_t *t = (__global intermediate_t *) &table[h * sizeof(intermediate_t)];
+
+		int old = atomic_cmpxchg((global int *) &(t->tuple.mark), -1, idx);
+		if (old == -1) {
+			storef (t, p);
+			flushf (t, entry);
+			return 1;
+		}
+
+		if (comparef(k, (__global input_t *) &input[old]) == 1) {
+			flushf (t, entry);
+			return 1;
+		}
+
+		h = (h + 1 == table_capacity) ? 0 : h + 1;
+	}
+
+	return 0;
+}
+
+/* The work group clears its table before it aggregates (a part of) a window */
+inline void local_begin (__local uchar *scratch) {
+
+	__local intermediate_t *local_table = (__local intermediate_t *) scratch;
+
+	for (int i = get_local_id (0); i < LOCAL_TABLE_CAPACITY; i += get_local_size (0))
+		local_clearf (&local_table[i]);
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+}
+
+/* A tuple that does not fit in the table of the work group goes to the table directly */
+inline void local_insert (__global uchar *table, int table_capacity, __global const uchar *input, int idx, 
+	__global int *failed, __local uchar *scratch) {
+
+	if (local_insertf (input, idx, scratch))
+		return;
+
+	if (! insertf (table, table_capacity, input, idx, scratch))
+		atomic_inc(&failed[0]);
+}
+
+/* The work group merges its table into the table once every work item has inserted its tuples */
+inline void local_end (__global uchar *table, int table_capacity, __global const uchar *input, 
+	__global int *failed, __local uchar *scratch) {
+
+	__local intermediate_t *local_table = (__local intermediate_t *) scratch;
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (int i = get_local_id (0); i < LOCAL_TABLE_CAPACITY; i += get_local_size (0)) {
+
+		if (local_table[i].tuple.mark == -1)
+			continue;
+
+		intermediate_t entry = local_table[i];
+
+		if (! flush_entry (table, table_capacity, input, &entry, scratch))
+			atomic_add(&failed[0], entry.tuple.count);
+	}
+
+	/* The next part clears the table */
+	barrier(CLK_LOCAL_MEM_FENCE);
+}
+
+#if PARTITION_BITS > 0
+/* The first of the partitioned tuple offsets in [from, to) that is not before idx */
+inline int lower_bound (__global const int *offsets, int from, int to, int idx) {
+	while (from < to) {
+		int mid = (from + to) / 2;
+		if (offsets[mid] < idx)
+			from = mid + 1;
+		else
+			to = mid;
+	}
+	return from;
+}
+#endif
+
+#if SORT_AGGREGATION
+/*
+ * Sorts a (key, tuple offset) pair per work item by key in local memory, those without a tuple (-1) 
+ * last, and returns the number of the others. A radix 4 least significant digit first sort: every pass 
+ * is a stable split by a digit, with the ranks of the four digits counted at once in 16 bit lanes.
+ */
+inline int sort_chunk (ulong key, int idx, __local ulong *keys, __local int *idxs, __local ulong *counts) {
+
+	int lid = get_local_id   (0);
+	int lgs = get_local_size (0);
+
+	int valid = 0;
+
+	/* The key digits, then whether there is a tuple, so that those come first in the order of their keys */
+	for (int shift = 0; shift <= SORT_KEY_BITS; shift += 2) {
+
+		int digit = (shift < SORT_KEY_BITS) ? (int) ((key >> shift) & 3) : (idx < 0);
+
+		ulong lane = 1ul << (16 * digit);
+
+		counts[lid] = lane;
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		for (int d = 1; d < lgs; d <<= 1) {
+			ulong before = (lid >= d) ? counts[lid - d] : 0;
+			barrier(CLK_LOCAL_MEM_FENCE);
+			counts[lid] += before;
+			barrier(CLK_LOCAL_MEM_FENCE);
+		}
+
+		ulong total = counts[lgs - 1];
+		ulong rank  = counts[lid] - lane;
+
+		int position = (int) ((rank >> (16 * digit)) & 0xFFFF);
+		for (int e = 0; e < digit; ++e)
+			position += (int) ((total >> (16 * e)) & 0xFFFF);
+
+		valid = (int) (total & 0xFFFF);
+
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		keys[position] = key;
+		idxs[position] = idx;
+
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		key = keys[lid];
+		idx = idxs[lid];
+	}
+
+	return valid;
+}
+#endif
+
+/*
+ * The work group aggregates the selected tuples between the window pointers into its table. Part
+ * `part` of `parts` work groups sharing the window takes every parts-th run of local size tuples.
+ *
+ * The tuples are first aggregated in local memory, so that a group takes one atomic update of the
+ * table per work group instead of one per tuple. Every work item of the group must call it, as it 
+ * synchronises the group.
+ *
+ * With partitions, the window is aggregated one partition at a time from the offsets the partition
+ * kernels sort the selected tuples of the batch by, so that the groups of a partition fit in local 
+ * memory even if those of the window do not.
+ *
+ * Sorting, the window is aggregated a work group of tuples at a time. The tuples are sorted by key,
+ * and the first work item of every run of equal keys reduces the run and merges it into the table, 
+ * so that there is no work group table to fill.
+ *
+ * With declared key bounds, the group of a key takes the slot of the key in the work group table and 
+ * then in the table, without hashing or probing. The keys out of the bounds are hashed into the rest 
+ * of the table.
+ */
+inline void aggregate_window (int start, int end, __global uchar *table, int _table_,
+	__global const uchar *input, __global int *failed, __global const int *partitions, __local uchar *scratch, 
+	int part, int parts) {
+
+	int table_capacity = _table_ / sizeof(intermediate_t);
+
+	int lid = get_local_id   (0);
+	int lgs = get_local_size (0);
+
+#if DIRECT_KEYS > 0
+	__local intermediate_t *local_table = (__local intermediate_t *) scratch;
+
+	__global uchar *hashed = &table[DIRECT_KEYS * sizeof(intermediate_t)];
+
+	local_begin (scratch);
+
+	int stride = parts * lgs * sizeof(input_t);
+
+	for (int idx = (part * lgs + lid) * sizeof(input_t) + start; idx < end; idx += stride) {
+
+		__global input_t *p = (__global input_t *) &input[idx];
+
+		if (! selectf (p))
+			continue;
+
+		int slot = key_index (p);
+		if (slot < 0) {
+			if (! insertf (hashed, table_capacity - DIRECT_KEYS, input, idx, scratch))
+				atomic_inc(&failed[0]);
+			continue;
+		}
+
+		/* The first tuple of the group marks it */
+		atomic_cmpxchg((local int *) &(local_table[slot].tuple.mark), -1, idx);
+		local_updatef (&local_table[slot], p);
+	}
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (int slot = lid; slot < DIRECT_KEYS; slot += lgs) {
+
+		intermediate_t entry = local_table[slot];
+		if (entry.tuple.mark == -1)
+			continue;
+
+		__global intermediate_t *t = (__global intermediate_t *) &table[slot * sizeof(intermediate_t)];
+
+		if (atomic_cmpxchg((global int *) &(t->tuple.mark), -1, entry.tuple.mark) == -1)
+			storef (t, (__global input_t *) &input[entry.tuple.mark]);
+
+		flushf (t, &entry);
+	}
+
+	/* The next window clears the work group table */
+	barrier(CLK_LOCAL_MEM_FENCE);
+#elif SORT_AGGREGATION
+	__local ulong *keys   = (__local ulong *) scratch;
+	__local ulong *counts = &keys[lgs];
+	__local int   *idxs   = (__local int *) &counts[lgs];
+
+	int stride = parts * lgs * sizeof(input_t);
+
+	for (int base = part * lgs * sizeof(input_t) + start; base < end; base += stride) {
+
+		int idx = base + lid * sizeof(input_t);
+
+		ulong key = 0;
+		if (idx < end && selectf ((__global input_t *) &input[idx]))
+			key = sort_key ((__global input_t *) &input[idx]);
+		else
+			idx = -1;
+
+		int valid = sort_chunk (key, idx, keys, idxs, counts);
+
+		if (lid < valid && (lid == 0 || keys[lid - 1] != keys[lid])) {
+
+			intermediate_t run;
+			private_clearf (&run);
+			run.tuple.mark = idxs[lid];
+
+			for (int i = lid; i < valid && keys[i] == keys[lid]; ++i)
+				accumulatef (&run, (__global input_t *) &input[idxs[i]]);
+
+			if (! flush_entry (table, table_capacity, input, &run, scratch))
+				atomic_add(&failed[0], run.tuple.count);
+		}
+
+		/* The next chunk overwrites the sorted pairs */
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+#elif PARTITION_BITS > 0
+	__global const int *starts  = partitions;
+	__global const int *offsets = &partitions[PARTITIONS + 1];
+
+	for (int p = 0; p < PARTITIONS; ++p) {
+
+		int from = lower_bound (offsets, starts[p], starts[p + 1], start);
+		int to   = lower_bound (offsets, from,      starts[p + 1], end);
+
+		if (from == to)
+			continue;
+
+		local_begin (scratch);
+
+		for (int i = from + part * lgs + lid; i < to; i += parts * lgs)
+			local_insert (table, table_capacity, input, offsets[i], failed, scratch);
+
+		local_end (table, table_capacity, input, failed, scratch);
+	}
+#else
+	local_begin (scratch);
+
+	int stride = parts * lgs * sizeof(input_t);
+
+	for (int idx = (part * lgs + lid) * sizeof(input_t) + start; idx < end; idx += stride) {
+
+		if (! selectf ((__global input_t *) &input[idx]))
+			continue;
+
+		local_insert (table, table_capacity, input, idx, failed, scratch);
+	}
+
+	local_end (table, table_capacity, input, failed, scratch);
+#endif
+}
+
 /* based on the value in window_ptrs_(start ptr) and _window_ptrs(end ptr), count the number of open, close, pending 
  * and complete window
  */
@@ -98,11 +481,11 @@ __kernel void countWindowsKernel (
 	__global uchar* pendingContents,
 	__global uchar* completeContents,
 	__global uchar* openingContents,
+	__global int* partitions,
 	__local uchar *scratch
 ) {
 	int tid = (int) get_global_id  (0);
 	int lid = (int) get_local_id   (0);
-	int gid = (int) get_group_id   (0);
 	int lgs = (int) get_local_size (0); /* Local group size */
 	int nlg = (int) get_num_groups (0);
 
@@ -114,37 +497,22 @@ __kernel void countWindowsKernel (
 
 	int wid = tid;
 
-	if (wid > num_windows)
-		return;
-
 	/* A group may process more than one windows */
 	while (wid <= num_windows) {
 
 		int  offset_ =  window_ptrs_ [wid]; /* Window start and end pointers */
 		int _offset  = _window_ptrs  [wid];
 
-		/* Check if a window is closing, opening, pending, or complete. */
+		/* Check if a window is closing, opening, pending, or complete (refer to cpu_window_classify) */
 		if (offset_ < 0 && _offset >= 0) {
-			/* A closing window; set start offset */
-			offset_ = 0;
 			atomic_inc(&windowCounts[0]);
 		} else
 		if (offset_ >= 0 && _offset < 0) {
-			/* An opening window; set end offset */
-			_offset = inputBytes;
 			atomic_inc(&windowCounts[3]);
 		} else
 		if (offset_ < 0 && _offset < 0) {
-			/* A pending window */
-			_offset  = 0;
-			offset_ = inputBytes;
 			atomic_inc(&windowCounts[1]);
-		} else
-		if (offset_ == 0 && _offset == 0) {
-			/* A closing window */
-			atomic_inc(&windowCounts[0]);
 		} else {
-			/* A complete window */
 			atomic_inc(&windowCounts[2]);
 		}
 
@@ -153,7 +521,31 @@ __kernel void countWindowsKernel (
 	return ;
 }
 
-__kernel void aggregateClosingWindowsKernel (
+#if PARTITION_BITS > 0
+/* The partition of the tuple at byte idx by the high bits of the hash of its key, -1 if it is not selected */
+inline int partitionf (__global const uchar *input, int idx, __local uchar *scratch) {
+
+	__global input_t *p = (__global input_t *) &input[idx];
+
+	if (! selectf (p))
+		return -1;
+
+	int lidx = LOCAL_TABLE_BYTES + get_local_id (0) * sizeof(key_t);
+
+	pack_key ((__local key_t *) &scratch[lidx], p);
+
+	return (uint) jenkinsHash(&scratch[lidx], sizeof(key_t), 1) >> (32 - PARTITION_BITS);
+}
+#endif
+
+/*
+ * The partition buffer holds the start of every partition (and the end of the last), the byte offsets
+ * of the selected tuples of the batch ordered by partition and then by offset, and the number of tuples 
+ * of each partition in each work group, partition major.
+ *
+ * The kernels do nothing without partitions.
+ */
+__kernel void partitionHistogramKernel (
 	const int tuples,
 	const int inputBytes,
 	const int outputBytes,
@@ -172,104 +564,174 @@ __kernel void aggregateClosingWindowsKernel (
 	__global uchar* pendingContents,
 	__global uchar* completeContents,
 	__global uchar* openingContents,
+	__global int* partitions,
 	__local uchar *scratch
 ) {
+#if PARTITION_BITS > 0
 	int tid = (int) get_global_id  (0);
 	int lid = (int) get_local_id   (0);
+	int lgs = (int) get_local_size (0);
 	int gid = (int) get_group_id   (0);
-	int lgs = (int) get_local_size (0); /* Local group size */
 	int nlg = (int) get_num_groups (0);
 
+	__local int *counts = (__local int *) scratch;
 
-	__local int num_windows;
-	if (lid == 0)
-		num_windows = windowCounts[0];
- 
-	barrier(CLK_LOCAL_MEM_FENCE);
+	for (int p = lid; p < PARTITIONS; p += lgs)
+		counts[p] = 0;
 
-	int group_offset = lgs * sizeof(input_t);
+	barrier(CLK_LOCAL_MEM_FENCE);
 
-	int table_capacity = _table_ / sizeof(intermediate_t);
+	int q = partitionf (input, tid * sizeof(input_t), scratch);
+	if (q >= 0)
+		atomic_inc(&counts[q]);
 
-	int wid = gid;
+	barrier(CLK_LOCAL_MEM_FENCE);
 
-	if (wid >= num_windows)
-		return;
+	__global int *histograms = &partitions[PARTITIONS + 1 + tuples];
 
-	// A group may process more than one closing windows
-	while (wid < num_windows) {
-		//
-		// The offset of closing windows should start from 0.
-		//
-		int table_offset = wid * (_table_);
+	for (int p = lid; p < PARTITIONS; p += lgs)
+		histograms[p * nlg + gid] = counts[p];
+#endif
+}
 
-		int  offset_ =  window_ptrs_ [wid]; // Window start and end pointers
-		int _offset  = _window_ptrs  [wid];
+/* Every work group writes the offsets of its tuples after those of the work groups before it */
+__kernel void partitionKernel (
+	const int tuples,
+	const int inputBytes,
+	const int outputBytes,
+	const int _table_,
+	const int maxWindows,
+	const long previousPaneId,
+	const long batchOffset,
+	__global const uchar* input,
+	__global int* window_ptrs_,
+	__global int* _window_ptrs,
+	__global int *failed,
+	// __global int *attempts,
+	__global long *offset, /* Temp. variable holding the window pointer offset and window counts */
+	__global int *windowCounts,
+	__global uchar* closingContents,
+	__global uchar* pendingContents,
+	__global uchar* completeContents,
+	__global uchar* openingContents,
+	__global int* partitions,
+	__local uchar *scratch
+) {
+#if PARTITION_BITS > 0
+	int tid = (int) get_global_id  (0);
+	int lid = (int) get_local_id   (0);
+	int lgs = (int) get_local_size (0);
+	int gid = (int) get_group_id   (0);
+	int nlg = (int) get_num_groups (0);
 
-		if (offset_ == _offset) {
-		 	wid += nlg;
-			continue;
+	__local int *bases  = (__local int *) scratch;
+	__local int *totals = &bases[PARTITIONS];
+	__local int *keys   = &totals[PARTITIONS + 1];
+
+	__global int *starts     = partitions;
+	__global int *offsets    = &partitions[PARTITIONS + 1];
+	__global int *histograms = &partitions[PARTITIONS + 1 + tuples];
+
+	for (int p = lid; p < PARTITIONS; p += lgs) {
+		int before = 0, total = 0;
+		for (int g = 0; g < nlg; ++g) {
+			int count = histograms[p * nlg + g];
+			if (g < gid)
+				before += count;
+			total += count;
 		}
+		bases [p] = before;
+		totals[p] = total;
+	}
 
-		int idx = lid * sizeof(input_t) + offset_;
-
-		while (idx < _offset) {
-
-			int lidx = lid * sizeof(key_t);
+	barrier(CLK_LOCAL_MEM_FENCE);
 
-			__global input_t *p = (__global input_t *)   &input[ idx];
-			__local key_t    *k = (__local  key_t   *) &scratch[lidx];
+	if (lid == 0) {
+		int sum = 0;
+		for (int p = 0; p < PARTITIONS; ++p) {
+			int total = totals[p];
+			totals[p] = sum;
+			sum += total;
+		}
+		totals[PARTITIONS] = sum;
+	}
 
-			pack_key (k, p);
+	barrier(CLK_LOCAL_MEM_FENCE);
 
-			int h = jenkinsHash(&scratch[lidx], sizeof(key_t), 1) & (table_capacity - 1);
+	for (int p = lid; p <= PARTITIONS; p += lgs) {
+		if (p < PARTITIONS)
+			bases[p] += totals[p];
+		if (gid == 0)
+			starts[p] = totals[p];
+	}
 
-			int tableIndex = h * sizeof(intermediate_tuple_t) + table_offset;
+	int q = partitionf (input, tid * sizeof(input_t), scratch);
+	keys[lid] = q;
 
-			// Insert
-			bool success = false;
+	barrier(CLK_LOCAL_MEM_FENCE);
 
-			for (int attempt = 1; attempt <= table_capacity; ++attempt) {
+	if (q < 0)
+		return;
 
-				__global intermediate_t *t = (__global intermediate_t *) &closingContents[tableIndex];
+	/* The rank among the tuples of the partition in the work group keeps the offsets ordered */
+	int rank = 0;
+	for (int i = 0; i < lid; ++i)
+		if (keys[i] == q)
+			rank++;
 
-				int old = atomic_cmpxchg((global int *) &(t->tuple.mark), -1, idx);
-				if (old == -1) {
+	offsets[bases[q] + rank] = tid * sizeof(input_t);
+#endif
+}
 
-					// Insert new tuple
-					storef (t, p);
+__kernel void aggregateClosingWindowsKernel (
+	const int tuples,
+	const int inputBytes,
+	const int outputBytes,
+	const int _table_,
+	const int maxWindows,
+	const long previousPaneId,
+	const long batchOffset,
+	__global const uchar* input,
+	__global int* window_ptrs_,
+	__global int* _window_ptrs,
+	__global int *failed,
+	// __global int *attempts,
+	__global long *offset, /* Temp. variable holding the window pointer offset and window counts */
+	__global int *windowCounts,
+	__global uchar* closingContents,
+	__global uchar* pendingContents,
+	__global uchar* completeContents,
+	__global uchar* openingContents,
+	__global int* partitions,
+	__local uchar *scratch
+) {
+	int gid = (int) get_group_id   (0);
+	int lid = (int) get_local_id   (0);
+	int nlg = (int) get_num_groups (0);
 
-					success = true;
-					break;
+	__local int num_windows;
 
-				} else {
+	if (lid == 0) {
+		num_windows = windowCounts[0];
+	}
 
-					// Check tuple at position `old`
-					__global input_t *theOther = (__global input_t *) &input[old];
+	barrier(CLK_LOCAL_MEM_FENCE);
 
-					// Compare keys
-					if (comparef(k, theOther) == 1) {
-						// Update value and count
-						updatef(t, p);
+	int windowIndexOffset = 0;
 
-						success = true;
-						break;
+	/* Windows are numbered in the order of their kinds, and each takes the next table of its region */
+	for (int wid = gid + windowIndexOffset; wid < num_windows + windowIndexOffset; wid += nlg) {
 
-					}
-				}
-				// Conflict; try next slot
-				++h;
-				tableIndex = (h & (table_capacity - 1)) * sizeof(intermediate_tuple_t) + table_offset;
-			}
+		int table_offset = (wid - windowIndexOffset) * (_table_);
 
-			if (! success) {
-				atomic_inc(&failed[0]);
-			}
+		/* The tables that do not fit in the region are dropped, as by the host backend */
+		if (table_offset + _table_ > outputBytes)
+			break;
 
-			idx += group_offset;
-		}
+		int  offset_ = 0; /* Window start and end pointers */
+		int _offset  = _window_ptrs [wid];
 
-		wid += nlg; // try next window
+		aggregate_window (offset_, _offset, &closingContents[table_offset], _table_, input, failed, partitions, scratch, 0, 1);
 	}
 
 	return ;
@@ -294,12 +756,11 @@ __kernel void aggregateCompleteWindowsKernel (
 	__global uchar* pendingContents,
 	__global uchar* completeContents,
 	__global uchar* openingContents,
+	__global int* partitions,
 	__local uchar *scratch
 ) {
-	int tid = (int) get_global_id  (0);
-	int lid = (int) get_local_id   (0);
 	int gid = (int) get_group_id   (0);
-	int lgs = (int) get_local_size (0); /* Local group size */
+	int lid = (int) get_local_id   (0);
 	int nlg = (int) get_num_groups (0);
 
 	__local int num_windows;
@@ -316,99 +777,23 @@ __kernel void aggregateCompleteWindowsKernel (
 
 	barrier(CLK_LOCAL_MEM_FENCE);
 
-	if (npending > 0)
-		return;
-
-	int windowIndexOffset = nclosing;
-
-	int group_offset = lgs * sizeof(input_t);
+	int windowIndexOffset = nclosing + npending;
 
-	int table_capacity = _table_ / sizeof(intermediate_t);
-
-	int wid = gid + windowIndexOffset;
-
-	if (wid >= num_windows + windowIndexOffset)
-		return;
+	/* Windows are numbered in the order of their kinds, and each takes the next table of its region */
+	for (int wid = gid + windowIndexOffset; wid < num_windows + windowIndexOffset; wid += nlg) {
 
-	/* A group may process more than one closing windows */
-	while (wid < num_windows + windowIndexOffset) {
-
-		/*
-		 * The offset of closing windows should start from 0.
-		 */
 		int table_offset = (wid - windowIndexOffset) * (_table_);
 
-		int  offset_ =  window_ptrs_ [wid]; /* Window start and end pointers */
-		int _offset  = _window_ptrs  [wid];
-
-		if (offset_ == _offset) {
-		 	wid += nlg;
-			continue;
-		}
-
-		int idx = lid * sizeof(input_t) + offset_;
-
-		while (idx < _offset) {
-
-			int lidx = lid * sizeof(key_t);
-
-			__global input_t *p = (__global input_t *)   &input[ idx];
-			__local key_t    *k = (__local  key_t   *) &scratch[lidx];
-
-			pack_key (k, p);
-
-			int h = jenkinsHash(&scratch[lidx], sizeof(key_t), 1) & (table_capacity - 1);
-
-			int tableIndex = h * sizeof(intermediate_tuple_t) + table_offset;
-
-			if (tableIndex >= outputBytes)
-				break;
-
-			/* Insert */
-			bool success = false;
-
-			for (int attempt = 1; attempt <= table_capacity; ++attempt) {
-
-				__global intermediate_t *t = (__global intermediate_t *) &completeContents[tableIndex];
-
-				int old = atomic_cmpxchg((global int *) &(t->tuple.mark), -1, idx);
-				if (old == -1) {
-
-					/* Insert new tuple */
-					storef (t, p);
-
-					success = true;
-					break;
-
-				} else {
-
-					/* Check tuple at position `old` */
-					__global input_t *theOther = (__global input_t *) &input[old];
-
-					/* Compare keys */
-					if (comparef(k, theOther) == 1) {
-						/* Update value and count */
-						updatef(t, p);
-
-						success = true;
-						break;
-
-					}
-				}
-				/* Conflict; try next slot */
-				++h;
-				tableIndex = (h & (table_capacity - 1)) * sizeof(intermediate_tuple_t) + table_offset;
-			}
-
-			if (! success) {
-				atomic_inc(&failed[0]);
-			}
+		/* The tables that do not fit in the region are dropped, as by the host backend */
+		if (table_offset + _table_ > outputBytes)
+			break;
 
-			idx += group_offset;
-		}
+		int  offset_ = window_ptrs_ [wid]; /* Window start and end pointers */
+		int _offset  = _window_ptrs [wid];
 
-		wid += nlg; /* try next window */
+		aggregate_window (offset_, _offset, &completeContents[table_offset], _table_, input, failed, partitions, scratch, 0, 1);
 	}
+
 	return ;
 }
 
@@ -431,12 +816,11 @@ __kernel void aggregateOpeningWindowsKernel (
 	__global uchar* pendingContents,
 	__global uchar* completeContents,
 	__global uchar* openingContents,
+	__global int* partitions,
 	__local uchar *scratch
 ) {
-	int tid = (int) get_global_id  (0);
-	int lid = (int) get_local_id   (0);
 	int gid = (int) get_group_id   (0);
-	int lgs = (int) get_local_size (0); /* Local group size */
+	int lid = (int) get_local_id   (0);
 	int nlg = (int) get_num_groups (0);
 
 	__local int num_windows;
@@ -457,90 +841,21 @@ __kernel void aggregateOpeningWindowsKernel (
 
 	int windowIndexOffset = nclosing + npending + ncomplete;
 
-	int group_offset = lgs * sizeof(input_t);
+	/* Windows are numbered in the order of their kinds, and each takes the next table of its region */
+	for (int wid = gid + windowIndexOffset; wid < num_windows + windowIndexOffset; wid += nlg) {
 
-	int table_capacity = _table_ / sizeof(intermediate_t);
-
-	int wid = gid + windowIndexOffset;
-
-	if (wid >= num_windows + windowIndexOffset)
-		return;
-
-	/* A group may process more than one closing windows */
-	while (wid < num_windows + windowIndexOffset) {
-		/*
-		 * The offset of closing windows should start from 0.
-		 */
 		int table_offset = (wid - windowIndexOffset) * (_table_);
 
-		int  offset_ =  window_ptrs_ [wid]; /* Window start and end pointers */
-		int _offset  = _window_ptrs  [wid];
-
-		if (offset_ == _offset) {
-		 	wid += nlg;
-			continue;
-		}
-
-		int idx = lid * sizeof(input_t) + offset_;
-
-		while (idx < _offset) {
-
-			int lidx = lid * sizeof(key_t);
-
-			__global input_t *p = (__global input_t *)   &input[ idx];
-			__local key_t    *k = (__local  key_t   *) &scratch[lidx];
-
-			pack_key (k, p);
-
-			int h = jenkinsHash(&scratch[lidx], sizeof(key_t), 1) & (table_capacity - 1);
-
-			int tableIndex = h * sizeof(intermediate_tuple_t) + table_offset;
-
-			/* Insert */
-			bool success = false;
-
-			for (int attempt = 1; attempt <= table_capacity; ++attempt) {
-
-				__global intermediate_t *t = (__global intermediate_t *) &completeContents[tableIndex];
-
-				int old = atomic_cmpxchg((global int *) &(t->tuple.mark), -1, idx);
-				if (old == -1) {
-
-					/* Insert new tuple */
-					storef (t, p);
-
-					success = true;
-					break;
-
-				} else {
-
-					/* Check tuple at position `old` */
-					__global input_t *theOther = (__global input_t *) &input[old];
-
-					/* Compare keys */
-					if (comparef(k, theOther) == 1) {
-						/* Update value and count */
-						updatef(t, p);
-
-						success = true;
-						break;
-
-					}
-				}
-				/* Conflict; try next slot */
-				++h;
-				tableIndex = (h & (table_capacity - 1)) * sizeof(intermediate_tuple_t) + table_offset;
-			}
-
-			if (! success) {
-				atomic_inc(&failed[0]);
-			}
+		/* The tables that do not fit in the region are dropped, as by the host backend */
+		if (table_offset + _table_ > outputBytes)
+			break;
 
-			idx += group_offset;
-		}
+		int  offset_ = window_ptrs_ [wid]; /* Window start and end pointers */
+		int _offset  = inputBytes;
 
-		wid += nlg; /* try next window */
+		aggregate_window (offset_, _offset, &openingContents[table_offset], _table_, input, failed, partitions, scratch, 0, 1);
 	}
+
 	return ;
 }
 
@@ -563,91 +878,25 @@ __kernel void aggregatePendingWindowsKernel (
 	__global uchar* pendingContents,
 	__global uchar* completeContents,
 	__global uchar* openingContents,
+	__global int* partitions,
 	__local uchar *scratch
 ) {
-	int tid = (int) get_global_id  (0);
-	int lid = (int) get_local_id   (0);
 	int gid = (int) get_group_id   (0);
-	int lgs = (int) get_local_size (0); /* Local group size */
+	int lid = (int) get_local_id   (0);
 	int nlg = (int) get_num_groups (0);
 
 	__local int num_windows;
 
-	__local int nclosing;
-
-	if (lid == 0) {
-		nclosing = windowCounts[0];
+	if (lid == 0)
 		num_windows = windowCounts[1];
-	}
 
 	barrier(CLK_LOCAL_MEM_FENCE);
 
-	int windowIndexOffset = nclosing;
-
 	if (num_windows <= 0)
 		return;
 
-	int table_capacity = _table_ / sizeof(intermediate_t);
-
-	int wid = windowIndexOffset;
-
-	//  There is only one window
-	int  offset_ =  window_ptrs_ [wid]; // Window start and end pointers
-	int _offset  = _window_ptrs  [wid];
-
-	int idx = tid * sizeof(input_t) + offset_;
-
-	int lidx = lid * sizeof(key_t);
-
-	__global input_t *p = (__global input_t *)   &input[ idx];
-	__local key_t    *k = (__local  key_t   *) &scratch[lidx];
-
-	pack_key (k, p);
-
-	int h = jenkinsHash(&scratch[lidx], sizeof(key_t), 1) & (table_capacity - 1);
-
-	int tableIndex = h * sizeof(intermediate_tuple_t);
-
-	// Insert
-	bool success = false;
-
-	for (int attempt = 1; attempt <= table_capacity; ++attempt) {
-
-		__global intermediate_t *t = (__global intermediate_t *) &completeContents[tableIndex];
-
-		int old = atomic_cmpxchg((global int *) &(t->tuple.mark), -1, idx);
-		if (old == -1) {
-
-			// Insert new tuple
-			storef (t, p);
-
-			success = true;
-			break;
-
-		} else {
-
-			// Check tuple at position `old`
-			__global input_t *theOther = (__global input_t *) &input[old];
-
-			// Compare keys
-			if (comparef(k, theOther) == 1) {
-				// Update value and count
-				updatef(t, p);
-
-				success = true;
-				break;
-
-			}
-		}
-
-		// Conflict; try next slot
-		++h;
-		tableIndex = (h & (table_capacity - 1)) * sizeof(intermediate_tuple_t);
-	}
-
-	if (! success) {
-		atomic_inc(&failed[0]);
-	}
+	/* There is only one pending window computed, and it spans the whole batch, so every work group takes a part */
+	aggregate_window (0, inputBytes, pendingContents, _table_, input, failed, partitions, scratch, gid, nlg);
 
 	return ;
 }
@@ -671,34 +920,22 @@ __kernel void clearKernel (
 	__global uchar* pendingContents,
 	__global uchar* completeContents,
 	__global uchar* openingContents,
+	__global int* partitions,
 	__local uchar *scratch
 ) {
 
 	int tid = (int) get_global_id (0);
 
-	int outputIndex = tid * sizeof(intermediate_tuple_t);
-	if (outputIndex >= outputBytes)
-		return;
-
-	__global intermediate_t *t1 = (__global intermediate_t *) &closingContents[outputIndex];
-	t1->vectors[0] =  0;
-	t1->vectors[1] =  0;
-	t1->tuple.mark = -1;
-
-	__global intermediate_t *t2 = (__global intermediate_t *) &pendingContents[outputIndex];
-	t2->vectors[0] =  0;
-	t2->vectors[1] =  0;
-	t2->tuple.mark = -1;
-
-	__global intermediate_t *t3 = (__global intermediate_t *) &completeContents[outputIndex];
-	t3->vectors[0] =  0;
-	t3->vectors[1] =  0;
-	t3->tuple.mark = -1;
+	/* Every table starts a multiple of _table_ into its region, which entries do not divide */
+	int table_capacity = _table_ / sizeof(intermediate_t);
+	int outputIndex = (tid / table_capacity) * _table_ + (tid % table_capacity) * sizeof(intermediate_t);
+	if ((tid / table_capacity + 1) * _table_ <= outputBytes) {
 
-	__global intermediate_t *t4 = (__global intermediate_t *) &completeContents[outputIndex];
-	t4->vectors[0] =  0;
-	t4->vectors[1] =  0;
-	t4->tuple.mark = -1;
+		clearf ((__global intermediate_t *) &closingContents [outputIndex]);
+		clearf ((__global intermediate_t *) &pendingContents [outputIndex]);
+		clearf ((__global intermediate_t *) &completeContents[outputIndex]);
+		clearf ((__global intermediate_t *) &openingContents [outputIndex]);
+	}
 
 	if (tid < tuples) {
 
@@ -711,12 +948,12 @@ __kernel void clearKernel (
 		failed  [tid] = 0;
 		// attempts[tid] = 0;
 
-		if (tid < 5) {
+		if (tid < 6) {
 
 			/* Initialise window counters: closing, pending, complete, opening.
 			 *
-			 * The last slot is reserved for output size */
-			windowCounts[tid] = 0;
+			 * Then the bytes of a table, and the tuples that did not fit (set by packKernel) */
+			windowCounts[tid] = (tid == 4) ? _table_ : 0;
 
 			if (tid == 0) {
 				offset[0] = LONG_MAX;
@@ -747,64 +984,30 @@ __kernel void computeOffsetKernel (
 		__global uchar* pendingContents,
 		__global uchar* completeContents,
 		__global uchar* openingContents,
+		__global int* partitions,
 		__local uchar *scratch
 ) {
 	int tid = (int) get_global_id  (0);
 
-	long wid;
-	long paneId, normalisedPaneId;
-
-	long currPaneId;
-	long prevPaneId;
+	/* The first window not closed by the previous batch of the stream, in closed form */
+	if (tid == 0) {
+		if (batchOffset == 0 || previousPaneId < PANES_PER_WINDOW)
+			offset[0] = 0;
+		else
+			offset[0] = (previousPaneId - PANES_PER_WINDOW) / PANES_PER_SLIDE + 1;
 
-	if (batchOffset == 0) {
-		offset[0] = 0;
-		return;
-	}
-
-	/* Every thread is assigned a tuple */
-#ifdef RANGE_BASED
-	__global input_t *curr = (__global input_t *) &input[tid * sizeof(input_t)];
-	currPaneId = curr->tuple.t / PANE_SIZE;
-#else
-	currPaneId = ((batchOffset + (tid * sizeof(input_t))) / sizeof(input_t)) / PANE_SIZE;
-#endif
-	if (tid > 0) {
+		/* The windows the last tuple is in have started, even if neither end is in the batch (pending) */
 #ifdef RANGE_BASED
-		__global input_t *prev = (__global input_t *) &input[(tid - 1) * sizeof(input_t)];
-		prevPaneId = prev->tuple.t / PANE_SIZE;
-#else
-		prevPaneId = ((batchOffset + ((tid - 1) * sizeof(input_t))) / sizeof(input_t)) / PANE_SIZE;
-#endif
-	} else {
-		prevPaneId = previousPaneId;
-	}
-
-	if (prevPaneId < currPaneId) {
-		/* Compute offset based on the first closing window */
-		while (prevPaneId < currPaneId) {
-			paneId = prevPaneId + 1;
-			normalisedPaneId = paneId - PANES_PER_WINDOW;
-			if (normalisedPaneId >= 0 && normalisedPaneId % PANES_PER_SLIDE == 0) {
-				wid = normalisedPaneId / PANES_PER_SLIDE;
-				if (wid >= 0) {
-#ifdef __APPLE__ /* build-in gpu does not support khr_int64_extended_atomics extension */ 
-                    atomic_min((__global int *) &offset[0], (int) wid);
+		__global input_t *last = (__global input_t *) &input[(tuples - 1) * sizeof(input_t)];
+		long lastPaneId = last->tuple.t / PANE_SIZE;
 #else
-                    atom_min(&offset[0], wid);
+		long lastPaneId = (batchOffset / sizeof(input_t) + tuples - 1) / PANE_SIZE;
 #endif
-					break;
-				}
-			}
-			prevPaneId += 1;
-		}
+		long lastOpen = lastPaneId / PANES_PER_SLIDE - offset[0];
+		if (lastOpen > 0 && lastOpen < maxWindows)
+			offset[1] = lastOpen;
 	}
 
-//	if (tid == 0) {
-//		if (offset[0] == LONG_MAX)
-//			offset[0] = 0;
-//	}
-
 	return ;
 }
 
@@ -829,6 +1032,7 @@ __kernel void computePointersKernel (
 	__global uchar* pendingContents,
 	__global uchar* completeContents,
 	__global uchar* openingContents,
+	__global int* partitions,
 	__local uchar *scratch
 ) {
 	int tid = (int) get_global_id  (0);
@@ -876,26 +1080,29 @@ __kernel void computePointersKernel (
 				wid = normalisedPaneId / PANES_PER_SLIDE; // absolute window id, think about it
 				if (wid >= 0) {
 					index = convert_int_sat(wid - windowOffset); // (local) window id in the work group 
+					if (index >= 0 && index < maxWindows) {
 #ifdef __APPLE__
-                    atomic_max((__global int *) &offset[1], (int) (wid - windowOffset));
+						atomic_max((__global int *) &offset[1], (int) (wid - windowOffset));
 #else
-                    atom_max(&offset[1], (wid - windowOffset));
+						atom_max(&offset[1], (wid - windowOffset));
 #endif
-
-					_window_ptrs[index] = tid * sizeof(input_t);
+						_window_ptrs[index] = tid * sizeof(input_t);
+					}
 				}
 			}
 			// Check opening windows
 			if (paneId % PANES_PER_SLIDE == 0) {
 				wid = paneId / PANES_PER_SLIDE;
 				index = convert_int_sat(wid - windowOffset); // wid and windowOffset are long
+				/* Windows before the offset were opened by the previous batch */
+				if (index >= 0 && index < maxWindows) {
 #ifdef __APPLE__
-                    atomic_max((__global int *) &offset[1], (int) (wid - windowOffset));
+					atomic_max((__global int *) &offset[1], (int) (wid - windowOffset));
 #else
-                    atom_max(&offset[1], (wid - windowOffset));
+					atom_max(&offset[1], (wid - windowOffset));
 #endif
-
-				window_ptrs_[index] = tid * sizeof(input_t);
+					window_ptrs_[index] = tid * sizeof(input_t);
+				}
 			}
 			prevPaneId += 1;
 		}
@@ -923,11 +1130,16 @@ __kernel void packKernel (
 	__global uchar* pendingContents,
 	__global uchar* completeContents,
 	__global uchar* openingContents,
+	__global int* partitions,
 	__local uchar *scratch
 ) {
 
 	int tid = (int) get_global_id (0);
 
+	/* The host aggregates the windows of full tables again */
+	if (tid == 0)
+		windowCounts[5] = failed[0];
+
 //	int outputIndex = tid * sizeof(intermediate_tuple_t);
 //	if (outputIndex >= outputBytes)
 //		return;
@@ -0,0 +1,84 @@
+/* Atomics on floats and on the timestamp, as compare-and-swap loops */
+inline void atomic_addf (volatile __global float *p, float value) {
+    int old = as_int(*p);
+    int seen;
+    while ((seen = atomic_cmpxchg((volatile __global int *) p, old, as_int(as_float(old) + value))) != old) {
+        old = seen;
+    }
+}
+
+inline void atomic_minf (volatile __global float *p, float value) {
+    int old = as_int(*p);
+    while (as_float(old) > value) {
+        int seen = atomic_cmpxchg((volatile __global int *) p, old, as_int(value));
+        if (seen == old) {
+            break;
+        }
+        old = seen;
+    }
+}
+
+inline void atomic_maxf (volatile __global float *p, float value) {
+    int old = as_int(*p);
+    while (as_float(old) < value) {
+        int seen = atomic_cmpxchg((volatile __global int *) p, old, as_int(value));
+        if (seen == old) {
+            break;
+        }
+        old = seen;
+    }
+}
+
+inline void atomic_maxl (volatile __global long *p, long value) {
+    long old = *p;
+    while (old < value) {
+        long seen = atom_cmpxchg(p, old, value);
+        if (seen == old) {
+            break;
+        }
+        old = seen;
+    }
+}
+
+
+/* The same on the table of a work group */
+inline void atomic_addf_local (volatile __local float *p, float value) {
+    int old = as_int(*p);
+    int seen;
+    while ((seen = atomic_cmpxchg((volatile __local int *) p, old, as_int(as_float(old) + value))) != old) {
+        old = seen;
+    }
+}
+
+inline void atomic_minf_local (volatile __local float *p, float value) {
+    int old = as_int(*p);
+    while (as_float(old) > value) {
+        int seen = atomic_cmpxchg((volatile __local int *) p, old, as_int(value));
+        if (seen == old) {
+            break;
+        }
+        old = seen;
+    }
+}
+
+inline void atomic_maxf_local (volatile __local float *p, float value) {
+    int old = as_int(*p);
+    while (as_float(old) < value) {
+        int seen = atomic_cmpxchg((volatile __local int *) p, old, as_int(value));
+        if (seen == old) {
+            break;
+        }
+        old = seen;
+    }
+}
+
+inline void atomic_maxl_local (volatile __local long *p, long value) {
+    long old = *p;
+    while (old < value) {
+        long seen = atom_cmpxchg(p, old, value);
+        if (seen == old) {
+            break;
+        }
+        old = seen;
+    }
+}
@@ -0,0 +1,236 @@
+/*
+ * Up-sweep (reduce) on a local array `data` of length `length`.
+ * `length` must be a power of two.
+ */
+inline void upsweep (__local int *data, int length) {
+
+    int lid  = get_local_id (0);
+    int b = (lid * 2) + 1;
+    int depth = 1 + (int) log2 ((float) length);
+
+    for (int d = 0; d < depth; d++) {
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+        int mask = (0x1 << d) - 1;
+        if ((lid & mask) == mask) {
+
+            int offset = (0x1 << d);
+            int a = b - offset;
+            data[b] += data[a];
+        }
+    }
+}
+
+/*
+ * Down-sweep on a local array `data` of length `length`.
+ * `length` must be a power of two.
+ */
+inline void downsweep (__local int *data, int length) {
+
+    int lid = get_local_id (0);
+    int b = (lid * 2) + 1;
+    int depth = (int) log2 ((float) length);
+    for (int d = depth; d >= 0; d--) {
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+        int mask = (0x1 << d) - 1;
+        if ((lid & mask) == mask) {
+
+            int offset = (0x1 << d);
+            int a = b - offset;
+            int t = data[a];
+            data[a] = data[b];
+            data[b] += t;
+        }
+    }
+}
+
+/* Multiplicative hashing of a key into [0, table_size), table_size being a power of two */
+inline int hashf (long key, int table_size) {
+    return (int) ((((ulong) key) * 0x9E3779B97F4A7C15UL) >> 32) & (table_size - 1);
+}
+
+/*
+ * Walks the chain of the bucket of the probe tuple and counts the build tuples with the same key
+ * that are in its window (t - window_size, t]. If write is set, they are joined into output from
+ * the result `offset`, as long as they fit in `capacity` results.
+ */
+inline int probef (
+    __global input_t *p,
+    __global const uchar *build,
+    __global const int *heads,
+    __global const int *next,
+    const int table_size,
+    const long window_size,
+    const int write,
+    __global uchar *output,
+    const int offset,
+    const int capacity
+) {
+    if (! selectf (p))
+        return 0;
+
+    long key = probe_keyf (p);
+    long t = p->tuple.t;
+
+    int count = 0;
+    for (int i = heads[hashf (key, table_size)]; i >= 0; i = next[i]) {
+        __global build_input_t *r = (__global build_input_t *) &build[i * sizeof(build_input_t)];
+
+        if (build_keyf (r) == key && r->tuple.t > t - window_size && r->tuple.t <= t) {
+            if (write && offset + count < capacity) {
+                joinf ((__global output_t *) &output[(offset + count) * sizeof(output_t)], p, r);
+            }
+            count++;
+        }
+    }
+    return count;
+}
+
+/*
+ * Assumes:
+ *
+ * - N probe tuples, every thread of countKernel and joinKernel handles two of them
+ * - L threads/group, every thread group handles (2 * L) tuples
+ * - clearKernel has one thread per bucket and buildKernel one per build tuple
+ *
+ * All kernels take the same arguments so that the per batch ones are set at the same index.
+ */
+
+__kernel void clearKernel (
+    const int tuples,
+    const int table_size,
+    const int capacity, /* Results the output can hold */
+    const long build_tuples, /* Tuples in the build window of this batch */
+    const long window_size,
+    __global const uchar *input,
+    __global const uchar *build,
+    __global int *heads,
+    __global int *next,
+    __global int *offsets,
+    __global int *partitions,
+    __global uchar *output,
+    __local  int *loffsets
+)
+{
+    int tid = get_global_id (0);
+
+    if (tid < table_size)
+        heads[tid] = -1;
+}
+
+__kernel void buildKernel (
+    const int tuples,
+    const int table_size,
+    const int capacity,
+    const long build_tuples,
+    const long window_size,
+    __global const uchar *input,
+    __global const uchar *build,
+    __global int *heads,
+    __global int *next,
+    __global int *offsets,
+    __global int *partitions,
+    __global uchar *output,
+    __local  int *loffsets
+)
+{
+    int tid = get_global_id (0);
+
+    if (tid >= build_tuples)
+        return;
+
+    __global build_input_t *r = (__global build_input_t *) &build[tid * sizeof(build_input_t)];
+
+    /* Push the tuple in front of the chain of its bucket */
+    next[tid] = atomic_xchg (&heads[hashf (build_keyf (r), table_size)], tid);
+}
+
+__kernel void countKernel (
+    const int tuples,
+    const int table_size,
+    const int capacity,
+    const long build_tuples,
+    const long window_size,
+    __global const uchar *input,
+    __global const uchar *build,
+    __global int *heads,
+    __global int *next,
+    __global int *offsets,
+    __global int *partitions,
+    __global uchar *output,
+    __local  int *loffsets
+)
+{
+    int lgs = get_local_size (0);
+    int tid = get_global_id (0);
+    int lid = get_local_id (0);
+    int gid = get_group_id (0);
+
+    int  left = (2 * tid);
+    int right = (2 * tid) + 1;
+
+    int  _left = (2 * lid);
+    int _right = (2 * lid) + 1;
+
+    __global input_t *lp = (__global input_t *) &input[ left * sizeof(input_t)];
+    __global input_t *rp = (__global input_t *) &input[right * sizeof(input_t)];
+
+    /* Matches of every tuple, then their offset in the results of the group */
+    loffsets[ _left] = ( left < tuples) ? probef (lp, build, heads, next, table_size, window_size, 0, output, 0, capacity) : 0;
+    loffsets[_right] = (right < tuples) ? probef (rp, build, heads, next, table_size, window_size, 0, output, 0, capacity) : 0;
+
+    upsweep(loffsets, 2 * lgs);
+
+    if (lid == (lgs - 1)) {
+        partitions[gid] = loffsets[_right];
+        loffsets[_right] = 0;
+    }
+
+    downsweep(loffsets, 2 * lgs);
+
+    offsets[ left] = loffsets[ _left];
+    offsets[right] = loffsets[_right];
+}
+
+__kernel void joinKernel (
+    const int tuples,
+    const int table_size,
+    const int capacity,
+    const long build_tuples,
+    const long window_size,
+    __global const uchar *input,
+    __global const uchar *build,
+    __global int *heads,
+    __global int *next,
+    __global int *offsets,
+    __global int *partitions,
+    __global uchar *output,
+    __local  int *loffsets
+)
+{
+    int tid = get_global_id (0);
+    int lid = get_local_id (0);
+    int gid = get_group_id (0);
+
+    int  left = (2 * tid);
+    int right = (2 * tid) + 1;
+
+    /* Results of the groups before */
+    __local int pivot;
+    if (lid == 0) {
+        pivot = 0;
+        for (int i = 0; i < gid; i++) {
+            pivot += partitions[i];
+        }
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    __global input_t *lp = (__global input_t *) &input[ left * sizeof(input_t)];
+    __global input_t *rp = (__global input_t *) &input[right * sizeof(input_t)];
+
+    if (left < tuples)
+        probef (lp, build, heads, next, table_size, window_size, 1, output, pivot + offsets[ left], capacity);
+    if (right < tuples)
+        probef (rp, build, heads, next, table_size, window_size, 1, output, pivot + offsets[right], capacity);
+}
@@ -0,0 +1,27 @@
+/*
+ * Assumes:
+ *
+ * - N tuples
+ * - Every thread handles one tuple, so #threads = N
+ * - The output tuples keep the order of the input tuples
+ *
+ */
+
+__kernel void projectKernel (
+    const int size, /* Size of the input in bytes */
+    const int tuples,
+    const int output_size, /* Size of the output in bytes */
+    __global const uchar *input,
+    __global uchar *output
+)
+{
+    int tid = get_global_id (0);
+
+    if (tid >= tuples)
+        return;
+
+    __global input_t  *p = (__global input_t  *) &input [tid * sizeof(input_t)];
+    __global output_t *q = (__global output_t *) &output[tid * sizeof(output_t)];
+
+    projectf (q, p);
+}
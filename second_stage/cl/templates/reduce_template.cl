@@ -14,6 +14,7 @@ __kernel void clearKernel (
     __global       long  *offset,
     __global       int   *window_counts,
     __global       uchar *output,
+    __global       uchar *panes,
     __local        uchar *scratch
 ) {
 
@@ -54,72 +55,29 @@ __kernel void computeOffsetKernel (
     __global       long  *offset,
     __global       int   *window_counts,
     __global       uchar *output,
+    __global       uchar *panes,
     __local        uchar *scratch
 ) {
 
     int tid = (int) get_global_id (0);
 
-    long wid;
-    long paneId, normalisedPaneId;
-
-    long currPaneId;
-    long prevPaneId;
-
-    if (start_pointer == 0) {
-        if (tid == 0)
+    /* The first window not closed by the previous batch of the stream, in closed form */
+    if (tid == 0) {
+        if (start_pointer == 0 || previous_pane_id < PANES_PER_WINDOW)
             offset[0] = 0L;
-        return;
-    }
-
-    /* Every thread is assigned a tuple */
-
-#ifdef RANGE_BASED
-    __global input_t *curr = (__global input_t *) &input[tid * sizeof(input_t)];
-    currPaneId = curr->tuple.t / PANE_SIZE;
-#else
-    currPaneId = ((start_pointer + (tid * sizeof(input_t))) / sizeof(input_t)) / PANE_SIZE;
-#endif
-
-    if (tid > 0) {
+        else
+            offset[0] = (previous_pane_id - PANES_PER_WINDOW) / PANES_PER_SLIDE + 1;
 
+        /* The windows the last tuple is in have started, even if neither end is in the batch (pending) */
 #ifdef RANGE_BASED
-    __global input_t *prev = (__global input_t *) &input[(tid - 1) * sizeof(input_t)];
-    prevPaneId = prev->tuple.t / PANE_SIZE;
-#else
-    prevPaneId = ((start_pointer + ((tid - 1) * sizeof(input_t))) / sizeof(input_t)) / PANE_SIZE;
-#endif
-
-    } else {
-
-        prevPaneId = previous_pane_id;
-    }
-
-    if (prevPaneId < currPaneId) {
-
-        /* Compute offset based on the first closing window */
-
-        while (prevPaneId < currPaneId) {
-
-            paneId = prevPaneId + 1;
-
-            normalisedPaneId = paneId - PANES_PER_WINDOW;
-
-            if (normalisedPaneId >= 0 && normalisedPaneId % PANES_PER_SLIDE == 0) {
-
-                wid = normalisedPaneId / PANES_PER_SLIDE;
-
-                if (wid >= 0) {
-
-#ifdef __APPLE__ /* build-in gpu does not support khr_int64_extended_atomics extension */ 
-                    atomic_min((__global int *) &offset[0], (int) wid);
+        __global input_t *last = (__global input_t *) &input[(tuples - 1) * sizeof(input_t)];
+        long last_pane = last->tuple.t / PANE_SIZE;
 #else
-                    atom_min(&offset[0], wid);
+        long last_pane = (start_pointer / sizeof(input_t) + tuples - 1) / PANE_SIZE;
 #endif
-                    break;
-                }
-            }
-            prevPaneId += 1;
-        }
+        long last_open = last_pane / PANES_PER_SLIDE - offset[0];
+        if (last_open > 0 && last_open < max_windows)
+            offset[1] = last_open;
     }
 
     return;
@@ -141,6 +99,7 @@ __kernel void computePointersKernel (
     __global       long  *offset,
     __global       int   *window_counts,
     __global       uchar *output,
+    __global       uchar *panes,
     __local        uchar *scratch
 ) {
 
@@ -195,13 +154,14 @@ __kernel void computePointersKernel (
 
                     index = convert_int_sat(wid - windowOffset);
 
+                    if (index >= 0 && index < max_windows) {
 #ifdef __APPLE__
-                    atomic_max((__global int *) &offset[1], (int) (wid - windowOffset));
+                        atomic_max((__global int *) &offset[1], (int) (wid - windowOffset));
 #else
-                    atom_max(&offset[1], (wid - windowOffset));
+                        atom_max(&offset[1], (wid - windowOffset));
 #endif
-
-                    window_end_pointers [index] = tid * sizeof(input_t);
+                        window_end_pointers [index] = tid * sizeof(input_t);
+                    }
                 }
             }
 
@@ -213,13 +173,15 @@ __kernel void computePointersKernel (
 
                 index = convert_int_sat(wid - windowOffset);
 
+                /* Windows before the offset were opened by the previous batch */
+                if (index >= 0 && index < max_windows) {
 #ifdef __APPLE__
                     atomic_max((__global int *) &offset[1], (int) (wid - windowOffset));
 #else
                     atom_max(&offset[1], (wid - windowOffset));
 #endif
-
-                window_start_pointers [index] = tid * sizeof(input_t);
+                    window_start_pointers [index] = tid * sizeof(input_t);
+                }
             }
 
             prevPaneId += 1;
@@ -229,6 +191,130 @@ __kernel void computePointersKernel (
     return;
 }
 
+/* The index of the first tuple of the batch in a pane, or after it */
+inline int find_pane_start (__global const uchar *input, int tuples, long pane_id, long start_pointer) {
+
+#ifdef RANGE_BASED
+    int lo = 0;
+    int hi = tuples;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        __global input_t *p = (__global input_t *) &input[mid * sizeof(input_t)];
+        if (p->tuple.t / PANE_SIZE < pane_id)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+#else
+    long first = pane_id * PANE_SIZE - start_pointer / sizeof(input_t);
+    return (int) clamp(first, 0L, (long) tuples);
+#endif
+}
+
+/* Every thread reduces a pane of the windows of the batch, which the windows are then merged from */
+__kernel void paneKernel (
+
+    const int tuples,
+    const int bytes,
+
+    const int max_windows,
+
+    const long previous_pane_id,
+    const long start_pointer,
+
+    __global const uchar *input,
+    __global       int   *window_start_pointers,
+    __global       int   *window_end_pointers,
+    __global       long  *offset,
+    __global       int   *window_counts,
+    __global       uchar *output,
+    __global       uchar *panes,
+    __local        uchar *scratch
+) {
+
+#if PANES_PER_WINDOW > PANES_PER_SLIDE
+    int tid = (int) get_global_id (0);
+
+    if (tid >= MAX_PANES)
+        return;
+
+    /* Panes are numbered from the first pane of the first window of the batch */
+    long pane_id = offset[0] * PANES_PER_SLIDE + tid;
+
+    int idx = find_pane_start (input, tuples, pane_id, start_pointer);
+    int end = find_pane_start (input, tuples, pane_id + 1, start_pointer);
+
+    output_t tuple;
+    initf (&tuple);
+
+    for (; idx < end; idx++) {
+        __global input_t *p = (__global input_t *) &input[idx * sizeof(input_t)];
+        reducef (&tuple, p);
+    }
+
+    __global output_t *pane = (__global output_t *) &panes[tid * sizeof(output_t)];
+    *pane = tuple;
+#endif
+
+    return;
+}
+
+/**
+ * Every thread scans a block of PANES_PER_WINDOW pane ids from its start (prefixes) and from its end 
+ * (suffixes). Blocks are aligned to pane ids, so that a window is the suffix of its first pane and the 
+ * prefix of its last, merged once whatever the slide.
+ **/
+__kernel void scanKernel (
+
+    const int tuples,
+    const int bytes,
+
+    const int max_windows,
+
+    const long previous_pane_id,
+    const long start_pointer,
+
+    __global const uchar *input,
+    __global       int   *window_start_pointers,
+    __global       int   *window_end_pointers,
+    __global       long  *offset,
+    __global       int   *window_counts,
+    __global       uchar *output,
+    __global       uchar *panes,
+    __local        uchar *scratch
+) {
+
+#if PANES_PER_WINDOW > PANES_PER_SLIDE
+    int tid = (int) get_global_id (0);
+
+    long base = offset[0] * PANES_PER_SLIDE;
+    long first = (base / PANES_PER_WINDOW + tid) * PANES_PER_WINDOW - base;
+
+    int from = (int) max(first, 0L);
+    int to = (int) min(first + PANES_PER_WINDOW, (long) MAX_PANES);
+
+    __global uchar *prefixes = &panes[MAX_PANES * sizeof(output_t)];
+    __global uchar *suffixes = &panes[2 * MAX_PANES * sizeof(output_t)];
+
+    output_t tuple;
+
+    initf (&tuple);
+    for (int j = from; j < to; j++) {
+        pane_mergef (&tuple, (__global output_t *) &panes[j * sizeof(output_t)]);
+        *((__global output_t *) &prefixes[j * sizeof(output_t)]) = tuple;
+    }
+
+    initf (&tuple);
+    for (int j = to - 1; j >= from; j--) {
+        pane_mergef (&tuple, (__global output_t *) &panes[j * sizeof(output_t)]);
+        *((__global output_t *) &suffixes[j * sizeof(output_t)]) = tuple;
+    }
+#endif
+
+    return;
+}
+
 __kernel void reduceKernel (
 
     const int tuples,
@@ -245,6 +331,7 @@ __kernel void reduceKernel (
     __global       long  *offset,
     __global       int   *window_counts,
     __global       uchar *output,
+    __global       uchar *panes,
     __local        uchar *scratch
 ) {
 
@@ -314,26 +401,50 @@ __kernel void reduceKernel (
 
         if (start == end) {
 
-            /* Skip empty windows */
+            /* An empty window still has a (zero count) result */
+            if (lid == 0) {
+                output_t empty;
+                initf (&empty);
+
+                __global output_t *result = (__global output_t *) &output [wid * sizeof(output_t)];
+                *result = empty;
+            }
             wid += nlg;
             continue;
         }
 
-        int idx = lid * sizeof(input_t) + start;
-
         output_t tuple;
         initf (&tuple);
 
-        /* The sequential part */
-        while (idx < end && idx < bytes) {
+#if PANES_PER_WINDOW > PANES_PER_SLIDE
+        if (wid * PANES_PER_SLIDE + PANES_PER_WINDOW <= MAX_PANES) {
+
+            /* Overlapping windows are merged from the scans of the panes, without going through the tuples again */
+            if (lid == 0) {
+                int first = wid * PANES_PER_SLIDE;
+                int last = first + PANES_PER_WINDOW - 1;
+
+                pane_mergef (&tuple, (__global output_t *) &panes[(2 * MAX_PANES + first) * sizeof(output_t)]);
+                if ((offset[0] * PANES_PER_SLIDE + first) % PANES_PER_WINDOW != 0)
+                    pane_mergef (&tuple, (__global output_t *) &panes[(MAX_PANES + last) * sizeof(output_t)]);
+            }
+
+        } else
+#endif
+        {
+            int idx = lid * sizeof(input_t) + start;
+
+            /* The sequential part */
+            while (idx < end && idx < bytes) {
 
-            /* Get tuple from main memory */
-            __global input_t *p = (__global input_t *) &input[idx];
+                /* Get tuple from main memory */
+                __global input_t *p = (__global input_t *) &input[idx];
 
-            reducef (&tuple, p);
-            // printf("(W%d) Reducing tuple %d with value %f\n", wid, tuple.tuple.t, tuple.tuple._1);
+                reducef (&tuple, p);
+                // printf("(W%d) Reducing tuple %d with value %f\n", wid, tuple.tuple.t, tuple.tuple._1);
 
-            idx += group_offset;
+                idx += group_offset;
+            }
         }
 
         /* Write value to scratch memory */
@@ -5,8 +5,11 @@
 #include <unistd.h>
 #include <stdlib.h>
 
+#include "wait/wait.h"
+
 void parse_arguments(int argc, char * argv[], 
-    enum test_cases * mode, int * work_load, int * batch_size, int * buffer_num, int * pipeline_num, bool * is_merging, bool * is_debug) {
+    enum test_cases * mode, int * work_load, int * batch_size, int * buffer_num, int * pipeline_num, bool * is_merging, bool * is_costing, bool * is_adapting, bool * is_debug,
+    bool * is_cpu, bool * is_hybrid, int * thread_num) {
 
 	extern char *optarg;
 	extern int optind;
@@ -14,9 +17,9 @@ void parse_arguments(int argc, char * argv[],
     int debug = 0;
 	int lflag=0, mflag=0, fflag=0, iflag=0; /* f --> fused */
 	char *mname = "merged-aggregation";
-	static char usage[] = "usage: %s [-d] -m test-case [-i input-buffers-to-read] [-l work-load-in-bytes] [-b batch-size-in-bytes] [-f]\n";
+	static char usage[] = "usage: %s [-d] -m test-case [-i input-buffers-to-read] [-l work-load-in-bytes] [-b batch-size-in-bytes] [-f | -e | -a] [-p pipeline-depth] [-c | -y] [-t host-threads] [-w [stage=]spins:yields]\n";
 
-	while ((c = getopt(argc, argv, "dm:l:fi:b:p:")) != -1) {
+	while ((c = getopt(argc, argv, "dm:l:feai:b:p:cyt:w:")) != -1) {
 		switch (c) {
             case 'd':
                 // debug = 1;
@@ -49,6 +52,30 @@ void parse_arguments(int argc, char * argv[],
                 fflag = 1;
                 *is_merging = true;
                 break;
+            case 'e':
+                /* Fused or separate, whichever is estimated cheaper */
+                *is_costing = true;
+                break;
+            case 'a':
+                /* Starts as -e does and switches between the two while it runs */
+                *is_adapting = true;
+                break;
+            case 'c':
+                *is_cpu = true;
+                break;
+            case 'y':
+                *is_hybrid = true;
+                break;
+            case 't':
+                *thread_num = atoi(optarg);
+                break;
+            case 'w':
+                /* e.g. -w 1000:100 for every stage or -w scheduler=100000:0 */
+                if (wait_parse_strategy(optarg) < 0) {
+                    fprintf(stderr, "%s: invalid waiting strategy %s\n", argv[0], optarg);
+                    err = 1;
+                }
+                break;
             case '?':
                 err = 1;
                 break;
@@ -100,6 +127,12 @@ void set_test_case(char const * mname, enum test_cases * mode) {
         *mode = CPU;
     } else if (strcmp(mname, "query1") == 0) {
         *mode = QUERY1;
+    } else if (strcmp(mname, "projection") == 0) {
+        *mode = PROJECTION;
+    } else if (strcmp(mname, "join") == 0) {
+        *mode = JOIN;
+    } else if (strcmp(mname, "chain") == 0) {
+        *mode = CHAIN;
     } else {
         *mode = ERROR;
     }
@@ -25,6 +25,9 @@ enum test_cases {
     TWO_SELECTION,
     QUERY1,
     QUERY2,
+    PROJECTION,
+    JOIN,
+    CHAIN,
     ERROR
 };
 
@@ -32,6 +35,6 @@ void set_test_case(char const * mname, enum test_cases * mode);
 void parse_arguments(int argc, char * argv[], 
     enum test_cases * mode, 
     int * work_load, int * batch_size, int * buffer_num, int * pipeline_num,
-    bool * is_merging, bool * is_debug);
+    bool * is_merging, bool * is_costing, bool * is_adapting, bool * is_debug, bool * is_cpu, bool * is_hybrid, int * thread_num);
 
 #endif // CONFIG_H
\ No newline at end of file
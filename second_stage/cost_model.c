@@ -0,0 +1,166 @@
+#include "cost_model.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "libgpu/gpu_agg.h"
+#include "libcpu/cpu_agg.h"
+#include "operators/selection.h"
+#include "operators/projection.h"
+#include "operators/reduction.h"
+#include "operators/aggregation.h"
+#include "operators/join.h"
+
+static cost_calibration_t calibrations [3];
+static bool calibrated [3] = {false, false, false};
+
+/* The result handler copies an output into the batches of the next stage on a single thread */
+static float host_copy_bandwidth() {
+    u_int8_t * source = (u_int8_t *) malloc(CPU_CALIBRATION_BYTES);
+    u_int8_t * target = (u_int8_t *) malloc(CPU_CALIBRATION_BYTES);
+    if (!source || !target) {
+        fprintf(stderr, "fatal error: out of memory\n");
+        exit(1);
+    }
+    memset(source, 1, CPU_CALIBRATION_BYTES);
+
+    /* Called through a pointer the compiler cannot see through, as the target is never read */
+    void * (* volatile copy) (void *, void const *, size_t) = memcpy;
+    copy(target, source, CPU_CALIBRATION_BYTES);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    copy(target, source, CPU_CALIBRATION_BYTES);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    free(source);
+    free(target);
+
+    float us = (end.tv_sec - start.tv_sec) * 1e6f + (end.tv_nsec - start.tv_nsec) / 1e3f;
+    return 2.0f * CPU_CALIBRATION_BYTES / us;
+}
+
+cost_calibration_p cost_calibrate(enum operator_backends backend) {
+    cost_calibration_p c = &calibrations[backend];
+    if (calibrated[backend]) {
+        return c;
+    }
+
+    /* A hybrid query is estimated as if it ran on the GPU */
+    if (backend == BACKEND_CPU) {
+        cpu_calibrate(&c->device_bandwidth, &c->launch_overhead);
+        c->transfer_bandwidth = 0;
+    } else {
+        gpu_calibrate(&c->transfer_bandwidth, &c->device_bandwidth, &c->launch_overhead);
+    }
+    c->host_bandwidth = host_copy_bandwidth();
+
+    calibrated[backend] = true;
+    return c;
+}
+
+/* Bytes of a tuple that operator i of the chain reads */
+static int cost_input_size(query_p query, int i) {
+    if (i > 0) {
+        return (* query->chain_callbacks[i-1]->get_output_schema_size) (query->chain[i-1]);
+    }
+
+    void * op = query->chain[0];
+    switch (query->chain_callbacks[0]->type) {
+    case OPERATOR_SELECT: return ((selection_p) op)->input_schema->size;
+    case OPERATOR_REDUCE: return ((reduction_p) op)->input_schema->size;
+    case OPERATOR_AGGREGATE: return ((aggregation_p) op)->input_schema->size;
+    case OPERATOR_PROJECT: return ((projection_p) op)->input_schema->size;
+    case OPERATOR_JOIN: return ((join_p) op)->input_schema->size;
+    default: return 0;
+    }
+}
+
+float cost_selectivity(query_p query, int i) {
+    if (query->chain_callbacks[i]->type != OPERATOR_SELECT) {
+        return 1;
+    }
+    return condition_estimate_selectivity(((selection_p) query->chain[i])->condition);
+}
+
+/* A host operator runs one or two parallel sections, which cost little next to its copies, so one is counted */
+static int cost_kernel_num(operator_p op, enum operator_backends backend) {
+    if (backend == BACKEND_CPU) {
+        return 1;
+    }
+
+    switch (op->type) {
+    case OPERATOR_SELECT: return SELECTION_KERNEL_NUM;
+    case OPERATOR_REDUCE: return REDUCTION_KERNEL_NUM;
+    case OPERATOR_AGGREGATE: return AGGREGATION_KERNEL_NUM;
+    case OPERATOR_PROJECT: return PROJECTION_KERNEL_NUM;
+    case OPERATOR_JOIN: return JOIN_KERNEL_NUM;
+    default: return 1;
+    }
+}
+
+/**
+ * The GPU kernels of a window operator compute every window on its own, so a tuple is read, and the
+ * operators fused before the sink evaluated on it, once per window it falls in. The host versions
+ * combine the panes of overlapping windows and read it once
+ **/
+static float cost_passes(query_p query, operator_p sink) {
+    if (query->backend == BACKEND_CPU || (sink->type != OPERATOR_REDUCE && sink->type != OPERATOR_AGGREGATE)) {
+        return 1;
+    }
+
+    float passes = (float) query->window->size / query->window->slide;
+    return (passes > 1) ? passes : 1;
+}
+
+/**
+ * A stage reads a batch of its input, once per pass, and writes what it passes on; on the GPU both are
+ * moved between the host and the device, and the output is copied into the batches of the next stage. A
+ * pipeline breaker ends a stage in every plan, so what it writes is the same in all of them and is left out.
+ * Forwarding selections copy the batch they are given on into the batches of the next operator as it is
+ **/
+float cost_estimate_plan(query_p query, cost_calibration_p calibration, 
+    int stage_num, int const firsts[], int const sinks[], bool forwarding, cost_stage_t stages[]) {
+
+    float total = 0;
+    float reach = 1;
+
+    for (int s=0; s<stage_num; s++) {
+        int first = firsts[s];
+        int sink = sinks[s];
+        operator_p sink_callbacks = query->chain_callbacks[sink];
+        cost_stage_p stage = &stages[s];
+
+        stage->reach = reach;
+        stage->selectivity = 1;
+        for (int i=first; i<=sink; i++) {
+            stage->selectivity *= cost_selectivity(query, i);
+        }
+        stage->passes = cost_passes(query, sink_callbacks);
+
+        float in_bytes = (float) query->batch_size * cost_input_size(query, first);
+        float out_bytes = 0;
+        if (sink_callbacks->type != OPERATOR_REDUCE && sink_callbacks->type != OPERATOR_AGGREGATE &&
+            sink_callbacks->type != OPERATOR_JOIN) {
+            out_bytes = (float) query->batch_size * stage->selectivity *
+                (* sink_callbacks->get_output_schema_size) (query->chain[sink]);
+        }
+
+        stage->launch = cost_kernel_num(sink_callbacks, query->backend) * calibration->launch_overhead;
+        stage->transfer = (calibration->transfer_bandwidth > 0) ?
+            (in_bytes + out_bytes) / calibration->transfer_bandwidth : 0;
+        stage->device = (in_bytes * stage->passes + out_bytes) / calibration->device_bandwidth;
+        stage->handoff = (s < stage_num - 1) ? out_bytes / calibration->host_bandwidth : 0;
+        stage->forward = forwarding ? in_bytes / calibration->host_bandwidth : 0;
+        stage->total = stage->launch + stage->transfer + stage->device + stage->handoff + 
+            (sink - first) * stage->forward;
+
+        /* The next stage sees this one's output in batches of the same size, fewer of them */
+        total += reach * stage->total;
+        reach *= stage->selectivity;
+    }
+
+    return total;
+}
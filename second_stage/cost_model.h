@@ -0,0 +1,47 @@
+#ifndef COST_MODEL_H
+#define COST_MODEL_H
+
+#include "query.h"
+
+/* Bandwidths in bytes per microsecond, overheads in microseconds */
+typedef struct cost_calibration * cost_calibration_p;
+typedef struct cost_calibration {
+    float transfer_bandwidth; /* Between the host and the device, 0 if the kernels read host memory */
+    float device_bandwidth;   /* Of the memory the kernels read and write */
+    float host_bandwidth;     /* Of the copy a stage output takes into the batches of the next stage */
+    float launch_overhead;    /* Of one kernel */
+} cost_calibration_t;
+
+/**
+ * The estimate of a stage for a batch of its own input. The selections are estimated by the pass rates
+ * they have sampled, refer to query_sample, and by a guess from their comparisons otherwise
+ **/
+typedef struct cost_stage * cost_stage_p;
+typedef struct cost_stage {
+    float reach;       /* Part of the query input that arrives at the stage */
+    float selectivity; /* Part of its input the stage passes on */
+    float passes;      /* Times the sink reads a tuple, once per window it falls in */
+
+    float launch;
+    float transfer;
+    float device;
+    float handoff;
+    float forward; /* Of each operator before the sink when they forward, refer to query_adapt */
+    float total;
+} cost_stage_t;
+
+/* Part of its input operator i of the chain passes on */
+float cost_selectivity(query_p query, int i);
+
+/* Calibrates the backend the first time it is asked for; the backend has to be initialised */
+cost_calibration_p cost_calibrate(enum operator_backends backend);
+
+/**
+ * Estimates every stage of a plan of the chain of a query, stage i running the operators from first[i] to
+ * sink[i], and returns the microseconds of the plan for a batch of the query input. With forwarding the 
+ * operators before each sink are not fused into it but pass their input on to a copy of it that is
+ **/
+float cost_estimate_plan(query_p query, cost_calibration_p calibration, 
+    int stage_num, int const first[], int const sink[], bool forwarding, cost_stage_t stages[]);
+
+#endif
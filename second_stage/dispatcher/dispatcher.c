@@ -7,7 +7,10 @@
 #include <stdio.h>
 #include <unistd.h>
 
+#include "wait/wait.h"
+
 static task_p take_one_task(dispatcher_p p);
+static void insert(dispatcher_p p, u_int8_t * data, int len, int tuple_size, long upstream_time, bool unselected);
 static void create_task(dispatcher_p p, batch_p batch);
 static void assemble(dispatcher_p p, batch_p batch, int length);
 static void send_one_task(dispatcher_p p, task_p t);
@@ -30,6 +33,8 @@ static void * dispatcher(void * args) {
 	p->start = 1;
 
     while (1) {
+		WAIT_POLL(WAIT_DISPATCHER, p->size != 0);
+
 		pthread_mutex_lock(p->mutex);
 
 			while (p->size == 0) {
@@ -43,6 +48,8 @@ static void * dispatcher(void * args) {
 		pthread_cond_signal(p->took);
 
 		// if (t->query->operator_num > 1 && task_is_most_upstream(t)) {
+			WAIT_POLL(WAIT_DISPATCHER, p->cur_tasks < DISPATCHER_CONCURRENT_TASK);
+
 			pthread_mutex_lock(p->mutex_t);
 				while (p->cur_tasks == DISPATCHER_CONCURRENT_TASK) {
 					pthread_cond_wait(p->finished, p->mutex_t);
@@ -88,6 +95,9 @@ dispatcher_p dispatcher_init(scheduler_p scheduler, query_p query, int oid, even
 	p->manager = event_manager;
 
 	p->cur_tasks = 0;
+	p->seq = 0;
+	p->stream_bytes = 0;
+	p->last_timestamp = 0;
 
     p->start = 0;
 
@@ -119,16 +129,58 @@ dispatcher_p dispatcher_init(scheduler_p scheduler, query_p query, int oid, even
 		exit (1);
 	}
 	/* Wait until thread attaches itself to the JVM */
-	while (! p->start)
-		;
+	wait_until_set(&p->start);
 	return p;
 
     return p;  
 }
 
-void dispatcher_insert(dispatcher_p p, u_int8_t * data, int len, long upstream_time) {
-    batch_p new_batch = batch(p->query->batch_size, 0, data, p->query->batch_size, 64);
+/**
+ * The pane of the last tuple before the batch and the bytes of the stream before it, which are 
+ * previous_pane_id and start_pointer of the window kernels. A range based stream that goes back in 
+ * time (e.g. replayed input) starts over as a new stream.
+ **/
+static void set_stream_position(dispatcher_p p, batch_p batch, int len, int tuple_size) {
+	window_p window = p->query->window;
+	long first = batch_get_first_tuple_timestamp64(batch, batch->start);
+
+	if (window->type == RANGE_BASE && p->stream_bytes > 0 && first < p->last_timestamp) {
+		p->stream_bytes = 0;
+	}
+
+	batch->start_pointer = p->stream_bytes;
+	if (p->stream_bytes == 0) {
+		batch->previous_pane_id = -1;
+	} else if (window->type == RANGE_BASE) {
+		batch->previous_pane_id = p->last_timestamp / window->pane_size;
+	} else {
+		batch->previous_pane_id = (p->stream_bytes / tuple_size - 1) / window->pane_size;
+	}
+
+	p->stream_bytes += (long) len * tuple_size;
+	p->last_timestamp = batch_get_first_tuple_timestamp64(batch, batch->start + (long) (len - 1) * tuple_size);
+}
+
+void dispatcher_insert(dispatcher_p p, u_int8_t * data, int len, int tuple_size, long upstream_time) {
+	/* Every batch of the query input is a point at which an adaptive query may switch its plan */
+	if (p->operator_id == 0) {
+		query_adapt(p->query);
+	}
+
+	insert(p, data, len, tuple_size, upstream_time, false);
+}
+
+void dispatcher_insert_unselected(dispatcher_p p, u_int8_t * data, int len, int tuple_size, long upstream_time) {
+	insert(p, data, len, tuple_size, upstream_time, true);
+}
+
+static void insert(dispatcher_p p, u_int8_t * data, int len, int tuple_size, long upstream_time, bool unselected) {
+    batch_p new_batch = batch(p->query->batch_size, 0, data, p->query->batch_size, tuple_size);
+	/* A batch passed on from an upstream query may be shorter than the batch size */
+	new_batch->size = len;
+	new_batch->end = new_batch->start + (long) len * tuple_size;
 	batch_reset_timestamp(new_batch, upstream_time);
+	new_batch->unselected = unselected;
 
 	pthread_mutex_lock(p->mutex);
 		while (p->size == DISPATCHER_QUEUE_LIMIT) {
@@ -142,6 +194,7 @@ void dispatcher_insert(dispatcher_p p, u_int8_t * data, int len, long upstream_t
 		
 		p->size++;
 
+		set_stream_position(p, new_batch, len, tuple_size);
         assemble(p, new_batch, len);
 
 	pthread_mutex_unlock(p->mutex);
@@ -171,14 +224,22 @@ result_handler_p dispatcher_get_handler(dispatcher_p p) {
 }
 
 static void send_one_task(dispatcher_p p, task_p t) {
-    /* Execute */
-    scheduler_add_task(p->scheduler, t);
+    /* Execute, or pass the batch on */
+    if (t->forwarded) {
+        task_forward(t);
+        result_handler_add_task(p->handler, t);
+    } else {
+        scheduler_add_task(p->scheduler, t);
+    }
 
     p->task_head = (p->task_head + 1) % DISPATCHER_QUEUE_LIMIT;
 }
 
 static void create_task(dispatcher_p p, batch_p batch) {
     task_p new_task = task(p->query, p->operator_id, batch, (void *)p, p->manager);
+    new_task->seq = p->seq++;
+    new_task->forwarded = query_forwards(p->query, p->operator_id);
+    query_observe(p->query, p->operator_id, batch, new_task->seq);
 
 	if (p->tasks[p->task_tail]) {
 		task_free(p->tasks[p->task_tail]);
@@ -26,6 +26,11 @@ typedef struct dispatcher {
     int operator_id;
 
     volatile int cur_tasks;
+    long seq; /* Sequence number of the next task */
+
+    /* Stream position, so that windows carry on from one batch to the next */
+    long stream_bytes;
+    long last_timestamp; /* Of the last tuple inserted */
 
     u_int8_t ** buffers;
     int buffer_num;
@@ -43,7 +48,11 @@ typedef struct dispatcher {
 
 dispatcher_p dispatcher_init(scheduler_p scheduler, query_p query, int oid, event_manager_p event_manager);
 
-void dispatcher_insert(dispatcher_p p, u_int8_t * data, int len, long upstream_time);
+/* Inserts len tuples of tuple_size bytes as the next batch of the stream */
+void dispatcher_insert(dispatcher_p p, u_int8_t * data, int len, int tuple_size, long upstream_time);
+
+/* Inserts a batch that holds tuples the selections before a fused sink have passed on, refer to query_forwards */
+void dispatcher_insert_unselected(dispatcher_p p, u_int8_t * data, int len, int tuple_size, long upstream_time);
 
 result_handler_p dispatcher_get_handler(dispatcher_p p);
 
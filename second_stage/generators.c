@@ -190,4 +190,47 @@ char * generate_tuple_size(schema_p input_schema, schema_p output_schema, int ve
         (output_schema->size + schema_get_pad(output_schema, vector)) / vector);
 
     return ret;
-}
\ No newline at end of file
+}
+
+char * generate_c_filename(int id, char const * base) {
+    char * ret = (char *) malloc(64 * sizeof(char)); *ret = '\0';
+    char s [MAX_LINE_LENGTH] = "";
+
+    _sprintf("%s_%d.c", base, id);
+
+    return ret;
+}
+
+char * generate_c_headers() {
+    char * ret = (char *) malloc(512 * sizeof(char)); *ret = '\0';
+    char s [MAX_LINE_LENGTH] = "";
+
+    _sprint("#include <float.h>\n");
+    _sprint("#include <sys/types.h>\n\n");
+
+    _sprint("typedef unsigned char uchar;\n");
+    _sprint("typedef struct { uchar s[16]; } uchar16;\n\n");
+
+    /* Address spaces do not exist on the host, and the helpers stay private to the library */
+    _sprint("#define __global\n");
+    _sprint("#define __local\n");
+    _sprint("#define inline static inline\n\n");
+
+    return ret;
+}
+
+char * generate_c_select_range() {
+    char * ret = (char *) malloc(512 * sizeof(char)); *ret = '\0';
+    char s [MAX_LINE_LENGTH] = "";
+
+    _sprint("int select_range (u_int8_t const * input, int from, int to, int * flags) {\n");
+    _sprint("    int count = 0;\n");
+    _sprint("    for (int i = from; i < to; i++) {\n");
+    _sprint("        flags[i] = selectf((input_t *) (input + (long) i * sizeof(input_t)));\n");
+    _sprint("        count += flags[i];\n");
+    _sprint("    }\n");
+    _sprint("    return count;\n");
+    _sprint("}\n\n");
+
+    return ret;
+}
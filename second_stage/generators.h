@@ -16,4 +16,17 @@ char * generate_output_tuple (schema_p schema, char const * prefix, int vector);
 
 char * generate_tuple_size(schema_p input_size, schema_p output_size, int vector);
 
+/* Ends the function a patch is inserted into, as a patch may rebind the input tuple `in` (see projection.c) */
+#define PATCH_EPILOGUE "#undef in\n"
+
+/* Host backend: the generated functions are compiled as C instead of OpenCL */
+
+char * generate_c_filename(int id, char const * base);
+
+/* Defines the OpenCL types and qualifiers used by the generated functions */
+char * generate_c_headers();
+
+/* int select_range(u_int8_t const * input, int from, int to, int * flags), looping over selectf */
+char * generate_c_select_range();
+
 #endif
\ No newline at end of file
@@ -0,0 +1,220 @@
+#include "cpu_agg.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct cpu_pool {
+    int thread_num;
+    pthread_t thrs [CPU_MAX_THREADS];
+
+    pthread_mutex_t mutex;
+    pthread_mutex_t section; /* Held for a whole cpu_execute, which the scheduler and result handlers both call */
+    pthread_cond_t submitted;
+    pthread_cond_t finished;
+
+    /* Current parallel section */
+    cpu_kernel_p kernel;
+    void * args;
+
+    volatile long generation; /* Bumped once per cpu_execute */
+    volatile int running;     /* Workers still inside the current section */
+    volatile int stop;
+} cpu_pool_t;
+
+static cpu_pool_t pool;
+
+typedef struct cpu_worker_args {
+    int tid;
+} cpu_worker_args_t;
+
+static cpu_worker_args_t worker_args [CPU_MAX_THREADS];
+
+static void * cpu_worker(void * args) {
+    int tid = ((cpu_worker_args_t *) args)->tid;
+    long seen = 0;
+
+    while (1) {
+        pthread_mutex_lock(&pool.mutex);
+            while (pool.generation == seen && !pool.stop) {
+                pthread_cond_wait(&pool.submitted, &pool.mutex);
+            }
+            if (pool.stop) {
+                pthread_mutex_unlock(&pool.mutex);
+                break;
+            }
+            seen = pool.generation;
+
+            cpu_kernel_p kernel = pool.kernel;
+            void * kernel_args = pool.args;
+        pthread_mutex_unlock(&pool.mutex);
+
+        (* kernel) (kernel_args, tid, pool.thread_num);
+
+        pthread_mutex_lock(&pool.mutex);
+            pool.running--;
+            if (pool.running == 0) {
+                pthread_cond_signal(&pool.finished);
+            }
+        pthread_mutex_unlock(&pool.mutex);
+    }
+
+    return NULL;
+}
+
+void cpu_init(int thread_num) {
+    if (thread_num < 1 || thread_num > CPU_MAX_THREADS) {
+        fprintf(stderr, "error: the number of host threads should be in [1, %d] (%s)\n", 
+            CPU_MAX_THREADS, __FUNCTION__);
+        exit(1);
+    }
+
+    pool.thread_num = thread_num;
+    pool.kernel = NULL;
+    pool.args = NULL;
+    pool.generation = 0;
+    pool.running = 0;
+    pool.stop = 0;
+
+    pthread_mutex_init(&pool.mutex, NULL);
+    pthread_mutex_init(&pool.section, NULL);
+    pthread_cond_init(&pool.submitted, NULL);
+    pthread_cond_init(&pool.finished, NULL);
+
+    /* The caller of cpu_execute works as thread 0 */
+    for (int i=1; i<thread_num; i++) {
+        worker_args[i].tid = i;
+        if (pthread_create(&pool.thrs[i], NULL, cpu_worker, (void *) &worker_args[i])) {
+            fprintf(stderr, "error: failed to create host worker thread\n");
+            exit(1);
+        }
+    }
+
+    fprintf(stdout, "[CPU] Started %d host worker thread(s)\n", thread_num);
+}
+
+int cpu_get_thread_num() {
+    return pool.thread_num;
+}
+
+void cpu_execute(cpu_kernel_p kernel, void * args) {
+    if (pool.thread_num == 1) {
+        (* kernel) (args, 0, 1);
+        return;
+    }
+
+    /* One section at a time: the workers only know of the latest one submitted */
+    pthread_mutex_lock(&pool.section);
+
+    pthread_mutex_lock(&pool.mutex);
+        pool.kernel = kernel;
+        pool.args = args;
+        pool.running = pool.thread_num - 1;
+        pool.generation++;
+    pthread_mutex_unlock(&pool.mutex);
+    pthread_cond_broadcast(&pool.submitted);
+
+    (* kernel) (args, 0, pool.thread_num);
+
+    pthread_mutex_lock(&pool.mutex);
+        while (pool.running > 0) {
+            pthread_cond_wait(&pool.finished, &pool.mutex);
+        }
+    pthread_mutex_unlock(&pool.mutex);
+
+    pthread_mutex_unlock(&pool.section);
+}
+
+void cpu_get_range(int n, int tid, int thread_num, int * from, int * to) {
+    int chunk = n / thread_num;
+    int rest = n % thread_num;
+
+    *from = tid * chunk + (tid < rest ? tid : rest);
+    *to = *from + chunk + (tid < rest ? 1 : 0);
+}
+
+typedef struct cpu_copy_args {
+    u_int8_t const * source;
+    u_int8_t * target;
+    int size;
+} cpu_copy_args_t;
+
+static void copyf(void * args_ptr, int tid, int thread_num) {
+    cpu_copy_args_t * args = (cpu_copy_args_t *) args_ptr;
+
+    int from, to;
+    cpu_get_range(args->size, tid, thread_num, &from, &to);
+    memcpy(args->target + from, args->source + from, to - from);
+}
+
+static void emptyf(void * args, int tid, int thread_num) {
+    (void) args; (void) tid; (void) thread_num;
+}
+
+static float elapsed_us(struct timespec const * start, struct timespec const * end) {
+    return (end->tv_sec - start->tv_sec) * 1e6f + (end->tv_nsec - start->tv_nsec) / 1e3f;
+}
+
+void cpu_calibrate(float * bandwidth, float * launch_overhead) {
+    cpu_copy_args_t args;
+    args.size = CPU_CALIBRATION_BYTES;
+    args.source = (u_int8_t *) malloc(CPU_CALIBRATION_BYTES);
+    args.target = (u_int8_t *) malloc(CPU_CALIBRATION_BYTES);
+    if (!args.source || !args.target) {
+        fprintf(stderr, "fatal error: out of memory\n");
+        exit(1);
+    }
+    memset((void *) args.source, 1, CPU_CALIBRATION_BYTES);
+
+    struct timespec start, end;
+
+    /* Once untimed so that the pages of the target are mapped */
+    cpu_execute(copyf, &args);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    cpu_execute(copyf, &args);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    *bandwidth = 2.0f * CPU_CALIBRATION_BYTES / elapsed_us(&start, &end);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i=0; i<CPU_CALIBRATION_LAUNCHES; i++) {
+        cpu_execute(emptyf, NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    *launch_overhead = elapsed_us(&start, &end) / CPU_CALIBRATION_LAUNCHES;
+
+    free((void *) args.source);
+    free(args.target);
+}
+
+void cpu_free() {
+    pthread_mutex_lock(&pool.mutex);
+        pool.stop = 1;
+    pthread_mutex_unlock(&pool.mutex);
+    pthread_cond_broadcast(&pool.submitted);
+
+    for (int i=1; i<pool.thread_num; i++) {
+        pthread_join(pool.thrs[i], NULL);
+    }
+}
+
+static int avx2_enabled = 1;
+
+int cpu_supports_avx2() {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    static int supported = -1;
+    if (supported < 0) {
+        __builtin_cpu_init();
+        supported = __builtin_cpu_supports("avx2") ? 1 : 0;
+    }
+    return supported && avx2_enabled;
+#else
+    return 0;
+#endif
+}
+
+void cpu_set_avx2(int enabled) {
+    avx2_enabled = enabled;
+}
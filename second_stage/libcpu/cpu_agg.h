@@ -0,0 +1,61 @@
+#ifndef __CPU_H_
+#define __CPU_H_
+
+#include <sys/types.h>
+
+#include "schema.h"
+
+#define CPU_MAX_THREADS 64
+
+/* Bytes copied to time the memory bandwidth, and parallel sections averaged to time one, refer to cpu_calibrate */
+#define CPU_CALIBRATION_BYTES (16 * 1024 * 1024)
+#define CPU_CALIBRATION_LAUNCHES 64
+
+/**
+ * A parallel section executed once by every worker of the pool. 
+ * 
+ * tid is in [0, thread_num) and the calling thread always runs as tid 0
+ **/
+typedef void (* cpu_kernel_p) (void * args, int tid, int thread_num);
+
+/* Start the host worker pool */
+void cpu_init(int thread_num);
+
+int cpu_get_thread_num();
+
+/* Run kernel on every worker and return once all of them have finished. Calls from different threads
+   (the scheduler, the result handlers) take turns, and a kernel must not call it itself */
+void cpu_execute(cpu_kernel_p kernel, void * args);
+
+/* Split [0, n) into thread_num contiguous ranges and return the one of tid */
+void cpu_get_range(int n, int tid, int thread_num, int * from, int * to);
+
+/**
+ * Measures the bytes per microsecond the workers read and write together in a copy, and the microseconds
+ * cpu_execute takes for a section that does nothing. Must be called after cpu_init
+ **/
+void cpu_calibrate(float * bandwidth, float * launch_overhead);
+
+/* Stop the worker pool */
+void cpu_free();
+
+/* Runtime CPU feature detection for the vectorised operator paths */
+int cpu_supports_avx2();
+
+/* Turn the vectorised paths off (and on again), so that they can be checked against the scalar ones */
+void cpu_set_avx2(int enabled);
+
+/* Read a numeric attribute as a float, as the implicit conversion in the generated kernels does */
+static inline float cpu_read_float(u_int8_t const * attr, enum attr_types type) {
+    switch (type) {
+    case TYPE_INT:
+        return (float) *((int const *) attr);
+    case TYPE_LONG:
+        return (float) *((long const *) attr);
+    case TYPE_FLOAT:
+    default:
+        return *((float const *) attr);
+    }
+}
+
+#endif /* __CPU_H_ */
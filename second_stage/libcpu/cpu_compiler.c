@@ -0,0 +1,86 @@
+#include "cpu_compiler.h"
+
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "helpers.h"
+
+#define CPU_COMPILER_FLAGS "-O3 -march=native -shared -fPIC -w"
+
+/* The buffers are sized from the file name, so that a long path is never cut short */
+static char * cpu_compiler_alloc(size_t length) {
+    char * ret = (char *) malloc(length);
+    if (!ret) {
+        fprintf(stderr, "fatal error: out of memory\n");
+        exit(1);
+    }
+    return ret;
+}
+
+void * cpu_compile(char const * source, char const * filename) {
+    char const * compiler = getenv("CC");
+    if (!compiler || !*compiler) {
+        compiler = "cc";
+    }
+
+    print_to_file(filename, source);
+
+    /* select_0.c -> select_0.so */
+    char * library_name = cpu_compiler_alloc(strlen(filename) + strlen(".so") + 1);
+    strcpy(library_name, filename);
+    char * extension = strrchr(library_name, '.');
+    if (extension && !strchr(extension, '/')) {
+        *extension = '\0';
+    }
+    strcat(library_name, ".so");
+
+    size_t command_length = strlen(compiler) + strlen(CPU_COMPILER_FLAGS) + strlen(library_name) + strlen(filename) + 8;
+    char * command = cpu_compiler_alloc(command_length);
+    snprintf(command, command_length, "%s %s -o %s %s", compiler, CPU_COMPILER_FLAGS, library_name, filename);
+    if (system(command) != 0) {
+        fprintf(stderr, "error: failed to compile %s with \"%s\" (%s)\n", filename, command, __FUNCTION__);
+        free(command);
+        free(library_name);
+        return NULL;
+    }
+    free(command);
+
+    /* A relative path would be searched for in the library paths instead */
+    char * path = cpu_compiler_alloc(strlen(library_name) + 3);
+    if (library_name[0] != '/') {
+        strcpy(path, "./");
+        strcat(path, library_name);
+    } else {
+        strcpy(path, library_name);
+    }
+    free(library_name);
+
+    void * library = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!library) {
+        fprintf(stderr, "error: failed to load %s: %s (%s)\n", path, dlerror(), __FUNCTION__);
+        free(path);
+        return NULL;
+    }
+    free(path);
+
+    return library;
+}
+
+void * cpu_get_function(void * library, char const * name) {
+    void * function = dlsym(library, name);
+
+    if (!function) {
+        fprintf(stderr, "error: generated function %s not found (%s)\n", name, __FUNCTION__);
+        exit(1);
+    }
+
+    return function;
+}
+
+void cpu_release(void * library) {
+    if (library) {
+        dlclose(library);
+    }
+}
@@ -0,0 +1,18 @@
+#ifndef __CPU_COMPILER_H_
+#define __CPU_COMPILER_H_
+
+/**
+ * Host counterpart of the OpenCL program build: the generated source is written to filename, compiled 
+ * by the system compiler ($CC, or cc) into a shared object next to it and loaded.
+ * 
+ * @return
+ * The library handle, or NULL if the source could not be compiled or loaded
+ **/
+void * cpu_compile(char const * source, char const * filename);
+
+/* Look up a generated function of a library returned by cpu_compile */
+void * cpu_get_function(void * library, char const * name);
+
+void cpu_release(void * library);
+
+#endif /* __CPU_COMPILER_H_ */
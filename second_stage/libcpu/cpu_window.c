@@ -0,0 +1,283 @@
+#include "cpu_window.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "cpu_agg.h"
+
+typedef struct window_args {
+    cpu_window_pointers_p p;
+
+    u_int8_t const * input;
+    int tuples;
+    int tuple_size;
+
+    long pane_size;
+    long panes_per_window;
+    long panes_per_slide;
+    enum window_types type;
+
+    long previous_pane_id;
+    long start_pointer;
+
+    long window_offset;
+    long first_block;
+    long last_window [CPU_MAX_THREADS];
+
+    int pane_counts [CPU_MAX_THREADS + 1];
+} window_args_t;
+
+static inline long get_pane_id(window_args_t const * args, int i) {
+    if (i < 0) {
+        return args->previous_pane_id;
+    }
+    if (args->type == RANGE_BASE) {
+        /* The first attribute is always the timestamp */
+        return *((long const *) (args->input + (long) i * args->tuple_size)) / args->pane_size;
+    } else {
+        return ((args->start_pointer + (long) i * args->tuple_size) / args->tuple_size) / args->pane_size;
+    }
+}
+
+/* computePointersKernel */
+static void compute_pointers(void * args_ptr, int tid, int thread_num) {
+    window_args_t * args = (window_args_t *) args_ptr;
+    cpu_window_pointers_p p = args->p;
+    int from, to;
+    cpu_get_range(args->tuples, tid, thread_num, &from, &to);
+
+    long last = 0;
+    long prev = get_pane_id(args, from - 1);
+    for (int i=from; i<to; i++) {
+        long curr = get_pane_id(args, i);
+        int offset = i * args->tuple_size;
+
+        for (long pane = prev + 1; pane <= curr; pane++) {
+            long normalised = pane - args->panes_per_window;
+            long index;
+
+            /* Closing windows */
+            if (normalised >= 0 && normalised % args->panes_per_slide == 0) {
+                index = normalised / args->panes_per_slide - args->window_offset;
+                if (index >= 0 && index < p->max_windows) {
+                    p->ends[index] = offset;
+                    last = (index > last) ? index : last;
+                }
+            }
+
+            /* Opening windows */
+            if (pane % args->panes_per_slide == 0) {
+                index = pane / args->panes_per_slide - args->window_offset;
+                if (index >= p->max_windows) {
+                    /* Indices only grow from here on */
+                    break;
+                }
+                if (index >= 0) {
+                    p->starts[index] = offset;
+                    last = (index > last) ? index : last;
+                }
+            }
+        }
+        prev = curr;
+    }
+
+    args->last_window[tid] = last;
+}
+
+/* Panes start where the pane id changes, counted first and then written from the count of the threads before */
+static void compute_panes(void * args_ptr, int tid, int thread_num, int write) {
+    window_args_t * args = (window_args_t *) args_ptr;
+    cpu_window_pointers_p p = args->p;
+    int from, to;
+    cpu_get_range(args->tuples, tid, thread_num, &from, &to);
+
+    int count = 0;
+    int * panes = p->panes + (write ? args->pane_counts[tid] : 0);
+    int * blocks = p->pane_blocks + (write ? args->pane_counts[tid] : 0);
+    long prev = (from > 0) ? get_pane_id(args, from - 1) : 0;
+    for (int i=from; i<to; i++) {
+        long curr = get_pane_id(args, i);
+        if (i == 0 || curr != prev) {
+            if (write) {
+                panes[count] = i * args->tuple_size;
+                blocks[count] = (int) (curr / args->panes_per_window - args->first_block);
+            }
+            count++;
+        }
+        prev = curr;
+    }
+
+    if (! write) {
+        args->pane_counts[tid + 1] = count;
+    }
+}
+
+static void count_panes(void * args_ptr, int tid, int thread_num) {
+    compute_panes(args_ptr, tid, thread_num, 0);
+}
+
+static void write_panes(void * args_ptr, int tid, int thread_num) {
+    compute_panes(args_ptr, tid, thread_num, 1);
+}
+
+cpu_window_pointers_p cpu_window_pointers(int max_windows) {
+    cpu_window_pointers_p p = (cpu_window_pointers_p) malloc(sizeof(cpu_window_pointers_t));
+    if (! p) {
+        fprintf(stderr, "fatal error: out of memory\n");
+        exit(1);
+    }
+
+    p->max_windows = max_windows;
+    p->starts = (int *) malloc(max_windows * sizeof(int));
+    p->ends = (int *) malloc(max_windows * sizeof(int));
+    if (! p->starts || ! p->ends) {
+        fprintf(stderr, "fatal error: out of memory\n");
+        exit(1);
+    }
+
+    /* -1 in every byte gives -1 in every int */
+    memset(p->starts, -1, max_windows * sizeof(int));
+    memset(p->ends, -1, max_windows * sizeof(int));
+    p->used = 0;
+
+    p->panes = NULL;
+    p->pane_blocks = NULL;
+    p->pane_num = 0;
+    p->max_panes = 0;
+
+    return p;
+}
+
+int cpu_window_compute(cpu_window_pointers_p p, 
+    u_int8_t const * input, int tuples, int tuple_size, window_p window, 
+    long previous_pane_id, long start_pointer) {
+
+    /* clearKernel: only the entries touched by the previous batch */
+    memset(p->starts, -1, p->used * sizeof(int));
+    memset(p->ends, -1, p->used * sizeof(int));
+
+    window_args_t args;
+    {
+        args.p = p;
+        args.input = input;
+        args.tuples = tuples;
+        args.tuple_size = tuple_size;
+
+        args.pane_size = window->pane_size;
+        args.panes_per_window = window->size / window->pane_size;
+        args.panes_per_slide = window->slide / window->pane_size;
+        args.type = window->type;
+
+        args.previous_pane_id = previous_pane_id;
+        args.start_pointer = start_pointer;
+    }
+
+    /* computeOffsetKernel */
+    if (start_pointer == 0) {
+        args.window_offset = 0;
+    } else {
+        args.window_offset = window_get_first_open(window, previous_pane_id);
+    }
+
+    cpu_execute(compute_pointers, &args);
+
+    long last = 0;
+    for (int i=0; i<cpu_get_thread_num(); i++) {
+        if (args.last_window[i] > last) {
+            last = args.last_window[i];
+        }
+    }
+
+    /* The windows the last tuple is in have started, even if neither end is in the batch (pending) */
+    long last_open = get_pane_id(&args, tuples - 1) / args.panes_per_slide - args.window_offset;
+    if (last_open > last && last_open < p->max_windows) {
+        last = last_open;
+    }
+    p->used = last + 1;
+
+    return (int) last;
+}
+
+int cpu_window_panes(cpu_window_pointers_p p, 
+    u_int8_t const * input, int tuples, int tuple_size, window_p window, long start_pointer) {
+
+    if (p->max_panes < tuples) {
+        free(p->panes);
+        free(p->pane_blocks);
+        p->panes = (int *) malloc(tuples * sizeof(int));
+        p->pane_blocks = (int *) malloc(tuples * sizeof(int));
+        if (! p->panes || ! p->pane_blocks) {
+            fprintf(stderr, "fatal error: out of memory\n");
+            exit(1);
+        }
+        p->max_panes = tuples;
+    }
+
+    window_args_t args;
+    {
+        args.p = p;
+        args.input = input;
+        args.tuples = tuples;
+        args.tuple_size = tuple_size;
+
+        args.pane_size = window->pane_size;
+        args.panes_per_window = window->size / window->pane_size;
+        args.type = window->type;
+
+        args.start_pointer = start_pointer;
+    }
+    args.first_block = get_pane_id(&args, 0) / args.panes_per_window;
+
+    int thread_num = cpu_get_thread_num();
+    args.pane_counts[0] = 0;
+    cpu_execute(count_panes, &args);
+    for (int i=0; i<thread_num; i++) {
+        args.pane_counts[i + 1] += args.pane_counts[i];
+    }
+    cpu_execute(write_panes, &args);
+
+    p->pane_num = args.pane_counts[thread_num];
+    return p->pane_num;
+}
+
+int cpu_window_find_pane(cpu_window_pointers_p p, int offset) {
+    int lo = 0, hi = p->pane_num;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (p->panes[mid] < offset) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+enum window_kinds cpu_window_classify(cpu_window_pointers_p p, int wid, int bytes, int * start, int * end) {
+    *start = p->starts[wid];
+    *end = p->ends[wid];
+
+    if (*start < 0 && *end >= 0) {
+        *start = 0;
+        return WINDOW_CLOSING;
+    } else if (*start >= 0 && *end < 0) {
+        *end = bytes;
+        return WINDOW_OPENING;
+    } else if (*start < 0 && *end < 0) {
+        *start = 0;
+        *end = bytes;
+        return WINDOW_PENDING;
+    } else {
+        return WINDOW_COMPLETE;
+    }
+}
+
+void cpu_window_pointers_free(cpu_window_pointers_p p) {
+    if (p) {
+        free(p->starts);
+        free(p->ends);
+        free(p->panes);
+        free(p->pane_blocks);
+        free(p);
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef __CPU_WINDOW_H_
+#define __CPU_WINDOW_H_
+
+#include <stdlib.h>
+
+#include "window.h"
+
+/**
+ * Host counterpart of clearKernel, computeOffsetKernel and computePointersKernel: for every window
+ * (relative to the first window closing in the batch) it holds the byte offsets of its first and 
+ * last tuples inside the batch, or -1 if the window starts (ends) outside of it.
+ **/
+typedef struct cpu_window_pointers * cpu_window_pointers_p;
+typedef struct cpu_window_pointers {
+    int max_windows;
+    int * starts;
+    int * ends;
+
+    int used; /* Entries that have to be cleared before the next batch */
+
+    /* Byte offset of the first tuple of every non-empty pane of the batch, refer to cpu_window_panes */
+    int * panes;
+    int * pane_blocks; /* Pane ids divided by the panes of a window, from the block of the first pane */
+    int pane_num;
+    int max_panes;
+} cpu_window_pointers_t;
+
+cpu_window_pointers_p cpu_window_pointers(int max_windows);
+
+/**
+ * Fill the window pointers of a batch 
+ * 
+ * @return
+ * The index of the last window found in the batch (offset[1] of the kernels)
+ **/
+int cpu_window_compute(cpu_window_pointers_p p, 
+    u_int8_t const * input, int tuples, int tuple_size, window_p window, 
+    long previous_pane_id, long start_pointer);
+
+/**
+ * Split a batch into its panes, so that a window is assembled from the partials of the panes 
+ * between its pointers instead of from its tuples
+ * 
+ * @return
+ * The number of panes
+ **/
+int cpu_window_panes(cpu_window_pointers_p p, 
+    u_int8_t const * input, int tuples, int tuple_size, window_p window, long start_pointer);
+
+/**
+ * A window spans at most two blocks: the tail of one and the head of the next. Pane j starts 
+ * a block if it is the first pane of the batch in it.
+ **/
+static inline int cpu_window_block_first(cpu_window_pointers_p p, int j) {
+    return j == 0 || p->pane_blocks[j - 1] != p->pane_blocks[j];
+}
+
+/* The first pane starting at or after byte offset, pane_num if none */
+int cpu_window_find_pane(cpu_window_pointers_p p, int offset);
+
+/* Classify window wid and set its byte range [start, end) inside a batch of the given bytes */
+enum window_kinds cpu_window_classify(cpu_window_pointers_p p, int wid, int bytes, int * start, int * end);
+
+void cpu_window_pointers_free(cpu_window_pointers_p p);
+
+#endif /* __CPU_WINDOW_H_ */
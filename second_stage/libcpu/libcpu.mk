@@ -0,0 +1,11 @@
+CPU_OBJDIR=$(OBJDIR)/libcpu
+$(CPU_OBJDIR): ; mkdir -p $@
+
+CPU_DEPDIR=$(DEPDIR)/libcpu
+$(CPU_DEPDIR): ; mkdir -p $@
+
+CPU_LIB = cpu_agg.c cpu_window.c cpu_compiler.c
+CPU_LIB := $(foreach file,$(CPU_LIB),libcpu/$(file))
+SRCS += $(CPU_LIB)
+
+LIBDIR += $(CPU_DEPDIR) $(CPU_OBJDIR)
@@ -6,6 +6,9 @@
 #include <CL/cl.h>
 #endif
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
 #include "gpu_query.h"
 #include "gpu_input_buffer.h"
@@ -28,18 +31,23 @@ static gpu_config_p pipeline [MAX_DEPTH];
 
 static event_manager_p event_manager = NULL;
 
+static void (*completion_handler)(query_event_p) = NULL;
+
 /* Callback functions */
 
 void callback_setKernelAggregate (cl_kernel, gpu_config_p, int *, long *);
 void callback_setKernelCompact (cl_kernel kernel, gpu_config_p context, int *args1, long *args2);
 void callback_setKernelReduce (cl_kernel kernel, gpu_config_p context, int *args1, long *args2);
 void callback_setKernelSelect (cl_kernel kernel, gpu_config_p context, int *args1, long *args2);
+void callback_setKernelProject (cl_kernel kernel, gpu_config_p context, int *args1, long *args2);
+void callback_setKernelJoin (cl_kernel kernel, gpu_config_p context, int *args1, long *args2);
 
 void callback_resetConstReduce (cl_kernel kernel, gpu_config_p context, int *args1, long *args2);
 void callback_resetConstAggregate (cl_kernel kernel, gpu_config_p config, int *args1, long *args2);
 
 void callback_configureReduce (cl_kernel kernel, gpu_config_p context, int *args1, long *args2);
 void callback_configureAggregate (cl_kernel kernel, gpu_config_p context, int *args1, long *args2);
+void callback_configureJoin (cl_kernel kernel, gpu_config_p context, int *args1, long *args2);
 
 void callback_readOutput (gpu_config_p context, int qid, int ndx, int mark);
 void callback_notifyEnd (query_event_p event);
@@ -72,6 +80,11 @@ static void set_device () {
         1,                    // return an ID for only one GPU &device_id
         &device,              // on return, the device ID
         &count);              // on return, the number of devices
+	if (error == CL_DEVICE_NOT_FOUND) {
+		/* No GPU, e.g. pocl on a development machine: use whatever device the platform offers */
+		fprintf(stdout, "[GPU] No GPU device found, falling back to the default OpenCL device\n");
+		error = clGetDeviceIDs (platform, CL_DEVICE_TYPE_ALL, 1, &device, &count);
+	}
 	if (error != CL_SUCCESS) {
 		fprintf(stderr, "opencl error (%d): %s\n", error, getErrorMessage(error));
 		exit (1);
@@ -136,6 +149,10 @@ void gpu_init (int _queries, int _depth, event_manager_p _event_manager) {
     set_context ();
     
 	query_num = _queries;
+	if (_queries > MAX_QUERIES) {
+		fprintf(stderr, "[GPU] error: the number of queries has exceed the limit (%d)\n", MAX_QUERIES);
+		exit(1);
+	}
 	free_query_id = 0;
 	for (int i = 0; i < MAX_QUERIES; i++)
 		queries[i] = NULL;
@@ -160,6 +177,90 @@ void gpu_init (int _queries, int _depth, event_manager_p _event_manager) {
 	return;
 }
 
+void gpu_set_completion_handler(void (*handler)(query_event_p)) {
+	if (pipeline_depth > 0) {
+		fprintf(stderr, "error: completion handler requires a pipeline depth of 0 (%s)\n", __FUNCTION__);
+		exit(1);
+	}
+	completion_handler = handler;
+}
+
+static float elapsed_us (struct timespec const * start, struct timespec const * end) {
+	return (end->tv_sec - start->tv_sec) * 1e6f + (end->tv_nsec - start->tv_nsec) / 1e3f;
+}
+
+void gpu_calibrate (float * transfer_bandwidth, float * device_bandwidth, float * launch_overhead) {
+	int error = 0;
+	struct timespec start, end;
+
+	cl_command_queue queue = clCreateCommandQueue (context, device, 0, &error);
+	if (! queue) {
+		fprintf(stderr, "opencl error (%d): %s (%s)\n", error, getErrorMessage(error), __FUNCTION__);
+		exit (1);
+	}
+
+	void * host = malloc (CALIBRATION_BYTES);
+	if (! host) {
+		fprintf(stderr, "fatal error: out of memory\n");
+		exit(1);
+	}
+	memset (host, 1, CALIBRATION_BYTES);
+
+	cl_mem source = clCreateBuffer (context, CL_MEM_READ_WRITE, CALIBRATION_BYTES, NULL, &error);
+	cl_mem target = clCreateBuffer (context, CL_MEM_READ_WRITE, CALIBRATION_BYTES, NULL, &error);
+	if (! source || ! target) {
+		fprintf(stderr, "opencl error (%d): %s (%s)\n", error, getErrorMessage(error), __FUNCTION__);
+		exit (1);
+	}
+
+	/* Every step runs once untimed, so that the buffers are allocated on the device and the kernel is loaded */
+	error |= clEnqueueWriteBuffer (queue, source, CL_TRUE, 0, CALIBRATION_BYTES, host, 0, NULL, NULL);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	error |= clEnqueueWriteBuffer (queue, source, CL_TRUE, 0, CALIBRATION_BYTES, host, 0, NULL, NULL);
+	error |= clEnqueueReadBuffer  (queue, source, CL_TRUE, 0, CALIBRATION_BYTES, host, 0, NULL, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	*transfer_bandwidth = 2.0f * CALIBRATION_BYTES / elapsed_us(&start, &end);
+
+	error |= clEnqueueCopyBuffer (queue, source, target, 0, 0, CALIBRATION_BYTES, 0, NULL, NULL);
+	error |= clFinish (queue);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	error |= clEnqueueCopyBuffer (queue, source, target, 0, 0, CALIBRATION_BYTES, 0, NULL, NULL);
+	error |= clFinish (queue);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	*device_bandwidth = 2.0f * CALIBRATION_BYTES / elapsed_us(&start, &end);
+
+	cl_program program = gpu_query_buildProgram (device, context, "__kernel void emptyKernel () {}");
+	cl_kernel kernel = clCreateKernel (program, "emptyKernel", &error);
+	if (! kernel) {
+		fprintf(stderr, "opencl error (%d): %s (%s)\n", error, getErrorMessage(error), __FUNCTION__);
+		exit (1);
+	}
+	size_t threads = 1;
+	error |= clEnqueueNDRangeKernel (queue, kernel, 1, NULL, &threads, &threads, 0, NULL, NULL);
+	error |= clFinish (queue);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int i = 0; i < CALIBRATION_LAUNCHES; i++)
+		error |= clEnqueueNDRangeKernel (queue, kernel, 1, NULL, &threads, &threads, 0, NULL, NULL);
+	error |= clFinish (queue);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	*launch_overhead = elapsed_us(&start, &end) / CALIBRATION_LAUNCHES;
+
+	if (error != CL_SUCCESS) {
+		fprintf(stderr, "opencl error (%d): %s (%s)\n", error, getErrorMessage(error), __FUNCTION__);
+		exit (1);
+	}
+
+	clReleaseKernel (kernel);
+	clReleaseProgram (program);
+	clReleaseMemObject (source);
+	clReleaseMemObject (target);
+	clReleaseCommandQueue (queue);
+	free (host);
+}
+
 int gpu_get_query (const char *source, int _kernels, int _inputs, int _outputs) {
 	
 	int query_id = free_query_id++;
@@ -174,6 +275,22 @@ int gpu_get_query (const char *source, int _kernels, int _inputs, int _outputs)
 	return query_id;
 }
 
+cl_program gpu_build_program (const char *source) {
+	return gpu_query_buildProgram (device, context, source);
+}
+
+void gpu_set_program (int qid, cl_program program) {
+	if (qid < 0 || qid >= query_num) {
+		fprintf(stderr, "error: query index [%d] out of bounds\n", qid);
+		exit (1);
+	}
+	gpu_query_setProgram (queries[qid], program);
+}
+
+void gpu_release_program (cl_program program) {
+	clReleaseProgram (program);
+}
+
 void gpu_free () {
 	int error = 0;
 
@@ -246,6 +363,26 @@ int gpu_exec (int qid,
 	return gpu_query_exec (query, threads, threadsPerGroup, operator, input_batches, output_batches, addr_size, event);
 }
 
+void gpu_collect (void ** output_batches, size_t addr_size) {
+	/* Shift the pipeline as a new batch would, without one */
+	gpu_config_p out_config = callback_execKernel (NULL);
+	if (! out_config)
+		return;
+
+	gpu_config_moveOutputBuffers (out_config, output_batches, addr_size);
+	gpu_config_flush (out_config);
+	gpu_config_finish (out_config);
+
+	if (out_config->event) {
+		out_config->event->device = gpu_config_elapsed (out_config);
+		out_config->event = NULL;
+	}
+
+#ifdef GPU_PROFILE
+	gpu_config_profileQuery (out_config);
+#endif
+}
+
 void gpu_set_kernel_aggregate(int qid, int * args1, long * args2) {
     /**
      * TODO
@@ -257,11 +394,13 @@ void gpu_set_kernel_aggregate(int qid, int * args1, long * args2) {
 	gpu_set_kernel (qid, 1, "computeOffsetKernel",            &callback_setKernelAggregate, args1, args2);
 	gpu_set_kernel (qid, 2, "computePointersKernel",          &callback_setKernelAggregate, args1, args2);
 	gpu_set_kernel (qid, 3, "countWindowsKernel",             &callback_setKernelAggregate, args1, args2);
-	gpu_set_kernel (qid, 4, "aggregateClosingWindowsKernel",  &callback_setKernelAggregate, args1, args2);
-	gpu_set_kernel (qid, 5, "aggregateCompleteWindowsKernel", &callback_setKernelAggregate, args1, args2);
-	gpu_set_kernel (qid, 6, "aggregateOpeningWindowsKernel",  &callback_setKernelAggregate, args1, args2);
-	gpu_set_kernel (qid, 7, "aggregatePendingWindowsKernel",  &callback_setKernelAggregate, args1, args2);
-	gpu_set_kernel (qid, 8, "packKernel",                     &callback_setKernelAggregate, args1, args2);
+	gpu_set_kernel (qid, 4, "partitionHistogramKernel",       &callback_setKernelAggregate, args1, args2);
+	gpu_set_kernel (qid, 5, "partitionKernel",                &callback_setKernelAggregate, args1, args2);
+	gpu_set_kernel (qid, 6, "aggregateClosingWindowsKernel",  &callback_setKernelAggregate, args1, args2);
+	gpu_set_kernel (qid, 7, "aggregateCompleteWindowsKernel", &callback_setKernelAggregate, args1, args2);
+	gpu_set_kernel (qid, 8, "aggregateOpeningWindowsKernel",  &callback_setKernelAggregate, args1, args2);
+	gpu_set_kernel (qid, 9, "aggregatePendingWindowsKernel",  &callback_setKernelAggregate, args1, args2);
+	gpu_set_kernel (qid,10, "packKernel",                     &callback_setKernelAggregate, args1, args2);
 	
 	return;
 }
@@ -277,11 +416,13 @@ void gpu_reset_kernel_aggregate(int qid, int * args1, long * args2) {
 	gpu_reset_kernel (qid, 1, "computeOffsetKernel",            &callback_resetConstAggregate, args1, args2);
 	gpu_reset_kernel (qid, 2, "computePointersKernel",          &callback_resetConstAggregate, args1, args2);
 	gpu_reset_kernel (qid, 3, "countWindowsKernel",             &callback_resetConstAggregate, args1, args2);
-	gpu_reset_kernel (qid, 4, "aggregateClosingWindowsKernel",  &callback_resetConstAggregate, args1, args2);
-	gpu_reset_kernel (qid, 5, "aggregateCompleteWindowsKernel", &callback_resetConstAggregate, args1, args2);
-	gpu_reset_kernel (qid, 6, "aggregateOpeningWindowsKernel",  &callback_resetConstAggregate, args1, args2);
-	gpu_reset_kernel (qid, 7, "aggregatePendingWindowsKernel",  &callback_resetConstAggregate, args1, args2);
-	gpu_reset_kernel (qid, 8, "packKernel",                     &callback_resetConstAggregate, args1, args2);
+	gpu_reset_kernel (qid, 4, "partitionHistogramKernel",       &callback_resetConstAggregate, args1, args2);
+	gpu_reset_kernel (qid, 5, "partitionKernel",                &callback_resetConstAggregate, args1, args2);
+	gpu_reset_kernel (qid, 6, "aggregateClosingWindowsKernel",  &callback_resetConstAggregate, args1, args2);
+	gpu_reset_kernel (qid, 7, "aggregateCompleteWindowsKernel", &callback_resetConstAggregate, args1, args2);
+	gpu_reset_kernel (qid, 8, "aggregateOpeningWindowsKernel",  &callback_resetConstAggregate, args1, args2);
+	gpu_reset_kernel (qid, 9, "aggregatePendingWindowsKernel",  &callback_resetConstAggregate, args1, args2);
+	gpu_reset_kernel (qid,10, "packKernel",                     &callback_resetConstAggregate, args1, args2);
 	
 	return;
 }
@@ -376,8 +517,14 @@ void callback_setKernelAggregate (cl_kernel kernel, gpu_config_p config, int *ar
 			sizeof(cl_mem),
 			(void *) &(config->kernelOutput.outputs[8]->device_buffer));
 	
+	error |= clSetKernelArg (
+			kernel,
+			17,
+			sizeof(cl_mem),
+			(void *) &(config->kernelOutput.outputs[9]->device_buffer));
+	
 	/* Set local memory */
-	error |= clSetKernelArg (kernel, 17, (size_t) cache_size, (void *) NULL);
+	error |= clSetKernelArg (kernel, 18, (size_t) cache_size, (void *) NULL);
 	
 	if (error != CL_SUCCESS) {
 		fprintf(stderr, "opencl error (%d): %s\n", error, getErrorMessage(error));
@@ -429,7 +576,9 @@ void gpu_set_kernel_reduce(int qid, int * args1, long * args2) {
 	gpu_set_kernel (qid, 0, "clearKernel",           &callback_setKernelReduce, args1, args2);
 	gpu_set_kernel (qid, 1, "computeOffsetKernel",   &callback_setKernelReduce, args1, args2);
 	gpu_set_kernel (qid, 2, "computePointersKernel", &callback_setKernelReduce, args1, args2);
-	gpu_set_kernel (qid, 3, "reduceKernel",          &callback_setKernelReduce, args1, args2);
+	gpu_set_kernel (qid, 3, "paneKernel",            &callback_setKernelReduce, args1, args2);
+	gpu_set_kernel (qid, 4, "scanKernel",            &callback_setKernelReduce, args1, args2);
+	gpu_set_kernel (qid, 5, "reduceKernel",          &callback_setKernelReduce, args1, args2);
 
 	return;
 }
@@ -440,7 +589,9 @@ void gpu_reset_kernel_reduce(int qid, int * args1, long * args2) {
 	gpu_reset_kernel (qid, 0, "clearKernel",           &callback_resetConstReduce, args1, args2);
 	gpu_reset_kernel (qid, 1, "computeOffsetKernel",   &callback_resetConstReduce, args1, args2);
 	gpu_reset_kernel (qid, 2, "computePointersKernel", &callback_resetConstReduce, args1, args2);
-	gpu_reset_kernel (qid, 3, "reduceKernel",          &callback_resetConstReduce, args1, args2);
+	gpu_reset_kernel (qid, 3, "paneKernel",            &callback_resetConstReduce, args1, args2);
+	gpu_reset_kernel (qid, 4, "scanKernel",            &callback_resetConstReduce, args1, args2);
+	gpu_reset_kernel (qid, 5, "reduceKernel",          &callback_resetConstReduce, args1, args2);
 
 	return;
 }
@@ -466,6 +617,7 @@ void gpu_execute (int qid,
 
 	operator->readOutput = callback_readOutput;
 	operator->execKernel = callback_execKernel;
+	operator->notifyComplete = completion_handler;
 	operator->notifyEnd = callback_notifyEnd;
 
 	gpu_exec (qid, threads, threadsPerGroup, operator, input_batches, output_batches, addr_size, event);
@@ -537,8 +689,14 @@ void callback_setKernelReduce (cl_kernel kernel, gpu_config_p context, int *args
 			sizeof(cl_mem),
 			(void *) &(context->kernelOutput.outputs[4]->device_buffer));
 
+	error |= clSetKernelArg (
+			kernel,
+			11,
+			sizeof(cl_mem),
+			(void *) &(context->kernelOutput.outputs[5]->device_buffer));
+
 	/* Set local memory */
-	error |= clSetKernelArg (kernel, 11, (size_t)  cache_size, (void *) NULL);
+	error |= clSetKernelArg (kernel, 12, (size_t)  cache_size, (void *) NULL);
 
 	if (error != CL_SUCCESS) {
 		fprintf(stderr, "opencl error (%d): %s\n", error, getErrorMessage(error));
@@ -584,7 +742,7 @@ void gpu_execute_reduce(int qid,
 	void ** input_batches, void ** output_batches, size_t addr_size,
 	query_event_p event) {
 
-	int const kernel_num = 4;
+	int const kernel_num = 6;
 	for (int i=0; i<kernel_num; i++) {
 		dbg("[DBG] kernel %d: %10zu threads %10zu threads/group\n", i, threads[i], threads_per_group[i]);
 	}
@@ -601,6 +759,7 @@ void gpu_execute_reduce(int qid,
 	operator->readOutput = callback_readOutput;
 	operator->notifyEnd = callback_notifyEnd;
 	operator->execKernel = callback_execKernel;
+	operator->notifyComplete = completion_handler;
 
 	gpu_exec(qid, threads, threads_per_group, operator, input_batches, output_batches, addr_size, event);
 
@@ -697,6 +856,46 @@ void callback_setKernelCompact (cl_kernel kernel, gpu_config_p context, int *arg
 	callback_setKernelSelect (kernel, context, args1, args2);
 }
 
+void gpu_set_kernel_project (int qid, int * args) {
+
+	gpu_set_kernel (qid, 0, "projectKernel", &callback_setKernelProject, args, NULL);
+
+	return ;
+}
+
+void callback_setKernelProject (cl_kernel kernel, gpu_config_p context, int *args1, long *args2) {
+
+	(void) args2;
+
+	/* Get all constants */
+	int numberOfBytes       = args1[0];
+	int numberOfTuples      = args1[1];
+	int numberOfOutputBytes = args1[2];
+
+	int error = 0;
+	/* Set constant arguments */
+	error |= clSetKernelArg (kernel, 0, sizeof(int), (void *)       &numberOfBytes);
+	error |= clSetKernelArg (kernel, 1, sizeof(int), (void *)      &numberOfTuples);
+	error |= clSetKernelArg (kernel, 2, sizeof(int), (void *) &numberOfOutputBytes);
+	/* Set I/O byte buffers */
+	error |= clSetKernelArg (
+		kernel,
+		3,
+		sizeof(cl_mem),
+		(void *) &(context->kernelInput.inputs[0]->device_buffer));
+	error |= clSetKernelArg (
+		kernel,
+		4,
+		sizeof(cl_mem),
+		(void *) &(context->kernelOutput.outputs[0]->device_buffer));
+
+	if (error != CL_SUCCESS) {
+		fprintf(stderr, "opencl error (%d): %s\n", error, getErrorMessage(error));
+		exit (1);
+	}
+	return;
+}
+
 void gpu_execute_aggregate(int qid, 
 	size_t * threads, size_t * threads_per_group, long * args2, 
 	void ** input_batches, void ** output_batches, size_t addr_size,
@@ -719,6 +918,7 @@ void gpu_execute_aggregate(int qid,
 	operator->readOutput = callback_readOutput;
 	operator->notifyEnd = callback_notifyEnd;
 	operator->execKernel = callback_execKernel;
+	operator->notifyComplete = completion_handler;
 
 	gpu_exec (qid, threads, threads_per_group, operator, input_batches, output_batches, addr_size, event);
 
@@ -737,9 +937,13 @@ void callback_configureAggregate (cl_kernel kernel, gpu_config_p context, int *a
 	long previousPaneId = args2[0];
 	long startOffset    = args2[1];
 
+	/* The tables of each batch are sized from the groups estimated */
+	int hashTableSize   = (int) args2[2];
+
 	int error = 0;
 
 	/* Set constant arguments */
+	error |= clSetKernelArg (kernel, 3, sizeof(int),  (void *)  &hashTableSize);
 	error |= clSetKernelArg (kernel, 5, sizeof(long), (void *) &previousPaneId);
 	error |= clSetKernelArg (kernel, 6, sizeof(long), (void *)    &startOffset);
 
@@ -775,7 +979,9 @@ void callback_notifyEnd (query_event_p event) {
 	clock_gettime(CLOCK_MONOTONIC_RAW, &end);
 	event->end = end.tv_sec * 1000000 + end.tv_nsec / 1000;
 
-	event_manager_add_event(event_manager, event);
+	if (event_manager) {
+		event_manager_add_event(event_manager, event);
+	}
 
 	return;
 }
@@ -798,3 +1004,103 @@ gpu_config_p callback_execKernel(gpu_config_p config) {
 	
 	return p;
 }
+
+void gpu_set_kernel_join (int qid, int * args1, long * args2) {
+
+	gpu_set_kernel (qid, 0, "clearKernel", &callback_setKernelJoin, args1, args2);
+	gpu_set_kernel (qid, 1, "buildKernel", &callback_setKernelJoin, args1, args2);
+	gpu_set_kernel (qid, 2, "countKernel", &callback_setKernelJoin, args1, args2);
+	gpu_set_kernel (qid, 3,  "joinKernel", &callback_setKernelJoin, args1, args2);
+
+	return ;
+}
+
+void callback_setKernelJoin (cl_kernel kernel, gpu_config_p context, int *args1, long *args2) {
+
+	/* Get all constants */
+	int numberOfTuples = args1[0];
+	int tableSize      = args1[1];
+	int capacity       = args1[2];
+	long windowSize    = (long) args1[3];
+	int cache_size     = args1[4]; /* Local buffer size */
+
+	long buildTuples   = args2[0];
+
+	int error = 0;
+	/* Set constant arguments */
+	error |= clSetKernelArg (kernel, 0, sizeof(int),  (void *) &numberOfTuples);
+	error |= clSetKernelArg (kernel, 1, sizeof(int),  (void *)      &tableSize);
+	error |= clSetKernelArg (kernel, 2, sizeof(int),  (void *)       &capacity);
+	error |= clSetKernelArg (kernel, 3, sizeof(long), (void *)    &buildTuples);
+	error |= clSetKernelArg (kernel, 4, sizeof(long), (void *)     &windowSize);
+	/* Set I/O byte buffers: the probe and build tuples, then the heads and links of the hash table,
+	   the offsets of the results of every tuple, the results of every group and the results */
+	for (int i = 0; i < 2; i++) {
+		error |= clSetKernelArg (
+			kernel,
+			5 + i,
+			sizeof(cl_mem),
+			(void *) &(context->kernelInput.inputs[i]->device_buffer));
+	}
+	for (int i = 0; i < 5; i++) {
+		error |= clSetKernelArg (
+			kernel,
+			7 + i,
+			sizeof(cl_mem),
+			(void *) &(context->kernelOutput.outputs[i]->device_buffer));
+	}
+	/* Set local memory */
+	error |= clSetKernelArg (kernel, 12, (size_t) cache_size, (void *) NULL);
+
+	if (error != CL_SUCCESS) {
+		fprintf(stderr, "opencl error (%d): %s\n", error, getErrorMessage(error));
+		exit (1);
+	}
+	return;
+}
+
+void gpu_execute_join(int qid, 
+	size_t * threads, size_t * threads_per_group, long * args2, 
+	void ** input_batches, void ** output_batches, size_t addr_size,
+	query_event_p event) {
+
+	/* Create and setup operator */
+	query_operator_p operator = (query_operator_p) malloc (sizeof(query_operator_t));
+	if (! operator) {
+		fprintf(stderr, "fatal error: out of memory\n");
+		exit(1);
+	}
+	operator->args1 = NULL;
+	operator->args2 = args2;
+	operator->configure = callback_configureJoin;
+	operator->readOutput = callback_readOutput;
+	operator->notifyEnd = callback_notifyEnd;
+	operator->execKernel = callback_execKernel;
+	operator->notifyComplete = completion_handler;
+
+	gpu_exec(qid, threads, threads_per_group, operator, input_batches, output_batches, addr_size, event);
+
+	/* Free operator */
+	if (operator)
+		free (operator);
+
+	return;
+}
+
+void callback_configureJoin (cl_kernel kernel, gpu_config_p config, int *args1, long *args2) {
+
+	(void) config;
+	(void)   args1;
+
+	long buildTuples = args2[0];
+
+	int error = 0;
+	error |= clSetKernelArg (kernel, 3, sizeof(long), (void *) &buildTuples);
+
+	if (error != CL_SUCCESS) {
+		fprintf(stderr, "opencl error (%d): %s\n", error, getErrorMessage(error));
+		exit (1);
+	}
+
+	return;
+}
@@ -21,6 +21,9 @@ typedef struct query_operator {
 
 	gpu_config_p (*execKernel) (gpu_config_p);
 
+	/* If set, called once the outputs of the batch have been read instead of pipelining */
+	void (*notifyComplete) (query_event_p);
+
 } query_operator_t;
 
 /* call opencl api to create kernels */
@@ -55,12 +58,49 @@ void gpu_reset_kernel_reduce(int qid, int * args1, long * args2);
 
 void gpu_set_kernel_select(int qid, int * args);
 
+/* set kernel for project operator
+ * args:int[] [0]inputSize, [1]tuples, [2]outputSize
+ */
+void gpu_set_kernel_project(int qid, int * args);
+
+/* set kernel for join operator
+ * args1:int[] [0]tuples, [1]tableSize, [2]capacity, [3]windowSize, [4]cacheSize
+ * args2:long[] [0]build tuples
+ */
+void gpu_set_kernel_join(int qid, int * args1, long * args2);
+
 /* Initialise OpenCL device */
 void gpu_init(int query_num, int pipeline_depth, event_manager_p event_manager);
 
+/**
+ * Without a pipeline (depth 0), each batch reads its own outputs and the handler is
+ * called with the event of the batch from an OpenCL runtime thread once they are on the host
+ **/
+void gpu_set_completion_handler(void (*handler)(query_event_p));
+
+/**
+ * Measures the bytes per microsecond written to the device and read back, the bytes per microsecond a copy
+ * on the device reads and writes, and the microseconds an empty kernel takes when enqueued back to back 
+ * as the kernels of an operator are. Must be called after gpu_init
+ **/
+void gpu_calibrate (float * transfer_bandwidth, float * device_bandwidth, float * launch_overhead);
+
 /* Creates and returns a new query */
 int gpu_get_query (const char *source, int _kernels, int _inputs, int _outputs);
 
+/**
+ * Builds the source of a query into a new program without touching the running queries, so that
+ * it can be done on another thread. gpu_set_program swaps it in for the next batches, after which
+ * the kernels have to be set again. Each config keeps its kernels until its batch in the pipeline
+ * has been collected
+ **/
+cl_program gpu_build_program (const char *source);
+
+void gpu_set_program (int qid, cl_program program);
+
+/* Releases a program that has not been swapped in */
+void gpu_release_program (cl_program program);
+
 /* Creats a new input buffer */
 int gpu_set_input(int qid, int input_id, int size);
 
@@ -94,4 +134,18 @@ void gpu_execute_aggregate(int qid,
 	void ** input_batches, void ** output_batches, size_t addr_size,
 	query_event_p event);
 
+/**
+ * Takes the oldest slot out of the pipeline as the execution of a new batch would. If it holds a
+ * batch, its outputs are read into output_batches and waited for. Called pipeline depth times, it
+ * empties the pipeline at the end of a stream
+ **/
+void gpu_collect (void ** output_batches, size_t addr_size);
+
+/* Join, args2 as in gpu_set_kernel_join */
+void gpu_execute_join(int qid, 
+	size_t * threads, size_t * threads_per_group, 
+	long * args2, 
+	void ** input_batches, void ** output_batches, size_t addr_size,
+	query_event_p event);
+
 #endif
\ No newline at end of file
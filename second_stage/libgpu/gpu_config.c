@@ -48,10 +48,14 @@ gpu_config_p gpu_config (
 	config->program = program;
 
 	config->kernel.count = _kernels;
+	config->pending_program = NULL;
+	for (int i = 0; i < MAX_KERNELS; i++)
+		config->pending_kernels[i] = NULL;
 	config->kernelInput.count = _inputs;
 	config->kernelOutput.count = _outputs;
 
-	/* Create two command queues */
+	/* Create two command queues: [0] runs the kernels and [1] moves data, so that the transfers of
+	   one batch can overlap with the kernels of another */
 	int error;
 	config->command_queue[0] = clCreateCommandQueue (
 		config->context, 
@@ -62,15 +66,20 @@ gpu_config_p gpu_config (
 		error_print("opencl error (%d): %s (%s)\n", error, getErrorMessage(error), __FUNCTION__);
 		exit (1);
 	}
-	// config->command_queue[1] = clCreateCommandQueue (
-	// 	config->context, 
-	// 	config->device, 
-	// 	CL_QUEUE_PROFILING_ENABLE, 
-	// 	&error);
-	// if (! config->command_queue[1]) {
-	// 	error_print("opencl error (%d): %s (%s)\n", error, getErrorMessage(error), __FUNCTION__);
-	// 	exit (1);
-	// }
+	config->command_queue[1] = clCreateCommandQueue (
+		config->context, 
+		config->device, 
+		CL_QUEUE_PROFILING_ENABLE, 
+		&error);
+	if (! config->command_queue[1]) {
+		error_print("opencl error (%d): %s (%s)\n", error, getErrorMessage(error), __FUNCTION__);
+		exit (1);
+	}
+	config->writing = NULL;
+	config->written = NULL;
+	config->ready = NULL;
+	config->executed = NULL;
+	config->event = NULL;
 
 	config->scheduled  = 0; /* No read or write events scheduled */
 	config->readCount  = 0;
@@ -91,6 +100,12 @@ void gpu_config_setOutput (gpu_config_p q, int ndx, int size,
 			getOutputBuffer (q->context, q->command_queue[0], size, writeOnly, doNotMove, bearsMark, readEvent, ignoreMark);
 }
 
+static void gpu_config_freeKernel (kernel_p kernel) {
+	clReleaseKernel (kernel->kernel[0]);
+	clReleaseKernel (kernel->kernel[1]);
+	free (kernel);
+}
+
 void gpu_config_free (gpu_config_p config) {
 
 	int i;
@@ -106,12 +121,23 @@ void gpu_config_free (gpu_config_p config) {
 			clReleaseKernel (config->kernel.kernels[i]->kernel[0]);
 			clReleaseKernel (config->kernel.kernels[i]->kernel[1]);
 			free (config->kernel.kernels[i]);
+			if (config->pending_kernels[i])
+				gpu_config_freeKernel (config->pending_kernels[i]);
 		}
+		/* Release the events linking the queues */
+		if (config->writing)
+			clReleaseEvent(config->writing);
+		if (config->written)
+			clReleaseEvent(config->written);
+		if (config->ready)
+			clReleaseEvent(config->ready);
+		if (config->executed)
+			clReleaseEvent(config->executed);
 		/* Release command queues */
 		if (config->command_queue[0])
 			clReleaseCommandQueue(config->command_queue[0]);
-		// if (config->command_queue[1])
-		// 	clReleaseCommandQueue(config->command_queue[1]);
+		if (config->command_queue[1])
+			clReleaseCommandQueue(config->command_queue[1]);
 		/* Free object */
 		free(config);
 	}
@@ -126,14 +152,17 @@ void gpu_config_setKernel (gpu_config_p query,
 
 	int i;
 	int error = 0;
-	query->kernel.kernels[ndx] = (kernel_p) malloc (sizeof(kernel_t));
+	/* The kernels of a program that has not been swapped in wait along with it */
+	cl_program program = query->pending_program ? query->pending_program : query->program;
+	kernel_p * kernel = query->pending_program ? &(query->pending_kernels[ndx]) : &(query->kernel.kernels[ndx]);
+	*kernel = (kernel_p) malloc (sizeof(kernel_t));
 	for (i = 0; i < 2; i++) {
-		query->kernel.kernels[ndx]->kernel[i] = clCreateKernel (query->program, name, &error);
-		if (! query->kernel.kernels[ndx]->kernel[i]) {
+		(*kernel)->kernel[i] = clCreateKernel (program, name, &error);
+		if (! (*kernel)->kernel[i]) {
 			fprintf(stderr, "opencl error (%d): %s (%s)\n", error, getErrorMessage(error), __FUNCTION__);
 			exit (1);
 		} else {
-			(*callback) (query->kernel.kernels[ndx]->kernel[i], query, args1, args2);
+			(*callback) ((*kernel)->kernel[i], query, args1, args2);
 		}
 	}
 	return;
@@ -146,17 +175,65 @@ void gpu_config_resetKernel (gpu_config_p query,
 	int *args1, long *args2) {
 
 	int i;
+	/* The next batch runs the kernels of a program that has not been swapped in */
+	kernel_p kernel = query->pending_kernels[ndx] ? query->pending_kernels[ndx] : query->kernel.kernels[ndx];
 	for (i = 0; i < 2; i++) {
-		if (! query->kernel.kernels[ndx]->kernel[i]) {
+		if (! kernel->kernel[i]) {
 			fprintf(stderr, "error: kernel %d has not been created (%s)\n", ndx, __FUNCTION__);
 			exit (1);
 		} else {
-			(*callback) (query->kernel.kernels[ndx]->kernel[i], query, args1, args2);
+			(*callback) (kernel->kernel[i], query, args1, args2);
+		}
+	}
+	return;
+}
+
+void gpu_config_setProgram (gpu_config_p query, cl_program program) {
+
+	int i;
+	/* Replaces a program that has not been swapped in yet */
+	for (i = 0; i < query->kernel.count; i++) {
+		if (query->pending_kernels[i]) {
+			gpu_config_freeKernel (query->pending_kernels[i]);
+			query->pending_kernels[i] = NULL;
 		}
 	}
+	query->pending_program = program;
+	return;
+}
+
+void gpu_config_swapProgram (gpu_config_p query) {
+
+	if (! query->pending_program)
+		return;
+
+	/* The pipeline has normally finished the batch already */
+	gpu_config_finish (query);
+
+	int i;
+	for (i = 0; i < query->kernel.count; i++) {
+		if (query->kernel.kernels[i])
+			gpu_config_freeKernel (query->kernel.kernels[i]);
+		query->kernel.kernels[i] = query->pending_kernels[i];
+		query->pending_kernels[i] = NULL;
+	}
+	query->program = query->pending_program;
+	query->pending_program = NULL;
 	return;
 }
 
+/* Replaces *event with a marker of everything enqueued so far on queue, and of wait if set */
+static void gpu_config_mark (cl_command_queue queue, cl_event wait, cl_event * event) {
+	int error = 0;
+	if (*event)
+		error |= clReleaseEvent (*event);
+	error |= clEnqueueMarkerWithWaitList (queue, wait ? 1 : 0, wait ? &wait : NULL, event);
+	if (error != CL_SUCCESS) {
+		fprintf(stderr, "opencl error (%d): %s (%s)\n", error, getErrorMessage(error), __FUNCTION__);
+		exit (1);
+	}
+}
+
 void gpu_config_configureKernel (gpu_config_p q,
 	void (*callback)(cl_kernel, gpu_config_p, int *, long *),
 	int *args1, long *args2) {
@@ -170,9 +247,13 @@ void gpu_config_configureKernel (gpu_config_p q,
 void gpu_config_submitKernel (gpu_config_p config, size_t *threads, size_t *threadsPerGroup) {
 	int i;
 	int error = 0;
-	/* Execute */
+	/* The kernels start here, refer to gpu_config_elapsed */
+	gpu_config_mark (config->command_queue[0], config->written, &(config->ready));
+
+	/* Execute once the input has been written by the transfer queue */
 	for (i = 0; i < config->kernel.count; i++) {
 		dbg("[DBG] submit kernel %d: %10zu threads %10zu threads/group\n", i, threads[i], threadsPerGroup[i]);
+		cl_uint waits = (i == 0 && config->written) ? 1 : 0;
 #ifdef GPU_PROFILE
 		error |= clEnqueueNDRangeKernel (
 			config->command_queue[0],
@@ -181,7 +262,7 @@ void gpu_config_submitKernel (gpu_config_p config, size_t *threads, size_t *thre
 			NULL,
 			&(threads[i]),
 			&(threadsPerGroup[i]),
-			0, NULL, &(config->exec_event[i]));
+			waits, waits ? &(config->written) : NULL, &(config->exec_event[i]));
 #else
 		error |= clEnqueueNDRangeKernel (
 			config->command_queue[0],
@@ -190,20 +271,23 @@ void gpu_config_submitKernel (gpu_config_p config, size_t *threads, size_t *thre
 			NULL,
 			&(threads[i]),
 			&(threadsPerGroup[i]),
-			0, NULL, NULL);
+			waits, waits ? &(config->written) : NULL, NULL);
 #endif
 		if (error != CL_SUCCESS) {
 			fprintf(stderr, "opencl error (%d): %s (%s)\n", error, getErrorMessage(error), __FUNCTION__);
 			exit (1);
 		}
 	}
+
+	/* The outputs are read by the transfer queue after this */
+	gpu_config_mark (config->command_queue[0], NULL, &(config->executed));
 	return;
 }
 
 void gpu_config_flush (gpu_config_p config) {
 	int error = 0;
 	error |= clFlush (config->command_queue[0]);
-	// error |= clFlush (config->command_queue[1]);
+	error |= clFlush (config->command_queue[1]);
 	if (error != CL_SUCCESS) {
 		fprintf(stderr, "opencl error (%d): %s (%s)\n", error, getErrorMessage(error), __FUNCTION__);
 		exit (1);
@@ -216,21 +300,40 @@ void gpu_config_finish (gpu_config_p config) {
 	/* There are tasks scheduled */
 	int error = 0;
 	error |= clFinish (config->command_queue[0]);
-	// error |= clFinish (config->command_queue[1]);
+	error |= clFinish (config->command_queue[1]);
 	if (error != CL_SUCCESS) {
 		fprintf(stderr, "opencl error (%d): %s (%s), config=%d @%p\n", error, getErrorMessage(error), __FUNCTION__, config->query_id, config);
 		exit (1);
 	}
 }
 
+long gpu_config_elapsed (gpu_config_p config) {
+	if (! config->writing || ! config->written || ! config->ready || ! config->executed)
+		return -1;
+
+	cl_ulong writing = 0, written = 0, ready = 0, executed = 0; /* ns */
+	int error = 0;
+	error |= clGetEventProfilingInfo (config->writing,  CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &writing,  NULL);
+	error |= clGetEventProfilingInfo (config->written,  CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &written,  NULL);
+	error |= clGetEventProfilingInfo (config->ready,    CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &ready,    NULL);
+	error |= clGetEventProfilingInfo (config->executed, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &executed, NULL);
+	if (error != CL_SUCCESS || written < writing || executed < ready || executed == 0)
+		return -1;
+
+	return (long) ((written - writing) + (executed - ready)) / 1000;
+}
+
 void gpu_config_moveInputBuffers (gpu_config_p config, void ** host_addr, size_t addr_size) {
 	int i;
 	int error = 0;
+	/* The writes start here, refer to gpu_config_elapsed */
+	gpu_config_mark (config->command_queue[1], NULL, &(config->writing));
+
 	/* Write */
 	for (i = 0; i < config->kernelInput.count; i++) {
 		if (i == config->kernelInput.count - 1) { // last input buffer
 			error |= clEnqueueWriteBuffer (
-				config->command_queue[0],
+				config->command_queue[1],
 				config->kernelInput.inputs[i]->device_buffer,
 				CL_FALSE,
 				0,
@@ -243,7 +346,7 @@ void gpu_config_moveInputBuffers (gpu_config_p config, void ** host_addr, size_t
 #endif
 		} else {
 			error |= clEnqueueWriteBuffer (
-				config->command_queue[0],
+				config->command_queue[1],
 				config->kernelInput.inputs[i]->device_buffer,
 				CL_FALSE,
 				0,
@@ -258,6 +361,9 @@ void gpu_config_moveInputBuffers (gpu_config_p config, void ** host_addr, size_t
 		}
 	}
 
+	/* The kernels wait for this on the compute queue */
+	gpu_config_mark (config->command_queue[1], NULL, &(config->written));
+
 	config->writeCount += 1;
 	config->scheduled = 1;
 
@@ -268,6 +374,8 @@ void gpu_config_moveOutputBuffers (gpu_config_p config, void ** host_addr, size_
 	int i;
 	int error = 0;
 	int moved = 0;
+	/* Read once the kernels on the compute queue are done */
+	cl_uint waits = config->executed ? 1 : 0;
 	/* Read */
 	for (i = 0; i < config->kernelOutput.count; i++) {
 
@@ -276,26 +384,26 @@ void gpu_config_moveOutputBuffers (gpu_config_p config, void ** host_addr, size_
 
 		if (config->kernelOutput.outputs[i]->readEvent) {
 			error |= clEnqueueReadBuffer (
-				config->command_queue[0],
+				config->command_queue[1],
 				config->kernelOutput.outputs[i]->device_buffer,
 				CL_FALSE,
 				0,
 				config->kernelOutput.outputs[i]->size,
 				*(host_addr + moved * addr_size),
 #ifdef GPU_PROFILE
-				0, NULL, &(config->read_event));
+				waits, waits ? &(config->executed) : NULL, &(config->read_event));
 #else
-				0, NULL, NULL);
+				waits, waits ? &(config->executed) : NULL, NULL);
 #endif
 		} else {
 			error |= clEnqueueReadBuffer (
-				config->command_queue[0],
+				config->command_queue[1],
 				config->kernelOutput.outputs[i]->device_buffer,
 				CL_FALSE,
 				0,
 				config->kernelOutput.outputs[i]->size,
 				*(host_addr + moved * addr_size),
-				0, NULL, NULL);
+				waits, waits ? &(config->executed) : NULL, NULL);
 		}
 
 		moved += 1;
@@ -358,6 +466,47 @@ void gpu_config_notifyEnd (gpu_config_p q,
 	return;
 }
 
+typedef struct gpu_completion {
+	void (*callback)(query_event_p);
+	query_event_p event;
+} gpu_completion_t;
+
+static void CL_CALLBACK gpu_config_completed (cl_event marker, cl_int status, void * user_data) {
+	gpu_completion_t * completion = (gpu_completion_t *) user_data;
+
+	if (status != CL_COMPLETE) {
+		fprintf(stderr, "opencl error (%d): %s (%s)\n", status, getErrorMessage(status), __FUNCTION__);
+		exit (1);
+	}
+
+	(*completion->callback) (completion->event);
+
+	clReleaseEvent (marker);
+	free (completion);
+}
+
+void gpu_config_notifyComplete (gpu_config_p config,
+	void (*callback)(query_event_p), query_event_p event) {
+
+	gpu_completion_t * completion = (gpu_completion_t *) malloc (sizeof(gpu_completion_t));
+	if (! completion) {
+		fprintf(stderr, "fatal error: out of memory\n");
+		exit(1);
+	}
+	completion->callback = callback;
+	completion->event = event;
+
+	/* The transfer queue is in-order and the reads come last, so the marker completes after them */
+	cl_event marker;
+	int error = 0;
+	error |= clEnqueueMarkerWithWaitList (config->command_queue[1], 0, NULL, &marker);
+	error |= clSetEventCallback (marker, CL_COMPLETE, gpu_config_completed, completion);
+	if (error != CL_SUCCESS) {
+		fprintf(stderr, "opencl error (%d): %s (%s)\n", error, getErrorMessage(error), __FUNCTION__);
+		exit (1);
+	}
+}
+
 
 #ifdef GPU_PROFILE
 static unsigned first = 1;
@@ -41,9 +41,17 @@ typedef struct gpu_config {
 	cl_context context;
 	cl_program program;
 	gpu_kernel_t kernel;
+	/* A program and its kernels waiting for the batch of the config to finish, refer to gpu_config_setProgram */
+	cl_program pending_program;
+	kernel_p pending_kernels [MAX_KERNELS];
 	gpu_kernel_input_t kernelInput;
 	gpu_kernel_output_t kernelOutput;
-	cl_command_queue command_queue [2];
+	cl_command_queue command_queue [2]; /* [0] compute, [1] transfer */
+	cl_event writing;  /* Transfer queue free for the input, refer to gpu_config_elapsed */
+	cl_event written;  /* Input written, waited for by the kernels */
+	cl_event ready;    /* Compute queue free and input written, refer to gpu_config_elapsed */
+	cl_event executed; /* Kernels done, waited for by the output reads */
+	query_event_p event; /* Of the batch in the pipeline, NULL if there is none */
 	int scheduled;
 	cl_event  read_event;
 	cl_event write_event;
@@ -74,6 +82,15 @@ void gpu_config_resetKernel (gpu_config_p,
 		void (*callback)(cl_kernel, gpu_config_p, int *, long *),
 		int *, long *);
 
+/**
+ * Switches to program once the config is next used, refer to gpu_config_swapProgram, so that a batch
+ * still in the pipeline keeps its kernels. The kernels have to be set again and wait along with it
+ **/
+void gpu_config_setProgram (gpu_config_p, cl_program);
+
+/* Waits for the last batch of the config and swaps in the program and kernels set since, if any */
+void gpu_config_swapProgram (gpu_config_p);
+
 /**
  * host_addr - an array of addresses to input batches
  **/ 
@@ -100,6 +117,13 @@ void gpu_config_flush (gpu_config_p);
 
 void gpu_config_finish (gpu_config_p);
 
+/**
+ * Microseconds the device spent writing the input of the last batch and running its kernels, from
+ * the profiled markers around them, or -1 if the device does not profile them. The waits for the
+ * other batches in the pipeline are left out. Valid once the batch has finished
+ **/
+long gpu_config_elapsed (gpu_config_p);
+
 /* Profiling related functions */
 
 void gpu_config_waitForReadEvent (gpu_config_p);
@@ -114,4 +138,11 @@ void gpu_config_readOutput (gpu_config_p q,
 void gpu_config_notifyEnd (gpu_config_p q,
 	void (*callback)(query_event_p), query_event_p event);
 
+/**
+ * Calls back from an OpenCL runtime thread once all the commands enqueued so far
+ * have completed, so that the caller does not block in gpu_config_finish
+ **/
+void gpu_config_notifyComplete (gpu_config_p config,
+	void (*callback)(query_event_p), query_event_p event);
+
 #endif /* __GPU_CONFIG_H_ */
\ No newline at end of file
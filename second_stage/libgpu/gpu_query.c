@@ -30,10 +30,16 @@ static int gpu_query_exec_2 (
 	void ** input_batches, void ** output_batches, size_t addr_size,
 	query_event_p event);
 
-gpu_query_p gpu_query_new (int qid, cl_device_id device, cl_context context, const char *source,
-	int _kernels, int _inputs, int _outputs) {
-	
-	int i;
+/* with completion notified by a callback */
+static int gpu_query_exec_3 (
+	gpu_query_p query, 
+	size_t *threads, size_t *threadsPerGroup, 
+	query_operator_p operator, 
+	void ** input_batches, void ** output_batches, size_t addr_size,
+	query_event_p event);
+
+cl_program gpu_query_buildProgram (cl_device_id device, cl_context context, const char *source) {
+
 	int error = 0;
 	char msg [32768]; /* Compiler message */
 	size_t length;
@@ -50,32 +56,21 @@ gpu_query_p gpu_query_new (int qid, cl_device_id device, cl_context context, con
 	const char *flags = "-cl-fast-relaxed-math -Werror -cl-nv-verbose";
 #endif
 
-	gpu_query_p query = (gpu_query_p) malloc (sizeof(gpu_query_t));
-	if (! query) {
-		fprintf(stderr, "fatal error: out of memory\n");
-		exit(1);
-	}
-
-	query->qid = qid;
-
-	query->device = device;
-	query->context = context;
-
 	/* Create program */
-	query->program = clCreateProgramWithSource (
-		query->context, 
+	cl_program program = clCreateProgramWithSource (
+		context, 
 		1, 
 		(const char **) &source, 
 		NULL, 
 		&error);
-	if (! query->program) {
+	if (! program) {
 		fprintf(stderr, "opencl error (%d): %s\n", error, getErrorMessage(error));
 		exit (1);
 	}
 
 	/* Build program */
 	error = clBuildProgram (
-		query->program, 
+		program, 
 		1, 
 		&device, 
 		flags, 
@@ -84,8 +79,8 @@ gpu_query_p gpu_query_new (int qid, cl_device_id device, cl_context context, con
 
 	/* Get compiler info (or error) */
 	clGetProgramBuildInfo (
-		query->program, 
-		query->device, 
+		program, 
+		device, 
 		CL_PROGRAM_BUILD_LOG, 
 		sizeof(msg), 
 		msg, 
@@ -100,6 +95,27 @@ gpu_query_p gpu_query_new (int qid, cl_device_id device, cl_context context, con
 		exit (1);
 	}
 
+	return program;
+}
+
+gpu_query_p gpu_query_new (int qid, cl_device_id device, cl_context context, const char *source,
+	int _kernels, int _inputs, int _outputs) {
+	
+	int i;
+
+	gpu_query_p query = (gpu_query_p) malloc (sizeof(gpu_query_t));
+	if (! query) {
+		fprintf(stderr, "fatal error: out of memory\n");
+		exit(1);
+	}
+
+	query->qid = qid;
+
+	query->device = device;
+	query->context = context;
+
+	query->program = gpu_query_buildProgram (device, context, source);
+
 	// query->handler = NULL;
 
 	query->cur_config = -1;
@@ -127,6 +143,15 @@ void gpu_query_free (gpu_query_p query) {
 	}
 }
 
+void gpu_query_setProgram (gpu_query_p query, cl_program program) {
+	int i;
+	for (i = 0; i < NCONTEXTS; i++)
+		gpu_config_setProgram (query->configs[i], program);
+	/* The kernels of the configs that have not swapped yet keep the old program alive */
+	clReleaseProgram (query->program);
+	query->program = program;
+}
+
 int gpu_query_setInput (gpu_query_p query, int input_id, int size) {
 	if (! query)
 		return -1;
@@ -208,6 +233,8 @@ gpu_config_p gpu_switch_config(gpu_query_p query) {
 		dbg ("[DBG] switch from %d to context %d\n",
 			current, next);
 #endif
+	/* With fewer slots in the pipeline than configs, the last batch of this one has been collected */
+	gpu_config_swapProgram (query->configs[next]);
 	return query->configs[next];
 }
 
@@ -221,7 +248,14 @@ int gpu_query_exec (
 	if (! query)
 		return -1;
 
-	if (NCONTEXTS == 1) {
+	if (operator->notifyComplete != NULL) {
+		return gpu_query_exec_3 (
+			query, 
+			threads, threadsPerGroup, 
+			operator, 
+			input_batches, output_batches, addr_size,
+			event);
+	} else if (NCONTEXTS == 1) {
 		return gpu_query_exec_1 (
 			query, 
 			threads, threadsPerGroup, 
@@ -336,10 +370,18 @@ static int gpu_query_exec_2 (
 	
 	gpu_config_flush (config);
 	
+	/* The batch to be timed once it pops out of the pipeline */
+	config->event = event;
+
 	/* Wait until read output from the swapped out query config has finished */
 	if (out_config) {
 		gpu_config_finish(out_config);
 
+		if (out_config->event) {
+			out_config->event->device = gpu_config_elapsed(out_config);
+			out_config->event = NULL;
+		}
+
 #ifdef GPU_PROFILE
 		gpu_config_profileQuery (out_config);
 #endif
@@ -348,3 +390,34 @@ static int gpu_query_exec_2 (
 	return 0;
 }
 
+
+static int gpu_query_exec_3 (
+	gpu_query_p query, 
+	size_t *threads, size_t *threadsPerGroup, 
+	query_operator_p operator, 
+	void ** input_batches, void ** output_batches, size_t addr_size,
+	query_event_p event) {
+
+	/**
+	 * The transfers of a config run in order on its transfer queue, so a config
+	 * can be reused while its previous batch is still in flight: the new write
+	 * waits for the previous read to complete on the device, not on this thread.
+	 */
+	gpu_config_p config = gpu_switch_config (query);
+
+	gpu_config_moveInputBuffers (config, input_batches, addr_size);
+
+	if (operator->configure != NULL) {
+		gpu_config_configureKernel (config, operator->configure, operator->args1, operator->args2);
+	}
+	gpu_config_submitKernel (config, threads, threadsPerGroup);
+
+	/* The outputs of this batch go straight to its own task */
+	gpu_config_moveOutputBuffers (config, output_batches, addr_size);
+
+	gpu_config_notifyComplete (config, operator->notifyComplete, event);
+
+	gpu_config_flush (config);
+
+	return 0;
+}
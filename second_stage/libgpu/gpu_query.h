@@ -29,6 +29,12 @@ typedef struct gpu_query {
 /* Constractor */
 gpu_query_p gpu_query_new (int, cl_device_id, cl_context, const char *, int, int, int);
 
+/* Creates and builds a program; only reads the device and context, so it can run on another thread */
+cl_program gpu_query_buildProgram (cl_device_id, cl_context, const char *);
+
+/* Replaces the program of the query, whose kernels then have to be set again */
+void gpu_query_setProgram (gpu_query_p, cl_program);
+
 // void gpu_query_setResultHandler (gpu_query_p, resultHandlerP);
 
 void gpu_query_free (gpu_query_p query);
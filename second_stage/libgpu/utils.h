@@ -1,7 +1,7 @@
 #ifndef __GPU_UTILS_H_
 #define __GPU_UTILS_H_
 
-#define MAX_QUERIES    3
+#define MAX_QUERIES    16
 
 #define MAX_KERNELS   12
 #define MAX_INPUTS     6
@@ -11,6 +11,15 @@
 
 #define NCONTEXTS      3 /* one query runs on one device */
 
+/* A config has left the pipeline by the time it is used again, refer to gpu_switch_config */
+#if MAX_DEPTH >= NCONTEXTS
+#error "the pipeline must be shallower than the configs of a query"
+#endif
+
+/* Bytes moved to time the bandwidths and kernels averaged to time a launch, refer to gpu_calibrate */
+#define CALIBRATION_BYTES    (16 * 1024 * 1024)
+#define CALIBRATION_LAUNCHES 64
+
 // #undef GPU_HANDLER
 #define GPU_HANDLER
 
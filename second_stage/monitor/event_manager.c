@@ -6,6 +6,8 @@
 #include <stdio.h>
 #include <sched.h>
 
+#include "wait/wait.h"
+
 static pthread_t thr = NULL;
 
 static query_event_p take_one_event(event_manager_p p);
@@ -29,8 +31,9 @@ void event_set_end(query_event_p event, long time) {
 }
 
 long event_get_mtime() {
-    static struct timespec now;
-    static long mtime;
+    /* Called from the scheduler and the host worker concurrently, so no static state here */
+    struct timespec now;
+    long mtime;
 
     clock_gettime(CLOCK_MONOTONIC_RAW, &now);
     mtime = now.tv_sec * 1000000 + now.tv_nsec / 1000;
@@ -65,6 +68,8 @@ static void * event_manager(void * args) {
 	p->start = 1;
 
     while (1) {
+        WAIT_POLL(WAIT_EVENT_MANAGER, p->event_tail - p->event_head != 0);
+
         pthread_mutex_lock (p->mutex);
             while (p->event_tail - p->event_head == 0) {
                 pthread_cond_wait(p->added, p->mutex);
@@ -114,8 +119,7 @@ event_manager_p event_manager_init(int operator_num) {
 		exit (1);
 	}
 	/* Wait until thread attaches itself to the JVM */
-	while (! p->start)
-		;
+	wait_until_set(&p->start);
 	return p;
 }
 
@@ -133,7 +137,7 @@ void event_manager_add_event (event_manager_p p, query_event_p e) {
 }
 
 void event_manager_get_data (event_manager_p p, 
-    int * num, int * event_num, long * processed_data, long * latency_sum) {
+    int * num, int * event_num, long * processed_data, long * latency_sum, long * execution_sum) {
     pthread_mutex_lock (p->mutex);
         *num = p->operator_num;
 
@@ -141,6 +145,7 @@ void event_manager_get_data (event_manager_p p,
             event_num[i] = p->event_num[i];
             processed_data[i] = p->processed_data[i];
             latency_sum[i] = p->latency_sum[i];
+            execution_sum[i] = p->execution_sum[i];
         }
 
         reset_data(p);
@@ -151,6 +156,7 @@ static void process_one_event (event_manager_p p, query_event_p e) {
     p->event_num[e->operator_id] += 1;
     p->processed_data[e->operator_id] += e->tuples * e->tuple_size;
     p->latency_sum[e->operator_id] += e->end - e->insert;
+    p->execution_sum[e->operator_id] += e->end - e->start;
 
     free(e);
 }
@@ -159,6 +165,7 @@ static void reset_data(event_manager_p p) {
     for (int i=0; i<p->operator_num; i++) {
         p->event_num[i] = 0;
         p->latency_sum[i] = 0;
+        p->execution_sum[i] = 0;
         p->processed_data[i] = 0;
     }
 }
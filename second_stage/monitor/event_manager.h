@@ -4,7 +4,7 @@
 #include <pthread.h>
 
 #define EVENT_MANAGER_QUEUE_LIMIT 1000
-#define EVENT_MANAGER_OPERATOR_LIMIT 2
+#define EVENT_MANAGER_OPERATOR_LIMIT 8
 
 typedef struct query_event * query_event_p;
 typedef struct query_event {
@@ -17,6 +17,12 @@ typedef struct query_event {
     long end;
     int tuples;
     int tuple_size;
+
+    /* Device time of a pipelined GPU batch (us), -1 unless the device has reported it */
+    long device;
+
+    /* The task being measured, for completions that arrive asynchronously */
+    void * task;
 } query_event_t;
 
 long event_get_mtime();
@@ -46,6 +52,7 @@ typedef struct event_manager {
     volatile int event_num[EVENT_MANAGER_OPERATOR_LIMIT];
     volatile long processed_data[EVENT_MANAGER_OPERATOR_LIMIT];
     volatile long latency_sum[EVENT_MANAGER_OPERATOR_LIMIT];
+    volatile long execution_sum[EVENT_MANAGER_OPERATOR_LIMIT]; /* From the start to the end of a task */
 } event_manager_t;
 
 event_manager_p event_manager_init(int operator_num);
@@ -53,6 +60,6 @@ event_manager_p event_manager_init(int operator_num);
 void event_manager_add_event (event_manager_p p, query_event_p e);
 
 void event_manager_get_data (event_manager_p p, 
-    int * num, int * event_num, long * processed_data, long * latency_sum);
+    int * num, int * event_num, long * processed_data, long * latency_sum, long * execution_sum);
 
 #endif
\ No newline at end of file
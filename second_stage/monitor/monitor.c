@@ -7,6 +7,8 @@
 #include <unistd.h>
 #include <sched.h>
 
+#include "wait/wait.h"
+
 static pthread_t thr = NULL;
 
 static void print_data(monitor_p p);
@@ -51,23 +53,25 @@ monitor_p monitor_init(event_manager_p manager, scheduler_p scheduler, int pipel
 
 	p->scheduler = scheduler;
 
+	p->start = 0;
+
 	/* Initialise thread */
 	if (pthread_create(&thr, NULL, monitor, (void *) p)) {
 		fprintf(stderr, "error: failed to create throughput monitor thread\n");
 		exit (1);
 	}
 	/* Wait until thread attaches itself to the JVM */
-	while (! p->start)
-		;
+	wait_until_set(&p->start);
 	return p;    
 }
 
 static void print_data(monitor_p p) {
-    int event_num[2], operators;
-    long processed_data[2], latency_sum[2];
+    int event_num[EVENT_MANAGER_OPERATOR_LIMIT], operators;
+    long processed_data[EVENT_MANAGER_OPERATOR_LIMIT], latency_sum[EVENT_MANAGER_OPERATOR_LIMIT];
+    long execution_sum[EVENT_MANAGER_OPERATOR_LIMIT];
 	float avg_throughput = 0;
     
-    event_manager_get_data(p->manager, &operators, event_num, processed_data, latency_sum);
+    event_manager_get_data(p->manager, &operators, event_num, processed_data, latency_sum, execution_sum);
 
 	printf("[MONITOR] ");
 	for (int i=0; i<operators; i++) {
@@ -76,6 +80,12 @@ static void print_data(monitor_p p) {
 		avg_throughput += throughput;
 
 		printf("(%d) t: %9.3f MB/s  l: %9.3f us   ", i, throughput, latency_avg);
+
+		/* A costed plan shows the time a batch takes next to its estimate */
+		float estimate = p->dispatchers[i]->query->stage_estimates[i];
+		if (estimate >= 0) {
+			printf("x: %9.3f us  e: %9.3f us   ", execution_sum[i] / (float) event_num[i], estimate);
+		}
 	}
 	// printf("(avg) t: %9.3f MB/s", avg_throughput / operators);
 
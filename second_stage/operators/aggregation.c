@@ -2,6 +2,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <math.h>
 
 #include "config.h"
 #include "generators.h"
@@ -26,7 +27,18 @@ aggregation_p aggregation(
         p->operator->process = (void *) aggregation_process;
         p->operator->process_output = (void *) aggregation_process_output;
         p->operator->get_output_buffer = (void *) aggregation_get_output_buffer;
+        p->operator->get_output_size = NULL;
+        p->operator->set_input_schema = (void *) aggregation_set_input_schema;
         p->operator->get_output_schema_size = (void *) aggregation_get_output_schema_size;
+        p->operator->cpu_setup = (void *) aggregation_cpu_setup;
+        p->operator->cpu_process = (void *) aggregation_cpu_process;
+        p->operator->get_partial_size = (void *) aggregation_get_partial_size;
+        p->operator->get_fragment = (void *) aggregation_get_fragment;
+        p->operator->init_partial = (void *) aggregation_init_partial;
+        p->operator->merge_partial = (void *) aggregation_merge_partial;
+        p->operator->write_window = (void *) aggregation_write_window;
+        p->operator->recover_output = (void *) aggregation_recover_output;
+        p->operator->clone = (void *) aggregation_clone;
 
         p->operator->type = OPERATOR_AGGREGATE;
 
@@ -35,6 +47,36 @@ aggregation_p aggregation(
 
     p->id = free_id++;
 
+    p->window_pointers = NULL;
+    p->cpu_panes = NULL;
+    p->cpu_pane_sizes = NULL;
+    p->cpu_pane_capacity = 0;
+
+    p->cpu_library = NULL;
+    p->cpu_select_range = NULL;
+    p->cpu_flags = NULL;
+
+    p->strategy = AGGREGATION_HASH;
+    p->partition_bits = 0;
+    p->has_key_bounds = false;
+    p->key_min = p->key_max = 0;
+    p->estimated_groups = -1;
+    p->batch_count = 0;
+    p->patch = NULL;
+    p->window = NULL;
+    p->rebuilding = 0;
+    pthread_mutex_init(&p->adapt_lock, NULL);
+    p->pending_program = NULL;
+
+    p->table_size = HASH_TABLE_SIZE;
+    p->recovered_output = NULL;
+    p->recovered_num = 0;
+    p->recovered_capacity = 0;
+    p->recovered_windows = NULL;
+    p->recovered_tables = NULL;
+    p->recover_pointers = NULL;
+    p->recover_flags = NULL;
+
     p->input_schema = input_schema;
 
     p->ref_num = ref_num;
@@ -48,6 +90,16 @@ aggregation_p aggregation(
         p->expressions[i] = expressions[i];
     }
 
+    p->group_num = group_num;
+    if (group_num > AGGREGATION_MAX_GROUP) {
+        fprintf(stderr, "error: the number of group-by attributes has exceeded the limit (%d)\n", 
+            AGGREGATION_MAX_GROUP);
+        exit(1);
+    }
+    for (int i=0; i<group_num; i++) {
+        p->groups[i] = groups[i];
+    }
+
     /* Generate output schema */
     int key_length = 0;
     p->output_schema = schema();
@@ -73,208 +125,329 @@ aggregation_p aggregation(
     return p;    
 }
 
-static char * generate_initf(aggregation_p aggregate) {
-    char * ret = (char *) malloc(512 * sizeof(char)); *ret = '\0';
+static char const * attr_type_name(enum attr_types attr) {
+    switch (attr) {
+    case TYPE_INT:   return "int";
+    case TYPE_FLOAT: return "float";
+    case TYPE_LONG:  return "long";
+    default:
+        fprintf(stderr, "error: unsupported attribute type (%s)\n", __FUNCTION__);
+        exit(1);
+    }
+}
+
+/* The name of an input attribute in input_tuple_t, the first is always the timestamp */
+#define ATTR_NAME_LENGTH 16
+
+static void attr_name(char * name, int column) {
+    if (column == 0) {
+        strcpy(name, "t");
+    } else {
+        snprintf(name, ATTR_NAME_LENGTH, "_%d", column);
+    }
+}
+
+/* The bytes of intermediate_t */
+static int table_entry_size(aggregation_p aggregate) {
+    int size = 16 + aggregate->key_length + aggregate->ref_num * sizeof(float) + sizeof(int);
+    int vectors = (size + 15) / 16;
+
+    return vectors * 16;
+}
+
+/* The number of groups the table of a work group holds */
+static int local_table_capacity(aggregation_p aggregate) {
+    return AGGREGATION_LOCAL_TABLE_SIZE / table_entry_size(aggregate);
+}
+
+/**
+ * The entries of the hash tables, which must keep the layout the host backend reads them with 
+ * (refer to aggregation_cpu.c): mark, pad, t, the group-by keys, the values and the count, 
+ * padded to 16 bytes
+ **/
+static char * generate_intermediate_tuple(aggregation_p aggregate) {
+    char * ret = (char *) malloc(2048 * sizeof(char)); *ret = '\0';
     char s [MAX_LINE_LENGTH] = "";
 
-    /* TODO support aggregation types and multiple of them */
-    int aggregation_num = aggregate->ref_num;
+    int size = 16 + aggregate->key_length + aggregate->ref_num * sizeof(float) + sizeof(int);
+    int vectors = (size + 15) / 16;
 
-    /* initf */
-    _sprint("inline void initf (output_t *p) {\n");
-    
-    /* Set timestamp */
-    _sprint("    p->tuple.t = 0;\n");
+    _sprint("typedef struct {\n");
+    _sprint("    int mark;\n");
+    _sprint("    int pad0;\n");
+    _sprint("    long t;\n");
+    for (int i = 0; i < aggregate->group_num; ++i) {
+        _sprintf("    %s key_%d;\n", attr_type_name(aggregate->input_schema->attr[aggregate->groups[i]]), (i + 1));
+    }
+    for (int i = 0; i < aggregate->ref_num; ++i) {
+        _sprintf("    float value_%d;\n", (i + 1));
+    }
+    _sprint("    int count;\n");
+    if (vectors * 16 > size) {
+        _sprintf("    uchar pad1[%d];\n", vectors * 16 - size);
+    }
+    _sprint("} intermediate_tuple_t __attribute__((aligned(1)));\n\n");
+
+    _sprint("typedef union {\n");
+    _sprint("    intermediate_tuple_t tuple;\n");
+    _sprintf("    uchar16 vectors[%d];\n", vectors);
+    _sprint("} intermediate_t;\n\n");
+
+    /* Keys are packed into local memory to be hashed */
+    _sprint("typedef struct {\n");
+    for (int i = 0; i < aggregate->group_num; ++i) {
+        _sprintf("    %s key_%d;\n", attr_type_name(aggregate->input_schema->attr[aggregate->groups[i]]), (i + 1));
+    }
+    _sprint("} key_t __attribute__((aligned(1)));\n\n");
+
+    /* The work group table and the partitions, refer to aggregate_window */
+    _sprintf("#define LOCAL_TABLE_CAPACITY %d\n\n", local_table_capacity(aggregate));
+    _sprintf("#define PARTITION_BITS %d\n", aggregate->partition_bits);
+    _sprint("#define PARTITIONS (1 << PARTITION_BITS)\n\n");
+    _sprintf("#define SORT_AGGREGATION %d\n\n", (aggregate->strategy == AGGREGATION_SORT) ? 1 : 0);
+    _sprintf("#define DIRECT_KEYS %ld\n\n", 
+        (aggregate->strategy == AGGREGATION_DIRECT) ? aggregate->key_max - aggregate->key_min + 1 : 0);
 
-    int i;
-    for (i = 0; i < aggregation_num; ++i) {
-        
+    return ret;
+}
+
+static char * generate_clearf(aggregation_p aggregate, char const * name, char const * qualifier) {
+    char * ret = (char *) malloc(1024 * sizeof(char)); *ret = '\0';
+    char s [MAX_LINE_LENGTH] = "";
+
+    int size = 16 + aggregate->key_length + aggregate->ref_num * sizeof(float) + sizeof(int);
+    int vectors = (size + 15) / 16;
+
+    /* clearf */
+    _sprintf("inline void %s (%sintermediate_t *p) {\n", name, qualifier);
+    for (int i = 0; i < vectors; ++i) {
+        _sprintf("    p->vectors[%d] = 0;\n", i);
+    }
+    _sprint("    p->tuple.mark = -1;\n");
+    for (int i = 0; i < aggregate->ref_num; ++i) {
         switch (aggregate->expressions[i]) {
-        case CNT:
-        case SUM:
-        case AVG: _sprintf("    p->tuple._%d = %s;\n", (i + 1), "0"); break;
-        case MIN: _sprintf("    p->tuple._%d = %s;\n", (i + 1), "FLT_MAX"); break;
-        case MAX: _sprintf("    p->tuple._%d = %s;\n", (i + 1), "FLT_MIN"); break;
-        default:
-            // throw new IllegalArgumentException("error: invalid aggregation type");
-            break;
+        case MIN: _sprintf("    p->tuple.value_%d = FLT_MAX;\n", (i + 1)); break;
+        case MAX: _sprintf("    p->tuple.value_%d = -FLT_MAX;\n", (i + 1)); break;
+        default: break;
         }
     }
-    /* Set count to zero */
-    _sprintf("    p->tuple._%d = 0;\n", (i + 1));
-    _sprint("}\n");
-    
-    _sprint("\n");
+    _sprint("}\n\n");
 
     return ret;
 }
 
-static char * generate_updatef (aggregation_p aggregate, char const * patch) {
-    char * ret = (char *) malloc(512 * sizeof(char)); *ret = '\0';
+static char * generate_keyf(aggregation_p aggregate) {
+    char * ret = (char *) malloc(2048 * sizeof(char)); *ret = '\0';
     char s [MAX_LINE_LENGTH] = "";
-    int i;
+    char name [ATTR_NAME_LENGTH];
 
-    /* TODO support aggregation types and multiple of them */
-    int aggregation_num = aggregate->ref_num;
+    /* pack_key */
+    _sprint("inline void pack_key (__local key_t *q, __global input_t *p) {\n");
+    for (int i = 0; i < aggregate->group_num; ++i) {
+        attr_name(name, aggregate->groups[i]);
+        _sprintf("    q->key_%d = p->tuple.%s;\n", (i + 1), name);
+    }
+    _sprint("}\n\n");
 
-    /* aggregatef */
-    _sprint("inline void aggregatef (output_t *out, __global input_t *in) {\n");
-    
-    /* Reserve for select */
-    _sprint("    int flag = 1;\n\n");
+    /* storef: the values are left to updatef, which the inserting thread calls next */
+    _sprint("inline void storef (__global intermediate_t *q, __global input_t *p) {\n");
+    for (int i = 0; i < aggregate->group_num; ++i) {
+        attr_name(name, aggregate->groups[i]);
+        _sprintf("    q->tuple.key_%d = p->tuple.%s;\n", (i + 1), name);
+    }
+    _sprint("}\n\n");
 
-    /* Insert patch */
-    if (patch) {
-        _sprintf("%s", patch);
+    _sprint("inline void local_storef (__local intermediate_t *q, __global input_t *p) {\n");
+    for (int i = 0; i < aggregate->group_num; ++i) {
+        attr_name(name, aggregate->groups[i]);
+        _sprintf("    q->tuple.key_%d = p->tuple.%s;\n", (i + 1), name);
     }
+    _sprint("}\n\n");
+
+    /* comparef */
+    _sprint("inline int comparef (__local key_t *q, __global input_t *p) {\n");
+    _sprint("    int value = 1;\n");
+    for (int i = 0; i < aggregate->group_num; ++i) {
+        attr_name(name, aggregate->groups[i]);
+        _sprintf("    value = value & (q->key_%d == p->tuple.%s);\n", (i + 1), name);
+    }
+    _sprint("    return value;\n");
+    _sprint("}\n\n");
 
-    /* Set timestamp */
-    _sprint("    out->tuple.t = (!flag || (flag && (out->tuple.t > in->tuple.t))) ? out->tuple.t : in->tuple.t;\n");
+    return ret;
+}
+
+/* Atomic updates of an entry of the global (suffix "") or the work group (suffix "_local") table */
+static char * generate_updatef(aggregation_p aggregate, char const * name, char const * qualifier, char const * suffix) {
+    char * ret = (char *) malloc(2048 * sizeof(char)); *ret = '\0';
+    char s [MAX_LINE_LENGTH] = "";
+    char name_ [ATTR_NAME_LENGTH];
+
+    /* updatef */
+    _sprintf("inline void %s (%sintermediate_t *out, __global input_t *p) {\n", name, qualifier);
+    _sprintf("    atomic_maxl%s (&(out->tuple.t), p->tuple.t);\n", suffix);
+    for (int i = 0; i < aggregate->ref_num; ++i) {
+        attr_name(name_, aggregate->refs[i]);
 
-    /* Aggregation */
-    for (i = 0; i < aggregation_num; ++i) {
-        
-        int column = aggregate->refs[i];
-        
         switch (aggregate->expressions[i]) {
-        case CNT: 
-            _sprintf("    out->tuple._%d += 1 * flag;\n", (i + 1)); 
+        case CNT:
+            _sprintf("    atomic_addf%s (&(out->tuple.value_%d), 1);\n", suffix, (i + 1));
             break;
         case SUM:
-        case AVG: 
-            _sprintf("    out->tuple._%d += in->tuple._%d * flag;\n", (i + 1), column); 
+        case AVG:
+            _sprintf("    atomic_addf%s (&(out->tuple.value_%d), (float) p->tuple.%s);\n", suffix, (i + 1), name_);
             break;
         case MIN:
-            _sprintf("    out->tuple._%d = (flag && (out->tuple._%d > in->tuple._%d)) ? in->tuple._%d : out->tuple._%d;\n",
-                    (i + 1), (i + 1), column, column, (i + 1));
+            _sprintf("    atomic_minf%s (&(out->tuple.value_%d), (float) p->tuple.%s);\n", suffix, (i + 1), name_);
             break;
         case MAX:
-            _sprintf("    out->tuple._%d = (flag && (out->tuple._%d < in->tuple._%d)) ? in->tuple._%d : out->tuple._%d;\n",
-                    (i + 1), (i + 1), column, column, (i + 1));
+            _sprintf("    atomic_maxf%s (&(out->tuple.value_%d), (float) p->tuple.%s);\n", suffix, (i + 1), name_);
             break;
         default:
             fprintf(stderr, "error: invalid aggregation type\n");
             break;
         }
     }
-
-    /* Increase counter */
-    _sprintf("    out->tuple._%d += 1 * flag;\n", (i + 1));
-    _sprint("}\n");
-    
-    _sprint("\n");
+    _sprint("    atomic_inc (&(out->tuple.count));\n");
+    _sprint("}\n\n");
 
     return ret;
 }
 
-static char * generate_cachef(aggregation_p aggregate) {
-    char * ret = (char *) malloc(512 * sizeof(char)); *ret = '\0';
+/* Merges an entry of the work group table, or a run of sorted tuples, into the global table */
+static char * generate_flushf(aggregation_p aggregate) {
+    char * ret = (char *) malloc(2048 * sizeof(char)); *ret = '\0';
     char s [MAX_LINE_LENGTH] = "";
 
-    /* TODO */
-    int numberOfVectors = 1;
-
-    /* cachef */
-    _sprint("inline void cachef (output_t * tuple, __local output_t * cache) {\n");
-    
-    for (int i = 0; i < numberOfVectors; i++) {
-        _sprintf("    cache->vectors[%d] = tuple->vectors[%d];\n", i, i);
+    /* flushf */
+    _sprint("inline void flushf (__global intermediate_t *out, intermediate_t *in) {\n");
+    _sprint("    atomic_maxl (&(out->tuple.t), in->tuple.t);\n");
+    for (int i = 0; i < aggregate->ref_num; ++i) {
+        switch (aggregate->expressions[i]) {
+        case CNT:
+        case SUM:
+        case AVG:
+            _sprintf("    atomic_addf (&(out->tuple.value_%d), in->tuple.value_%d);\n", (i + 1), (i + 1));
+            break;
+        case MIN:
+            _sprintf("    atomic_minf (&(out->tuple.value_%d), in->tuple.value_%d);\n", (i + 1), (i + 1));
+            break;
+        case MAX:
+            _sprintf("    atomic_maxf (&(out->tuple.value_%d), in->tuple.value_%d);\n", (i + 1), (i + 1));
+            break;
+        default:
+            fprintf(stderr, "error: invalid aggregation type\n");
+            break;
+        }
     }
-    
-    _sprint("}\n");
-    
-    _sprint("\n");
+    _sprint("    atomic_add (&(out->tuple.count), in->tuple.count);\n");
+    _sprint("}\n\n");
 
     return ret;
 }
 
-static char * generate_mergef(aggregation_p aggregate) {
-    char * ret = (char *) malloc(512 * sizeof(char)); *ret = '\0';
+/**
+ * The sort key of a tuple, unsigned and ordered as the group-by attribute, and the aggregation of a 
+ * run of tuples with the same key by a single work item
+ **/
+static char * generate_sortf(aggregation_p aggregate) {
+    char * ret = (char *) malloc(2048 * sizeof(char)); *ret = '\0';
     char s [MAX_LINE_LENGTH] = "";
+    char name [ATTR_NAME_LENGTH];
 
-    /* TODO */
-    int aggregation_num = aggregate->ref_num;
+    if (aggregate->group_num != 1) {
+        fprintf(stderr, "error: sorting supports a single group-by attribute (%s)\n", __FUNCTION__);
+        exit(1);
+    }
 
-    /* mergef */
-    _sprint("inline void mergef (__local output_t * mine, __local output_t * other) {\n");
+    enum attr_types attr = aggregate->input_schema->attr[aggregate->groups[0]];
+    attr_name(name, aggregate->groups[0]);
+
+    /* sort_key */
+    _sprintf("#define SORT_KEY_BITS %d\n\n", attr_types_get_size(attr) * 8);
+    _sprint("inline ulong sort_key (__global input_t *p) {\n");
+    switch (attr) {
+    case TYPE_INT:
+        _sprintf("    return (uint) p->tuple.%s ^ 0x80000000u;\n", name);
+        break;
+    case TYPE_LONG:
+        _sprintf("    return (ulong) p->tuple.%s ^ 0x8000000000000000ul;\n", name);
+        break;
+    case TYPE_FLOAT:
+        _sprintf("    uint b = as_uint(p->tuple.%s);\n", name);
+        _sprint("    return (b & 0x80000000u) ? ~b : (b | 0x80000000u);\n");
+        break;
+    }
+    _sprint("}\n\n");
+
+    /* accumulatef */
+    _sprint("inline void accumulatef (intermediate_t *out, __global input_t *p) {\n");
+    _sprint("    out->tuple.t = max(out->tuple.t, p->tuple.t);\n");
+    for (int i = 0; i < aggregate->ref_num; ++i) {
+        attr_name(name, aggregate->refs[i]);
 
-    /* Always pick the largest timestamp as the new timestamp */
-    _sprint("   if (mine->tuple.t < other->tuple.t) {\n");
-    _sprint("        mine->tuple.t = other->tuple.t;\n");
-    _sprint("    }\n");
-    
-    int i;
-    for (i = 0; i < aggregation_num; ++i) {
-        
         switch (aggregate->expressions[i]) {
         case CNT:
+            _sprintf("    out->tuple.value_%d += 1;\n", (i + 1));
+            break;
         case SUM:
         case AVG:
-            _sprintf("    mine->tuple._%d += other->tuple._%d;\n", (i + 1), (i + 1));
+            _sprintf("    out->tuple.value_%d += (float) p->tuple.%s;\n", (i + 1), name);
             break;
         case MIN:
-            _sprintf("    mine->tuple._%d = (mine->tuple._%d > other->tuple._%d) ? other->tuple._%d : mine->tuple._%d;\n", 
-                    (i + 1), (i + 1), (i + 1), (i + 1), (i + 1));
+            _sprintf("    out->tuple.value_%d = fmin(out->tuple.value_%d, (float) p->tuple.%s);\n", (i + 1), (i + 1), name);
             break;
         case MAX:
-            _sprintf("    mine->tuple._%d = (mine->tuple._%d < other->tuple._%d) ? other->tuple._%d : mine->tuple._%d;\n", 
-                    (i + 1), (i + 1), (i + 1), (i + 1), (i + 1));
+            _sprintf("    out->tuple.value_%d = fmax(out->tuple.value_%d, (float) p->tuple.%s);\n", (i + 1), (i + 1), name);
             break;
         default:
-        //     throw new IllegalArgumentException("error: invalid aggregation type");
+            fprintf(stderr, "error: invalid aggregation type\n");
             break;
         }
     }
-    _sprintf("    mine->tuple._%d += other->tuple._%d;\n", (i + 1), (i + 1));
-    _sprint("}\n");
-    
-    _sprint("\n");
+    _sprint("    out->tuple.count += 1;\n");
+    _sprint("}\n\n");
 
     return ret;
 }
 
-static char * generate_copyf(aggregation_p aggregate, int vector) {
-    char * ret = (char *) malloc(512 * sizeof(char)); *ret = '\0';
+/* The slot of the key of a tuple within the declared bounds, -1 out of them */
+static char * generate_key_indexf(aggregation_p aggregate) {
+    char * ret = (char *) malloc(1024 * sizeof(char)); *ret = '\0';
     char s [MAX_LINE_LENGTH] = "";
+    char name [ATTR_NAME_LENGTH];
 
-    /* TODO */
-    int aggregation_num = aggregate->ref_num;
-    int numberOfVectors = (aggregate->output_schema->size + schema_get_pad(aggregate->output_schema, vector)) / vector;
+    attr_name(name, aggregate->groups[0]);
 
-    /* copyf */
-    _sprint("inline void copyf (__local output_t *p, __global output_t *q) {\n");
-    
-    /* Compute average */
-    bool containsAverage = false;
-    for (int i = 0; i < aggregation_num; ++i) {
-        if (aggregate->expressions[i] == AVG) {
-            containsAverage = true;
-        }
-    }
-    
-    if (containsAverage) {
-        
-        int countAttribute = aggregation_num + 1;
-        _sprintf("    int count = p->tuple._%d;\n", countAttribute);
-        
-        for (int i = 0; i < aggregation_num; ++i)
-            if (aggregate->expressions[i] == AVG) {
-                _sprintf("    p->tuple._%d = p->tuple._%d / (float) count;\n", (i + 1), (i + 1));
-            }
+    /* key_index */
+    _sprint("inline int key_index (__global input_t *p) {\n");
+    _sprintf("    long k = (long) p->tuple.%s;\n", name);
+    _sprintf("    return (k < %ldL || k > %ldL) ? -1 : (int) (k - %ldL);\n", 
+        aggregate->key_min, aggregate->key_max, aggregate->key_min);
+    _sprint("}\n\n");
+
+    return ret;
+}
+
+/* The selection of a fused query, or every tuple if there is none */
+static char * generate_filterf(char const * patch) {
+    char * ret = (char *) malloc(((patch ? strlen(patch) : 0) + 128) * sizeof(char)); *ret = '\0';
+    char s [MAX_LINE_LENGTH] = "";
+
+    _sprint("inline int selectf (__global input_t *in) {\n");
+    _sprint("    int flag = 1;\n\n");
+    if (patch) {
+        strcat(ret, patch);
     }
-    
-    for (int i = 0; i < numberOfVectors; i++) {
-        _sprintf("    q->vectors[%d] = p->vectors[%d];\n", i, i);
+    _sprint("    return flag;\n");
+    _sprint("}\n\n");
+    if (patch) {
+        strcat(ret, PATCH_EPILOGUE);
     }
-    
-    _sprint("}\n");
-    
-    _sprint("\n");
 
     return ret;
 }
 
-
 static char * generate_source(aggregation_p aggregate, window_p window, char const * patch) {
     int vector = 16;
 
@@ -284,6 +457,8 @@ static char * generate_source(aggregation_p aggregate, window_p window, char con
 
     char * headers = read_file("cl/templates/headers.cl");
 
+    char * atomics = read_file("cl/templates/atomics.cl");
+
     /* Input and output vector sizes */
     char * tuple_size = generate_tuple_size(aggregate->input_schema, aggregate->output_schema, vector);
 
@@ -292,15 +467,23 @@ static char * generate_source(aggregation_p aggregate, window_p window, char con
 
     char * output_tuple = generate_output_tuple(aggregate->output_schema, NULL, vector);
 
+    /* Hash table entries and keys */
+    char * intermediate_tuple = generate_intermediate_tuple(aggregate);
+
     /* Window sizes */
     char * windows = generate_window_definition(window);
 
     /* Inline functions */
-    char * initf = generate_initf(aggregate);
-    // char * aggregatef = generate_aggregatef(aggregate, patch);
-    char * cachef = generate_cachef(aggregate);
-    char * mergef = generate_mergef(aggregate);
-    char * copyf = generate_copyf(aggregate, vector);
+    char * clearf = generate_clearf(aggregate, "clearf", "__global ");
+    char * local_clearf = generate_clearf(aggregate, "local_clearf", "__local ");
+    char * private_clearf = generate_clearf(aggregate, "private_clearf", "");
+    char * selectf = generate_filterf(patch);
+    char * keyf = generate_keyf(aggregate);
+    char * updatef = generate_updatef(aggregate, "updatef", "__global ", "");
+    char * local_updatef = generate_updatef(aggregate, "local_updatef", "__local ", "_local");
+    char * flushf = generate_flushf(aggregate);
+    char * sortf = (aggregate->strategy == AGGREGATION_SORT) ? generate_sortf(aggregate) : NULL;
+    char * key_indexf = (aggregate->strategy == AGGREGATION_DIRECT) ? generate_key_indexf(aggregate) : NULL;
 
     /* Template funcitons */
     char * template = read_file(AGGREGATION_CODE_TEMPLATE);
@@ -309,19 +492,31 @@ static char * generate_source(aggregation_p aggregate, window_p window, char con
     strcat(source, extensions);
 
     strcat(source, headers);
+
+    strcat(source, atomics);
     
     strcat(source, tuple_size);
     
     strcat(source, input_tuple);
     strcat(source, output_tuple);
+    strcat(source, intermediate_tuple);
     
     strcat(source, windows);
     
-    strcat(source, initf);
-    // strcat(source, aggregatef);
-    strcat(source, cachef);
-    strcat(source, mergef);
-    strcat(source, copyf);
+    strcat(source, clearf);
+    strcat(source, local_clearf);
+    strcat(source, private_clearf);
+    strcat(source, selectf);
+    strcat(source, keyf);
+    strcat(source, updatef);
+    strcat(source, local_updatef);
+    strcat(source, flushf);
+    if (sortf) {
+        strcat(source, sortf);
+    }
+    if (key_indexf) {
+        strcat(source, key_indexf);
+    }
     
     strcat(source, template);
 
@@ -330,24 +525,233 @@ static char * generate_source(aggregation_p aggregate, window_p window, char con
 
     free(headers);
 
+    free(atomics);
+
     free(tuple_size);
 
     free(output_tuple);
     free(input_tuple);
+    free(intermediate_tuple);
 
     free(windows);
 
-    free(initf);
-    // free(aggregatef);
-    free(cachef);
-    free(mergef);
-    free(copyf);
+    free(clearf);
+    free(local_clearf);
+    free(private_clearf);
+    free(selectf);
+    free(keyf);
+    free(updatef);
+    free(local_updatef);
+    free(flushf);
+    free(sortf);
+    free(key_indexf);
     
     free(template);
 
     return source;
 }
 
+char * aggregation_generate_c_source(aggregation_p aggregate, char const * patch) {
+    int vector = 16;
+
+    char * source = (char *) malloc(MAX_SOURCE_LENGTH * sizeof(char)); *source = '\0';
+
+    char * headers = generate_c_headers();
+    char * tuple_size = generate_tuple_size(aggregate->input_schema, aggregate->output_schema, vector);
+    char * input_tuple = generate_input_tuple(aggregate->input_schema, NULL, vector);
+    char * filterf = generate_filterf(patch);
+    char * select_range = generate_c_select_range();
+
+    strcat(source, headers);
+    strcat(source, tuple_size);
+    strcat(source, input_tuple);
+    strcat(source, filterf);
+    strcat(source, select_range);
+
+    free(headers);
+    free(tuple_size);
+    free(input_tuple);
+    free(filterf);
+    free(select_range);
+
+    return source;
+}
+
+/* Linear counting: of m bits that the keys hash to, a fraction V stays clear for about -m ln(V) keys */
+long aggregation_estimate_groups(aggregation_p aggregate, u_int8_t const * input, int tuples) {
+    int tuple_size = aggregate->input_schema->size;
+
+    int offsets [AGGREGATION_MAX_GROUP] = {0}, sizes [AGGREGATION_MAX_GROUP] = {0};
+    for (int i=0; i<aggregate->group_num; i++) {
+        offsets[i] = schema_get_attr_offset(aggregate->input_schema, aggregate->groups[i]);
+        sizes[i] = attr_types_get_size(aggregate->input_schema->attr[aggregate->groups[i]]);
+    }
+
+    u_int64_t * bitmap = (u_int64_t *) calloc(AGGREGATION_SKETCH_BITS / 64, sizeof(u_int64_t));
+    if (! bitmap) {
+        fprintf(stderr, "fatal error: out of memory\n");
+        exit(1);
+    }
+
+    for (int t=0; t<tuples; t++) {
+        u_int8_t const * tuple = input + (long) t * tuple_size;
+
+        /* FNV-1a over the key bytes, then mixed so that the low bits depend on all of them */
+        u_int64_t h = 14695981039346656037ULL;
+        for (int i=0; i<aggregate->group_num; i++) {
+            for (int b=0; b<sizes[i]; b++) {
+                h ^= tuple[offsets[i] + b];
+                h *= 1099511628211ULL;
+            }
+        }
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+
+        int bit = (int) (h % AGGREGATION_SKETCH_BITS);
+        bitmap[bit / 64] |= 1ULL << (bit % 64);
+    }
+
+    int clear = 0;
+    for (int i=0; i<AGGREGATION_SKETCH_BITS / 64; i++) {
+        clear += 64 - __builtin_popcountll(bitmap[i]);
+    }
+    free(bitmap);
+
+    /* A full bitmap only tells that there are many */
+    if (clear == 0) {
+        return tuples;
+    }
+
+    double m = AGGREGATION_SKETCH_BITS;
+    long groups = (long) (-m * log(clear / m) + 0.5);
+
+    return (groups < tuples) ? groups : tuples;
+}
+
+/* The fewest partitions whose groups fill at most half of a work group table, else sorting */
+static enum aggregation_strategies aggregation_choose_strategy(aggregation_p aggregate, long groups, int * partition_bits) {
+    long fit = local_table_capacity(aggregate) / 2;
+
+    *partition_bits = 0;
+    if (groups <= fit) {
+        return AGGREGATION_HASH;
+    }
+
+    if (groups > (fit << AGGREGATION_MAX_PARTITION_BITS) && aggregate->group_num == 1) {
+        return AGGREGATION_SORT;
+    }
+
+    int bits = 1;
+    while (bits < AGGREGATION_MAX_PARTITION_BITS && (groups >> bits) > fit) {
+        bits++;
+    }
+    *partition_bits = bits;
+    return AGGREGATION_PARTITION;
+}
+
+typedef struct aggregation_rebuild {
+    aggregation_p aggregate;
+    char * source;
+} aggregation_rebuild_t;
+
+/* Builds the program of a new strategy and leaves it for aggregation_process to swap in */
+static void * aggregation_rebuild(void * rebuild_ptr) {
+    aggregation_rebuild_t * rebuild = (aggregation_rebuild_t *) rebuild_ptr;
+    aggregation_p aggregate = rebuild->aggregate;
+
+    cl_program program = gpu_build_program(rebuild->source);
+
+    cl_program old = (cl_program) __atomic_exchange_n(&aggregate->pending_program, (void *) program, __ATOMIC_ACQ_REL);
+    if (old) {
+        gpu_release_program(old);
+    }
+    free(rebuild->source);
+
+    __atomic_store_n(&aggregate->rebuilding, 0, __ATOMIC_RELEASE);
+    free(rebuild);
+
+    return NULL;
+}
+
+void aggregation_set_key_bounds(aggregation_p aggregate, long min, long max) {
+    if (min > max) {
+        fprintf(stderr, "error: the key bounds are empty (%s)\n", __FUNCTION__);
+        exit(1);
+    }
+    aggregate->has_key_bounds = true;
+    aggregate->key_min = min;
+    aggregate->key_max = max;
+}
+
+void aggregation_size_tables(aggregation_p aggregate, long groups, int size) {
+    int entry_size = table_entry_size(aggregate);
+    long max_size = (HASH_TABLE_SIZE) / entry_size * entry_size;
+
+    if (size > 0) {
+        /* Only ever grows, as the estimate may be lowering it on the dispatcher */
+        int grown = (2L * size < max_size) ? 2 * size : (int) max_size;
+
+        int current = __atomic_load_n(&aggregate->table_size, __ATOMIC_RELAXED);
+        while (current < grown && 
+            !__atomic_compare_exchange_n(&aggregate->table_size, &current, grown, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+        return;
+    }
+
+    long entries = 2 * groups;
+    if (entries < AGGREGATION_MIN_TABLE_ENTRIES) {
+        entries = AGGREGATION_MIN_TABLE_ENTRIES;
+    }
+    /* A slot for every key in the bounds, the others are hashed after them */
+    if (aggregate->strategy == AGGREGATION_DIRECT) {
+        entries += aggregate->key_max - aggregate->key_min + 1;
+    }
+
+    long bytes = entries * entry_size;
+    __atomic_store_n(&aggregate->table_size, (int) ((bytes < max_size) ? bytes : max_size), __ATOMIC_RELAXED);
+}
+
+static void aggregation_adapt(aggregation_p aggregate, batch_p input) {
+    /* The key bounds are declared, there is nothing to estimate */
+    if (aggregate->strategy == AGGREGATION_DIRECT) {
+        return;
+    }
+
+    if ((__atomic_add_fetch(&aggregate->batch_count, 1, __ATOMIC_RELAXED) - 1) % AGGREGATION_SAMPLE_INTERVAL != 0) {
+        return;
+    }
+
+    if (pthread_mutex_trylock(&aggregate->adapt_lock) != 0) {
+        return;
+    }
+
+    if (!__atomic_load_n(&aggregate->rebuilding, __ATOMIC_ACQUIRE)) {
+        aggregate->estimated_groups = aggregation_estimate_groups(aggregate, input->buffer + input->start, input->size);
+        aggregation_size_tables(aggregate, aggregate->estimated_groups, 0);
+
+        int bits;
+        enum aggregation_strategies strategy = aggregation_choose_strategy(aggregate, aggregate->estimated_groups, &bits);
+        if (strategy != aggregate->strategy || bits != aggregate->partition_bits) {
+            aggregate->strategy = strategy;
+            aggregate->partition_bits = bits;
+
+            aggregation_rebuild_t * rebuild = (aggregation_rebuild_t *) malloc(sizeof(aggregation_rebuild_t));
+            rebuild->aggregate = aggregate;
+            rebuild->source = generate_source(aggregate, aggregate->window, aggregate->patch);
+
+            aggregate->rebuilding = 1;
+
+            pthread_t thread;
+            if (pthread_create(&thread, NULL, aggregation_rebuild, (void *) rebuild)) {
+                fprintf(stderr, "error: failed to create the rebuilding thread (%s)\n", __FUNCTION__);
+                exit(1);
+            }
+            pthread_detach(thread);
+        }
+    }
+
+    pthread_mutex_unlock(&aggregate->adapt_lock);
+}
 
 void aggregation_setup(void * aggregate_ptr, int batch_size, window_p window, char const * patch) {
     aggregation_p aggregate = (aggregation_p) aggregate_ptr;
@@ -364,8 +768,16 @@ void aggregation_setup(void * aggregate_ptr, int batch_size, window_p window, ch
         }
     }
 
+    /* A small dense key domain is indexed directly */
+    if (aggregate->has_key_bounds && aggregate->group_num == 1
+        && aggregate->input_schema->attr[aggregate->groups[0]] != TYPE_FLOAT
+        && aggregate->key_max - aggregate->key_min < local_table_capacity(aggregate)) {
+        aggregate->strategy = AGGREGATION_DIRECT;
+        aggregation_size_tables(aggregate, 0, 0);
+    }
+
     /* Code generation */
-    // char * source = generate_source(aggregate, window, patch);
+    char * source = generate_source(aggregate, window, patch);
 
 #ifdef OPMERGER_DEBUG
     /* Output generated code */
@@ -376,13 +788,7 @@ void aggregation_setup(void * aggregate_ptr, int batch_size, window_p window, ch
 #endif
     
     /* Build opencl program */
-    char * source;
-    if (patch == NULL) {
-        source = read_source("cl/aggregation_sep.cl");
-    } else {
-        source = read_source("cl/aggregation_meg.cl");
-    }
-    int qid = gpu_get_query(source, 9, 1, 9);
+    int qid = gpu_get_query(source, AGGREGATION_KERNEL_NUM, 1, 10);
     aggregate->qid = qid;
     free(source);
     
@@ -400,7 +806,7 @@ void aggregation_setup(void * aggregate_ptr, int batch_size, window_p window, ch
     int offset_size = 16; /* The size of two longs */
     gpu_set_output(qid, 3, offset_size, 0, 1, 0, 0, 1);
     
-    int window_counts_size = 20; /* 4 integers, +1 that is the mark */
+    int window_counts_size = AGGREGATION_COUNTS_SIZE;
     gpu_set_output(qid, 4, window_counts_size, 0, 0, 1, 0, 1);
     
     /* Set partial window results */
@@ -411,56 +817,62 @@ void aggregation_setup(void * aggregate_ptr, int batch_size, window_p window, ch
     gpu_set_output(qid, 7, output_size, 1, 0, 0, 1, 1);
     gpu_set_output(qid, 8, output_size, 1, 0, 0, 1, 1);
 
+    /* Partition starts, tuple offsets and per work group counts, for the most partitions */
+    int partitions = 1 << AGGREGATION_MAX_PARTITION_BITS;
+    int work_group_num = (batch_size + MAX_THREADS_PER_GROUP - 1) / MAX_THREADS_PER_GROUP;
+    int partitions_size = 4 * (partitions + 1 + batch_size + partitions * work_group_num);
+    gpu_set_output(qid, 9, partitions_size, 0, 1, 0, 0, 1);
+
     /* Refer to selection.c */
     aggregate->output_entries[0] = 0; /* window_count */
-    aggregate->output_entries[1] = 20; /* closing window */
-    aggregate->output_entries[2] = 20 + output_size; /* pending window */
-    aggregate->output_entries[3] = 20 + output_size * 2; /* complete window */
-    aggregate->output_entries[4] = 20 + output_size * 3; /* opening window */
+    aggregate->output_entries[1] = AGGREGATION_COUNTS_SIZE; /* closing window */
+    aggregate->output_entries[2] = AGGREGATION_COUNTS_SIZE + output_size; /* pending window */
+    aggregate->output_entries[3] = AGGREGATION_COUNTS_SIZE + output_size * 2; /* complete window */
+    aggregate->output_entries[4] = AGGREGATION_COUNTS_SIZE + output_size * 3; /* opening window */
     
-    /* GPU kernels setup */
-    int args1 [6];
+    /* GPU kernels setup; the arguments are kept to set the kernels of a rebuilt program */
+    int * args1 = aggregate->kernel_args;
     args1[0] = batch_size; /* tuples */
     args1[1] = batch_size * tuple_size; /* input size */
     args1[2] = output_size;
-    args1[3] = HASH_TABLE_SIZE;
+    args1[3] = aggregate->table_size; /* Set again for every batch */
     args1[4] = PARTIAL_WINDOWS;
-    args1[5] = aggregate->key_length * MAX_THREADS_PER_GROUP; /* local cache size */
+    args1[5] = aggregate->key_length * MAX_THREADS_PER_GROUP + AGGREGATION_LOCAL_TABLE_SIZE; /* local cache size */
 
-    long args2 [2];
+    long args2 [3];
     args2[0] = 0; /* Previous pane id   */
     args2[1] = 0; /* Batch start offset */
+    args2[2] = aggregate->table_size;
 
     gpu_set_kernel_aggregate(qid, args1, args2);
+
+    aggregate->window = window;
+    if (patch && !aggregate->patch) {
+        aggregate->patch = strdup(patch);
+    }
 }
 
 void aggregation_process(void * aggregate_ptr, batch_p batch, window_p window, u_int8_t ** processed_outputs, query_event_p event) {
     aggregation_p aggregate = (aggregation_p) aggregate_ptr;
     
-    long args2[2];
-    {
-        /* Previous pane id, based on stream start pointer, s */
-        args2[0] = -1;
-        long s = batch->start;
-        int  t = aggregate->input_schema->size;
-        long p = window->pane_size;
-        if (batch->start > 0) {
-            if (window->type == RANGE_BASE) {
-                int offset = s - t;
-                args2[0] = batch_get_first_tuple_timestamp64(batch, offset) / p;
-            } else {
-                args2[0] = ((s / (long) t) / p) - 1;
-            }
-        }
-        /* Force every batch to be a new window because the batch->start here is not the same with Saber's */
-        args2[0] = -1;
-    
-        args2[1] = s;
-        
-        /* Also the same to curent pane id */
-        args2[1] = 0;
+    /* Windows carry on from the previous batch of the stream (set by the dispatcher) */
+    long args2[3];
+    args2[0] = batch->previous_pane_id;
+    args2[1] = batch->start_pointer;
+    args2[2] = __atomic_load_n(&aggregate->table_size, __ATOMIC_RELAXED);
+
+    /* Swap in the program of a new strategy; the batches in the pipeline finish with the old one */
+    cl_program program = (cl_program) __atomic_exchange_n(&aggregate->pending_program, NULL, __ATOMIC_ACQ_REL);
+    if (program) {
+        gpu_set_program(aggregate->qid, program);
+        gpu_set_kernel_aggregate(aggregate->qid, aggregate->kernel_args, args2);
     }
-    
+
+    aggregation_adapt(aggregate, batch);
+
+    /* The bytes of the tables, from a new estimate */
+    args2[2] = __atomic_load_n(&aggregate->table_size, __ATOMIC_RELAXED);
+
     u_int8_t * inputs [1] = {
         batch->buffer + batch->start};
 
@@ -482,7 +894,7 @@ void aggregation_process_output(void * aggregate_ptr, batch_p outputs) {
     int batch_size = outputs->size;
 
     /* Deserialise output buffer */
-    int window_counts_size = 20; /* 4 integers, +1 that is the mark */
+    int window_counts_size = AGGREGATION_COUNTS_SIZE;
     int * window_counts = (int *) (outputs->buffer + current_offset);
     current_offset += window_counts_size;
     
@@ -541,6 +953,24 @@ void aggregation_process_output(void * aggregate_ptr, batch_p outputs) {
     // }
 }
 
+void aggregation_set_input_schema(void * aggregate_ptr, schema_p input_schema) {
+    aggregation_p aggregate = (aggregation_p) aggregate_ptr;
+
+    aggregate->input_schema = input_schema;
+}
+
+void * aggregation_clone(void * aggregate_ptr) {
+    aggregation_p aggregate = (aggregation_p) aggregate_ptr;
+
+    aggregation_p p = aggregation(aggregate->input_schema, aggregate->ref_num, aggregate->refs, aggregate->expressions,
+        aggregate->group_num, aggregate->groups);
+    if (aggregate->has_key_bounds) {
+        aggregation_set_key_bounds(p, aggregate->key_min, aggregate->key_max);
+    }
+
+    return p;
+}
+
 u_int8_t ** aggregation_get_output_buffer(void * aggregate_ptr, batch_p output) {
     aggregation_p aggregate = (aggregation_p) aggregate_ptr;
 
@@ -550,7 +980,7 @@ u_int8_t ** aggregation_get_output_buffer(void * aggregate_ptr, batch_p output)
     int batch_size = aggregate->batch_size;
     int tuple_size = aggregate->output_schema->size;
 
-    if ((output->end - output->start) < (long) (20 + 4 * batch_size * tuple_size)) {
+    if ((output->end - output->start) < (long) (AGGREGATION_COUNTS_SIZE + 4 * batch_size * tuple_size)) {
         fprintf(stderr, "error: Expected output size has exceeded the given output buffer size (%s)\n", __FUNCTION__);
         exit(1);
     }
@@ -573,7 +1003,7 @@ void aggregation_print_output(batch_p outputs, int batch_size, int tuple_size) {
     /* Deserialise output buffer */
     int current_offset = 0;
     
-    int window_counts_size = 20; /* 4 integers, +1 that is the complete windows mark, +1 that is the mark */
+    int window_counts_size = AGGREGATION_COUNTS_SIZE;
     int * window_counts = (int *) (outputs->buffer + current_offset);
     current_offset += window_counts_size;
 
@@ -587,9 +1017,9 @@ void aggregation_print_output(batch_p outputs, int batch_size, int tuple_size) {
     /* print */
     printf("[Results] Required Output buffer size is %d\n", current_offset);
     printf("[Results] Closing Windows: %d    Pending Windows: %d    Complete Windows: %d    \
-Opening Windows: %d    Mark:%d\n",
+Opening Windows: %d    Table size: %d    Failed: %d\n",
         window_counts[0], window_counts[1], window_counts[2], 
-        window_counts[3], window_counts[4]);
+        window_counts[3], window_counts[4], window_counts[5]);
 
     for (int t=0; t<4; t++) {
 
@@ -1,17 +1,48 @@
 #ifndef AGGREGATION_H
 #define AGGREGATION_H
 
+#include <pthread.h>
+
 #include "batch.h"
 #include "operator.h"
 #include "schema.h"
+#include "libcpu/cpu_window.h"
 
-#define AGGREGATION_KERNEL_NUM 9
+#define AGGREGATION_KERNEL_NUM 11
 #define AGGREGATION_CODE_FILENAME "cl/aggregate"
 #define AGGREGATION_CODE_TEMPLATE "cl/templates/aggregate_template.cl"
 #define AGGREGATION_MAX_REFERENCE 2
 #define AGGREGATION_MAX_GROUP 1
 #define AGGREGATION_OUTPUT_NUM 5
 
+/* An output starts with the numbers of closing, pending, complete and opening windows, then the bytes
+   of a table and the tuples that did not fit in their tables */
+#define AGGREGATION_COUNTS_SIZE 24
+
+/* The tables of a batch hold twice the groups last estimated, at least AGGREGATION_MIN_TABLE_ENTRIES and
+   at most HASH_TABLE_SIZE bytes. If tuples do not fit, the result handler aggregates the windows of the full
+   tables again into tables of HASH_TABLE_SIZE, and the tables of the next batches are twice as large */
+#define AGGREGATION_MIN_TABLE_ENTRIES 64
+
+/* Bytes of the table a work group pre-aggregates a window into before the global table */
+#define AGGREGATION_LOCAL_TABLE_SIZE (16 * 1024)
+
+/* The groups of a batch are estimated every AGGREGATION_SAMPLE_INTERVAL batches (from the first one) by
+   linear counting on a bitmap of AGGREGATION_SKETCH_BITS. If a work group table would be more than half
+   full, the tuples are radix partitioned by key hash into up to 2^AGGREGATION_MAX_PARTITION_BITS partitions,
+   and if that is not enough either, they are sorted */
+#define AGGREGATION_SAMPLE_INTERVAL 16
+#define AGGREGATION_SKETCH_BITS (64 * 1024)
+#define AGGREGATION_MAX_PARTITION_BITS 6
+
+/* How the work groups aggregate the tuples of a window, refer to aggregate_window */
+enum aggregation_strategies {
+    AGGREGATION_HASH,      /* Into a work group table */
+    AGGREGATION_PARTITION, /* Into a work group table, a radix partition at a time */
+    AGGREGATION_SORT,      /* Radix sorted a work group at a time, then reduced by runs of equal keys */
+    AGGREGATION_DIRECT     /* Into a work group array indexed by key, for declared key bounds */
+};
+
 enum aggregation_types {
     CNT,
     SUM,
@@ -43,6 +74,42 @@ typedef struct aggregation {
     schema_p output_schema;
     int output_entries[AGGREGATION_OUTPUT_NUM];
 
+    cpu_window_pointers_p window_pointers; /* Host backend only */
+    void * cpu_panes; /* Groups of the panes of a batch, refer to aggregation_cpu.c */
+    int * cpu_pane_sizes;
+    int cpu_pane_capacity;
+
+    /* Host version of a fused query: the generated selection sets one flag per tuple before aggregating */
+    void * cpu_library;
+    int (* cpu_select_range) (u_int8_t const * input, int from, int to, int * flags);
+    int * cpu_flags;
+
+    /* Adaptive strategy. The program of a new strategy is built on another thread and 
+       swapped in before the next batch, as for the predicate order of a selection */
+    enum aggregation_strategies strategy;
+    int partition_bits; /* AGGREGATION_PARTITION only */
+    bool has_key_bounds;
+    long key_min, key_max;
+    long estimated_groups;
+    int batch_count;
+    char * patch;
+    window_p window;
+    int kernel_args[6];
+    int rebuilding;
+    pthread_mutex_t adapt_lock;
+    void * pending_program; /* cl_program */
+
+    int table_size; /* Bytes of a table of the next batch */
+
+    /* The windows of an output that were aggregated again, refer to aggregation_recover_output */
+    batch_p recovered_output;
+    int recovered_num;
+    int recovered_capacity;
+    int * recovered_windows; /* Pairs of window kind and index */
+    u_int8_t * recovered_tables;
+    cpu_window_pointers_p recover_pointers;
+    int * recover_flags;
+
 } aggregation_t;
 
 /* Refer to selection.h for explainations of following member methods */
@@ -64,6 +131,44 @@ void aggregation_print_output(batch_p outputs, int batch_size, int tuple_size);
 
 u_int8_t ** aggregation_get_output_buffer(void * aggregate_ptr, batch_p output);
 
+void aggregation_set_input_schema(void * aggregate_ptr, schema_p input_schema);
+
+/* The copy keeps the declared key bounds */
+void * aggregation_clone(void * aggregate_ptr);
+
 int aggregation_get_output_schema_size(void * aggregate_ptr);
 
+/* Declares that the group-by attribute (an integer) is in [min, max], e.g. the codes of a dictionary. Set
+   before setup: if the domain fits in a work group table, the groups are aggregated into slots indexed by key
+   instead of hashed. Keys out of the bounds are still aggregated, only by hashing */
+void aggregation_set_key_bounds(aggregation_p aggregate, long min, long max);
+
+/* Estimated number of the groups of the given tuples */
+long aggregation_estimate_groups(aggregation_p aggregate, u_int8_t const * input, int tuples);
+
+/* Host backend (aggregation_cpu.c) */
+char * aggregation_generate_c_source(aggregation_p aggregate, char const * patch);
+
+void aggregation_cpu_setup(void * aggregate_ptr, int batch_size, window_p window, char const * patch);
+
+void aggregation_cpu_process(void * aggregate_ptr, batch_p batch, window_p window, u_int8_t ** processed_outputs, query_event_p event);
+
+/* Window assembly, refer to operator.h. A partial is an output table, so these are with the host 
+   version of its layout in aggregation_cpu.c */
+int aggregation_get_partial_size(void * aggregate_ptr);
+
+u_int8_t * aggregation_get_fragment(void * aggregate_ptr, batch_p output, enum window_kinds kind, int index, int * size);
+
+void aggregation_init_partial(void * aggregate_ptr, u_int8_t * partial);
+
+void aggregation_merge_partial(void * aggregate_ptr, u_int8_t * partial, u_int8_t const * fragment, int size);
+
+int aggregation_write_window(void * aggregate_ptr, u_int8_t const * partial, int size, u_int8_t * output);
+
+void aggregation_recover_output(void * aggregate_ptr, batch_p input, batch_p output);
+
+/* Sizes the tables of the next batches from the estimated groups, or doubles them if tables of size
+   bytes were too small (refer to aggregation.c) */
+void aggregation_size_tables(aggregation_p aggregate, long groups, int size);
+
 #endif
\ No newline at end of file
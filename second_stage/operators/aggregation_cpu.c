@@ -0,0 +1,1028 @@
+#include "aggregation.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+#include "generators.h"
+#include "libcpu/cpu_agg.h"
+#include "libcpu/cpu_compiler.h"
+
+/**
+ * Layout of a hash table entry, the host version of intermediate_t:
+ *     int   mark;   -1 if empty, otherwise the input byte offset of the first tuple
+ *     int   pad;
+ *     long  t;
+ *     key   (key_length bytes of the group-by attributes)
+ *     float values [ref_num];
+ *     int   count;
+ * padded to a multiple of 16 bytes
+ **/
+#define ENTRY_MARK_OFFSET 0
+#define ENTRY_TIME_OFFSET 8
+#define ENTRY_KEY_OFFSET 16
+
+/* Budget of the two scratch tables of a thread, so that probing stays in its L2 cache */
+#define AGGREGATION_CPU_L2_SIZE (512 * 1024)
+
+/**
+ * Each thread aggregates its share of the tuples into a private scratch table. The group-by key is a
+ * single attribute, so it is kept as a fixed-width integer and compared in one instruction.
+ **/
+typedef struct scratch_entry {
+    unsigned long key;
+    long t;
+    int mark; /* -1 if empty, as in the output table */
+    int count;
+    float values [AGGREGATION_MAX_REFERENCE];
+} scratch_entry_t;
+
+typedef struct scratch_table {
+    scratch_entry_t * entries;
+    int * used;   /* Occupied slots, so that a table is cleared and flushed without a full scan */
+    int used_num;
+} scratch_table_t;
+
+typedef struct thread_scratch {
+    int capacity; /* A power of two */
+    int bits;
+    scratch_table_t tables [2];
+
+    /* Windows this thread has only seen part of, left in tables[partial_tables[i]] for the merge */
+    int partial_num;
+    int partial_tasks [2];
+    int partial_tables [2];
+
+    int failed;
+} thread_scratch_t;
+
+static thread_scratch_t scratch [CPU_MAX_THREADS];
+
+typedef struct window_task {
+    int wid;
+    int start;
+    int end;
+    long first; /* Tuples of all the tasks before this one */
+    int done;   /* Written to its output table by a single thread */
+    u_int8_t * table;
+} window_task_t;
+
+typedef struct aggregation_args {
+    aggregation_p aggregate;
+
+    u_int8_t const * input;
+    int bytes;
+    int tuple_size;
+
+    int group_offset;
+    int attr_offsets[AGGREGATION_MAX_REFERENCE];
+    enum attr_types attr_types[AGGREGATION_MAX_REFERENCE];
+
+    int value_offset;
+    int count_offset;
+    int entry_size;
+    int table_capacity;
+
+    int task_num;
+    window_task_t * tasks;
+    long total; /* Tuples of all the tasks */
+
+    int tuples;
+    int const * flags; /* Tuples selected by a fused query, or NULL */
+
+    /**
+     * Used when windows overlap: the groups of pane j are kept from pane_entries + the index of its
+     * first tuple, as a pane has at most as many groups as tuples
+     **/
+    int pane_num;
+    scratch_entry_t * pane_entries;
+    int * pane_sizes;
+} aggregation_args_t;
+
+static inline unsigned long hashf(unsigned long key) {
+    /* Fibonacci hashing */
+    return key * 11400714819323198485ul;
+}
+
+static inline unsigned long read_key(aggregation_args_t const * args, u_int8_t const * in) {
+    u_int8_t const * attr = in + args->group_offset;
+    return (args->aggregate->key_length == 8) ?
+        *((unsigned long const *) attr) : *((unsigned int const *) attr);
+}
+
+static inline void storef(aggregation_args_t const * args, scratch_entry_t * entry, unsigned long key, u_int8_t const * in, int idx) {
+    aggregation_p aggregate = args->aggregate;
+
+    entry->key = key;
+    entry->t = *((long const *) in);
+    entry->mark = idx;
+    entry->count = 1;
+    for (int i=0; i<aggregate->ref_num; i++) {
+        entry->values[i] = (aggregate->expressions[i] == CNT) ?
+            1 : cpu_read_float(in + args->attr_offsets[i], args->attr_types[i]);
+    }
+}
+
+static inline void updatef(aggregation_args_t const * args, scratch_entry_t * entry, u_int8_t const * in) {
+    aggregation_p aggregate = args->aggregate;
+
+    long t = *((long const *) in);
+    entry->t = (entry->t > t) ? entry->t : t;
+
+    for (int i=0; i<aggregate->ref_num; i++) {
+        float value = cpu_read_float(in + args->attr_offsets[i], args->attr_types[i]);
+
+        switch (aggregate->expressions[i]) {
+        case CNT: entry->values[i] += 1; break;
+        case SUM:
+        case AVG: entry->values[i] += value; break;
+        case MIN: entry->values[i] = (entry->values[i] > value) ? value : entry->values[i]; break;
+        case MAX: entry->values[i] = (entry->values[i] < value) ? value : entry->values[i]; break;
+        default: break;
+        }
+    }
+    entry->count += 1;
+}
+
+/* Combines two partial aggregates of the same group */
+static inline void mergef(aggregation_p aggregate, float * values, float const * other) {
+    for (int i=0; i<aggregate->ref_num; i++) {
+        switch (aggregate->expressions[i]) {
+        case CNT:
+        case SUM:
+        case AVG: values[i] += other[i]; break;
+        case MIN: values[i] = (values[i] > other[i]) ? other[i] : values[i]; break;
+        case MAX: values[i] = (values[i] < other[i]) ? other[i] : values[i]; break;
+        default: break;
+        }
+    }
+}
+
+/* Linear probing insert into a scratch table, returns 0 if the table is full */
+static inline int insertf(aggregation_args_t const * args, thread_scratch_t * s, scratch_table_t * table, u_int8_t const * in, int idx) {
+    unsigned long key = read_key(args, in);
+    int const mask = s->capacity - 1;
+
+    int h = hashf(key) >> (64 - s->bits);
+    for (int attempt = 0; attempt < s->capacity; ++attempt) {
+        scratch_entry_t * entry = &table->entries[h];
+
+        if (entry->mark == -1) {
+            storef(args, entry, key, in, idx);
+            table->used[table->used_num++] = h;
+            return 1;
+        } else if (entry->key == key) {
+            updatef(args, entry, in);
+            return 1;
+        }
+
+        /* Conflict; try next slot */
+        h = (h + 1) & mask;
+    }
+
+    return 0;
+}
+
+static void clear_scratch(scratch_table_t * table) {
+    for (int i=0; i<table->used_num; i++) {
+        table->entries[table->used[i]].mark = -1;
+    }
+    table->used_num = 0;
+}
+
+/* The layout of the entries of an output table of size bytes */
+static void set_table_layout(aggregation_p aggregate, aggregation_args_t * args, int size) {
+    args->aggregate = aggregate;
+
+    args->value_offset = ENTRY_KEY_OFFSET + aggregate->key_length;
+    args->count_offset = args->value_offset + aggregate->ref_num * sizeof(float);
+    args->entry_size = ((args->count_offset + sizeof(int) + 15) / 16) * 16;
+    args->table_capacity = size / args->entry_size;
+}
+
+/* clearKernel of one output table */
+static void clear_output(aggregation_args_t const * args, u_int8_t * table) {
+    for (int e=0; e<args->table_capacity; e++) {
+        *((int *) (table + (long) e * args->entry_size + ENTRY_MARK_OFFSET)) = -1;
+    }
+}
+
+/* Adds a partial aggregate to an output table, returns 0 if the table is full */
+static int flushf(aggregation_args_t const * args, u_int8_t * table, scratch_entry_t const * partial) {
+    aggregation_p aggregate = args->aggregate;
+    int const capacity = args->table_capacity;
+
+    int h = (hashf(partial->key) >> 32) % capacity;
+    for (int attempt = 0; attempt < capacity; ++attempt) {
+        u_int8_t * entry = table + (long) h * args->entry_size;
+        int * mark = (int *) (entry + ENTRY_MARK_OFFSET);
+        long * t = (long *) (entry + ENTRY_TIME_OFFSET);
+        float * values = (float *) (entry + args->value_offset);
+        int * count = (int *) (entry + args->count_offset);
+
+        if (*mark == -1) {
+            *mark = partial->mark;
+            *t = partial->t;
+            memcpy(entry + ENTRY_KEY_OFFSET, &partial->key, aggregate->key_length);
+            memcpy(values, partial->values, aggregate->ref_num * sizeof(float));
+            *count = partial->count;
+            return 1;
+        }
+
+        unsigned long key = 0;
+        memcpy(&key, entry + ENTRY_KEY_OFFSET, aggregate->key_length);
+        if (key == partial->key) {
+            *mark = (*mark < partial->mark) ? *mark : partial->mark;
+            *t = (*t > partial->t) ? *t : partial->t;
+            mergef(aggregate, values, partial->values);
+            *count += partial->count;
+            return 1;
+        }
+
+        /* Conflict; try next slot */
+        h = (h + 1 == capacity) ? 0 : h + 1;
+    }
+
+    return 0;
+}
+
+static void flush_scratch(aggregation_args_t const * args, thread_scratch_t * s, scratch_table_t const * table, u_int8_t * output) {
+    for (int i=0; i<table->used_num; i++) {
+        if (! flushf(args, output, &table->entries[table->used[i]])) {
+            s->failed += table->entries[table->used[i]].count;
+        }
+    }
+}
+
+/* The task holding global tuple g */
+static int find_task(aggregation_args_t const * args, long g) {
+    int lo = 0, hi = args->task_num - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (args->tasks[mid].first <= g) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return lo;
+}
+
+/* Phase 0 of a fused query: the generated selection flags every tuple of the batch */
+static void filter_kernel(void * args_ptr, int tid, int thread_num) {
+    aggregation_args_t * args = (aggregation_args_t *) args_ptr;
+
+    int from, to;
+    cpu_get_range(args->tuples, tid, thread_num, &from, &to);
+
+    (* args->aggregate->cpu_select_range) (args->input, from, to, (int *) args->flags);
+}
+
+/**
+ * Phase 1: every thread takes an equal share of all the tuples. A window it sees whole goes
+ * straight to its output table, the one or two windows cut by its share are kept for the merge.
+ **/
+static void aggregate_kernel(void * args_ptr, int tid, int thread_num) {
+    aggregation_args_t * args = (aggregation_args_t *) args_ptr;
+    thread_scratch_t * s = &scratch[tid];
+
+    s->partial_num = 0;
+    s->failed = 0;
+    if (args->task_num == 0) {
+        return;
+    }
+
+    long from = args->total * tid / thread_num;
+    long to = args->total * (tid + 1) / thread_num;
+
+    int current = 0; /* The scratch table in use */
+    for (int k = find_task(args, from); k < args->task_num && args->tasks[k].first < to; k++) {
+        window_task_t * task = &args->tasks[k];
+        long n = (task->end - task->start) / args->tuple_size;
+        if (n == 0) {
+            continue;
+        }
+
+        long first = (from > task->first) ? from : task->first;
+        long last = (to < task->first + n) ? to : task->first + n;
+        if (first >= last) {
+            continue;
+        }
+
+        scratch_table_t * table = &s->tables[current];
+        int idx = task->start + (int) (first - task->first) * args->tuple_size;
+        int end = task->start + (int) (last - task->first) * args->tuple_size;
+        for (; idx < end; idx += args->tuple_size) {
+            if (args->flags && ! args->flags[idx / args->tuple_size]) {
+                continue;
+            }
+            if (! insertf(args, s, table, args->input + idx, idx)) {
+                s->failed += 1;
+            }
+        }
+
+        if (first == task->first && last == task->first + n) {
+            clear_output(args, task->table);
+            flush_scratch(args, s, table, task->table);
+            clear_scratch(table);
+            task->done = 1;
+        } else {
+            s->partial_tasks[s->partial_num] = k;
+            s->partial_tables[s->partial_num] = current;
+            s->partial_num++;
+            current = 1 - current;
+        }
+    }
+}
+
+/* Phase 2: windows closed by more than one thread (and empty ones) are merged into their output tables */
+static void merge_kernel(void * args_ptr, int tid, int thread_num) {
+    aggregation_args_t * args = (aggregation_args_t *) args_ptr;
+    thread_scratch_t * mine = &scratch[tid];
+
+    int from, to;
+    cpu_get_range(args->task_num, tid, thread_num, &from, &to);
+
+    for (int k=from; k<to; k++) {
+        window_task_t * task = &args->tasks[k];
+        if (task->done) {
+            continue;
+        }
+
+        clear_output(args, task->table);
+        for (int t=0; t<thread_num; t++) {
+            for (int i=0; i<scratch[t].partial_num; i++) {
+                if (scratch[t].partial_tasks[i] == k) {
+                    flush_scratch(args, mine, &scratch[t].tables[scratch[t].partial_tables[i]], task->table);
+                }
+            }
+        }
+    }
+}
+
+/* Every tuple is aggregated once, into the groups of its pane */
+static void pane_kernel(void * args_ptr, int tid, int thread_num) {
+    aggregation_args_t * args = (aggregation_args_t *) args_ptr;
+    thread_scratch_t * s = &scratch[tid];
+    int const * panes = args->aggregate->window_pointers->panes;
+
+    s->partial_num = 0;
+    s->failed = 0;
+
+    int from, to;
+    cpu_get_range(args->pane_num, tid, thread_num, &from, &to);
+    for (int j=from; j<to; j++) {
+        scratch_table_t * table = &s->tables[0];
+        int end = (j + 1 < args->pane_num) ? panes[j + 1] : args->bytes;
+
+        for (int idx = panes[j]; idx < end; idx += args->tuple_size) {
+            if (args->flags && ! args->flags[idx / args->tuple_size]) {
+                continue;
+            }
+            if (! insertf(args, s, table, args->input + idx, idx)) {
+                s->failed += 1;
+            }
+        }
+
+        scratch_entry_t * entries = args->pane_entries + panes[j] / args->tuple_size;
+        for (int i=0; i<table->used_num; i++) {
+            entries[i] = table->entries[table->used[i]];
+        }
+        args->pane_sizes[j] = table->used_num;
+        clear_scratch(table);
+    }
+}
+
+/* A window merges the groups of the panes between its pointers into its output table */
+static void assemble_windows_kernel(void * args_ptr, int tid, int thread_num) {
+    aggregation_args_t * args = (aggregation_args_t *) args_ptr;
+    thread_scratch_t * s = &scratch[tid];
+    cpu_window_pointers_p pointers = args->aggregate->window_pointers;
+
+    int from, to;
+    cpu_get_range(args->task_num, tid, thread_num, &from, &to);
+    for (int k=from; k<to; k++) {
+        window_task_t * task = &args->tasks[k];
+
+        clear_output(args, task->table);
+
+        int last = cpu_window_find_pane(pointers, task->end);
+        for (int j = cpu_window_find_pane(pointers, task->start); j < last; j++) {
+            scratch_entry_t const * entries = args->pane_entries + pointers->panes[j] / args->tuple_size;
+            for (int i=0; i<args->pane_sizes[j]; i++) {
+                if (! flushf(args, task->table, &entries[i])) {
+                    s->failed += entries[i].count;
+                }
+            }
+        }
+    }
+}
+
+/* Adds (sign 1) or removes (sign -1) the groups of a pane to a running table, returns 0 if it is full */
+static int slidef(aggregation_args_t const * args, thread_scratch_t * s, scratch_table_t * table, int j, int sign) {
+    aggregation_p aggregate = args->aggregate;
+    int const mask = s->capacity - 1;
+
+    scratch_entry_t const * entries = args->pane_entries + args->aggregate->window_pointers->panes[j] / args->tuple_size;
+    for (int i=0; i<args->pane_sizes[j]; i++) {
+        scratch_entry_t const * partial = &entries[i];
+
+        int h = hashf(partial->key) >> (64 - s->bits);
+        int attempt;
+        for (attempt = 0; attempt < s->capacity; ++attempt) {
+            scratch_entry_t * entry = &table->entries[h];
+
+            if (entry->mark == -1) {
+                /* A removed group is still in the table, with a count of 0 */
+                *entry = *partial;
+                table->used[table->used_num++] = h;
+                break;
+            } else if (entry->key == partial->key) {
+                for (int v=0; v<aggregate->ref_num; v++) {
+                    entry->values[v] += sign * partial->values[v];
+                }
+                entry->count += sign * partial->count;
+                if (sign > 0) {
+                    entry->mark = (entry->mark < partial->mark) ? entry->mark : partial->mark;
+                    entry->t = (entry->t > partial->t) ? entry->t : partial->t;
+                }
+                break;
+            }
+
+            /* Conflict; try next slot */
+            h = (h + 1) & mask;
+        }
+        if (attempt == s->capacity) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Counts, sums and averages can be taken back, so that a window is the one before it with panes added and removed */
+static int invertible(aggregation_p aggregate) {
+    for (int i=0; i<aggregate->ref_num; i++) {
+        if (aggregate->expressions[i] == MIN || aggregate->expressions[i] == MAX) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Consecutive windows of a thread slide a running table over the panes: a pane is added when the first
+ * window holding it is written and removed after the last, instead of being merged once per window
+ **/
+static void slide_windows_kernel(void * args_ptr, int tid, int thread_num) {
+    aggregation_args_t * args = (aggregation_args_t *) args_ptr;
+    thread_scratch_t * s = &scratch[tid];
+    scratch_table_t * table = &s->tables[0];
+    cpu_window_pointers_p pointers = args->aggregate->window_pointers;
+
+    /* Panes [head, tail) are in the running table */
+    int head = 0, tail = 0;
+
+    int from, to;
+    cpu_get_range(args->task_num, tid, thread_num, &from, &to);
+    for (int k=from; k<to; k++) {
+        window_task_t * task = &args->tasks[k];
+
+        int first = cpu_window_find_pane(pointers, task->start);
+        int last = cpu_window_find_pane(pointers, task->end);
+
+        int slid = (first >= head && last >= tail && first < tail);
+        if (slid) {
+            for (; head < first && slid; head++) {
+                slid = slidef(args, s, table, head, -1);
+            }
+            for (; tail < last && slid; tail++) {
+                slid = slidef(args, s, table, tail, 1);
+            }
+        }
+        if (! slid) {
+            /* Rebuilt from the panes of the window, which also drops the groups that were removed */
+            clear_scratch(table);
+            int complete = 1;
+            for (head = tail = first; tail < last; tail++) {
+                if (! slidef(args, s, table, tail, 1)) {
+                    s->failed += args->pane_sizes[tail];
+                    complete = 0;
+                }
+            }
+            /* The groups left out are missing from the panes it shares with the next window, which rebuilds it */
+            if (! complete) {
+                tail = head;
+            }
+        }
+
+        /* The first tuple of a group may have been removed, the window start stands in for it */
+        clear_output(args, task->table);
+        for (int i=0; i<table->used_num; i++) {
+            scratch_entry_t partial = table->entries[table->used[i]];
+            if (partial.count <= 0) {
+                continue;
+            }
+            partial.mark = (partial.mark > task->start) ? partial.mark : task->start;
+            if (! flushf(args, task->table, &partial)) {
+                s->failed += partial.count;
+            }
+        }
+    }
+    clear_scratch(table);
+}
+
+/* Scratch tables are cleared lazily once their windows are merged */
+static void release_kernel(void * args_ptr, int tid, int thread_num) {
+    thread_scratch_t * s = &scratch[tid];
+
+    for (int i=0; i<s->partial_num; i++) {
+        clear_scratch(&s->tables[s->partial_tables[i]]);
+    }
+    s->partial_num = 0;
+}
+
+static void scratch_init(int table_capacity) {
+    /* Twice the output table keeps probing short, bounded by the L2 budget */
+    int bits = 1;
+    while ((1 << bits) < 2 * table_capacity &&
+        (2 << bits) * (int) sizeof(scratch_entry_t) <= AGGREGATION_CPU_L2_SIZE) {
+        bits++;
+    }
+    while ((1 << bits) < table_capacity) {
+        bits++;
+    }
+
+    for (int t=0; t<cpu_get_thread_num(); t++) {
+        thread_scratch_t * s = &scratch[t];
+        if (s->capacity == (1 << bits)) {
+            continue;
+        }
+
+        for (int i=0; i<2; i++) {
+            free(s->tables[i].entries);
+            free(s->tables[i].used);
+
+            s->tables[i].entries = (scratch_entry_t *) malloc((1 << bits) * sizeof(scratch_entry_t));
+            s->tables[i].used = (int *) malloc((1 << bits) * sizeof(int));
+            if (! s->tables[i].entries || ! s->tables[i].used) {
+                fprintf(stderr, "fatal error: out of memory\n");
+                exit(1);
+            }
+            for (int e=0; e<(1 << bits); e++) {
+                s->tables[i].entries[e].mark = -1;
+            }
+            s->tables[i].used_num = 0;
+        }
+        s->capacity = 1 << bits;
+        s->bits = bits;
+        s->partial_num = 0;
+    }
+}
+
+/* The generated selection of a fused query, built as a shared library. Returns 0 without a C compiler */
+static int compile_selection(aggregation_p aggregate, char const * patch) {
+    char * source = aggregation_generate_c_source(aggregate, patch);
+    char * filename = generate_c_filename(aggregate->id, AGGREGATION_CODE_FILENAME);
+
+    aggregate->cpu_library = cpu_compile(source, filename);
+    if (aggregate->cpu_library) {
+        aggregate->cpu_select_range = cpu_get_function(aggregate->cpu_library, "select_range");
+    }
+
+    free(filename);
+    free(source);
+
+    return aggregate->cpu_library != NULL;
+}
+
+void aggregation_cpu_setup(void * aggregate_ptr, int batch_size, window_p window, char const * patch) {
+    aggregation_p aggregate = (aggregation_p) aggregate_ptr;
+
+    if (aggregate->key_length != 4 && aggregate->key_length != 8) {
+        fprintf(stderr, "error: the host backend only supports 4 or 8-byte group-by keys (%s)\n", __FUNCTION__);
+        exit(1);
+    }
+
+    aggregate->batch_size = batch_size;
+    aggregate->window = window;
+
+    /* Refer to selection_cpu.c */
+    if (patch && *patch) {
+        if (! compile_selection(aggregate, patch)) {
+            fprintf(stderr, "error: the host backend needs a C compiler to run fused operators (%s)\n", __FUNCTION__);
+            exit(1);
+        }
+
+        free(aggregate->cpu_flags);
+        aggregate->cpu_flags = (int *) malloc(batch_size * sizeof(int));
+        if (! aggregate->cpu_flags) {
+            fprintf(stderr, "fatal error: out of memory\n");
+            exit(1);
+        }
+    }
+
+    /* Refer to aggregation_setup */
+    int out_tuple_size = aggregate->output_schema->size;
+    int output_size = batch_size * out_tuple_size;
+    aggregate->output_entries[0] = 0; /* window_count */
+    aggregate->output_entries[1] = AGGREGATION_COUNTS_SIZE; /* closing window */
+    aggregate->output_entries[2] = AGGREGATION_COUNTS_SIZE + output_size; /* pending window */
+    aggregate->output_entries[3] = AGGREGATION_COUNTS_SIZE + output_size * 2; /* complete window */
+    aggregate->output_entries[4] = AGGREGATION_COUNTS_SIZE + output_size * 3; /* opening window */
+
+    if (aggregate->window_pointers) {
+        cpu_window_pointers_free(aggregate->window_pointers);
+    }
+    aggregate->window_pointers = cpu_window_pointers(PARTIAL_WINDOWS);
+}
+
+void aggregation_cpu_process(void * aggregate_ptr, batch_p batch, window_p window, u_int8_t ** processed_outputs, query_event_p event) {
+    aggregation_p aggregate = (aggregation_p) aggregate_ptr;
+    static int warned = 0;
+
+    /* Refer to aggregation_adapt, the host backend only sizes its tables from the estimate */
+    if (aggregate->strategy != AGGREGATION_DIRECT
+        && (__atomic_add_fetch(&aggregate->batch_count, 1, __ATOMIC_RELAXED) - 1) % AGGREGATION_SAMPLE_INTERVAL == 0) {
+        aggregation_size_tables(aggregate, 
+            aggregation_estimate_groups(aggregate, batch->buffer + batch->start, batch->size), 0);
+    }
+    int table_size = __atomic_load_n(&aggregate->table_size, __ATOMIC_RELAXED);
+
+    aggregation_args_t args;
+    {
+        args.aggregate = aggregate;
+
+        args.input = batch->buffer + batch->start;
+        args.tuple_size = aggregate->input_schema->size;
+        args.bytes = batch->size * args.tuple_size;
+
+        args.group_offset = schema_get_attr_offset(aggregate->input_schema, aggregate->groups[0]);
+        for (int i=0; i<aggregate->ref_num; i++) {
+            args.attr_offsets[i] = schema_get_attr_offset(aggregate->input_schema, aggregate->refs[i]);
+            args.attr_types[i] = aggregate->input_schema->attr[aggregate->refs[i]];
+        }
+
+        set_table_layout(aggregate, &args, table_size);
+
+        args.tuples = batch->size;
+        args.flags = aggregate->cpu_flags;
+    }
+
+    scratch_init(args.table_capacity);
+
+    /* Same as aggregation_process */
+    long previous_pane_id = batch->previous_pane_id;
+    long start_pointer = batch->start_pointer;
+
+    int num_windows = cpu_window_compute(aggregate->window_pointers,
+        args.input, batch->size, args.tuple_size, window, previous_pane_id, start_pointer);
+
+    /* countWindowsKernel, and assign each window a table in the region of its kind */
+    int * window_counts = (int *) processed_outputs[0];
+    memset(window_counts, 0, AGGREGATION_COUNTS_SIZE);
+    window_counts[4] = table_size;
+
+    int region_size = aggregate->batch_size * aggregate->output_schema->size;
+    int region_tables = region_size / table_size;
+
+    window_task_t * tasks = (window_task_t *) malloc((num_windows + 1) * sizeof(window_task_t));
+    if (! tasks) {
+        fprintf(stderr, "fatal error: out of memory\n");
+        exit(1);
+    }
+    args.task_num = 0;
+    args.tasks = tasks;
+    args.total = 0;
+    for (int wid=0; wid<=num_windows; wid++) {
+        int start, end;
+        enum window_kinds kind =
+            cpu_window_classify(aggregate->window_pointers, wid, args.bytes, &start, &end);
+        int slot = window_counts[kind]++;
+
+        /* The pending window is computed once */
+        if (kind == WINDOW_PENDING && slot > 0) {
+            continue;
+        }
+        /* Aggregated by aggregation_recover_output instead */
+        if (slot >= region_tables) {
+            continue;
+        }
+
+        window_task_t * task = &tasks[args.task_num++];
+        task->wid = wid;
+        task->start = start;
+        task->end = end;
+        task->first = args.total;
+        task->done = 0;
+        task->table = processed_outputs[1 + kind] + (long) slot * table_size;
+
+        args.total += (end - start) / args.tuple_size;
+    }
+
+    /* Overlapping windows are assembled from panes, so that a tuple is not aggregated once per window */
+    args.pane_num = 0;
+    if (window->size > window->slide) {
+        args.pane_num = cpu_window_panes(aggregate->window_pointers,
+            args.input, batch->size, args.tuple_size, window, start_pointer);
+
+        if (aggregate->cpu_pane_capacity < batch->size) {
+            free(aggregate->cpu_panes);
+            free(aggregate->cpu_pane_sizes);
+            aggregate->cpu_panes = malloc(batch->size * sizeof(scratch_entry_t));
+            aggregate->cpu_pane_sizes = (int *) malloc(batch->size * sizeof(int));
+            if (! aggregate->cpu_panes || ! aggregate->cpu_pane_sizes) {
+                fprintf(stderr, "fatal error: out of memory\n");
+                exit(1);
+            }
+            aggregate->cpu_pane_capacity = batch->size;
+        }
+        args.pane_entries = (scratch_entry_t *) aggregate->cpu_panes;
+        args.pane_sizes = aggregate->cpu_pane_sizes;
+    }
+
+    if (aggregate->cpu_select_range) {
+        cpu_execute(filter_kernel, &args);
+    }
+    if (args.pane_num >= cpu_get_thread_num()) {
+        cpu_execute(pane_kernel, &args);
+        cpu_execute(invertible(aggregate) ? slide_windows_kernel : assemble_windows_kernel, &args);
+    } else {
+        cpu_execute(aggregate_kernel, &args);
+        cpu_execute(merge_kernel, &args);
+        cpu_execute(release_kernel, &args);
+    }
+    free(tasks);
+
+    int failed = 0;
+    for (int i=0; i<cpu_get_thread_num(); i++) {
+        failed += scratch[i].failed;
+    }
+    if (failed > 0 && ! warned) {
+        fprintf(stderr, "warning: %d tuples failed to be inserted into full hash tables (%s)\n", failed, __FUNCTION__);
+        warned = 1;
+    }
+    window_counts[5] = failed;
+}
+
+/* Window assembly (refer to operator.h): a partial is an output table, whichever backend wrote it */
+
+int aggregation_get_partial_size(void * aggregate_ptr) {
+    return HASH_TABLE_SIZE;
+}
+
+u_int8_t * aggregation_get_fragment(void * aggregate_ptr, batch_p output, enum window_kinds kind, int index, int * size) {
+    aggregation_p aggregate = (aggregation_p) aggregate_ptr;
+
+    /* The pending windows share the table of the first */
+    if (kind == WINDOW_PENDING) {
+        index = 0;
+    }
+
+    /* The output starts after the window counts, refer to aggregation_process_output */
+    u_int8_t * regions = output->buffer + output->start - aggregate->output_entries[1];
+    int table_size = ((int const *) regions)[4];
+
+    if (output == aggregate->recovered_output) {
+        for (int i=0; i<aggregate->recovered_num; i++) {
+            if (aggregate->recovered_windows[2 * i] == kind && aggregate->recovered_windows[2 * i + 1] == index) {
+                *size = HASH_TABLE_SIZE;
+                return aggregate->recovered_tables + (long) i * (HASH_TABLE_SIZE);
+            }
+        }
+    }
+
+    /* A window without a table in its region was dropped (refer to aggregation_cpu_process) */
+    int region_tables = aggregate->batch_size * aggregate->output_schema->size / table_size;
+    if (index >= region_tables) {
+        return NULL;
+    }
+
+    *size = table_size;
+    return regions + aggregate->output_entries[1 + kind] + (long) index * table_size;
+}
+
+void aggregation_init_partial(void * aggregate_ptr, u_int8_t * partial) {
+    aggregation_args_t args;
+    set_table_layout((aggregation_p) aggregate_ptr, &args, HASH_TABLE_SIZE);
+
+    clear_output(&args, partial);
+}
+
+void aggregation_merge_partial(void * aggregate_ptr, u_int8_t * partial, u_int8_t const * fragment, int size) {
+    aggregation_p aggregate = (aggregation_p) aggregate_ptr;
+    static int warned = 0;
+
+    aggregation_args_t args;
+    set_table_layout(aggregate, &args, HASH_TABLE_SIZE);
+
+    /* Merged by key, as the GPU kernels may have placed the groups of the fragment differently */
+    for (int e=0; e<size / args.entry_size; e++) {
+        u_int8_t const * entry = fragment + (long) e * args.entry_size;
+
+        scratch_entry_t other;
+        other.mark = *((int const *) (entry + ENTRY_MARK_OFFSET));
+        if (other.mark == -1) {
+            continue;
+        }
+        other.t = *((long const *) (entry + ENTRY_TIME_OFFSET));
+        other.key = 0;
+        memcpy(&other.key, entry + ENTRY_KEY_OFFSET, aggregate->key_length);
+        memcpy(other.values, entry + args.value_offset, aggregate->ref_num * sizeof(float));
+        other.count = *((int const *) (entry + args.count_offset));
+
+        if (! flushf(&args, partial, &other) && ! warned) {
+            fprintf(stderr, "warning: a window has more groups than a hash table holds (%s)\n", __FUNCTION__);
+            warned = 1;
+        }
+    }
+}
+
+int aggregation_write_window(void * aggregate_ptr, u_int8_t const * partial, int size, u_int8_t * output) {
+    aggregation_p aggregate = (aggregation_p) aggregate_ptr;
+    schema_p schema = aggregate->output_schema;
+
+    aggregation_args_t args;
+    set_table_layout(aggregate, &args, size);
+
+    int key_offset = schema_get_attr_offset(schema, 1 + aggregate->ref_num);
+
+    /* Every group is an output tuple: timestamp, aggregates and group-by attributes */
+    int bytes = 0;
+    for (int e=0; e<args.table_capacity; e++) {
+        u_int8_t const * entry = partial + (long) e * args.entry_size;
+        if (*((int const *) (entry + ENTRY_MARK_OFFSET)) == -1) {
+            continue;
+        }
+        u_int8_t * q = output + bytes;
+
+        int count = *((int const *) (entry + args.count_offset));
+        float const * values = (float const *) (entry + args.value_offset);
+
+        memcpy(q, entry + ENTRY_TIME_OFFSET, sizeof(long));
+        for (int i=0; i<aggregate->ref_num; i++) {
+            float value = values[i];
+            if (aggregate->expressions[i] == AVG && count > 0) {
+                value = value / (float) count;
+            }
+            memcpy(q + schema_get_attr_offset(schema, 1 + i), &value, sizeof(float));
+        }
+        memcpy(q + key_offset, entry + ENTRY_KEY_OFFSET, aggregate->key_length);
+
+        bytes += schema->size;
+    }
+
+    return bytes;
+}
+
+/* A tuple only fails to be inserted into a full table, or into the full part after the key slots of AGGREGATION_DIRECT */
+static int table_full(aggregation_args_t const * args, u_int8_t const * table, int capacity) {
+    aggregation_p aggregate = args->aggregate;
+
+    int first = 0;
+    if (aggregate->strategy == AGGREGATION_DIRECT) {
+        first = (int) (aggregate->key_max - aggregate->key_min + 1);
+    }
+
+    for (int e=first; e<capacity; e++) {
+        if (*((int const *) (table + (long) e * args->entry_size + ENTRY_MARK_OFFSET)) == -1) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* A table of HASH_TABLE_SIZE for window index of the given kind */
+static u_int8_t * recover_table(aggregation_p aggregate, enum window_kinds kind, int index) {
+    if (aggregate->recovered_num == aggregate->recovered_capacity) {
+        int capacity = (aggregate->recovered_capacity > 0) ? 2 * aggregate->recovered_capacity : 4;
+
+        aggregate->recovered_windows = (int *) realloc(aggregate->recovered_windows, 2 * capacity * sizeof(int));
+        aggregate->recovered_tables = (u_int8_t *) realloc(aggregate->recovered_tables, (long) capacity * (HASH_TABLE_SIZE));
+        if (! aggregate->recovered_windows || ! aggregate->recovered_tables) {
+            fprintf(stderr, "fatal error: out of memory\n");
+            exit(1);
+        }
+        aggregate->recovered_capacity = capacity;
+    }
+
+    int i = aggregate->recovered_num++;
+    aggregate->recovered_windows[2 * i] = kind;
+    aggregate->recovered_windows[2 * i + 1] = index;
+
+    return aggregate->recovered_tables + (long) i * (HASH_TABLE_SIZE);
+}
+
+/**
+ * The kernels count the tuples that did not fit in their tables. The windows whose tables are full, and
+ * the windows that had no table left in their region, are aggregated again on this thread, into tables of 
+ * HASH_TABLE_SIZE that get_fragment returns instead, and the tables of the next batches are made larger. It
+ * keeps its own window pointers and flags, as the host backend may be processing another batch meanwhile.
+ **/
+void aggregation_recover_output(void * aggregate_ptr, batch_p input, batch_p output) {
+    aggregation_p aggregate = (aggregation_p) aggregate_ptr;
+    static int warned = 0;
+
+    aggregate->recovered_output = output;
+    aggregate->recovered_num = 0;
+
+    u_int8_t const * regions = output->buffer + output->start - aggregate->output_entries[1];
+    int const * window_counts = (int const *) regions;
+    int table_size = window_counts[4];
+    int failed = window_counts[5];
+
+    int region_tables = aggregate->batch_size * aggregate->output_schema->size / table_size;
+    bool spilled = window_counts[WINDOW_CLOSING] > region_tables || window_counts[WINDOW_COMPLETE] > region_tables
+        || window_counts[WINDOW_OPENING] > region_tables;
+    if (failed == 0 && ! spilled) {
+        return;
+    }
+
+    if (failed > 0) {
+        aggregation_size_tables(aggregate, 0, table_size);
+    }
+
+    aggregation_args_t args;
+    {
+        args.input = input->buffer + input->start;
+        args.tuple_size = aggregate->input_schema->size;
+        args.bytes = input->size * args.tuple_size;
+
+        args.group_offset = schema_get_attr_offset(aggregate->input_schema, aggregate->groups[0]);
+        for (int i=0; i<aggregate->ref_num; i++) {
+            args.attr_offsets[i] = schema_get_attr_offset(aggregate->input_schema, aggregate->refs[i]);
+            args.attr_types[i] = aggregate->input_schema->attr[aggregate->refs[i]];
+        }
+
+        set_table_layout(aggregate, &args, HASH_TABLE_SIZE);
+    }
+    int fragment_capacity = table_size / args.entry_size;
+
+    /* Already as large as a table gets, or the tuples cannot be read back */
+    if ((fragment_capacity >= args.table_capacity && ! spilled) || ! aggregate->window
+        || (aggregate->key_length != 4 && aggregate->key_length != 8)
+        || (aggregate->patch && ! aggregate->cpu_select_range && ! compile_selection(aggregate, aggregate->patch))) {
+        if (! warned) {
+            fprintf(stderr, "warning: %d tuples and the windows without a table in a batch are lost (%s)\n", failed, __FUNCTION__);
+            warned = 1;
+        }
+        return;
+    }
+
+    if (aggregate->cpu_select_range) {
+        if (! aggregate->recover_flags) {
+            aggregate->recover_flags = (int *) malloc(aggregate->batch_size * sizeof(int));
+            if (! aggregate->recover_flags) {
+                fprintf(stderr, "fatal error: out of memory\n");
+                exit(1);
+            }
+        }
+        (* aggregate->cpu_select_range) (args.input, 0, input->size, aggregate->recover_flags);
+    }
+    if (! aggregate->recover_pointers) {
+        aggregate->recover_pointers = cpu_window_pointers(PARTIAL_WINDOWS);
+    }
+
+    int num_windows = cpu_window_compute(aggregate->recover_pointers,
+        args.input, input->size, args.tuple_size, aggregate->window, input->previous_pane_id, input->start_pointer);
+
+    /* Refer to aggregation_cpu_process */
+    int counts [4] = {0, 0, 0, 0};
+    int lost = 0;
+    for (int wid=0; wid<=num_windows; wid++) {
+        int start, end;
+        enum window_kinds kind =
+            cpu_window_classify(aggregate->recover_pointers, wid, args.bytes, &start, &end);
+        int slot = counts[kind]++;
+
+        if (kind == WINDOW_PENDING && slot > 0) {
+            continue;
+        }
+
+        if (slot < region_tables) {
+            u_int8_t const * fragment = regions + aggregate->output_entries[1 + kind] + (long) slot * table_size;
+            if (failed == 0 || fragment_capacity >= args.table_capacity || ! table_full(&args, fragment, fragment_capacity)) {
+                continue;
+            }
+        }
+
+        u_int8_t * table = recover_table(aggregate, kind, slot);
+        clear_output(&args, table);
+
+        for (int idx = start; idx < end; idx += args.tuple_size) {
+            if (aggregate->cpu_select_range && ! aggregate->recover_flags[idx / args.tuple_size]) {
+                continue;
+            }
+
+            scratch_entry_t entry;
+            storef(&args, &entry, read_key(&args, args.input + idx), args.input + idx, idx);
+            if (! flushf(&args, table, &entry)) {
+                lost += 1;
+            }
+        }
+    }
+
+    if (lost > 0 && ! warned) {
+        fprintf(stderr, "warning: %d tuples did not fit in the hash tables of a batch (%s)\n", lost, __FUNCTION__);
+        warned = 1;
+    }
+}
@@ -0,0 +1,500 @@
+#include "join.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libgpu/gpu_agg.h"
+
+#include "config.h"
+#include "generators.h"
+#include "helpers.h"
+
+static int free_id = 0;
+
+int join_get_output_schema_size(void * join_ptr) {
+    join_p join = (join_p) join_ptr;
+
+    return join->output_schema->size;
+}
+
+/* The result counts of the groups and the results */
+long join_get_output_size(void * join_ptr) {
+    join_p join = (join_p) join_ptr;
+
+    return join->output_entries[1] + (long) join->capacity * join->output_schema->size;
+}
+
+static void set_output_schema(join_p p) {
+    p->output_schema = schema();
+
+    for (int i=0; i<p->input_schema->attr_num; i++) {
+        schema_add_attr (p->output_schema, p->input_schema->attr[i]);
+    }
+    for (int i=0; i<p->build_schema->attr_num; i++) {
+        schema_add_attr (p->output_schema, p->build_schema->attr[i]);
+    }
+    p->output_attr_num = p->output_schema->attr_num;
+
+    while (schema_get_pad(p->output_schema, 16) > 0) {
+        schema_add_attr (p->output_schema, TYPE_INT);
+    }
+}
+
+static void check_key(schema_p schema, int key) {
+    if (key < 0 || key >= schema->attr_num) {
+        fprintf(stderr, "error: join key %d is out of the schema (%s)\n", key, __FUNCTION__);
+        exit(1);
+    }
+    if (schema->attr[key] == TYPE_FLOAT) {
+        fprintf(stderr, "error: join key %d should be an integer attribute (%s)\n", key, __FUNCTION__);
+        exit(1);
+    }
+}
+
+join_p join(schema_p input_schema, int input_key, schema_p build_schema, int build_key, int build_capacity) {
+
+    join_p p = (join_p) malloc(sizeof(join_t));
+    p->operator = (operator_p) malloc(sizeof (operator_t));
+    {
+        p->operator->setup = join_setup;
+        p->operator->process = join_process;
+        p->operator->process_output = join_process_output;
+        p->operator->reset = join_reset;
+        p->operator->generate_patch = join_generate_patch;
+        p->operator->get_output_schema_size = join_get_output_schema_size;
+        p->operator->get_output_buffer = join_get_output_buffer;
+        p->operator->get_output_size = join_get_output_size;
+        p->operator->set_input_schema = join_set_input_schema;
+        p->operator->cpu_setup = join_cpu_setup;
+        p->operator->cpu_process = join_cpu_process;
+
+        /* No windows to assemble */
+        p->operator->get_partial_size = NULL;
+        p->operator->get_fragment = NULL;
+        p->operator->init_partial = NULL;
+        p->operator->merge_partial = NULL;
+        p->operator->write_window = NULL;
+        p->operator->recover_output = NULL;
+        p->operator->clone = NULL;
+
+        p->operator->type = OPERATOR_JOIN;
+
+        strcpy(p->operator->code_name, JOIN_CODE_FILENAME);
+    }
+
+    p->id = free_id++;
+    p->qid = -1;
+
+    check_key(input_schema, input_key);
+    check_key(build_schema, build_key);
+
+    p->input_schema = input_schema;
+    p->input_key = input_key;
+
+    p->build_schema = build_schema;
+    p->build_key = build_key;
+    p->build_tuple_size = build_schema->size + schema_get_pad(build_schema, 16);
+
+    if (input_schema->attr_num + build_schema->attr_num + 3 > MAX_ATTR_NUM) {
+        fprintf(stderr, "error: the joined tuples have more than %d attributes (%s)\n", MAX_ATTR_NUM, __FUNCTION__);
+        exit(1);
+    }
+    set_output_schema(p);
+
+    pthread_mutex_init(&p->build_lock, NULL);
+    p->build_capacity = build_capacity;
+    p->build_num = 0;
+    p->dropped = 0;
+    p->build_tuples = (u_int8_t *) malloc((long) build_capacity * p->build_tuple_size);
+    for (int i=0; i<JOIN_STAGING_BUFFERS; i++) {
+        p->staging[i] = (u_int8_t *) malloc((long) build_capacity * p->build_tuple_size);
+        if (! p->staging[i]) {
+            fprintf(stderr, "fatal error: out of memory\n");
+            exit(1);
+        }
+    }
+    p->staging_next = 0;
+
+    /* At most half full */
+    p->table_size = 1;
+    while (p->table_size < 2 * build_capacity) {
+        p->table_size *= 2;
+    }
+
+    p->results_per_tuple = JOIN_RESULTS_PER_TUPLE;
+
+    p->cpu_heads = NULL;
+    p->cpu_next = NULL;
+    p->cpu_library = NULL;
+    p->cpu_select_range = NULL;
+    p->cpu_flags = NULL;
+
+    return p;
+}
+
+void join_set_results(join_p join, int results_per_tuple) {
+    if (results_per_tuple < 1) {
+        fprintf(stderr, "error: a join output holds at least a result per tuple (%s)\n", __FUNCTION__);
+        exit(1);
+    }
+    join->results_per_tuple = results_per_tuple;
+}
+
+void join_insert(join_p join, batch_p build) {
+    int tuple_size = join->build_schema->size;
+    int n = build->size;
+    u_int8_t const * tuples = build->buffer + build->start;
+
+    /* Only the latest build_capacity tuples of a batch can be kept */
+    if (n > join->build_capacity) {
+        tuples += (long) (n - join->build_capacity) * tuple_size;
+        join->dropped += n - join->build_capacity;
+        n = join->build_capacity;
+    }
+
+    pthread_mutex_lock(&join->build_lock);
+
+    /* A full window pushes out its oldest tuples */
+    int overflow = join->build_num + n - join->build_capacity;
+    if (overflow > 0) {
+        memmove(join->build_tuples, join->build_tuples + (long) overflow * join->build_tuple_size,
+            (long) (join->build_num - overflow) * join->build_tuple_size);
+        join->build_num -= overflow;
+        join->dropped += overflow;
+    }
+
+    u_int8_t * out = join->build_tuples + (long) join->build_num * join->build_tuple_size;
+    for (int i=0; i<n; i++) {
+        memcpy(out, tuples + (long) i * tuple_size, tuple_size);
+        memset(out + tuple_size, 0, join->build_tuple_size - tuple_size);
+        out += join->build_tuple_size;
+    }
+    join->build_num += n;
+
+    pthread_mutex_unlock(&join->build_lock);
+}
+
+u_int8_t * join_stage(join_p join, batch_p input, int * build_num) {
+    /* The probe stream is in time order, so nothing older than the window of its first tuple is needed */
+    long bound = batch_get_first_tuple_timestamp64(input, input->start) - join->window_size;
+
+    pthread_mutex_lock(&join->build_lock);
+
+    int kept = 0;
+    for (int i=0; i<join->build_num; i++) {
+        u_int8_t * tuple = join->build_tuples + (long) i * join->build_tuple_size;
+        if (*((long *) tuple) > bound) {
+            if (kept != i) {
+                memcpy(join->build_tuples + (long) kept * join->build_tuple_size, tuple, join->build_tuple_size);
+            }
+            kept++;
+        }
+    }
+    join->build_num = kept;
+
+    u_int8_t * staging = join->staging[join->staging_next];
+    join->staging_next = (join->staging_next + 1) % JOIN_STAGING_BUFFERS;
+
+    memcpy(staging, join->build_tuples, (long) kept * join->build_tuple_size);
+    *build_num = kept;
+
+    pthread_mutex_unlock(&join->build_lock);
+
+    return staging;
+}
+
+void join_set_input_schema(void * join_ptr, schema_p input_schema) {
+    join_p join = (join_p) join_ptr;
+
+    join->input_schema = input_schema;
+}
+
+void join_generate_patch(void * join_ptr, char * patch) {
+    fprintf(stderr, "error: a join can only be the last operator of a fused query (%s)\n", __FUNCTION__);
+    exit(1);
+}
+
+/* e.g. "inline long probe_keyf (__global input_t *in) { return in->tuple._3; }" */
+static void generate_keyf(char const * name, char const * type, int key, char * ret) {
+    char s [MAX_LINE_LENGTH] = "";
+
+    _sprintf("inline long %s (__global %s *in) {\n", name, type);
+    if (key == 0) {
+        _sprint("    return in->tuple.t;\n");
+    } else {
+        _sprintf("    return (long) in->tuple._%d;\n", key);
+    }
+    _sprint("}\n\n");
+}
+
+/* The fused upstream selection, or every probe tuple */
+static char * generate_selectf(char const * patch) {
+    char * ret = (char *) malloc(((patch ? strlen(patch) : 0) + 128) * sizeof(char)); *ret = '\0';
+    char s [MAX_LINE_LENGTH] = "";
+
+    _sprint("inline int selectf (__global input_t *in) {\n");
+    _sprint("    int flag = 1;\n\n");
+    if (patch) {
+        strcat(ret, patch);
+    }
+    _sprint("    return flag;\n");
+    _sprint("}\n\n");
+    if (patch) {
+        strcat(ret, PATCH_EPILOGUE);
+    }
+
+    return ret;
+}
+
+static char * generate_joinf(join_p join) {
+    char * ret = (char *) malloc(2048 * sizeof(char)); *ret = '\0';
+    char s [MAX_LINE_LENGTH] = "";
+
+    int left_num = join->input_schema->attr_num;
+
+    _sprint("inline void joinf (__global output_t *out, __global input_t *p, __global build_input_t *r) {\n");
+    _sprint("    out->tuple.t = p->tuple.t;\n");
+    for (int i = 1; i < left_num; i++) {
+        _sprintf("    out->tuple._%d = p->tuple._%d;\n", i, i);
+    }
+    _sprintf("    out->tuple._%d = r->tuple.t;\n", left_num);
+    for (int i = 1; i < join->build_schema->attr_num; i++) {
+        _sprintf("    out->tuple._%d = r->tuple._%d;\n", left_num + i, i);
+    }
+    /* Padding attributes */
+    for (int i = join->output_attr_num; i < join->output_schema->attr_num; i++) {
+        _sprintf("    out->tuple._%d = 0;\n", i);
+    }
+    _sprint("}\n\n");
+
+    return ret;
+}
+
+/* Tuple structs and the inline functions the template calls */
+static char * generate_functions(join_p join, char const * patch) {
+    int vector = 16;
+
+    char * ret = (char *) malloc(MAX_SOURCE_LENGTH * sizeof(char)); *ret = '\0';
+    char s [MAX_LINE_LENGTH] = "";
+
+    char * tuple_size = generate_tuple_size(join->input_schema, join->output_schema, vector);
+    strcat(ret, tuple_size);
+    _sprintf("#define BUILD_INPUT_VECTOR_SIZE %d\n\n", join->build_tuple_size / vector);
+
+    char * input_tuple = generate_input_tuple(join->input_schema, NULL, vector);
+    char * build_tuple = generate_input_tuple(join->build_schema, "build", vector);
+    char * output_tuple = generate_output_tuple(join->output_schema, NULL, vector);
+    strcat(ret, input_tuple);
+    strcat(ret, build_tuple);
+    strcat(ret, output_tuple);
+
+    generate_keyf("probe_keyf", "input_t", join->input_key, ret);
+    generate_keyf("build_keyf", "build_input_t", join->build_key, ret);
+
+    char * selectf = generate_selectf(patch);
+    char * joinf = generate_joinf(join);
+    strcat(ret, selectf);
+    strcat(ret, joinf);
+
+    free(tuple_size);
+    free(input_tuple);
+    free(build_tuple);
+    free(output_tuple);
+    free(selectf);
+    free(joinf);
+
+    return ret;
+}
+
+static char * generate_source(join_p join, char const * patch) {
+    char * source = (char *) malloc(MAX_SOURCE_LENGTH * sizeof(char)); *source = '\0';
+
+    char * extensions = read_file("cl/templates/extensions.cl");
+    char * headers = read_file("cl/templates/headers.cl");
+    char * functions = generate_functions(join, patch);
+    char * template = read_file(JOIN_CODE_TEMPLATE);
+
+    strcat(source, extensions);
+    strcat(source, headers);
+    strcat(source, functions);
+    strcat(source, template);
+
+    free(extensions);
+    free(headers);
+    free(functions);
+    free(template);
+
+    return source;
+}
+
+char * join_generate_c_source(join_p join, char const * patch) {
+    int vector = 16;
+
+    char * source = (char *) malloc(MAX_SOURCE_LENGTH * sizeof(char)); *source = '\0';
+
+    char * headers = generate_c_headers();
+    char * tuple_size = generate_tuple_size(join->input_schema, join->output_schema, vector);
+    char * input_tuple = generate_input_tuple(join->input_schema, NULL, vector);
+    char * selectf = generate_selectf(patch);
+    char * select_range = generate_c_select_range();
+
+    strcat(source, headers);
+    strcat(source, tuple_size);
+    strcat(source, input_tuple);
+    strcat(source, selectf);
+    strcat(source, select_range);
+
+    free(headers);
+    free(tuple_size);
+    free(input_tuple);
+    free(selectf);
+    free(select_range);
+
+    return source;
+}
+
+void join_reset(void * join_ptr, int new_batch_size) {
+    join_p join = (join_p) join_ptr;
+
+    join->batch_size = new_batch_size;
+    join->capacity = join->results_per_tuple * new_batch_size;
+
+    /* clearKernel: one thread per bucket, buildKernel: one per build tuple, rounded up to full groups */
+    join->threads[0] = join->table_size;
+    join->threads[1] = join->build_capacity;
+    join->threads[2] = new_batch_size / JOIN_TUPLES_PER_THREADS;
+    join->threads[3] = new_batch_size / JOIN_TUPLES_PER_THREADS;
+
+    for (int i=0; i<JOIN_KERNEL_NUM; i++) {
+        if (join->threads[i] < MAX_THREADS_PER_GROUP) {
+            join->threads_per_group[i] = join->threads[i];
+        } else {
+            join->threads_per_group[i] = MAX_THREADS_PER_GROUP;
+            join->threads[i] = (join->threads[i] + MAX_THREADS_PER_GROUP - 1) / MAX_THREADS_PER_GROUP * MAX_THREADS_PER_GROUP;
+        }
+    }
+
+    /* The results every group has, then the results */
+    int work_group_num = join->threads[2] / join->threads_per_group[2];
+    join->output_entries[0] = 0;
+    join->output_entries[1] = 4 * work_group_num;
+}
+
+void join_setup(void * join_ptr, int batch_size, window_p window, char const * patch) {
+    join_p join = (join_p) join_ptr;
+
+    if (window->type != RANGE_BASE) {
+        fprintf(stderr, "error: a join needs a range based window (%s)\n", __FUNCTION__);
+        exit(1);
+    }
+    join->window_size = window->size;
+
+    int tuple_size = join->input_schema->size;
+    int out_tuple_size = join->output_schema->size;
+
+    /* Operator setup */
+    join_reset(join, batch_size);
+    int work_group_num = join->threads[2] / join->threads_per_group[2];
+
+    /* Source generation */
+    char * source = generate_source(join, (patch && *patch) ? patch : NULL);
+
+#ifdef OPMERGER_DEBUG
+    /* Output generated code */
+    char * filename = generate_filename(join->id, JOIN_CODE_FILENAME);
+    printf("[JOIN] Printing the generated source code to file: %s\n", filename);
+    print_to_file(filename, source);
+    free(filename);
+#endif
+
+    /* Build opencl program */
+    int qid = gpu_get_query(source, JOIN_KERNEL_NUM, 2, 5);
+    join->qid = qid;
+
+    /* GPU inputs and outputs setup */
+    gpu_set_input(qid, 0, batch_size * tuple_size);
+    gpu_set_input(qid, 1, join->build_capacity * join->build_tuple_size);
+
+    gpu_set_output (qid, 0, 4 * join->table_size,              0, 1, 0, 0, 1); /*      Heads */
+    gpu_set_output (qid, 1, 4 * join->build_capacity,          0, 1, 0, 0, 1); /*      Links */
+    gpu_set_output (qid, 2, 4 * batch_size,                    0, 1, 0, 0, 1); /*    Offsets */
+    gpu_set_output (qid, 3, 4 * work_group_num,                0, 0, 0, 0, 1); /* Partitions */
+    gpu_set_output (qid, 4, join->capacity * out_tuple_size,   1, 0, 0, 1, 0); /*    Results */
+
+    /* GPU kernels setup */
+    int args1[5];
+    args1[0] = batch_size;
+    args1[1] = join->table_size;
+    args1[2] = join->capacity;
+    args1[3] = (int) join->window_size;
+    args1[4] = 4 * join->threads_per_group[2] * JOIN_TUPLES_PER_THREADS;
+
+    long args2[1];
+    args2[0] = 0; /* Build tuples */
+
+    gpu_set_kernel_join(qid, args1, args2);
+
+    free(source);
+}
+
+void join_process(void * join_ptr, batch_p input, window_p window, u_int8_t ** processed_output, query_event_p event) {
+    join_p join = (join_p) join_ptr;
+
+    int build_num;
+    u_int8_t * build = join_stage(join, input, &build_num);
+
+    /* Set input buffer addresses and entries */
+    u_int8_t * inputs [2] = {input->buffer + input->start, build};
+
+    long args2[1];
+    args2[0] = build_num;
+
+    /* Execute */
+    gpu_execute_join(join->qid,
+        join->threads, join->threads_per_group,
+        args2,
+        (void *) inputs, (void **) processed_output, sizeof(u_int8_t),
+        event);
+}
+
+u_int8_t ** join_get_output_buffer(void * join_ptr, batch_p output) {
+    join_p join = (join_p) join_ptr;
+
+    u_int8_t ** outputs = (u_int8_t **) malloc(2 * sizeof(u_int8_t *));
+
+    /* Validate whether the given output buffer is big enough */
+    if ((output->end - output->start) < join_get_output_size(join)) {
+        fprintf(stderr, "error: Expected output size has exceeded the given output buffer size (%s)\n", __FUNCTION__);
+        exit(1);
+    }
+
+    for (int i=0; i<2; i++) {
+        outputs[i] = output->buffer + output->start + join->output_entries[i];
+    }
+
+    return outputs;
+}
+
+void join_process_output(void * join_ptr, batch_p outputs) {
+    join_p join = (join_p) join_ptr;
+
+    int work_group_num = join->threads[2] / join->threads_per_group[2];
+
+    /* Calculate output tuples */
+    int * partitions = (int *) (outputs->buffer + outputs->start + join->output_entries[0]);
+    int count = 0;
+    for (int i=0; i<work_group_num; i++) {
+        count += partitions[i];
+    }
+
+    /* The results after the capacity were not written */
+    if (count > join->capacity) {
+        fprintf(stderr, "error: %d join results do not fit in the output of %d, refer to join_set_results (%s)\n",
+            count, join->capacity, __FUNCTION__);
+        exit(1);
+    }
+
+    outputs->start += join->output_entries[1];
+    outputs->size = count;
+    outputs->tuple_size = join->output_schema->size;
+}
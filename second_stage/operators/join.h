@@ -0,0 +1,121 @@
+#ifndef JOIN_H
+#define JOIN_H
+
+#include <pthread.h>
+
+#include "batch.h"
+#include "schema.h"
+#include "operator.h"
+
+#define JOIN_KERNEL_NUM 4
+#define JOIN_TUPLES_PER_THREADS 2
+#define JOIN_RESULTS_PER_TUPLE 1 /* Results an output can hold per probe tuple, unless set with join_set_results */
+#define JOIN_STAGING_BUFFERS 4 /* More than the batches in flight in the GPU pipeline */
+#define JOIN_CODE_FILENAME "cl/join"
+#define JOIN_CODE_TEMPLATE "cl/templates/join_template.cl"
+
+/**
+ * A windowed equi-join of the stream of the query (the probe side) with a second stream (the build
+ * side), which is inserted with join_insert. A probe tuple with timestamp t joins the build tuples
+ * with the same key and a timestamp in (t - window size, t], so the build stream is expected to run
+ * ahead of the probe stream, e.g. the machine events the task events happen on.
+ *
+ * Every batch builds a hash table over the build window and probes it with the batch. The window
+ * slides with the probe stream: the build tuples too old for the first tuple of a batch are evicted.
+ **/
+typedef struct join * join_p;
+typedef struct join {
+    operator_p operator; /* As a parent class */
+
+    int id; /* Refer to selection.h */
+    int qid;
+
+    int batch_size;
+    schema_p input_schema; /* Probe side */
+    int input_key;
+
+    schema_p build_schema;
+    int build_key;
+    int build_tuple_size; /* Padded to 16 bytes as the generated build_input_t */
+
+    long window_size;
+
+    /**
+     * The attributes of the probe tuple followed by the ones of the build tuple, which starts with
+     * its timestamp. It is padded with unused int attributes to a multiple of 16 bytes
+     **/
+    schema_p output_schema;
+    int output_attr_num;
+
+    /* Build window, in insertion order */
+    pthread_mutex_t build_lock;
+    u_int8_t * build_tuples;
+    int build_num;
+    int build_capacity;
+    long dropped; /* Build tuples pushed out of a full window before their time */
+
+    /* The copy of the build window a batch reads, which the GPU may still be transferring after process */
+    u_int8_t * staging [JOIN_STAGING_BUFFERS];
+    int staging_next;
+
+    int table_size; /* A power of two */
+    int results_per_tuple;
+    int capacity; /* Results an output can hold */
+
+    long output_entries[2];
+
+    size_t threads[JOIN_KERNEL_NUM];
+    size_t threads_per_group [JOIN_KERNEL_NUM];
+
+    /* Host backend: the hash table, and a fused upstream selection compiled from the generated C source */
+    int * cpu_heads;
+    int * cpu_next;
+    void * cpu_library;
+    int (* cpu_select_range) (u_int8_t const * input, int from, int to, int * flags);
+    int * cpu_flags;
+
+} join_t;
+
+/* Refer to selection.h for explainations of following member methods */
+
+/* build_capacity is the maximum number of build tuples in a window */
+join_p join(schema_p input_schema, int input_key, schema_p build_schema, int build_key, int build_capacity);
+
+/**
+ * The results an output holds per probe tuple, which is the most build tuples a probe tuple matches in a
+ * batch on average. It is set before the query is set up, and a batch with more results fails
+ **/
+void join_set_results(join_p join, int results_per_tuple);
+
+/* Appends a batch of the build stream to the build window */
+void join_insert(join_p join, batch_p build);
+
+/**
+ * Evicts the build tuples too old for the batch and copies the window to the next staging buffer, 
+ * which is returned with the number of tuples in it
+ **/
+u_int8_t * join_stage(join_p join, batch_p input, int * build_num);
+
+/* The join is last in a fused query, so the patch is a selection of the probe tuples */
+void join_setup(void * join_ptr, int batch_size, window_p window, char const * patch);
+
+void join_reset(void * join_ptr, int new_batch_size);
+
+void join_process(void * join_ptr, batch_p batch, window_p window, u_int8_t ** processed_output, query_event_p event);
+
+u_int8_t ** join_get_output_buffer(void * join_ptr, batch_p output);
+
+void join_process_output(void * join_ptr, batch_p outputs);
+
+void join_generate_patch(void * join_ptr, char * patch);
+
+void join_set_input_schema(void * join_ptr, schema_p input_schema);
+
+/* Host backend (join_cpu.c) */
+char * join_generate_c_source(join_p join, char const * patch);
+
+void join_cpu_setup(void * join_ptr, int batch_size, window_p window, char const * patch);
+
+void join_cpu_process(void * join_ptr, batch_p batch, window_p window, u_int8_t ** processed_output, query_event_p event);
+
+#endif
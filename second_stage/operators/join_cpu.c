@@ -0,0 +1,236 @@
+#include "join.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "generators.h"
+#include "libcpu/cpu_agg.h"
+#include "libcpu/cpu_compiler.h"
+
+typedef struct join_args {
+    join_p join;
+
+    u_int8_t const * input;
+    int tuples;
+    int tuple_size;
+
+    u_int8_t const * build;
+    int build_num;
+
+    int * heads;
+    int * next;
+
+    int const * flags; /* Of a fused selection, or NULL */
+
+    int partition_num;
+    int partition_size; /* In tuples */
+
+    int * partitions;
+    int * offsets; /* Exclusive prefix sum of partitions */
+    u_int8_t * results;
+} join_args_t;
+
+/* Same as hashf of the join template */
+static inline int hashf(long key, int table_size) {
+    return (int) ((((unsigned long) key) * 0x9E3779B97F4A7C15UL) >> 32) & (table_size - 1);
+}
+
+static inline long read_key(u_int8_t const * tuple, schema_p schema, int key) {
+    u_int8_t const * attr = tuple + schema_get_attr_offset(schema, key);
+
+    return (schema->attr[key] == TYPE_LONG) ? *((long const *) attr) : (long) *((int const *) attr);
+}
+
+/* Same as probef of the join template */
+static int probef(join_args_t const * args, int i, u_int8_t * output, int offset) {
+    join_p join = args->join;
+
+    if (args->flags && ! args->flags[i]) {
+        return 0;
+    }
+
+    u_int8_t const * p = args->input + (long) i * args->tuple_size;
+    long key = read_key(p, join->input_schema, join->input_key);
+    long t = *((long const *) p);
+
+    int const left_size = join->input_schema->size;
+    int const right_size = join->build_schema->size;
+    int const out_tuple_size = join->output_schema->size;
+
+    int count = 0;
+    for (int j = args->heads[hashf(key, join->table_size)]; j >= 0; j = args->next[j]) {
+        u_int8_t const * r = args->build + (long) j * join->build_tuple_size;
+        long rt = *((long const *) r);
+
+        if (read_key(r, join->build_schema, join->build_key) == key && rt > t - join->window_size && rt <= t) {
+            if (output && offset + count < join->capacity) {
+                u_int8_t * out = output + (long) (offset + count) * out_tuple_size;
+                memcpy(out, p, left_size);
+                memcpy(out + left_size, r, right_size);
+                memset(out + left_size + right_size, 0, out_tuple_size - left_size - right_size);
+            }
+            count++;
+        }
+    }
+    return count;
+}
+
+/* Phase 0 of a fused query: the generated selection flags every tuple of the batch */
+static void filter_kernel(void * args_ptr, int tid, int thread_num) {
+    join_args_t * args = (join_args_t *) args_ptr;
+
+    int from, to;
+    cpu_get_range(args->tuples, tid, thread_num, &from, &to);
+
+    (* args->join->cpu_select_range) (args->input, from, to, (int *) args->flags);
+}
+
+/* clearKernel */
+static void clear_kernel(void * args_ptr, int tid, int thread_num) {
+    join_args_t * args = (join_args_t *) args_ptr;
+    join_p join = args->join;
+
+    int from, to;
+    cpu_get_range(join->table_size, tid, thread_num, &from, &to);
+    for (int h=from; h<to; h++) {
+        args->heads[h] = -1;
+    }
+}
+
+/* buildKernel: the chains are pushed to concurrently, as with atomic_xchg on the device */
+static void build_kernel(void * args_ptr, int tid, int thread_num) {
+    join_args_t * args = (join_args_t *) args_ptr;
+    join_p join = args->join;
+
+    int from, to;
+    cpu_get_range(args->build_num, tid, thread_num, &from, &to);
+    for (int j=from; j<to; j++) {
+        u_int8_t const * r = args->build + (long) j * join->build_tuple_size;
+        int h = hashf(read_key(r, join->build_schema, join->build_key), join->table_size);
+
+        args->next[j] = __atomic_exchange_n(&args->heads[h], j, __ATOMIC_RELAXED);
+    }
+}
+
+/* countKernel: the results of each partition */
+static void count_kernel(void * args_ptr, int tid, int thread_num) {
+    join_args_t * args = (join_args_t *) args_ptr;
+
+    int from, to;
+    cpu_get_range(args->partition_num, tid, thread_num, &from, &to);
+
+    for (int p=from; p<to; p++) {
+        int start = p * args->partition_size;
+        int end = start + args->partition_size;
+
+        int count = 0;
+        for (int i=start; i<end && i<args->tuples; i++) {
+            count += probef(args, i, NULL, 0);
+        }
+        args->partitions[p] = count;
+    }
+}
+
+/* joinKernel: each partition writes its results from its offset */
+static void join_kernel(void * args_ptr, int tid, int thread_num) {
+    join_args_t * args = (join_args_t *) args_ptr;
+
+    int from, to;
+    cpu_get_range(args->partition_num, tid, thread_num, &from, &to);
+
+    for (int p=from; p<to; p++) {
+        int start = p * args->partition_size;
+        int end = start + args->partition_size;
+
+        int offset = args->offsets[p];
+        for (int i=start; i<end && i<args->tuples; i++) {
+            offset += probef(args, i, args->results, offset);
+        }
+    }
+}
+
+void join_cpu_setup(void * join_ptr, int batch_size, window_p window, char const * patch) {
+    join_p join = (join_p) join_ptr;
+
+    if (window->type != RANGE_BASE) {
+        fprintf(stderr, "error: a join needs a range based window (%s)\n", __FUNCTION__);
+        exit(1);
+    }
+    join->window_size = window->size;
+
+    /* A fused query is compiled from the same generated selectf as the GPU kernels */
+    if (patch && *patch) {
+        char * source = join_generate_c_source(join, patch);
+        char * filename = generate_c_filename(join->id, JOIN_CODE_FILENAME);
+
+        join->cpu_library = cpu_compile(source, filename);
+        if (!join->cpu_library) {
+            fprintf(stderr, "error: the host backend needs a C compiler to run fused operators (%s)\n", __FUNCTION__);
+            exit(1);
+        }
+        join->cpu_select_range = cpu_get_function(join->cpu_library, "select_range");
+
+        free(join->cpu_flags);
+        join->cpu_flags = (int *) malloc(batch_size * sizeof(int));
+
+        free(filename);
+        free(source);
+    }
+
+    /* Keep the same partitioning as the GPU kernels so that the output layout is identical */
+    join_reset(join, batch_size);
+
+    free(join->cpu_heads);
+    free(join->cpu_next);
+    join->cpu_heads = (int *) malloc(join->table_size * sizeof(int));
+    join->cpu_next = (int *) malloc(join->build_capacity * sizeof(int));
+    if (! join->cpu_heads || ! join->cpu_next || (join->cpu_select_range && ! join->cpu_flags)) {
+        fprintf(stderr, "fatal error: out of memory\n");
+        exit(1);
+    }
+}
+
+void join_cpu_process(void * join_ptr, batch_p input, window_p window, u_int8_t ** processed_output, query_event_p event) {
+    join_p join = (join_p) join_ptr;
+
+    int work_group_num = join->threads[2] / join->threads_per_group[2];
+
+    join_args_t args;
+    {
+        args.join = join;
+
+        args.input = input->buffer + input->start;
+        args.tuples = input->size;
+        args.tuple_size = join->input_schema->size;
+
+        args.build = join_stage(join, input, &args.build_num);
+
+        args.heads = join->cpu_heads;
+        args.next = join->cpu_next;
+
+        args.flags = join->cpu_select_range ? join->cpu_flags : NULL;
+
+        args.partition_num = work_group_num;
+        args.partition_size = join->threads_per_group[2] * JOIN_TUPLES_PER_THREADS;
+
+        args.partitions = (int *) processed_output[0];
+        args.results = processed_output[1];
+    }
+
+    if (join->cpu_select_range) {
+        cpu_execute(filter_kernel, &args);
+    }
+    cpu_execute(clear_kernel, &args);
+    cpu_execute(build_kernel, &args);
+    cpu_execute(count_kernel, &args);
+
+    int offsets [work_group_num];
+    int count = 0;
+    for (int p=0; p<work_group_num; p++) {
+        offsets[p] = count;
+        count += args.partitions[p];
+    }
+    args.offsets = offsets;
+
+    cpu_execute(join_kernel, &args);
+}
@@ -4,11 +4,15 @@
 #include <stdbool.h>
 
 #include "batch.h"
+#include "schema.h"
 #include "window.h"
 #include "monitor/event_manager.h"
 
 #define OPERATOR_CODE_FILENAME_LENGTH 256
 
+/* The most bytes generate_patch appends for one operator */
+#define OPERATOR_PATCH_MAX_LENGTH (16 * 1024)
+
 #define MAX_LINE_LENGTH 256
 #define _sprintf(format, ...) \
 {\
@@ -25,7 +29,16 @@
 enum operator_types {
     OPERATOR_SELECT,
     OPERATOR_REDUCE,
-    OPERATOR_AGGREGATE
+    OPERATOR_AGGREGATE,
+    OPERATOR_PROJECT,
+    OPERATOR_JOIN
+};
+
+/* Where the operator kernels are executed */
+enum operator_backends {
+    BACKEND_GPU,
+    BACKEND_CPU,
+    BACKEND_HYBRID /* Both, chosen per task by the scheduler */
 };
 
 /* A collection of operator callbacks */
@@ -38,6 +51,32 @@ typedef struct opmerger_operator {
     void (* generate_patch) (void * operator, char * patch);
     int (* get_output_schema_size) (void * operator);
     u_int8_t ** (* get_output_buffer) (void * operator, batch_p output);
+    /* The bytes an output takes, NULL for one and a half batches of output tuples of at least 64 bytes */
+    long (* get_output_size) (void * operator);
+
+    /* A fused query reads the tuples of the query input, which a projection before the last operator narrows */
+    void (* set_input_schema) (void * operator, schema_p input_schema);
+
+    /* Host counterparts of setup and process. They produce the same output layout so that 
+       process_output and the downstream operators do not need to know the backend */
+    void (* cpu_setup) (void * operator, int batch_size, window_p window, char const * patch);
+    void (* cpu_process) (void * operator, batch_p input, window_p window, u_int8_t ** processed_output, query_event_p event);
+
+    /* Window assembly in the result handler, NULL for an operator without windows. A partial holds a
+       window that spans batches and is at least as large as the tuples the window is written as. A 
+       fragment may be smaller than a partial, its size is passed along with it */
+    int (* get_partial_size) (void * operator);
+    u_int8_t * (* get_fragment) (void * operator, batch_p output, enum window_kinds kind, int index, int * size);
+    void (* init_partial) (void * operator, u_int8_t * partial);
+    void (* merge_partial) (void * operator, u_int8_t * partial, u_int8_t const * fragment, int size);
+    int (* write_window) (void * operator, u_int8_t const * partial, int size, u_int8_t * output);
+
+    /* Completes the fragments of an output from the batch it was computed from before they are assembled,
+       NULL if they are always complete */
+    void (* recover_output) (void * operator, batch_p input, batch_p output);
+
+    /* A new instance with the same parameters that has not been set up, NULL if the operator cannot be copied */
+    void * (* clone) (void * operator);
 
     enum operator_types type;
 
@@ -4,7 +4,7 @@ $(OP_OBJDIR): ; mkdir -p $@
 OP_DEPDIR=$(DEPDIR)/operators
 $(OP_DEPDIR): ; mkdir -p $@
 
-OPERATOR = aggregation.c reduction.c selection.c
+OPERATOR = aggregation.c reduction.c selection.c projection.c join.c aggregation_cpu.c reduction_cpu.c selection_cpu.c projection_cpu.c join_cpu.c
 OPERATOR := $(foreach file,$(OPERATOR),operators/$(file))
 SRCS += $(OPERATOR)
 
@@ -0,0 +1,352 @@
+#include "projection.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libgpu/gpu_agg.h"
+
+#include "config.h"
+#include "generators.h"
+#include "helpers.h"
+
+static int free_id = 0;
+
+/* Long enough for the longest expression, "in->tuple._<attr> * in->tuple._<attr>" */
+#define PROJECTION_EXPRESSION_LENGTH 64
+
+int projection_get_output_schema_size(void * project_ptr) {
+    projection_p project = (projection_p) project_ptr;
+
+    return project->output_schema->size;
+}
+
+/* Same promotion as C and OpenCL: float over long over int */
+static enum attr_types get_expression_type(schema_p input_schema, projection_expression_t const * expression) {
+    enum attr_types left = input_schema->attr[expression->left];
+    if (expression->op == PROJECT_COLUMN) {
+        return left;
+    }
+
+    enum attr_types right = input_schema->attr[expression->right];
+    if (left == TYPE_FLOAT || right == TYPE_FLOAT) {
+        return TYPE_FLOAT;
+    } else if (left == TYPE_LONG || right == TYPE_LONG) {
+        return TYPE_LONG;
+    }
+    return TYPE_INT;
+}
+
+static void set_output_schema(projection_p p) {
+    p->output_schema = schema();
+
+    /* The first attribute is always the timestamp, which the windows of the downstream operators need */
+    schema_add_attr (p->output_schema, TYPE_LONG);
+    for (int i=0; i<p->expression_num; i++) {
+        schema_add_attr (p->output_schema, get_expression_type(p->input_schema, &p->expressions[i]));
+    }
+    p->output_attr_num = p->output_schema->attr_num;
+
+    while (schema_get_pad(p->output_schema, 16) > 0) {
+        schema_add_attr (p->output_schema, TYPE_INT);
+    }
+}
+
+projection_p projection(schema_p input_schema, int expression_num, projection_expression_t const expressions[]) {
+
+    projection_p p = (projection_p) malloc(sizeof(projection_t));
+    p->operator = (operator_p) malloc(sizeof (operator_t));
+    {
+        p->operator->setup = projection_setup;
+        p->operator->process = projection_process;
+        p->operator->process_output = projection_process_output;
+        p->operator->reset = projection_reset;
+        p->operator->generate_patch = projection_generate_patch;
+        p->operator->get_output_schema_size = projection_get_output_schema_size;
+        p->operator->get_output_buffer = projection_get_output_buffer;
+        p->operator->get_output_size = NULL;
+        p->operator->set_input_schema = projection_set_input_schema;
+        p->operator->cpu_setup = projection_cpu_setup;
+        p->operator->cpu_process = projection_cpu_process;
+
+        /* No windows to assemble */
+        p->operator->get_partial_size = NULL;
+        p->operator->get_fragment = NULL;
+        p->operator->init_partial = NULL;
+        p->operator->merge_partial = NULL;
+        p->operator->write_window = NULL;
+        p->operator->recover_output = NULL;
+        p->operator->clone = NULL;
+
+        p->operator->type = OPERATOR_PROJECT;
+
+        strcpy(p->operator->code_name, PROJECTION_CODE_FILENAME);
+    }
+
+    p->id = free_id++;
+
+    p->input_schema = input_schema;
+
+    if (expression_num > PROJECTION_MAX_EXPRESSION || expression_num + 1 > MAX_ATTR_NUM) {
+        fprintf(stderr, "error: the number of expressions has exceeded the limit (%d)\n", 
+            PROJECTION_MAX_EXPRESSION);
+        exit(1);
+    }
+    p->expression_num = expression_num;
+    for (int i=0; i<expression_num; i++) {
+        int right = (expressions[i].op == PROJECT_COLUMN) ? expressions[i].left : expressions[i].right;
+        if (expressions[i].left < 0 || expressions[i].left >= input_schema->attr_num ||
+            right < 0 || right >= input_schema->attr_num) {
+            fprintf(stderr, "error: expression %d refers to a column out of the input schema (%s)\n", i, __FUNCTION__);
+            exit(1);
+        }
+        p->expressions[i] = expressions[i];
+    }
+
+    set_output_schema(p);
+
+    return p;
+}
+
+void projection_set_input_schema(void * project_ptr, schema_p input_schema) {
+    projection_p project = (projection_p) project_ptr;
+
+    project->input_schema = input_schema;
+}
+
+/* The right hand side of output attribute i + 1, e.g. "in->tuple._8 * in->tuple._9" */
+static void generate_expression(projection_p project, int i, char * ret) {
+    char s [MAX_LINE_LENGTH] = "";
+    projection_expression_t const * expression = &project->expressions[i];
+
+    *ret = '\0';
+    if (expression->left == 0) {
+        _sprint("in->tuple.t");
+    } else {
+        _sprintf("in->tuple._%d", expression->left);
+    }
+
+    switch (expression->op) {
+    case PROJECT_COLUMN: return;
+    case PROJECT_ADD: _sprint(" + "); break;
+    case PROJECT_SUB: _sprint(" - "); break;
+    case PROJECT_MUL: _sprint(" * "); break;
+    case PROJECT_DIV: _sprint(" / "); break;
+    default:
+        fprintf(stderr, "error: invalid projection operation\n");
+        exit(1);
+    }
+
+    if (expression->right == 0) {
+        _sprint("in->tuple.t");
+    } else {
+        _sprintf("in->tuple._%d", expression->right);
+    }
+}
+
+static char const * get_type_name(enum attr_types type) {
+    switch (type) {
+    case TYPE_INT:   return "int";
+    case TYPE_FLOAT: return "float";
+    case TYPE_LONG:  return "long";
+    default:
+        fprintf(stderr, "error: undefined attribute type (%s)\n", __FUNCTION__);
+        exit(1);
+    }
+}
+
+void projection_generate_patch(void * project_ptr, char * patch) {
+    projection_p project = (projection_p) project_ptr;
+
+    char * ret = patch; // Reuse the marcro funciton
+    char s [MAX_LINE_LENGTH] = "";
+    char expression [PROJECTION_EXPRESSION_LENGTH];
+
+    /* A private copy of the projected attributes, named as in its output_t */
+    _sprint("    struct {\n");
+    _sprint("        struct {\n");
+    _sprint("            long t;\n");
+    for (int i = 1; i < project->output_attr_num; i++) {
+        _sprintf("            %s _%d;\n", get_type_name(project->output_schema->attr[i]), i);
+    }
+    _sprint("        } tuple;\n");
+    _sprintf("    } projection_%d;\n", project->id);
+
+    _sprintf("    projection_%d.tuple.t = in->tuple.t;\n", project->id);
+    for (int i = 0; i < project->expression_num; i++) {
+        generate_expression(project, i, expression);
+        _sprintf("    projection_%d.tuple._%d = %s;\n", project->id, (i + 1), expression);
+    }
+
+    /* Closed by PATCH_EPILOGUE at the end of the function the patch is inserted into */
+    _sprint("#undef in\n");
+    _sprintf("#define in (&projection_%d)\n\n", project->id);
+}
+
+static char * generate_projectf(projection_p project) {
+    char * ret = (char *) malloc((256 + 128 * project->output_schema->attr_num) * sizeof(char)); *ret = '\0';
+    char s [MAX_LINE_LENGTH] = "";
+    char expression [PROJECTION_EXPRESSION_LENGTH];
+
+    _sprint("inline void projectf (__global output_t *out, __global input_t *in) {\n");
+    _sprint("    out->tuple.t = in->tuple.t;\n");
+    for (int i = 0; i < project->expression_num; i++) {
+        generate_expression(project, i, expression);
+        _sprintf("    out->tuple._%d = %s;\n", (i + 1), expression);
+    }
+    /* Padding attributes */
+    for (int i = project->output_attr_num; i < project->output_schema->attr_num; i++) {
+        _sprintf("    out->tuple._%d = 0;\n", i);
+    }
+    _sprint("}\n\n");
+
+    return ret;
+}
+
+static char * generate_source(projection_p project) {
+    int vector = 16;
+
+    char * extensions = read_file("cl/templates/extensions.cl");
+    char * headers = read_file("cl/templates/headers.cl");
+
+    /* Input and output vector sizes */
+    char * tuple_size = generate_tuple_size(project->input_schema, project->output_schema, vector);
+
+    /* Input and output tuple struct */
+    char * input_tuple = generate_input_tuple(project->input_schema, NULL, vector);
+    char * output_tuple = generate_output_tuple(project->output_schema, NULL, vector);
+
+    /* Inline function */
+    char * projectf = generate_projectf(project);
+
+    /* Template funcitons */
+    char * template = read_file(PROJECTION_CODE_TEMPLATE);
+
+    /* Assembling */
+    char * source = (char *) malloc((strlen(extensions) + strlen(headers) + strlen(tuple_size) + strlen(input_tuple) 
+        + strlen(output_tuple) + strlen(projectf) + strlen(template) + 1) * sizeof(char));
+    if (! source) {
+        fprintf(stderr, "fatal error: out of memory\n");
+        exit(1);
+    }
+    *source = '\0';
+
+    strcat(source, extensions);
+    strcat(source, headers);
+
+    strcat(source, tuple_size);
+
+    strcat(source, input_tuple);
+    strcat(source, output_tuple);
+
+    strcat(source, projectf);
+
+    strcat(source, template);
+
+    free(extensions);
+    free(headers);
+    free(tuple_size);
+    free(input_tuple);
+    free(output_tuple);
+    free(projectf);
+    free(template);
+
+    return source;
+}
+
+void projection_setup(void * project_ptr, int batch_size, window_p window, char const * patch) {
+    projection_p project = (projection_p) project_ptr;
+
+    if (patch && *patch) {
+        fprintf(stderr, "error: a projection cannot be the last operator of a fused query (%s)\n", __FUNCTION__);
+        exit(1);
+    }
+
+    int tuple_size = project->input_schema->size;
+    int out_tuple_size = project->output_schema->size;
+
+    /* Operator setup */
+    projection_reset(project, batch_size);
+
+    /* Source generation */
+    char * source = generate_source(project);
+
+#ifdef OPMERGER_DEBUG
+    /* Output generated code */
+    char * filename = generate_filename(project->id, PROJECTION_CODE_FILENAME);
+    printf("[PROJECTION] Printing the generated source code to file: %s\n", filename);
+    print_to_file(filename, source);
+    free(filename);
+#endif
+
+    /* Build opencl program */
+    int qid = gpu_get_query(source, PROJECTION_KERNEL_NUM, 1, 1);
+    project->qid = qid;
+
+    /* GPU inputs and outputs setup */
+    gpu_set_input(qid, 0, batch_size * tuple_size);
+
+    gpu_set_output (qid, 0, batch_size * out_tuple_size, 1, 0, 0, 1, 0); /* Results */
+
+    /* GPU kernels setup */
+    int args[3];
+    args[0] = batch_size * tuple_size;
+    args[1] = batch_size;
+    args[2] = batch_size * out_tuple_size;
+
+    gpu_set_kernel_project (qid, args);
+
+    free(source);
+}
+
+void projection_reset(void * project_ptr, int new_batch_size) {
+    projection_p project = (projection_p) project_ptr;
+
+    project->batch_size = new_batch_size;
+
+    /* One tuple per thread */
+    for (int i=0; i<PROJECTION_KERNEL_NUM; i++) {
+        project->threads[i] = new_batch_size;
+
+        if (project->threads[i] < MAX_THREADS_PER_GROUP) {
+            project->threads_per_group[i] = project->threads[i];
+        } else {
+            project->threads_per_group[i] = MAX_THREADS_PER_GROUP;
+        }
+    }
+}
+
+void projection_process(void * project_ptr, batch_p input, window_p window, u_int8_t ** processed_output, query_event_p event) {
+    projection_p project = (projection_p) project_ptr;
+
+    /* Set input buffer addresses and entries */
+    u_int8_t * inputs [1] = {input->buffer + input->start};
+
+    /* Execute */
+    gpu_execute(project->qid, 
+        project->threads, project->threads_per_group,
+        (void *) inputs, (void **) processed_output, sizeof(u_int8_t),
+        event);
+}
+
+u_int8_t ** projection_get_output_buffer(void * project_ptr, batch_p output) {
+    projection_p project = (projection_p) project_ptr;
+
+    u_int8_t ** outputs = (u_int8_t **) malloc(1 * sizeof(u_int8_t *));
+
+    /* Validate whether the given output buffer is big enough */
+    if ((output->end - output->start) < (long) project->batch_size * project->output_schema->size) {
+        fprintf(stderr, "error: Expected output size has exceeded the given output buffer size (%s)\n", __FUNCTION__);
+        exit(1);
+    }
+
+    outputs[0] = output->buffer + output->start;
+
+    return outputs;
+}
+
+void projection_process_output(void * project_ptr, batch_p outputs) {
+    projection_p project = (projection_p) project_ptr;
+
+    /* Every input tuple has a narrower output tuple, so the size is left as that of the input */
+    outputs->tuple_size = project->output_schema->size;
+}
@@ -0,0 +1,80 @@
+#ifndef PROJECTION_H
+#define PROJECTION_H
+
+#include "batch.h"
+#include "schema.h"
+#include "operator.h"
+
+#define PROJECTION_KERNEL_NUM 1
+#define PROJECTION_CODE_FILENAME "cl/project"
+#define PROJECTION_CODE_TEMPLATE "cl/templates/project_template.cl"
+#define PROJECTION_MAX_EXPRESSION 8
+
+enum projection_ops {
+    PROJECT_COLUMN, /* left */
+    PROJECT_ADD,    /* left + right */
+    PROJECT_SUB,    /* left - right */
+    PROJECT_MUL,    /* left * right */
+    PROJECT_DIV     /* left / right */
+};
+
+/* An output column computed from one or two columns of the input */
+typedef struct projection_expression {
+    enum projection_ops op;
+    int left;
+    int right; /* Not used by PROJECT_COLUMN */
+} projection_expression_t;
+
+typedef struct projection * projection_p;
+typedef struct projection {
+    operator_p operator; /* As a parent class */
+
+    int id; /* Refer to selection.h */
+    int qid;
+
+    int batch_size;
+    schema_p input_schema;
+
+    int expression_num;
+    projection_expression_t expressions[PROJECTION_MAX_EXPRESSION];
+
+    /**
+     * The timestamp followed by one attribute per expression. It is padded with unused int attributes 
+     * to a multiple of 16 bytes, so that the downstream kernels can move the tuples as uchar16 vectors
+     **/
+    schema_p output_schema;
+    int output_attr_num; /* Attributes before the padding */
+
+    size_t threads[PROJECTION_KERNEL_NUM];
+    size_t threads_per_group [PROJECTION_KERNEL_NUM];
+
+} projection_t;
+
+/* Refer to selection.h for explainations of following member methods */
+
+projection_p projection(schema_p input_schema, int expression_num, projection_expression_t const expressions[]);
+
+void projection_setup(void * project_ptr, int batch_size, window_p window, char const * patch);
+
+void projection_reset(void * project_ptr, int new_batch_size);
+
+void projection_process(void * project_ptr, batch_p batch, window_p window, u_int8_t ** processed_output, query_event_p event);
+
+u_int8_t ** projection_get_output_buffer(void * project_ptr, batch_p output);
+
+void projection_process_output(void * project_ptr, batch_p outputs);
+
+/**
+ * In a fused query, the patch computes the projected tuple into a local variable and rebinds `in` to 
+ * it, so that the operators after the projection keep reading their attributes through in->tuple
+ **/
+void projection_generate_patch(void * project_ptr, char * patch);
+
+void projection_set_input_schema(void * project_ptr, schema_p input_schema);
+
+/* Host backend (projection_cpu.c) */
+void projection_cpu_setup(void * project_ptr, int batch_size, window_p window, char const * patch);
+
+void projection_cpu_process(void * project_ptr, batch_p batch, window_p window, u_int8_t ** processed_output, query_event_p event);
+
+#endif
@@ -0,0 +1,135 @@
+#include "projection.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libcpu/cpu_agg.h"
+
+typedef struct projection_args {
+    projection_p project;
+
+    u_int8_t const * input;
+    int tuples;
+    int tuple_size;
+
+    u_int8_t * output;
+    int out_tuple_size;
+
+    /* Byte offsets and types of the operands, and the offset of the result */
+    int left_offsets[PROJECTION_MAX_EXPRESSION];
+    int right_offsets[PROJECTION_MAX_EXPRESSION];
+    enum attr_types left_types[PROJECTION_MAX_EXPRESSION];
+    enum attr_types right_types[PROJECTION_MAX_EXPRESSION];
+    int out_offsets[PROJECTION_MAX_EXPRESSION];
+    enum attr_types out_types[PROJECTION_MAX_EXPRESSION];
+} projection_args_t;
+
+static inline long read_long(u_int8_t const * attr, enum attr_types type) {
+    switch (type) {
+    case TYPE_INT:
+        return (long) *((int const *) attr);
+    case TYPE_LONG:
+        return *((long const *) attr);
+    case TYPE_FLOAT:
+    default:
+        return (long) *((float const *) attr);
+    }
+}
+
+#define PROJECTION_CPU_APPLY(type, read, a, b) \
+{\
+    type const l = (type) read((a), args->left_types[k]);\
+    type const r = (type) read((b), args->right_types[k]);\
+    type v;\
+    switch (expression->op) {\
+    case PROJECT_ADD: v = l + r; break;\
+    case PROJECT_SUB: v = l - r; break;\
+    case PROJECT_MUL: v = l * r; break;\
+    case PROJECT_DIV: v = l / r; break;\
+    default: v = l; break;\
+    }\
+    memcpy(out + args->out_offsets[k], &v, sizeof(type));\
+}
+
+/* Same as the generated projectf, in the types the operands are promoted to */
+static void projectf(projection_args_t const * args, u_int8_t const * in, u_int8_t * out) {
+    projection_p project = args->project;
+
+    memset(out, 0, args->out_tuple_size);
+    memcpy(out, in, sizeof(long)); /* Timestamp */
+
+    for (int k=0; k<project->expression_num; k++) {
+        projection_expression_t const * expression = &project->expressions[k];
+        u_int8_t const * a = in + args->left_offsets[k];
+        u_int8_t const * b = in + args->right_offsets[k];
+
+        if (expression->op == PROJECT_COLUMN) {
+            memcpy(out + args->out_offsets[k], a, attr_types_get_size(args->out_types[k]));
+            continue;
+        }
+
+        switch (args->out_types[k]) {
+        case TYPE_FLOAT: PROJECTION_CPU_APPLY(float, cpu_read_float, a, b); break;
+        case TYPE_LONG:  PROJECTION_CPU_APPLY(long, read_long, a, b); break;
+        case TYPE_INT:
+        default:         PROJECTION_CPU_APPLY(int, read_long, a, b); break;
+        }
+    }
+}
+
+static void project_kernel(void * args_ptr, int tid, int thread_num) {
+    projection_args_t * args = (projection_args_t *) args_ptr;
+
+    int from, to;
+    cpu_get_range(args->tuples, tid, thread_num, &from, &to);
+
+    for (int i=from; i<to; i++) {
+        projectf(args, 
+            args->input + (long) i * args->tuple_size, 
+            args->output + (long) i * args->out_tuple_size);
+    }
+}
+
+void projection_cpu_setup(void * project_ptr, int batch_size, window_p window, char const * patch) {
+    projection_p project = (projection_p) project_ptr;
+
+    /* Refer to projection_setup */
+    if (patch && *patch) {
+        fprintf(stderr, "error: a projection cannot be the last operator of a fused query (%s)\n", __FUNCTION__);
+        exit(1);
+    }
+
+    projection_reset(project, batch_size);
+}
+
+void projection_cpu_process(void * project_ptr, batch_p input, window_p window, u_int8_t ** processed_output, query_event_p event) {
+    projection_p project = (projection_p) project_ptr;
+    schema_p in_schema = project->input_schema;
+
+    projection_args_t args;
+    {
+        args.project = project;
+
+        args.input = input->buffer + input->start;
+        args.tuples = input->size;
+        args.tuple_size = in_schema->size;
+
+        args.output = processed_output[0];
+        args.out_tuple_size = project->output_schema->size;
+
+        for (int k=0; k<project->expression_num; k++) {
+            projection_expression_t const * expression = &project->expressions[k];
+            int right = (expression->op == PROJECT_COLUMN) ? expression->left : expression->right;
+
+            args.left_offsets[k] = schema_get_attr_offset(in_schema, expression->left);
+            args.right_offsets[k] = schema_get_attr_offset(in_schema, right);
+            args.left_types[k] = in_schema->attr[expression->left];
+            args.right_types[k] = in_schema->attr[right];
+
+            args.out_offsets[k] = schema_get_attr_offset(project->output_schema, k + 1);
+            args.out_types[k] = project->output_schema->attr[k + 1];
+        }
+    }
+
+    cpu_execute(project_kernel, &args);
+}
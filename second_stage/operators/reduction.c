@@ -1,5 +1,6 @@
 #include "reduction.h"
 
+#include <float.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -29,6 +30,17 @@ reduction_p reduction(schema_p input_schema,
         p->operator->process_output = (void *) reduction_process_output;
         p->operator->get_output_schema_size = (void *) reduction_get_output_schema_size;
         p->operator->get_output_buffer = (void *) reduction_get_output_buffer;
+        p->operator->get_output_size = NULL;
+        p->operator->set_input_schema = (void *) reduction_set_input_schema;
+        p->operator->cpu_setup = (void *) reduction_cpu_setup;
+        p->operator->cpu_process = (void *) reduction_cpu_process;
+        p->operator->get_partial_size = (void *) reduction_get_partial_size;
+        p->operator->get_fragment = (void *) reduction_get_fragment;
+        p->operator->init_partial = (void *) reduction_init_partial;
+        p->operator->merge_partial = (void *) reduction_merge_partial;
+        p->operator->write_window = (void *) reduction_write_window;
+        p->operator->recover_output = NULL;
+        p->operator->clone = (void *) reduction_clone;
 
         p->operator->type = OPERATOR_REDUCE;
 
@@ -37,6 +49,15 @@ reduction_p reduction(schema_p input_schema,
 
     p->id = free_id++;
 
+    p->max_panes = 0;
+
+    p->window_pointers = NULL;
+    p->cpu_panes = NULL;
+    p->cpu_pane_capacity = 0;
+
+    p->cpu_library = NULL;
+    p->cpu_reduce_range = NULL;
+
     p->ref_num = ref_num;
     if (ref_num > REDUCTION_MAX_REFERENCE) {
         fprintf(stderr, "error: the number of reference has exceeded the limit (%d)\n", 
@@ -99,7 +120,7 @@ static char * generate_initf(reduction_p reduce) {
 }
 
 static char * generate_reducef (reduction_p reduce, char const * patch) {
-    char * ret = (char *) malloc(512 * sizeof(char)); *ret = '\0';
+    char * ret = (char *) malloc((1024 + (patch ? strlen(patch) : 0)) * sizeof(char)); *ret = '\0';
     char s [MAX_LINE_LENGTH] = "";
     int i;
 
@@ -114,7 +135,7 @@ static char * generate_reducef (reduction_p reduce, char const * patch) {
 
     /* Insert patch */
     if (patch) {
-        _sprintf("%s", patch);
+        strcat(ret, patch);
     }
 
     /* Set timestamp */
@@ -152,6 +173,9 @@ static char * generate_reducef (reduction_p reduce, char const * patch) {
     _sprint("}\n");
     
     _sprint("\n");
+    if (patch) {
+        strcat(ret, PATCH_EPILOGUE);
+    }
 
     return ret;
 }
@@ -177,7 +201,7 @@ static char * generate_cachef(reduction_p reduce) {
     return ret;
 }
 
-static char * generate_mergef(reduction_p reduce) {
+static char * generate_mergef(reduction_p reduce, char const * name, char const * mine_qualifier, char const * other_qualifier) {
     char * ret = (char *) malloc(512 * sizeof(char)); *ret = '\0';
     char s [MAX_LINE_LENGTH] = "";
 
@@ -185,7 +209,7 @@ static char * generate_mergef(reduction_p reduce) {
     int aggregation_num = reduce->ref_num;
 
     /* mergef */
-    _sprint("inline void mergef (__local output_t * mine, __local output_t * other) {\n");
+    _sprintf("inline void %s (%soutput_t * mine, %soutput_t * other) {\n", name, mine_qualifier, other_qualifier);
 
     /* Always pick the largest timestamp as the new timestamp */
     _sprint("   if (mine->tuple.t < other->tuple.t) {\n");
@@ -284,11 +308,16 @@ static char * generate_source(reduction_p reduce, window_p window, char const *
     /* Window sizes */
     char * windows = generate_window_definition(window);
 
+    /* Panes of the windows a batch can have (refer to paneKernel) */
+    char * max_panes = (char *) malloc(MAX_LINE_LENGTH * sizeof(char));
+    sprintf(max_panes, "#define MAX_PANES %d\n\n", reduce->max_panes);
+
     /* Inline functions */
     char * initf = generate_initf(reduce);
     char * reducef = generate_reducef(reduce, patch);
     char * cachef = generate_cachef(reduce);
-    char * mergef = generate_mergef(reduce);
+    char * mergef = generate_mergef(reduce, "mergef", "__local ", "__local ");
+    char * pane_mergef = generate_mergef(reduce, "pane_mergef", "", "__global ");
     char * copyf = generate_copyf(reduce, vector);
 
     /* Template funcitons */
@@ -305,11 +334,13 @@ static char * generate_source(reduction_p reduce, window_p window, char const *
     strcat(source, output_tuple);
     
     strcat(source, windows);
+    strcat(source, max_panes);
     
     strcat(source, initf);
     strcat(source, reducef);
     strcat(source, cachef);
     strcat(source, mergef);
+    strcat(source, pane_mergef);
     strcat(source, copyf);
     
     strcat(source, template);
@@ -325,11 +356,13 @@ static char * generate_source(reduction_p reduce, window_p window, char const *
     free(input_tuple);
 
     free(windows);
+    free(max_panes);
 
     free(initf);
     free(reducef);
     free(cachef);
     free(mergef);
+    free(pane_mergef);
     free(copyf);
     
     free(template);
@@ -337,6 +370,63 @@ static char * generate_source(reduction_p reduce, window_p window, char const *
     return source;
 }
 
+/* Host entry point: folds the tuples in bytes [start, end) into the accumulator of reduction_cpu.c */
+static char * generate_reduce_range(reduction_p reduce) {
+    char * ret = (char *) malloc(1024 * sizeof(char)); *ret = '\0';
+    char s [MAX_LINE_LENGTH] = "";
+    int i;
+
+    _sprint("void reduce_range (u_int8_t const * input, int start, int end, long * t, float * values, int * count) {\n");
+    _sprint("    output_t out;\n");
+    _sprint("    out.tuple.t = *t;\n");
+    for (i = 0; i < reduce->ref_num; i++) {
+        _sprintf("    out.tuple._%d = values[%d];\n", (i + 1), i);
+    }
+    _sprintf("    out.tuple._%d = *count;\n\n", (i + 1));
+
+    _sprint("    for (int idx = start; idx < end; idx += sizeof(input_t)) {\n");
+    _sprint("        reducef(&out, (input_t *) (input + idx));\n");
+    _sprint("    }\n\n");
+
+    _sprint("    *t = out.tuple.t;\n");
+    for (i = 0; i < reduce->ref_num; i++) {
+        _sprintf("    values[%d] = out.tuple._%d;\n", i, (i + 1));
+    }
+    _sprintf("    *count = out.tuple._%d;\n", (i + 1));
+    _sprint("}\n\n");
+
+    return ret;
+}
+
+char * reduction_generate_c_source(reduction_p reduce, char const * patch) {
+    int vector = 16;
+
+    char * source = (char *) malloc(MAX_SOURCE_LENGTH * sizeof(char)); *source = '\0';
+
+    char * headers = generate_c_headers();
+    char * tuple_size = generate_tuple_size(reduce->input_schema, reduce->output_schema, vector);
+    char * input_tuple = generate_input_tuple(reduce->input_schema, NULL, vector);
+    char * output_tuple = generate_output_tuple(reduce->output_schema, NULL, vector);
+    char * reducef = generate_reducef(reduce, patch);
+    char * reduce_range = generate_reduce_range(reduce);
+
+    strcat(source, headers);
+    strcat(source, tuple_size);
+    strcat(source, input_tuple);
+    strcat(source, output_tuple);
+    strcat(source, reducef);
+    strcat(source, reduce_range);
+
+    free(headers);
+    free(tuple_size);
+    free(input_tuple);
+    free(output_tuple);
+    free(reducef);
+    free(reduce_range);
+
+    return source;
+}
+
 void reduction_setup(void * reduce_ptr, int batch_size, window_p window, char const * patch) {
     reduction_p reduce = (reduction_p) reduce_ptr;
 
@@ -351,6 +441,11 @@ void reduction_setup(void * reduce_ptr, int batch_size, window_p window, char co
         }
     }
 
+    /* paneKernel: a thread per pane of the windows a batch can have, scanKernel: at most as many blocks */
+    reduce->max_panes = batch_size + window->size / window->pane_size;
+    reduce->threads[3] = (reduce->max_panes + reduce->threads_per_group[3] - 1) / reduce->threads_per_group[3] * reduce->threads_per_group[3];
+    reduce->threads[4] = reduce->threads[3];
+
     /* Refer to selection.c */
     reduce->output_entries[0] = 0;
     reduce->output_entries[1] = 20;
@@ -367,7 +462,7 @@ void reduction_setup(void * reduce_ptr, int batch_size, window_p window, char co
 #endif
     
     /* Build opencl program */
-    int qid = gpu_get_query(source, 4, 1, 5);
+    int qid = gpu_get_query(source, REDUCTION_KERNEL_NUM, 1, 6);
     reduce->qid = qid;
     free(source);
     
@@ -388,6 +483,9 @@ void reduction_setup(void * reduce_ptr, int batch_size, window_p window, char co
     int out_tuple_size = reduce->output_schema->size;
     int outputSize = batch_size * out_tuple_size; /* SystemConf.UNBOUNDED_BUFFER_SIZE */
     gpu_set_output(qid, 4, outputSize, 1, 0, 0, 1, 0);
+
+    /* Pane partials, and their prefixes and suffixes in each block, stay on the device */
+    gpu_set_output(qid, 5, 3 * reduce->max_panes * out_tuple_size, 0, 1, 0, 0, 1);
     
     /* GPU kernels setup */
     int args1 [4];
@@ -406,29 +504,10 @@ void reduction_setup(void * reduce_ptr, int batch_size, window_p window, char co
 void reduction_process(void * reduce_ptr, batch_p batch, window_p window, u_int8_t ** processed_output, query_event_p event) {
     reduction_p reduce = (reduction_p) reduce_ptr;
     
+    /* Windows carry on from the previous batch of the stream (set by the dispatcher) */
     long args2[2];
-    {
-        /* Previous pane id, based on stream start pointer, s */
-        args2[0] = -1;
-        long s = batch->start;
-        int  t = reduce->input_schema->size;
-        long p = window->pane_size;
-        if (batch->start > 0) {
-            if (window->type == RANGE_BASE) {
-                int offset = s - t;
-                args2[0] = batch_get_first_tuple_timestamp64(batch, offset) / p;
-            } else {
-                args2[0] = ((s / (long) t) / p) - 1;
-            }
-        }
-        /* Force every batch to be a new window because the batch->start here is not the same with Saber's */
-        args2[0] = -1;
-    
-        args2[1] = s;
-        
-        /* Also the same to curent pane id */
-        args2[1] = 0;
-    }
+    args2[0] = batch->previous_pane_id;
+    args2[1] = batch->start_pointer;
     
     u_int8_t * inputs [1] = {
         batch->buffer + batch->start};
@@ -443,6 +522,18 @@ void reduction_process(void * reduce_ptr, batch_p batch, window_p window, u_int8
         // passing the batch without deserialisation
 }
 
+void reduction_set_input_schema(void * reduce_ptr, schema_p input_schema) {
+    reduction_p reduce = (reduction_p) reduce_ptr;
+
+    reduce->input_schema = input_schema;
+}
+
+void * reduction_clone(void * reduce_ptr) {
+    reduction_p reduce = (reduction_p) reduce_ptr;
+
+    return reduction(reduce->input_schema, reduce->ref_num, reduce->refs, reduce->expressions);
+}
+
 u_int8_t ** reduction_get_output_buffer(void * reduce_ptr, batch_p output) {
     reduction_p reduce = (reduction_p) reduce_ptr;
 
@@ -511,6 +602,12 @@ void reduction_process_output(void * reduce_ptr, batch_p outputs) {
     outputs->complete_windows = window_counts[2];
     outputs->opening_windows = window_counts[3];
 
+    /* Only the first pending window is computed, but all of them take a slot; the mark says how many */
+    if (outputs->pending_windows > 0) {
+        int windows = window_counts[4] / reduction_get_partial_size(reduce_ptr);
+        outputs->pending_windows = windows - window_counts[0] - window_counts[2] - window_counts[3];
+    }
+
     /* Keep only the windows */
     outputs->start += current_offset;
 
@@ -561,6 +658,92 @@ void reduction_process_output(void * reduce_ptr, batch_p outputs) {
     // }
 }
 
+int reduction_get_partial_size(void * reduce_ptr) {
+    reduction_p reduce = (reduction_p) reduce_ptr;
+
+    /* The size of output_t */
+    return reduce->output_schema->size + schema_get_pad(reduce->output_schema, 16);
+}
+
+u_int8_t * reduction_get_fragment(void * reduce_ptr, batch_p output, enum window_kinds kind, int index, int * size) {
+    /* Windows are in order, and the pending ones share the result of the first */
+    int wid = 0;
+    switch (kind) {
+    case WINDOW_CLOSING: wid = index; break;
+    case WINDOW_PENDING: wid = output->closing_windows; break;
+    case WINDOW_COMPLETE: wid = output->closing_windows + index; break;
+    case WINDOW_OPENING: 
+        wid = output->closing_windows + output->pending_windows + output->complete_windows + index; 
+        break;
+    }
+
+    *size = reduction_get_partial_size(reduce_ptr);
+    return output->buffer + output->start + (long) wid * reduction_get_partial_size(reduce_ptr);
+}
+
+void reduction_init_partial(void * reduce_ptr, u_int8_t * partial) {
+    reduction_p reduce = (reduction_p) reduce_ptr;
+
+    /* Same as initf */
+    memset(partial, 0, reduction_get_partial_size(reduce_ptr));
+    for (int i=0; i<reduce->ref_num; i++) {
+        float * value = (float *) (partial + schema_get_attr_offset(reduce->output_schema, i + 1));
+        switch (reduce->expressions[i]) {
+        case MIN: *value = FLT_MAX; break;
+        case MAX: *value = -FLT_MAX; break;
+        default: break;
+        }
+    }
+}
+
+void reduction_merge_partial(void * reduce_ptr, u_int8_t * partial, u_int8_t const * fragment, int size) {
+    reduction_p reduce = (reduction_p) reduce_ptr;
+
+    long * t = (long *) partial;
+    long other_t = *((long const *) fragment);
+    if (*t < other_t) {
+        *t = other_t;
+    }
+
+    int count_offset = schema_get_attr_offset(reduce->output_schema, reduce->ref_num + 1);
+    int * count = (int *) (partial + count_offset);
+    int other_count = *((int const *) (fragment + count_offset));
+
+    /* Same as mergef, except that an average has already been divided by its count in copyf */
+    for (int i=0; i<reduce->ref_num; i++) {
+        int offset = schema_get_attr_offset(reduce->output_schema, i + 1);
+        float * value = (float *) (partial + offset);
+        float other = *((float const *) (fragment + offset));
+
+        switch (reduce->expressions[i]) {
+        case CNT:
+        case SUM: *value += other; break;
+        case AVG:
+            if (*count + other_count > 0) {
+                *value = (*value * *count + other * other_count) / (float) (*count + other_count);
+            }
+            break;
+        case MIN: *value = (*value > other) ? other : *value; break;
+        case MAX: *value = (*value < other) ? other : *value; break;
+        default: break;
+        }
+    }
+    *count += other_count;
+}
+
+int reduction_write_window(void * reduce_ptr, u_int8_t const * partial, int size, u_int8_t * output) {
+    reduction_p reduce = (reduction_p) reduce_ptr;
+
+    /* A window without tuples has no result */
+    int count = *((int const *) (partial + schema_get_attr_offset(reduce->output_schema, reduce->ref_num + 1)));
+    if (count <= 0) {
+        return 0;
+    }
+
+    memcpy(output, partial, reduce->output_schema->size);
+    return reduce->output_schema->size;
+}
+
 void reduction_reset(void * reduce_ptr, int new_batch_size) {
     reduction_p reduce = (reduction_p) reduce_ptr;
 
@@ -576,6 +759,9 @@ void reduction_reset(void * reduce_ptr, int new_batch_size) {
             reduce->threads_per_group[i] = MAX_THREADS_PER_GROUP;
         }
     }
+    /* The panes are compiled in, so there are as many as at setup */
+    reduce->threads[3] = (reduce->max_panes + reduce->threads_per_group[3] - 1) / reduce->threads_per_group[3] * reduce->threads_per_group[3];
+    reduce->threads[4] = reduce->threads[3];
     
     /* GPU kernels setup */
     int args1 [4];
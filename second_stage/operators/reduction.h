@@ -5,8 +5,9 @@
 #include "batch.h"
 #include "schema.h"
 #include "operator.h"
+#include "libcpu/cpu_window.h"
 
-#define REDUCTION_KERNEL_NUM 4
+#define REDUCTION_KERNEL_NUM 6
 #define REDUCTION_CODE_FILENAME "cl/reduce"
 #define REDUCTION_CODE_TEMPLATE "cl/templates/reduce_template.cl"
 #define REDUCTION_MAX_REFERENCE 2
@@ -29,6 +30,16 @@ typedef struct reduction {
     schema_p output_schema;
     int output_entries[2];
 
+    int max_panes; /* Of the windows of a batch, which paneKernel and scanKernel are compiled for */
+
+    cpu_window_pointers_p window_pointers; /* Host backend only */
+    void * cpu_panes; /* Partials of the panes of a batch, refer to reduction_cpu.c */
+    int cpu_pane_capacity;
+
+    /* Host version of a fused query, compiled from the generated C source */
+    void * cpu_library;
+    void (* cpu_reduce_range) (u_int8_t const * input, int start, int end, long * t, float * values, int * count);
+
 } reduction_t;
 
 /* Refer to selection.h for explainations of following member methods */
@@ -45,8 +56,30 @@ void reduction_process(void * reduce_ptr, batch_p batch, window_p window, u_int8
 
 u_int8_t ** reduction_get_output_buffer(void * reduce_ptr, batch_p output);
 
+void reduction_set_input_schema(void * reduce_ptr, schema_p input_schema);
+
+void * reduction_clone(void * reduce_ptr);
+
 void reduction_process_output(void * reduce_ptr, batch_p outputs);
 
 void reduction_print_output(batch_p outputs, int batch_size, int tuple_size);
 
+/* Window assembly, refer to operator.h. A partial is a result of the output */
+int reduction_get_partial_size(void * reduce_ptr);
+
+u_int8_t * reduction_get_fragment(void * reduce_ptr, batch_p output, enum window_kinds kind, int index, int * size);
+
+void reduction_init_partial(void * reduce_ptr, u_int8_t * partial);
+
+void reduction_merge_partial(void * reduce_ptr, u_int8_t * partial, u_int8_t const * fragment, int size);
+
+int reduction_write_window(void * reduce_ptr, u_int8_t const * partial, int size, u_int8_t * output);
+
+/* Host backend (reduction_cpu.c) */
+char * reduction_generate_c_source(reduction_p reduce, char const * patch);
+
+void reduction_cpu_setup(void * reduce_ptr, int batch_size, window_p window, char const * patch);
+
+void reduction_cpu_process(void * reduce_ptr, batch_p batch, window_p window, u_int8_t ** processed_output, query_event_p event);
+
 #endif
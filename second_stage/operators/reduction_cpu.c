@@ -0,0 +1,492 @@
+#include "reduction.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+#include "generators.h"
+#include "libcpu/cpu_agg.h"
+#include "libcpu/cpu_compiler.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define REDUCTION_CPU_AVX2
+#include <immintrin.h>
+#endif
+
+/* Accumulator of one window, written out as output_t by copyf */
+typedef struct reduction_state {
+    long t;
+    float values[REDUCTION_MAX_REFERENCE];
+    int count;
+} reduction_state_t;
+
+typedef struct reduction_args {
+    reduction_p reduce;
+
+    u_int8_t const * input;
+    int bytes;
+    int tuple_size;
+    int attr_offsets[REDUCTION_MAX_REFERENCE];
+    enum attr_types attr_types[REDUCTION_MAX_REFERENCE];
+
+    int num_windows;
+    int first_pending;
+
+    /* Windows [bounds[tid], bounds[tid+1]) of each thread, balanced by their number of tuples */
+    int bounds[CPU_MAX_THREADS + 1];
+
+    int vectorised;
+
+    u_int8_t * output;
+    int out_tuple_size; /* Padded to 16 bytes like the uchar16 vectors of output_t */
+
+    /* Used when there are fewer windows than threads */
+    int start;
+    int end;
+    reduction_state_t partials[CPU_MAX_THREADS];
+
+    /* Used when windows overlap: one partial per pane, refer to cpu_window_panes, and the running 
+       partials of every block of panes from its first pane (prefixes) and to its last (suffixes) */
+    int pane_num;
+    reduction_state_t * panes;
+    reduction_state_t * prefixes;
+    reduction_state_t * suffixes;
+} reduction_args_t;
+
+static inline void initf(reduction_p reduce, reduction_state_t * p) {
+    p->t = 0;
+    for (int i=0; i<reduce->ref_num; i++) {
+        switch (reduce->expressions[i]) {
+        case CNT:
+        case SUM:
+        case AVG: p->values[i] = 0; break;
+        case MIN: p->values[i] = FLT_MAX; break;
+        case MAX: p->values[i] = -FLT_MAX; break;
+        default: break;
+        }
+    }
+    p->count = 0;
+}
+
+/* Column-wise accumulation of n attributes that are stride bytes apart */
+typedef struct column_stats {
+    float sum;
+    float min;
+    float max;
+} column_stats_t;
+
+static void columnf(u_int8_t const * attr, int n, int stride, enum attr_types type, column_stats_t * out) {
+    /* Independent accumulators, so that the additions do not wait for each other */
+    float sum[4] = {0, 0, 0, 0};
+    float min[4] = {FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX};
+    float max[4] = {-FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX};
+
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        for (int k=0; k<4; k++) {
+            float value = cpu_read_float(attr + (long) (i + k) * stride, type);
+            sum[k] += value;
+            min[k] = (min[k] > value) ? value : min[k];
+            max[k] = (max[k] < value) ? value : max[k];
+        }
+    }
+    for (; i < n; i++) {
+        float value = cpu_read_float(attr + (long) i * stride, type);
+        sum[0] += value;
+        min[0] = (min[0] > value) ? value : min[0];
+        max[0] = (max[0] < value) ? value : max[0];
+    }
+
+    out->sum = (sum[0] + sum[1]) + (sum[2] + sum[3]);
+    out->min = fminf(fminf(min[0], min[1]), fminf(min[2], min[3]));
+    out->max = fmaxf(fmaxf(max[0], max[1]), fmaxf(max[2], max[3]));
+}
+
+#ifdef REDUCTION_CPU_AVX2
+/* columnf on 8 attributes at a time for 4-byte ints and floats */
+__attribute__((target("avx2")))
+static void columnf_avx2(u_int8_t const * attr, int n, int stride, enum attr_types type, column_stats_t * out) {
+    __m256i const index = _mm256_mullo_epi32(
+        _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(stride));
+
+    __m256 sum = _mm256_setzero_ps();
+    __m256 min = _mm256_set1_ps(FLT_MAX);
+    __m256 max = _mm256_set1_ps(-FLT_MAX);
+
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        u_int8_t const * base = attr + (long) i * stride;
+
+        __m256 value = (type == TYPE_INT) ?
+            _mm256_cvtepi32_ps(_mm256_i32gather_epi32((int const *) base, index, 1)) :
+            _mm256_i32gather_ps((float const *) base, index, 1);
+
+        sum = _mm256_add_ps(sum, value);
+        min = _mm256_min_ps(min, value);
+        max = _mm256_max_ps(max, value);
+    }
+
+    float sums[8], mins[8], maxs[8];
+    _mm256_storeu_ps(sums, sum);
+    _mm256_storeu_ps(mins, min);
+    _mm256_storeu_ps(maxs, max);
+
+    columnf(attr + (long) i * stride, n - i, stride, type, out);
+    for (int k=0; k<8; k++) {
+        out->sum += sums[k];
+        out->min = (out->min > mins[k]) ? mins[k] : out->min;
+        out->max = (out->max < maxs[k]) ? maxs[k] : out->max;
+    }
+}
+#endif
+
+/* Reduce the tuples in bytes [start, end) */
+static void reducef(reduction_args_t const * args, reduction_state_t * out, int start, int end) {
+    reduction_p reduce = args->reduce;
+    int const n = (end - start) / args->tuple_size;
+
+    /* Fused query: the generated reducef evaluates the patch and counts the selected tuples only */
+    if (reduce->cpu_reduce_range) {
+        (* reduce->cpu_reduce_range) (args->input, start, end, &out->t, out->values, &out->count);
+        return;
+    }
+
+    for (int idx=start; idx<end; idx+=args->tuple_size) {
+        long t = *((long const *) (args->input + idx));
+        out->t = (out->t > t) ? out->t : t;
+    }
+
+    for (int i=0; i<reduce->ref_num; i++) {
+        if (reduce->expressions[i] == CNT) {
+            out->values[i] += n;
+            continue;
+        }
+
+        u_int8_t const * attr = args->input + start + args->attr_offsets[i];
+        column_stats_t column;
+#ifdef REDUCTION_CPU_AVX2
+        if (args->vectorised && args->attr_types[i] != TYPE_LONG) {
+            columnf_avx2(attr, n, args->tuple_size, args->attr_types[i], &column);
+        } else
+#endif
+        columnf(attr, n, args->tuple_size, args->attr_types[i], &column);
+
+        switch (reduce->expressions[i]) {
+        case SUM:
+        case AVG: out->values[i] += column.sum; break;
+        case MIN: out->values[i] = (out->values[i] > column.min) ? column.min : out->values[i]; break;
+        case MAX: out->values[i] = (out->values[i] < column.max) ? column.max : out->values[i]; break;
+        default: break;
+        }
+    }
+
+    out->count += n;
+}
+
+static void mergef(reduction_p reduce, reduction_state_t * mine, reduction_state_t const * other) {
+    mine->t = (mine->t < other->t) ? other->t : mine->t;
+
+    for (int i=0; i<reduce->ref_num; i++) {
+        switch (reduce->expressions[i]) {
+        case CNT:
+        case SUM:
+        case AVG: mine->values[i] += other->values[i]; break;
+        case MIN: mine->values[i] = (mine->values[i] > other->values[i]) ? other->values[i] : mine->values[i]; break;
+        case MAX: mine->values[i] = (mine->values[i] < other->values[i]) ? other->values[i] : mine->values[i]; break;
+        default: break;
+        }
+    }
+
+    mine->count += other->count;
+}
+
+static void copyf(reduction_args_t const * args, reduction_state_t * p, int wid) {
+    reduction_p reduce = args->reduce;
+    u_int8_t * q = args->output + (long) wid * args->out_tuple_size;
+
+    for (int i=0; i<reduce->ref_num; i++) {
+        if (reduce->expressions[i] == AVG && p->count > 0) {
+            p->values[i] = p->values[i] / (float) p->count;
+        }
+    }
+
+    memset(q, 0, args->out_tuple_size);
+    memcpy(q, &p->t, sizeof(long));
+    memcpy(q + sizeof(long), p->values, reduce->ref_num * sizeof(float));
+    memcpy(q + sizeof(long) + reduce->ref_num * sizeof(float), &p->count, sizeof(int));
+}
+
+/* The byte range of window wid, or -1 if it is not computed (duplicated pending windows) */
+static int get_window_range(reduction_args_t const * args, int wid, int * start, int * end) {
+    enum window_kinds kind =
+        cpu_window_classify(args->reduce->window_pointers, wid, args->bytes, start, end);
+
+    if (kind == WINDOW_PENDING && wid != args->first_pending) {
+        return -1;
+    }
+    return 0;
+}
+
+/* Whole windows per thread, in the ranges set by balance_windows */
+static void reduce_windows_kernel(void * args_ptr, int tid, int thread_num) {
+    reduction_args_t * args = (reduction_args_t *) args_ptr;
+
+    for (int wid=args->bounds[tid]; wid<args->bounds[tid + 1]; wid++) {
+        int start, end;
+        if (get_window_range(args, wid, &start, &end) < 0) {
+            continue;
+        }
+
+        reduction_state_t tuple;
+        initf(args->reduce, &tuple);
+        reducef(args, &tuple, start, end);
+        copyf(args, &tuple, wid);
+    }
+}
+
+/* All threads on one window, merged afterwards by the caller */
+static void reduce_partial_kernel(void * args_ptr, int tid, int thread_num) {
+    reduction_args_t * args = (reduction_args_t *) args_ptr;
+
+    int tuples = (args->end - args->start) / args->tuple_size;
+    int from, to;
+    cpu_get_range(tuples, tid, thread_num, &from, &to);
+
+    initf(args->reduce, &args->partials[tid]);
+    reducef(args, &args->partials[tid],
+        args->start + from * args->tuple_size, args->start + to * args->tuple_size);
+}
+
+/* Every tuple is reduced once, into the partial of its pane */
+static void reduce_panes_kernel(void * args_ptr, int tid, int thread_num) {
+    reduction_args_t * args = (reduction_args_t *) args_ptr;
+    int const * panes = args->reduce->window_pointers->panes;
+
+    int from, to;
+    cpu_get_range(args->pane_num, tid, thread_num, &from, &to);
+    for (int j=from; j<to; j++) {
+        int end = (j + 1 < args->pane_num) ? panes[j + 1] : args->bytes;
+
+        initf(args->reduce, &args->panes[j]);
+        reducef(args, &args->panes[j], panes[j], end);
+    }
+}
+
+/* Every block is scanned once in each direction by the thread its first pane belongs to */
+static void scan_blocks_kernel(void * args_ptr, int tid, int thread_num) {
+    reduction_args_t * args = (reduction_args_t *) args_ptr;
+    cpu_window_pointers_p pointers = args->reduce->window_pointers;
+
+    int from, to;
+    cpu_get_range(args->pane_num, tid, thread_num, &from, &to);
+    for (int j=from; j<to; j++) {
+        if (! cpu_window_block_first(pointers, j)) {
+            continue;
+        }
+
+        int last = j;
+        args->prefixes[j] = args->panes[j];
+        while (last + 1 < args->pane_num && ! cpu_window_block_first(pointers, last + 1)) {
+            last++;
+            args->prefixes[last] = args->prefixes[last - 1];
+            mergef(args->reduce, &args->prefixes[last], &args->panes[last]);
+        }
+
+        args->suffixes[last] = args->panes[last];
+        for (int k=last-1; k>=j; k--) {
+            args->suffixes[k] = args->panes[k];
+            mergef(args->reduce, &args->suffixes[k], &args->suffixes[k + 1]);
+        }
+    }
+}
+
+/**
+ * A window merges the partials of the panes between its pointers. As it spans at most two blocks, 
+ * that is the suffix of its first pane and the prefix of its last, whatever the slide and the 
+ * aggregate (the two-stacks of van Herk and Gil-Werman, built a batch at a time)
+ **/
+static void assemble_windows_kernel(void * args_ptr, int tid, int thread_num) {
+    reduction_args_t * args = (reduction_args_t *) args_ptr;
+    cpu_window_pointers_p pointers = args->reduce->window_pointers;
+
+    int from, to;
+    cpu_get_range(args->num_windows + 1, tid, thread_num, &from, &to);
+    for (int wid=from; wid<to; wid++) {
+        int start, end;
+        if (get_window_range(args, wid, &start, &end) < 0) {
+            continue;
+        }
+
+        int first = cpu_window_find_pane(pointers, start);
+        int last = cpu_window_find_pane(pointers, end) - 1;
+
+        reduction_state_t tuple;
+        if (first > last) {
+            initf(args->reduce, &tuple);
+        } else if (pointers->pane_blocks[first] != pointers->pane_blocks[last]) {
+            tuple = args->suffixes[first];
+            mergef(args->reduce, &tuple, &args->prefixes[last]);
+        } else if (cpu_window_block_first(pointers, first)) {
+            tuple = args->prefixes[last];
+        } else {
+            /* No pane of the block is after the window */
+            tuple = args->suffixes[first];
+        }
+        copyf(args, &tuple, wid);
+    }
+}
+
+/* Splits the windows into contiguous ranges of about the same number of tuples */
+static void balance_windows(reduction_args_t * args, int thread_num) {
+    long total = 0;
+    for (int wid=0; wid<=args->num_windows; wid++) {
+        int start, end;
+        if (get_window_range(args, wid, &start, &end) == 0) {
+            total += (end - start) / args->tuple_size;
+        }
+        total += 1; /* Every window costs at least its output */
+    }
+
+    long sum = 0;
+    int tid = 1;
+    args->bounds[0] = 0;
+    for (int wid=0; wid<=args->num_windows && tid<thread_num; wid++) {
+        int start, end;
+        if (get_window_range(args, wid, &start, &end) == 0) {
+            sum += (end - start) / args->tuple_size;
+        }
+        sum += 1;
+
+        while (tid < thread_num && sum * thread_num >= total * tid) {
+            args->bounds[tid++] = wid + 1;
+        }
+    }
+    while (tid <= thread_num) {
+        args->bounds[tid++] = args->num_windows + 1;
+    }
+}
+
+void reduction_cpu_setup(void * reduce_ptr, int batch_size, window_p window, char const * patch) {
+    reduction_p reduce = (reduction_p) reduce_ptr;
+
+    /* Refer to selection_cpu.c */
+    if (patch && *patch) {
+        char * source = reduction_generate_c_source(reduce, patch);
+        char * filename = generate_c_filename(reduce->id, REDUCTION_CODE_FILENAME);
+
+        reduce->cpu_library = cpu_compile(source, filename);
+        if (!reduce->cpu_library) {
+            fprintf(stderr, "error: the host backend needs a C compiler to run fused operators (%s)\n", __FUNCTION__);
+            exit(1);
+        }
+        reduce->cpu_reduce_range = cpu_get_function(reduce->cpu_library, "reduce_range");
+
+        free(filename);
+        free(source);
+    }
+
+    /* Refer to selection.c */
+    reduce->output_entries[0] = 0;
+    reduce->output_entries[1] = 20;
+
+    if (reduce->window_pointers) {
+        cpu_window_pointers_free(reduce->window_pointers);
+    }
+    reduce->window_pointers = cpu_window_pointers(PARTIAL_WINDOWS);
+}
+
+void reduction_cpu_process(void * reduce_ptr, batch_p batch, window_p window, u_int8_t ** processed_output, query_event_p event) {
+    reduction_p reduce = (reduction_p) reduce_ptr;
+
+    reduction_args_t args;
+    {
+        args.reduce = reduce;
+
+        args.input = batch->buffer + batch->start;
+        args.tuple_size = reduce->input_schema->size;
+        args.bytes = batch->size * args.tuple_size;
+        for (int i=0; i<reduce->ref_num; i++) {
+            args.attr_offsets[i] = schema_get_attr_offset(reduce->input_schema, reduce->refs[i]);
+            args.attr_types[i] = reduce->input_schema->attr[reduce->refs[i]];
+        }
+
+        args.output = processed_output[1];
+        args.out_tuple_size = reduce->output_schema->size + schema_get_pad(reduce->output_schema, 16);
+
+        args.vectorised = cpu_supports_avx2();
+    }
+
+    /* Same as reduction_process */
+    long previous_pane_id = batch->previous_pane_id;
+    long start_pointer = batch->start_pointer;
+
+    args.num_windows = cpu_window_compute(reduce->window_pointers,
+        args.input, batch->size, args.tuple_size, window, previous_pane_id, start_pointer);
+
+    /* Count windows; pending windows are computed once */
+    int * window_counts = (int *) processed_output[0];
+    memset(window_counts, 0, 4 * sizeof(int));
+    window_counts[4] = (args.num_windows + 1) * args.out_tuple_size;
+
+    args.first_pending = -1;
+    for (int wid=0; wid<=args.num_windows; wid++) {
+        int start, end;
+        switch (cpu_window_classify(reduce->window_pointers, wid, args.bytes, &start, &end)) {
+        case WINDOW_CLOSING: window_counts[0] += 1; break;
+        case WINDOW_OPENING: window_counts[3] += 1; break;
+        case WINDOW_COMPLETE: window_counts[2] += 1; break;
+        case WINDOW_PENDING:
+            if (args.first_pending < 0) {
+                args.first_pending = wid;
+                window_counts[1] = 1;
+            }
+            break;
+        }
+    }
+
+    int thread_num = cpu_get_thread_num();
+
+    /* Overlapping windows are assembled from panes, so that a tuple is not reduced once per window */
+    args.pane_num = 0;
+    if (window->size > window->slide) {
+        args.pane_num = cpu_window_panes(reduce->window_pointers,
+            args.input, batch->size, args.tuple_size, window, start_pointer);
+
+        if (reduce->cpu_pane_capacity < args.pane_num) {
+            free(reduce->cpu_panes);
+            reduce->cpu_panes = malloc(3 * batch->size * sizeof(reduction_state_t));
+            if (! reduce->cpu_panes) {
+                fprintf(stderr, "fatal error: out of memory\n");
+                exit(1);
+            }
+            reduce->cpu_pane_capacity = batch->size;
+        }
+        args.panes = (reduction_state_t *) reduce->cpu_panes;
+        args.prefixes = args.panes + reduce->cpu_pane_capacity;
+        args.suffixes = args.prefixes + reduce->cpu_pane_capacity;
+    }
+
+    if (args.pane_num >= thread_num) {
+        cpu_execute(reduce_panes_kernel, &args);
+        cpu_execute(scan_blocks_kernel, &args);
+        cpu_execute(assemble_windows_kernel, &args);
+    } else if (args.num_windows + 1 >= thread_num) {
+        balance_windows(&args, thread_num);
+        cpu_execute(reduce_windows_kernel, &args);
+    } else {
+        for (int wid=0; wid<=args.num_windows; wid++) {
+            if (get_window_range(&args, wid, &args.start, &args.end) < 0) {
+                continue;
+            }
+
+            cpu_execute(reduce_partial_kernel, &args);
+
+            for (int i=1; i<thread_num; i++) {
+                mergef(reduce, &args.partials[0], &args.partials[i]);
+            }
+            copyf(&args, &args.partials[0], wid);
+        }
+    }
+}
@@ -3,8 +3,10 @@
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
+#include <float.h>
 
 #include "libgpu/gpu_agg.h"
+#include "libcpu/cpu_compiler.h"
 
 #include "config.h"
 #include "generators.h"
@@ -48,10 +50,76 @@ int selection_get_output_schema_size(void * select_ptr) {
     return select->output_schema->size;
 }
 
-selection_p selection(
-    schema_p input_schema, 
-    int ref, ref_value_p value,
-    enum comparor com) {
+condition_p predicate(int ref, ref_value_p value, enum comparor com) {
+    condition_p p = (condition_p) malloc(sizeof(condition_t));
+
+    p->type = CONDITION_PREDICATE;
+    p->ref = ref;
+    p->value = value;
+    p->com = com;
+    p->selectivity = -1;
+    p->cost = -1;
+    p->left = NULL;
+    p->right = NULL;
+
+    return p;
+}
+
+static condition_p connective(enum condition_types type, condition_p left, condition_p right) {
+    if (!left || !right) {
+        fprintf(stderr, "error: a connective needs two conditions (%s)\n", __FUNCTION__);
+        exit(1);
+    }
+
+    condition_p p = (condition_p) malloc(sizeof(condition_t));
+
+    p->type = type;
+    p->ref = -1;
+    p->value = NULL;
+    p->selectivity = -1;
+    p->cost = -1;
+    p->left = left;
+    p->right = right;
+
+    return p;
+}
+
+condition_p conjunction(condition_p left, condition_p right) {
+    return connective(CONDITION_AND, left, right);
+}
+
+condition_p disjunction(condition_p left, condition_p right) {
+    return connective(CONDITION_OR, left, right);
+}
+
+int condition_get_predicate_num(condition_p condition) {
+    if (condition->type == CONDITION_PREDICATE) {
+        return 1;
+    }
+    return condition_get_predicate_num(condition->left) + condition_get_predicate_num(condition->right);
+}
+
+float condition_estimate_selectivity(condition_p condition) {
+    if (condition->type == CONDITION_PREDICATE) {
+        if (condition->selectivity >= 0) {
+            return condition->selectivity;
+        }
+
+        switch (condition->com) {
+        case EQUAL: return SELECTION_GUESS_EQUAL;
+        case UNEQUAL: return 1 - SELECTION_GUESS_EQUAL;
+        default: return SELECTION_GUESS_RANGE;
+        }
+    }
+
+    /* As if the operands were independent */
+    float left = condition_estimate_selectivity(condition->left);
+    float right = condition_estimate_selectivity(condition->right);
+
+    return (condition->type == CONDITION_AND) ? left * right : left + right - left * right;
+}
+
+selection_p selection_condition(schema_p input_schema, condition_p condition) {
 
     selection_p p = (selection_p) malloc(sizeof(selection_t));
     p->operator = (operator_p) malloc(sizeof (operator_t));
@@ -63,6 +131,19 @@ selection_p selection(
         p->operator->generate_patch = selection_generate_patch;
         p->operator->get_output_schema_size = selection_get_output_schema_size;
         p->operator->get_output_buffer = selection_get_output_buffer;
+        p->operator->get_output_size = NULL;
+        p->operator->set_input_schema = selection_set_input_schema;
+        p->operator->cpu_setup = selection_cpu_setup;
+        p->operator->cpu_process = selection_cpu_process;
+
+        /* No windows to assemble */
+        p->operator->get_partial_size = NULL;
+        p->operator->get_fragment = NULL;
+        p->operator->init_partial = NULL;
+        p->operator->merge_partial = NULL;
+        p->operator->write_window = NULL;
+        p->operator->recover_output = NULL;
+        p->operator->clone = selection_clone;
 
         p->operator->type = OPERATOR_SELECT;
 
@@ -70,180 +151,151 @@ selection_p selection(
     }
 
     p->id = free_id++;
+    p->qid = -1;
 
     p->input_schema = input_schema;
 
-    p->ref = ref;
-    p->value = value;
-    p->com = com;
+    p->condition = condition;
+    if (condition->type == CONDITION_PREDICATE) {
+        p->ref = condition->ref;
+        p->value = condition->value;
+        p->com = condition->com;
+    } else {
+        p->ref = -1;
+        p->value = NULL;
+    }
 
     /* For selection, the input and output schema are the same */
     p->output_schema = input_schema;
 
+    p->cpu_library = NULL;
+    p->cpu_select_range = NULL;
+
+    p->batch_count = 0;
+    p->patch = NULL;
+    p->version = 0;
+    p->rebuilding = 0;
+    pthread_mutex_init(&p->adapt_lock, NULL);
+    pthread_rwlock_init(&p->condition_lock, NULL);
+    p->pending_program = NULL;
+    p->pending_library = NULL;
+
     return p;
 }
 
-void selection_generate_patch(void * select_ptr, char * patch) {
-    selection_p select = (selection_p) select_ptr;
-
-    char * ret = patch; // Reuse the marcro funciton
-    char s [128] = "";
+selection_p selection(
+    schema_p input_schema, 
+    int ref, ref_value_p value,
+    enum comparor com) {
 
-    int const predicate_num = 1;
+    return selection_condition(input_schema, predicate(ref, value, com));
+}
 
-    for (int i = 0; i < predicate_num; i++) {
+/**
+ * Short-circuits, so the order chosen by condition_reorder decides which predicates are evaluated. Every 
+ * predicate loads its own attribute, so the tuple is not read for the predicates that are skipped either
+ **/
+static void generate_expression(condition_p condition, char * ret) {
+    char s [MAX_LINE_LENGTH] = "";
+
+    if (condition->type != CONDITION_PREDICATE) {
+        _sprint("(");
+        generate_expression(condition->left, ret);
+        _sprint((condition->type == CONDITION_AND) ? " && " : " || ");
+        generate_expression(condition->right, ret);
+        _sprint(")");
+        return;
+    }
 
-        if (select->value->i != NULL) {
-            _sprintf("    int attr_%d = in->tuple._%d;\n", select->id, select->ref);
-        } else if (select->value->l != NULL) {
-            _sprintf("    long attr_%d = in->tuple._%d;\n", select->id, select->ref);
-        } else if (select->value->f != NULL) {
-            _sprintf("    float attr_%d = in->tuple._%d;\n", select->id, select->ref);
-        } else if (select->value->c != NULL) {
-            _sprintf("    char attr_%d = in->tuple._%d;\n", select->id, select->ref);
-        } else {
-            exit(1);
-        }
-        
-        /* Conditions */
-        {
-            _sprint("    flag = flag & ");
-
-            _sprintf("(attr_%d ", select->id);
-
-            switch (select->com)
-            {
-            case GREATER:
-                _sprint(">");
-                break;
-            case EQUAL:
-                _sprint("==");
-                break;
-            case LESS:
-                _sprint("<");
-                break;
-            case GREATER_EQUAL:
-                _sprint(">=");
-                break;
-            case LESS_EQUAL:
-                _sprint("<=");
-                break;
-            case UNEQUAL:
-                _sprint("!=");
-                break;
-            default:
-                break;
-            }
+    /* Compared as the type of the reference value */
+    if (condition->value->i != NULL) {
+        _sprintf("((int) in->tuple._%d ", condition->ref);
+    } else if (condition->value->l != NULL) {
+        _sprintf("((long) in->tuple._%d ", condition->ref);
+    } else if (condition->value->f != NULL) {
+        _sprintf("((float) in->tuple._%d ", condition->ref);
+    } else if (condition->value->c != NULL) {
+        _sprintf("((char) in->tuple._%d ", condition->ref);
+    } else {
+        fprintf(stderr, "error: predicate has no reference value (%s)\n", __FUNCTION__);
+        exit(1);
+    }
 
-            if (select->value->i != NULL) {
-                _sprintf(" %d)", *(select->value->i));
-            } else if (select->value->l != NULL) {
-                _sprintf(" %ld)", *(select->value->l));
-            } else if (select->value->f != NULL) {
-                _sprintf(" %f)", *(select->value->f));
-            } else if (select->value->c != NULL) {
-                _sprintf(" %c)", *(select->value->c));
-            } else {
-                exit(1);
-            }
+    switch (condition->com)
+    {
+    case GREATER:
+        _sprint(">");
+        break;
+    case EQUAL:
+        _sprint("==");
+        break;
+    case LESS:
+        _sprint("<");
+        break;
+    case GREATER_EQUAL:
+        _sprint(">=");
+        break;
+    case LESS_EQUAL:
+        _sprint("<=");
+        break;
+    case UNEQUAL:
+        _sprint("!=");
+        break;
+    default:
+        break;
+    }
 
-            if (i == predicate_num - 1) {
-                _sprint(";\n");
-            } else {
-                _sprint(" & ");
-            }
-        }
+    if (condition->value->i != NULL) {
+        _sprintf(" %d)", *(condition->value->i));
+    } else if (condition->value->l != NULL) {
+        _sprintf(" %ld)", *(condition->value->l));
+    } else if (condition->value->f != NULL) {
+        _sprintf(" %f)", *(condition->value->f));
+    } else {
+        _sprintf(" %c)", *(condition->value->c));
     }
+}
 
-    _sprint("\n");
+/* Appends the statement that ands the condition into `flag` */
+static void generate_condition(selection_p select, char * ret) {
+    strcat(ret, "    flag = flag && ");
+    generate_expression(select->condition, ret);
+    strcat(ret, ";\n");
+}
+
+void selection_generate_patch(void * select_ptr, char * patch) {
+    selection_p select = (selection_p) select_ptr;
+
+    generate_condition(select, patch);
 }
 
 static char * generate_selectf(selection_p select, char const * patch) {
-    char * ret = (char *) malloc(1024 * sizeof(char)); *ret = '\0';
-    char s [128] = "";
+    int predicate_num = condition_get_predicate_num(select->condition);
 
-    int const predicate_num = 1;
+    char * ret = (char *) malloc((1024 + 128 * predicate_num + (patch ? strlen(patch) : 0)) * sizeof(char)); *ret = '\0';
+    char s [128] = "";
 
     _sprint("inline int selectf (__global input_t *in) {\n");
     _sprint("    int flag = 1;\n\n");
 
     if (patch) {
-        _sprintf("%s", patch);
+        strcat(ret, patch);
     }
 
-    for (int i = 0; i < predicate_num; i++) {
-
-        if (select->value->i != NULL) {
-            _sprintf("    int attr_%d = in->tuple._%d;\n", select->id, select->ref);
-        } else if (select->value->l != NULL) {
-            _sprintf("    long attr_%d = in->tuple._%d;\n", select->id, select->ref);
-        } else if (select->value->f != NULL) {
-            _sprintf("    float attr_%d = in->tuple._%d;\n", select->id, select->ref);
-        } else if (select->value->c != NULL) {
-            _sprintf("    char attr_%d = in->tuple._%d;\n", select->id, select->ref);
-        } else {
-            exit(1);
-        }
-        
-        /* Conditions */
-        {
-            _sprint("    flag = flag & ");
-
-            _sprintf("(attr_%d ", select->id);
-
-            switch (select->com)
-            {
-            case GREATER:
-                _sprint(">");
-                break;
-            case EQUAL:
-                _sprint("==");
-                break;
-            case LESS:
-                _sprint("<");
-                break;
-            case GREATER_EQUAL:
-                _sprint(">=");
-                break;
-            case LESS_EQUAL:
-                _sprint("<=");
-                break;
-            case UNEQUAL:
-                _sprint("!=");
-                break;
-            default:
-                break;
-            }
-
-            if (select->value->i != NULL) {
-                _sprintf(" %d)", *(select->value->i));
-            } else if (select->value->l != NULL) {
-                _sprintf(" %ld)", *(select->value->l));
-            } else if (select->value->f != NULL) {
-                _sprintf(" %f)", *(select->value->f));
-            } else if (select->value->c != NULL) {
-                _sprintf(" %c)", *(select->value->c));
-            } else {
-                exit(1);
-            }
+    generate_condition(select, ret);
+    _sprint("\n");
 
-            if (i == predicate_num - 1) {
-                _sprint(";\n\n");
-            } else {
-                _sprint(" & ");
-            }
-        }
-    }
     _sprint("    return flag;\n");
 
     _sprint("}\n\n");
+    if (patch) {
+        strcat(ret, PATCH_EPILOGUE);
+    }
 
     return ret;    
 }
 
 static char * generate_source(selection_p select, char const * patch) {
-    char * source = (char *) malloc(1024 * 10 * sizeof(char));
-
     char * extensions = read_file("cl/templates/extensions.cl");
     char * headers = read_file("cl/templates/headers.cl");
 
@@ -262,6 +314,12 @@ static char * generate_source(selection_p select, char const * patch) {
     char * template = read_file(SELECTION_CODE_TEMPLATE);
 
     /* Assembling */
+    char * source = (char *) malloc((strlen(extensions) + strlen(headers) + strlen(tuple_size) + strlen(input_tuple) 
+        + strlen(output_tuple) + strlen(selectf) + strlen(template) + 1) * sizeof(char));
+    if (! source) {
+        fprintf(stderr, "fatal error: out of memory\n");
+        exit(1);
+    }
     strcpy(source, extensions);
 
     strcat(source, headers);
@@ -286,6 +344,215 @@ static char * generate_source(selection_p select, char const * patch) {
     return source;
 }
 
+char * selection_generate_c_source(selection_p select, char const * patch) {
+    char * headers = generate_c_headers();
+    char * tuple_size = generate_tuple_size(select->input_schema, select->output_schema, 16);
+    char * input_tuple = generate_input_tuple(select->output_schema, NULL, 16);
+    char * selectf = generate_selectf(select, patch);
+    char * select_range = generate_c_select_range();
+
+    char * source = (char *) malloc((strlen(headers) + strlen(tuple_size) + strlen(input_tuple) + strlen(selectf) 
+        + strlen(select_range) + 1) * sizeof(char));
+    if (! source) {
+        fprintf(stderr, "fatal error: out of memory\n");
+        exit(1);
+    }
+    strcpy(source, headers);
+    strcat(source, tuple_size);
+    strcat(source, input_tuple);
+    strcat(source, selectf);
+    strcat(source, select_range);
+
+    free(headers);
+    free(tuple_size);
+    free(input_tuple);
+    free(selectf);
+    free(select_range);
+
+    return source;
+}
+
+/* Rank of an operand of a chain: AND first evaluates what rejects the most tuples per unit of cost, OR 
+   what accepts the most */
+static float condition_rank(enum condition_types type, float selectivity, float cost) {
+    float decided = (type == CONDITION_AND) ? 1 - selectivity : selectivity;
+
+    return (decided > 0) ? cost / decided : FLT_MAX;
+}
+
+/* The operands of the chain of connectives of the same type rooted at condition, and the connectives */
+static void condition_collect(condition_p condition, enum condition_types type,
+    condition_p * operands, int * operand_num, condition_p * connectives, int * connective_num) {
+
+    if (condition->type != type) {
+        operands[(*operand_num)++] = condition;
+        return;
+    }
+
+    connectives[(*connective_num)++] = condition;
+    condition_collect(condition->left, type, operands, operand_num, connectives, connective_num);
+    condition_collect(condition->right, type, operands, operand_num, connectives, connective_num);
+}
+
+/**
+ * Sorts the operands of every chain by rank and rebuilds the chain left-deep, so that both the generated 
+ * code and the host evaluation see them in that order. The selectivity and cost of a chain are estimated 
+ * from its operands as if they were independent. Returns whether any order has changed
+ **/
+static bool condition_reorder(condition_p condition, float * selectivity, float * cost) {
+    if (condition->type == CONDITION_PREDICATE) {
+        *selectivity = condition->selectivity;
+        *cost = condition->cost;
+        return false;
+    }
+
+    enum condition_types type = condition->type;
+    int n = condition_get_predicate_num(condition);
+
+    condition_p operands [n];
+    condition_p connectives [n];
+    int operand_num = 0, connective_num = 0;
+    condition_collect(condition, type, operands, &operand_num, connectives, &connective_num);
+
+    bool changed = false;
+    float selectivities [n], costs [n], ranks [n];
+    for (int i=0; i<operand_num; i++) {
+        changed |= condition_reorder(operands[i], &selectivities[i], &costs[i]);
+        ranks[i] = condition_rank(type, selectivities[i], costs[i]);
+    }
+
+    /* An operand only overtakes one that is clearly worse, so that sampling noise does not keep rebuilding */
+    for (int i=1; i<operand_num; i++) {
+        for (int j=i; j>0 && ranks[j] < ranks[j-1] * SELECTION_REORDER_MARGIN; j--) {
+            condition_p o = operands[j]; operands[j] = operands[j-1]; operands[j-1] = o;
+            float p = selectivities[j]; selectivities[j] = selectivities[j-1]; selectivities[j-1] = p;
+            float c = costs[j]; costs[j] = costs[j-1]; costs[j-1] = c;
+            float r = ranks[j]; ranks[j] = ranks[j-1]; ranks[j-1] = r;
+            changed = true;
+        }
+    }
+
+    /* The root stays the root: (((o0 op o1) op o2) ... op on) */
+    for (int k=0; k<connective_num; k++) {
+        connectives[k]->right = operands[operand_num - 1 - k];
+        connectives[k]->left = (k + 1 < connective_num) ? connectives[k + 1] : operands[0];
+    }
+
+    /* An operand is only evaluated on the tuples the ones before have not decided */
+    float undecided = 1;
+    *cost = 0;
+    for (int i=0; i<operand_num; i++) {
+        *cost += undecided * costs[i];
+        undecided *= (type == CONDITION_AND) ? selectivities[i] : 1 - selectivities[i];
+    }
+    *selectivity = (type == CONDITION_AND) ? undecided : 1 - undecided;
+
+    return changed;
+}
+
+typedef struct selection_rebuild {
+    selection_p select;
+    char * source;   /* OpenCL, if the query runs on the GPU */
+    char * c_source; /* C, if the query is fused on the host */
+    int version;
+} selection_rebuild_t;
+
+/* Builds the programs of a new order and leaves them for the backends to swap in */
+static void * selection_rebuild(void * rebuild_ptr) {
+    selection_rebuild_t * rebuild = (selection_rebuild_t *) rebuild_ptr;
+    selection_p select = rebuild->select;
+
+    if (rebuild->source) {
+        cl_program program = gpu_build_program(rebuild->source);
+
+        cl_program old = (cl_program) __atomic_exchange_n(&select->pending_program, (void *) program, __ATOMIC_ACQ_REL);
+        if (old) {
+            gpu_release_program(old);
+        }
+        free(rebuild->source);
+    }
+
+    if (rebuild->c_source) {
+        /* A new file name, since dlopen returns the library already loaded for the same one */
+        char base [64];
+        sprintf(base, "%s_%d", SELECTION_CODE_FILENAME, rebuild->version);
+        char * filename = generate_c_filename(select->id, base);
+
+        /* On failure the old library simply stays */
+        void * library = cpu_compile(rebuild->c_source, filename);
+        if (library) {
+            void * old = __atomic_exchange_n(&select->pending_library, library, __ATOMIC_ACQ_REL);
+            if (old) {
+                cpu_release(old);
+            }
+        }
+        free(filename);
+        free(rebuild->c_source);
+    }
+
+    __atomic_store_n(&select->rebuilding, 0, __ATOMIC_RELEASE);
+    free(rebuild);
+
+    return NULL;
+}
+
+void selection_adapt(selection_p select, batch_p input) {
+    if (select->condition->type == CONDITION_PREDICATE) {
+        return;
+    }
+
+    if (__atomic_add_fetch(&select->batch_count, 1, __ATOMIC_RELAXED) % SELECTION_SAMPLE_INTERVAL != 0) {
+        return;
+    }
+
+    /* Whichever backend comes first adapts; the other one does not wait for it */
+    if (pthread_mutex_trylock(&select->adapt_lock) != 0) {
+        return;
+    }
+
+    if (!__atomic_load_n(&select->rebuilding, __ATOMIC_ACQUIRE)) {
+        selection_cpu_sample(select, input->buffer + input->start, input->size);
+
+        bool changed = false;
+        if (pthread_rwlock_trywrlock(&select->condition_lock) == 0) {
+            float selectivity, cost;
+            changed = condition_reorder(select->condition, &selectivity, &cost);
+            pthread_rwlock_unlock(&select->condition_lock);
+        }
+
+        /* The separate host evaluation follows the new order at once, the generated programs are rebuilt */
+        if (changed && (select->qid >= 0 || select->cpu_library)) {
+            selection_rebuild_t * rebuild = (selection_rebuild_t *) malloc(sizeof(selection_rebuild_t));
+            rebuild->select = select;
+            rebuild->source = (select->qid >= 0) ? generate_source(select, select->patch) : NULL;
+            rebuild->c_source = (select->cpu_library) ? selection_generate_c_source(select, select->patch) : NULL;
+            rebuild->version = ++select->version;
+
+            select->rebuilding = 1;
+
+            pthread_t thread;
+            if (pthread_create(&thread, NULL, selection_rebuild, (void *) rebuild)) {
+                fprintf(stderr, "error: failed to create the rebuilding thread (%s)\n", __FUNCTION__);
+                exit(1);
+            }
+            pthread_detach(thread);
+        }
+    }
+
+    pthread_mutex_unlock(&select->adapt_lock);
+}
+
+void selection_observe(selection_p select, batch_p input) {
+    if (pthread_mutex_trylock(&select->adapt_lock) != 0) {
+        return;
+    }
+
+    /* The condition is only reordered under the same lock */
+    selection_cpu_sample(select, input->buffer + input->start, input->size);
+
+    pthread_mutex_unlock(&select->adapt_lock);
+}
+
 void selection_setup(void * select_ptr, int batch_size, window_p window, char const * patch) {
     selection_p select = (selection_p) select_ptr;
 
@@ -334,13 +601,16 @@ void selection_setup(void * select_ptr, int batch_size, window_p window, char co
     gpu_set_output (qid, 2, 4 * work_group_num,       0, 0, 0, 0, 1); /* Partitions */
     gpu_set_output (qid, 3, batch_size * tuple_size,  1, 0, 0, 1, 0); /*    Results */
     
-    /* GPU kernels setup */
-    int args[3];
-    args[0] = batch_size * tuple_size;
-    args[1] = batch_size;
-    args[2] = 4 * select->threads_per_group[0] * SELECTION_TUPLES_PER_THREADS;
+    /* GPU kernels setup; the arguments are kept to set the kernels of a rebuilt program */
+    select->kernel_args[0] = batch_size * tuple_size;
+    select->kernel_args[1] = batch_size;
+    select->kernel_args[2] = 4 * select->threads_per_group[0] * SELECTION_TUPLES_PER_THREADS;
 
-    gpu_set_kernel_select (qid, args);
+    gpu_set_kernel_select (qid, select->kernel_args);
+
+    if (patch && !select->patch) {
+        select->patch = strdup(patch);
+    }
 
     /* Free the inputed files */
     free(source);
@@ -369,6 +639,15 @@ void selection_process(void * select_ptr, batch_p input, window_p window, u_int8
     int tuple_size = select->input_schema->size;
     int work_group_num = select->threads[0] / select->threads_per_group[0];
 
+    /* Swap in the program of a new predicate order; the batches in the pipeline finish with the old one */
+    cl_program program = (cl_program) __atomic_exchange_n(&select->pending_program, NULL, __ATOMIC_ACQ_REL);
+    if (program) {
+        gpu_set_program(select->qid, program);
+        gpu_set_kernel_select(select->qid, select->kernel_args);
+    }
+
+    selection_adapt(select, input);
+
     /* Set input buffer addresses and entries */
     u_int8_t * inputs [1] = {input->buffer + input->start};
 
@@ -379,6 +658,32 @@ void selection_process(void * select_ptr, batch_p input, window_p window, u_int8
         event);
 }
 
+void selection_set_input_schema(void * select_ptr, schema_p input_schema) {
+    selection_p select = (selection_p) select_ptr;
+
+    select->input_schema = input_schema;
+
+    /* For selection, the input and output schema are the same */
+    select->output_schema = input_schema;
+}
+
+static condition_p condition_copy(condition_p condition) {
+    if (condition->type == CONDITION_PREDICATE) {
+        condition_p p = predicate(condition->ref, condition->value, condition->com);
+        p->selectivity = condition->selectivity;
+        p->cost = condition->cost;
+        return p;
+    }
+
+    return connective(condition->type, condition_copy(condition->left), condition_copy(condition->right));
+}
+
+void * selection_clone(void * select_ptr) {
+    selection_p select = (selection_p) select_ptr;
+
+    return selection_condition(select->input_schema, condition_copy(select->condition));
+}
+
 u_int8_t ** selection_get_output_buffer(void * select_ptr, batch_p output) {
     selection_p select = (selection_p) select_ptr;
 
@@ -466,4 +771,5 @@ void selection_process_output (void * select_ptr, batch_p outputs) {
     /* Update pointers to use only the output array (tuples) and exclude flags and partitions */
     outputs->start += select->output_entries[2];
     outputs->size = count;
+    outputs->tuple_size = select->output_schema->size;
 }
@@ -1,6 +1,8 @@
 #ifndef SELECTION_H
 #define SELECTION_H
 
+#include <pthread.h>
+
 #include "batch.h"
 #include "schema.h"
 #include "operator.h"
@@ -10,6 +12,16 @@
 #define SELECTION_CODE_FILENAME "cl/select"
 #define SELECTION_CODE_TEMPLATE "cl/templates/select_template.cl"
 
+/* A condition with several predicates samples them every SELECTION_SAMPLE_INTERVAL batches, on
+   SELECTION_SAMPLE_SIZE tuples, and reorders them when an operand ranks below MARGIN times the one before */
+#define SELECTION_SAMPLE_INTERVAL 16
+#define SELECTION_SAMPLE_SIZE 1024
+#define SELECTION_REORDER_MARGIN 0.8f
+
+/* Pass rates of a predicate that has not been sampled, by comparison; UNEQUAL passes what EQUAL does not */
+#define SELECTION_GUESS_EQUAL 0.1f
+#define SELECTION_GUESS_RANGE 0.33f
+
 enum comparor {
     GREATER,
     EQUAL,
@@ -27,6 +39,45 @@ typedef struct ref_value {
     char * c;
 } ref_value_t;
 
+enum condition_types {
+    CONDITION_PREDICATE, /* attribute com value */
+    CONDITION_AND,
+    CONDITION_OR
+};
+
+/* A boolean expression tree over the attributes of a tuple */
+typedef struct condition * condition_p;
+typedef struct condition {
+    enum condition_types type;
+
+    /* CONDITION_PREDICATE */
+    int ref;
+    ref_value_p value;
+    enum comparor com;
+
+    /* Sampled pass rate and nanoseconds per tuple of a predicate, negative until it is sampled */
+    float selectivity;
+    float cost;
+
+    /* CONDITION_AND and CONDITION_OR, evaluated left first */
+    condition_p left;
+    condition_p right;
+} condition_t;
+
+condition_p predicate(int ref, ref_value_p value, enum comparor com);
+
+/* left AND right */
+condition_p conjunction(condition_p left, condition_p right);
+
+/* left OR right */
+condition_p disjunction(condition_p left, condition_p right);
+
+/* Number of the predicates (leaves) of a condition */
+int condition_get_predicate_num(condition_p condition);
+
+/* Pass rate of a condition from the sampled ones of its predicates, or a guess for those not yet sampled */
+float condition_estimate_selectivity(condition_p condition);
+
 typedef struct selection * selection_p;
 typedef struct selection {
     operator_p operator; /* As a parent class */
@@ -37,6 +88,9 @@ typedef struct selection {
     int batch_size;
     schema_p input_schema;
 
+    condition_p condition;
+
+    /* The predicate of a condition with a single one, for the vectorised host path */
     int ref;
     ref_value_p value;
     enum comparor com;
@@ -47,6 +101,23 @@ typedef struct selection {
     size_t threads[SELECTION_KERNEL_NUM];
     size_t threads_per_group [SELECTION_KERNEL_NUM];
 
+    /* Host version of a fused query, compiled from the generated C source */
+    void * cpu_library;
+    int (* cpu_select_range) (u_int8_t const * input, int from, int to, int * flags);
+
+    /* Adaptive predicate order. Reordering takes the write lock of the condition without waiting, the 
+       host evaluation holds the read lock. The programs of the new order are built on another thread 
+       and each backend swaps in its pending one before its next batch */
+    int batch_count;
+    char * patch;
+    int kernel_args[3];
+    int version;
+    int rebuilding;
+    pthread_mutex_t adapt_lock;
+    pthread_rwlock_t condition_lock;
+    void * pending_program; /* cl_program */
+    void * pending_library;
+
 } selection_t;
 
 ref_value_p ref_value();
@@ -56,6 +127,9 @@ void ref_value_free(ref_value_p);
 /* Constructor */
 selection_p selection(schema_p input_schema, int ref, ref_value_p value, enum comparor com);
 
+/* Constructor of a selection with several predicates, evaluated by one branch-free function */
+selection_p selection_condition(schema_p input_schema, condition_p condition);
+
 void selection_setup(void * select_ptr, int batch_size, window_p window, char const * patch);
 
 /* Reset threads[] and thread_per_group[] according to new_batch_size */
@@ -65,6 +139,11 @@ void selection_process(void * select_ptr, batch_p batch, window_p window, u_int8
 
 u_int8_t ** selection_get_output_buffer(void * select_ptr, batch_p output);
 
+void selection_set_input_schema(void * select_ptr, schema_p input_schema);
+
+/* The copy evaluates a copy of the condition, which it samples and reorders on its own */
+void * selection_clone(void * select_ptr);
+
 /* Only for debugging. No longer consistent with the current design */
 void selection_print_output(selection_p select, batch_p outputs);
 
@@ -73,4 +152,23 @@ void selection_process_output (void * select_ptr, batch_p outputs);
 
 void selection_generate_patch(void * select_ptr, char * patch);
 
+/**
+ * Called by both backends before a batch: samples the predicates every SELECTION_SAMPLE_INTERVAL 
+ * batches and, if the best order has changed, reorders the condition and rebuilds the programs
+ **/
+void selection_adapt(selection_p select, batch_p input);
+
+/* Samples the predicates on a batch without processing it, for a selection that passes its batches on */
+void selection_observe(selection_p select, batch_p input);
+
+/* Host backend (selection_cpu.c) */
+char * selection_generate_c_source(selection_p select, char const * patch);
+
+void selection_cpu_setup(void * select_ptr, int batch_size, window_p window, char const * patch);
+
+/* Folds the pass rate and cost of every predicate on a block of the input into their statistics */
+void selection_cpu_sample(selection_p select, u_int8_t const * input, int batch_size);
+
+void selection_cpu_process(void * select_ptr, batch_p batch, window_p window, u_int8_t ** processed_outputs, query_event_p event);
+
 #endif
@@ -0,0 +1,455 @@
+#include "selection.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "generators.h"
+#include "libcpu/cpu_agg.h"
+#include "libcpu/cpu_compiler.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define SELECTION_CPU_AVX2
+#include <immintrin.h>
+#endif
+
+typedef struct selection_args {
+    selection_p select;
+
+    u_int8_t const * input;
+    int tuples; /* Of this batch, which may be shorter than the partitions cover */
+    int tuple_size;
+    int attr_offset; /* Of the predicate of a single-predicate condition */
+
+    int partition_num;
+    int partition_size; /* In tuples */
+
+    int * flags;
+    int * partitions;
+    u_int8_t * results;
+
+    int * offsets; /* Exclusive prefix sum of partitions */
+
+    int vectorised; /* AVX2 is available and the attribute is a 4-byte int or float */
+} selection_args_t;
+
+/* The flags of tuples [from, to) are written to out[0, to - from) */
+#define SELECTION_CPU_SCAN(type, op, value) \
+{\
+    type const v = (value);\
+    for (int i=from; i<to; i++) {\
+        out[i - from] = (*((type const *) (attr + (long) i * tuple_size)) op v);\
+    }\
+}
+
+#define SELECTION_CPU_COMPARE(type, value) \
+{\
+    switch (predicate->com) {\
+    case GREATER:       SELECTION_CPU_SCAN(type,  >, value); break;\
+    case EQUAL:         SELECTION_CPU_SCAN(type, ==, value); break;\
+    case LESS:          SELECTION_CPU_SCAN(type,  <, value); break;\
+    case GREATER_EQUAL: SELECTION_CPU_SCAN(type, >=, value); break;\
+    case LESS_EQUAL:    SELECTION_CPU_SCAN(type, <=, value); break;\
+    case UNEQUAL:       SELECTION_CPU_SCAN(type, !=, value); break;\
+    default: break;\
+    }\
+}
+
+static void predicatef(selection_args_t * args, condition_p predicate, int from, int to, int * out) {
+    int const tuple_size = args->tuple_size;
+    u_int8_t const * attr = args->input + schema_get_attr_offset(args->select->input_schema, predicate->ref);
+
+    if (predicate->value->i != NULL) {
+        SELECTION_CPU_COMPARE(int, *(predicate->value->i));
+    } else if (predicate->value->l != NULL) {
+        SELECTION_CPU_COMPARE(long, *(predicate->value->l));
+    } else if (predicate->value->f != NULL) {
+        SELECTION_CPU_COMPARE(float, *(predicate->value->f));
+    } else if (predicate->value->c != NULL) {
+        SELECTION_CPU_COMPARE(char, *(predicate->value->c));
+    } else {
+        fprintf(stderr, "error: selection has no reference value (%s)\n", __FUNCTION__);
+        exit(1);
+    }
+}
+
+/**
+ * A predicate at a time over the whole range, then the flags are combined without branching. The right 
+ * operand is only evaluated between the first and the last tuple the left one has not decided
+ **/
+static void conditionf(selection_args_t * args, condition_p condition, int from, int to, int * out) {
+    if (condition->type == CONDITION_PREDICATE) {
+        predicatef(args, condition, from, to, out);
+        return;
+    }
+
+    conditionf(args, condition->left, from, to, out);
+
+    int const decided = (condition->type == CONDITION_OR);
+    int first = from, last = to;
+    while (first < last && out[first - from] == decided) {
+        first++;
+    }
+    while (last > first && out[last - 1 - from] == decided) {
+        last--;
+    }
+    if (first == last) {
+        return;
+    }
+
+    int other [last - first];
+    conditionf(args, condition->right, first, last, other);
+
+    if (condition->type == CONDITION_AND) {
+        for (int i=first; i<last; i++) {
+            out[i - from] &= other[i - first];
+        }
+    } else {
+        for (int i=first; i<last; i++) {
+            out[i - from] |= other[i - first];
+        }
+    }
+}
+
+/* Evaluate the condition on tuples [from, to) and set their flags */
+static void selectf(selection_args_t * args, int from, int to) {
+    if (from < to) {
+        conditionf(args, args->select->condition, from, to, args->flags + from);
+    }
+}
+
+#ifdef SELECTION_CPU_AVX2
+
+/* Positions of the set bits of every 8-bit mask, to left-pack the selected tuples of 8 */
+static u_int8_t left_pack [256][8];
+
+static void left_pack_init() {
+    for (int mask=0; mask<256; mask++) {
+        int k = 0;
+        for (int j=0; j<8; j++) {
+            if (mask & (1 << j)) {
+                left_pack[mask][k++] = j;
+            }
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+static inline __m256i compare_int(__m256i x, __m256i v, enum comparor com) {
+    __m256i const ones = _mm256_set1_epi32(-1);
+
+    switch (com) {
+    case GREATER:       return _mm256_cmpgt_epi32(x, v);
+    case EQUAL:         return _mm256_cmpeq_epi32(x, v);
+    case LESS:          return _mm256_cmpgt_epi32(v, x);
+    case GREATER_EQUAL: return _mm256_xor_si256(_mm256_cmpgt_epi32(v, x), ones);
+    case LESS_EQUAL:    return _mm256_xor_si256(_mm256_cmpgt_epi32(x, v), ones);
+    case UNEQUAL:       return _mm256_xor_si256(_mm256_cmpeq_epi32(x, v), ones);
+    default:            return _mm256_setzero_si256();
+    }
+}
+
+__attribute__((target("avx2")))
+static inline __m256i compare_float(__m256 x, __m256 v, enum comparor com) {
+    switch (com) {
+    case GREATER:       return _mm256_castps_si256(_mm256_cmp_ps(x, v, _CMP_GT_OQ));
+    case EQUAL:         return _mm256_castps_si256(_mm256_cmp_ps(x, v, _CMP_EQ_OQ));
+    case LESS:          return _mm256_castps_si256(_mm256_cmp_ps(x, v, _CMP_LT_OQ));
+    case GREATER_EQUAL: return _mm256_castps_si256(_mm256_cmp_ps(x, v, _CMP_GE_OQ));
+    case LESS_EQUAL:    return _mm256_castps_si256(_mm256_cmp_ps(x, v, _CMP_LE_OQ));
+    case UNEQUAL:       return _mm256_castps_si256(_mm256_cmp_ps(x, v, _CMP_NEQ_UQ));
+    default:            return _mm256_setzero_si256();
+    }
+}
+
+/* selectf on 8 tuples at a time, gathering the attribute; returns the number of selected tuples */
+__attribute__((target("avx2")))
+static int selectf_avx2(selection_args_t * args, int from, int to) {
+    selection_p select = args->select;
+    int const tuple_size = args->tuple_size;
+    int * flags = args->flags;
+    u_int8_t const * attr = args->input + args->attr_offset;
+
+    int const is_float = (select->value->i == NULL);
+    __m256i const vi = _mm256_set1_epi32(is_float ? 0 : *(select->value->i));
+    __m256 const vf = _mm256_set1_ps(is_float ? *(select->value->f) : 0);
+
+    /* Byte offsets of the attribute in 8 consecutive tuples */
+    __m256i const index = _mm256_mullo_epi32(
+        _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(tuple_size));
+
+    int count = 0;
+    int i = from;
+    for (; i + 8 <= to; i += 8) {
+        u_int8_t const * base = attr + (long) i * tuple_size;
+
+        __m256i mask;
+        if (is_float) {
+            mask = compare_float(_mm256_i32gather_ps((float const *) base, index, 1), vf, select->com);
+        } else {
+            mask = compare_int(_mm256_i32gather_epi32((int const *) base, index, 1), vi, select->com);
+        }
+
+        _mm256_storeu_si256((__m256i *) (flags + i), _mm256_srli_epi32(mask, 31));
+        count += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(mask)));
+    }
+
+    if (i < to) {
+        selectf(args, i, to);
+        for (; i < to; i++) {
+            count += flags[i];
+        }
+    }
+    return count;
+}
+
+/* Copies the selected tuples of [start, end) to out, 8 flags at a time */
+__attribute__((target("avx2")))
+static void compactf_avx2(selection_args_t * args, int start, int end, u_int8_t * out) {
+    int const tuple_size = args->tuple_size;
+    int const * flags = args->flags;
+    u_int8_t const * input = args->input;
+
+    int i = start;
+    for (; i + 8 <= end; i += 8) {
+        __m256i f = _mm256_loadu_si256((__m256i const *) (flags + i));
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_slli_epi32(f, 31)));
+        int n = __builtin_popcount(mask);
+
+        u_int8_t const * positions = left_pack[mask];
+        for (int k=0; k<n; k++) {
+            u_int8_t const * in = input + (long) (i + positions[k]) * tuple_size;
+
+            if (tuple_size == 64) {
+                _mm256_storeu_si256((__m256i *) out, _mm256_loadu_si256((__m256i const *) in));
+                _mm256_storeu_si256((__m256i *) (out + 32), _mm256_loadu_si256((__m256i const *) (in + 32)));
+            } else {
+                memcpy(out, in, tuple_size);
+            }
+            out += tuple_size;
+        }
+    }
+
+    for (; i < end; i++) {
+        if (flags[i]) {
+            memcpy(out, input + (long) i * tuple_size, tuple_size);
+            out += tuple_size;
+        }
+    }
+}
+
+#endif /* SELECTION_CPU_AVX2 */
+
+/* Phase 1: flags and the number of selected tuples of each partition */
+static void select_kernel(void * args_ptr, int tid, int thread_num) {
+    selection_args_t * args = (selection_args_t *) args_ptr;
+
+    int from, to;
+    cpu_get_range(args->partition_num, tid, thread_num, &from, &to);
+
+    for (int p=from; p<to; p++) {
+        int start = p * args->partition_size;
+        int end = start + args->partition_size;
+        if (end > args->tuples) {
+            end = args->tuples;
+        }
+
+        if (start >= end) {
+            args->partitions[p] = 0;
+            continue;
+        }
+
+        if (args->select->cpu_select_range) {
+            args->partitions[p] = (* args->select->cpu_select_range) (args->input, start, end, args->flags);
+            continue;
+        }
+
+#ifdef SELECTION_CPU_AVX2
+        if (args->vectorised) {
+            args->partitions[p] = selectf_avx2(args, start, end);
+            continue;
+        }
+#endif
+
+        selectf(args, start, end);
+
+        int count = 0;
+        for (int i=start; i<end; i++) {
+            count += args->flags[i];
+        }
+        args->partitions[p] = count;
+    }
+}
+
+/* Phase 2: compact the selected tuples of each partition to its offset in the results */
+static void compact_kernel(void * args_ptr, int tid, int thread_num) {
+    selection_args_t * args = (selection_args_t *) args_ptr;
+    int const tuple_size = args->tuple_size;
+
+    int from, to;
+    cpu_get_range(args->partition_num, tid, thread_num, &from, &to);
+
+    for (int p=from; p<to; p++) {
+        int start = p * args->partition_size;
+        int end = start + args->partition_size;
+        if (end > args->tuples) {
+            end = args->tuples;
+        }
+
+        u_int8_t * out = args->results + (long) args->offsets[p] * tuple_size;
+
+#ifdef SELECTION_CPU_AVX2
+        if (args->vectorised) {
+            compactf_avx2(args, start, end, out);
+            continue;
+        }
+#endif
+
+        for (int i=start; i<end; i++) {
+            if (args->flags[i]) {
+                memcpy(out, args->input + (long) i * tuple_size, tuple_size);
+                out += tuple_size;
+            }
+        }
+    }
+}
+
+static void sample_predicates(selection_args_t * args, condition_p condition, int from, int to, int * out) {
+    if (condition->type != CONDITION_PREDICATE) {
+        sample_predicates(args, condition->left, from, to, out);
+        sample_predicates(args, condition->right, from, to, out);
+        return;
+    }
+
+    /* Once untimed so that the first predicate does not pay for bringing the block into the cache */
+    predicatef(args, condition, from, to, out);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    predicatef(args, condition, from, to, out);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    int passed = 0;
+    for (int i=0; i<to-from; i++) {
+        passed += out[i];
+    }
+
+    float selectivity = (float) passed / (to - from);
+    float cost = ((end.tv_sec - start.tv_sec) * 1e9f + (end.tv_nsec - start.tv_nsec)) / (to - from);
+
+    /* Half of the old statistics are kept, to follow the stream without jumping at every sample */
+    if (condition->selectivity < 0) {
+        condition->selectivity = selectivity;
+        condition->cost = cost;
+    } else {
+        condition->selectivity = (condition->selectivity + selectivity) / 2;
+        condition->cost = (condition->cost + cost) / 2;
+    }
+}
+
+void selection_cpu_sample(selection_p select, u_int8_t const * input, int batch_size) {
+    int size = (batch_size < SELECTION_SAMPLE_SIZE) ? batch_size : SELECTION_SAMPLE_SIZE;
+    if (size == 0) {
+        return;
+    }
+
+    /* Every sample is taken from another block of the batch */
+    int samples = select->batch_count / SELECTION_SAMPLE_INTERVAL;
+    int from = (int) (((long) samples * size) % (batch_size - size + 1));
+
+    selection_args_t args;
+    args.select = select;
+    args.input = input;
+    args.tuple_size = select->input_schema->size;
+
+    int out [size];
+    sample_predicates(&args, select->condition, from, from + size, out);
+}
+
+void selection_cpu_setup(void * select_ptr, int batch_size, window_p window, char const * patch) {
+    selection_p select = (selection_p) select_ptr;
+
+    /* A fused query is compiled from the same generated selectf as the GPU kernels */
+    if (patch && *patch) {
+        char * source = selection_generate_c_source(select, patch);
+        char * filename = generate_c_filename(select->id, SELECTION_CODE_FILENAME);
+
+        select->cpu_library = cpu_compile(source, filename);
+        if (!select->cpu_library) {
+            fprintf(stderr, "error: the host backend needs a C compiler to run fused operators (%s)\n", __FUNCTION__);
+            exit(1);
+        }
+        select->cpu_select_range = cpu_get_function(select->cpu_library, "select_range");
+
+        if (!select->patch) {
+            select->patch = strdup(patch);
+        }
+
+        free(filename);
+        free(source);
+    }
+
+    /* Keep the same partitioning as the GPU kernels so that the output layout is identical */
+    selection_reset(select, batch_size);
+    int work_group_num = select->threads[0] / select->threads_per_group[0];
+
+    select->output_entries[0] = 0;
+    select->output_entries[1] = 4 * batch_size;
+    select->output_entries[2] = 4 * batch_size + 4 * work_group_num;
+
+#ifdef SELECTION_CPU_AVX2
+    left_pack_init();
+#endif
+}
+
+void selection_cpu_process(void * select_ptr, batch_p input, window_p window, u_int8_t ** processed_outputs, query_event_p event) {
+    selection_p select = (selection_p) select_ptr;
+
+    int work_group_num = select->threads[0] / select->threads_per_group[0];
+
+    /* Swap in the library of a new predicate order; no batch is using the old one at this point */
+    void * library = __atomic_exchange_n(&select->pending_library, NULL, __ATOMIC_ACQ_REL);
+    if (library) {
+        void * old = select->cpu_library;
+        select->cpu_select_range = cpu_get_function(library, "select_range");
+        select->cpu_library = library;
+        cpu_release(old);
+    }
+
+    selection_adapt(select, input);
+
+    selection_args_t args;
+    {
+        args.select = select;
+
+        args.input = input->buffer + input->start;
+        args.tuples = input->size;
+        args.tuple_size = select->input_schema->size;
+        args.attr_offset = (select->ref >= 0) ? schema_get_attr_offset(select->input_schema, select->ref) : 0;
+
+        args.partition_num = work_group_num;
+        args.partition_size = select->threads_per_group[0] * SELECTION_TUPLES_PER_THREADS;
+
+        args.flags = (int *) processed_outputs[0];
+        args.partitions = (int *) processed_outputs[1];
+        args.results = processed_outputs[2];
+
+        /* Runtime dispatch; conditions with several predicates and 8-byte and 1-byte attributes take the scalar path */
+        args.vectorised = cpu_supports_avx2() && select->condition->type == CONDITION_PREDICATE &&
+            (select->value->i != NULL || select->value->f != NULL);
+    }
+
+    pthread_rwlock_rdlock(&select->condition_lock);
+    cpu_execute(select_kernel, &args);
+    pthread_rwlock_unlock(&select->condition_lock);
+
+    int offsets [work_group_num];
+    int count = 0;
+    for (int p=0; p<work_group_num; p++) {
+        offsets[p] = count;
+        count += args.partitions[p];
+    }
+    args.offsets = offsets;
+
+    cpu_execute(compact_kernel, &args);
+}
@@ -1,9 +1,13 @@
 #include "query.h"
 
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
 
 #include "helpers.h"
+#include "cost_model.h"
+#include "operators/projection.h"
+#include "operators/selection.h"
 
 query_p query(int id, int batch_size, window_p window, bool is_merging) {
     query_p query = (query_p) malloc(sizeof(query_t));
@@ -18,6 +22,27 @@ query_p query(int id, int batch_size, window_p window, bool is_merging) {
 
     query->operator_num = 0;
     query->is_merging = is_merging;
+    query->planning = is_merging ? QUERY_PLAN_FUSED : QUERY_PLAN_SEPARATE;
+    query->stage_num = 0;
+    query->chain_num = 0;
+    for (int i=0; i<QUERY_MAX_OPERATOR_NUM; i++) {
+        query->stage_estimates[i] = -1;
+    }
+
+    query->is_adaptive = false;
+    query->is_fused = 0;
+    query->fused_stage_num = 0;
+    query->adapt_count = 0;
+    for (int i=0; i<QUERY_MAX_OPERATOR_NUM; i++) {
+        query->fused[i] = NULL;
+        query->forwards[i] = false;
+        query->measured[0][i] = -1;
+        query->measured[1][i] = -1;
+    }
+    query->correction[0] = -1;
+    query->correction[1] = -1;
+
+    query->backend = BACKEND_GPU;
 
     return query;
 }
@@ -37,11 +62,271 @@ void query_add_operator(query_p query, void * new_operator, operator_p operator_
     query->callbacks[query->operator_num] = operator_callbacks;
     query->operator_num += 1;
 
-    /* TODO: If new_operator is not the first operator, its input schema should be generated by 
-       the last operator. For example, operator like projection would change the data schema and 
-       therefore proces an output with different schema from the input data. However, since aggregation
-       type of operator would be placed at the end of the operator queue, we could safely ignore them
-       for now */
+    /* If new_operator is not the first operator, its input schema should be the output schema of the 
+       last operator. A projection changes the schema, so the operators after it have to be constructed 
+       with its output_schema */
+}
+
+void query_set_backend(query_p query, enum operator_backends backend) {
+    if (query->has_setup) {
+        fprintf(stderr, "error: Cannot change the backend of a query which has been setup (%s)\n", __FUNCTION__);
+        exit(1);
+    }
+
+    query->backend = backend;
+}
+
+void query_set_planning(query_p query, enum query_plannings planning) {
+    if (query->has_setup) {
+        fprintf(stderr, "error: Cannot change the planning of a query which has been setup (%s)\n", __FUNCTION__);
+        exit(1);
+    }
+
+    query->planning = planning;
+}
+
+void query_sample(query_p query, u_int8_t const * input, int tuples) {
+    if (query->has_setup) {
+        fprintf(stderr, "error: Cannot sample a query which has been setup (%s)\n", __FUNCTION__);
+        exit(1);
+    }
+
+    /* After the first operator that is not a selection, the tuples are no longer those of the input */
+    for (int i=0; i<query->operator_num && query->callbacks[i]->type == OPERATOR_SELECT; i++) {
+        selection_cpu_sample((selection_p) query->operators[i], input, tuples);
+    }
+}
+
+/* The output of a pipeline breaker is not a patch, so no operator after it is fused with it */
+static bool query_is_breaker(operator_p op) {
+    return op->type == OPERATOR_REDUCE || op->type == OPERATOR_AGGREGATE || op->type == OPERATOR_JOIN;
+}
+
+static char const * query_operator_name(operator_p op) {
+    switch (op->type) {
+    case OPERATOR_SELECT: return "selection";
+    case OPERATOR_REDUCE: return "reduction";
+    case OPERATOR_AGGREGATE: return "aggregation";
+    case OPERATOR_PROJECT: return "projection";
+    case OPERATOR_JOIN: return "join";
+    default: return "operator";
+    }
+}
+
+static void query_add_stage(query_p query, int first, int sink) {
+    query->stage_first[query->stage_num] = first;
+    query->stage_sink[query->stage_num] = sink;
+    query->stage_num += 1;
+}
+
+/**
+ * Splits the chain into stages. A stage ends at a pipeline breaker or at the last operator, its sink, and
+ * the operators before the sink are generated as patches into the kernel of the sink. A projection changes 
+ * the tuples the operators after it read, so it is only fused into a reduction, whose generated reducef 
+ * reads the projected tuple through the patch: a selection would copy the input tuples instead of the 
+ * projected ones, and the aggregation and the join read the input tuples outside of the patch. For any other
+ * sink, the operators before a projection are a stage and the projection is one on its own.
+ **/
+static void query_plan(query_p query) {
+    query->stage_num = 0;
+
+    int first = 0;
+    while (first < query->chain_num) {
+        int sink = first;
+        while (sink < query->chain_num - 1 && !query_is_breaker(query->chain_callbacks[sink])) {
+            sink++;
+        }
+
+        if (query->chain_callbacks[sink]->type != OPERATOR_REDUCE) {
+            for (int i=first; i<=sink; i++) {
+                if (query->chain_callbacks[i]->type == OPERATOR_PROJECT) {
+                    sink = (i > first) ? i - 1 : i;
+                    break;
+                }
+            }
+        }
+
+        query_add_stage(query, first, sink);
+        first = sink + 1;
+    }
+}
+
+static void query_plan_separate(query_p query) {
+    query->stage_num = 0;
+    for (int i=0; i<query->chain_num; i++) {
+        query_add_stage(query, i, i);
+    }
+}
+
+static void query_explain(query_p query, char const * name, cost_stage_t const stages[], float cost) {
+    fprintf(stdout, "[QUERY]     %s plan: %.1f us per batch\n", name, cost);
+
+    for (int s=0; s<query->stage_num; s++) {
+        fprintf(stdout, "[QUERY]         Stage %d:", s);
+        for (int i=query->stage_first[s]; i<=query->stage_sink[s]; i++) {
+            fprintf(stdout, " %s%s", query_operator_name(query->chain_callbacks[i]), 
+                (i < query->stage_sink[s]) ? " +" : "");
+        }
+        fprintf(stdout, " (reach %.3f, pass %.3f, %.1f reads) launch %.1f + transfer %.1f + device %.1f + handoff %.1f = %.1f us\n",
+            stages[s].reach, stages[s].selectivity, stages[s].passes,
+            stages[s].launch, stages[s].transfer, stages[s].device, stages[s].handoff, stages[s].total);
+    }
+}
+
+/* Estimates both plans, reports them and keeps the cheaper one; returns whether it is the fused one */
+static bool query_choose_plan(query_p query) {
+    cost_calibration_p calibration = cost_calibrate(query->backend);
+
+    fprintf(stdout, "[QUERY] Explain: transfer %.0f B/us, device %.0f B/us, host %.0f B/us, launch %.2f us per kernel\n",
+        calibration->transfer_bandwidth, calibration->device_bandwidth, calibration->host_bandwidth, 
+        calibration->launch_overhead);
+
+    cost_stage_t fused [QUERY_MAX_OPERATOR_NUM];
+    query_plan(query);
+    float fused_cost = cost_estimate_plan(query, calibration, query->stage_num, query->stage_first, query->stage_sink, 
+        false, fused);
+    query_explain(query, "Fused", fused, fused_cost);
+
+    cost_stage_t separate [QUERY_MAX_OPERATOR_NUM];
+    query_plan_separate(query);
+    float separate_cost = cost_estimate_plan(query, calibration, query->stage_num, query->stage_first, query->stage_sink, 
+        false, separate);
+    query_explain(query, "Separate", separate, separate_cost);
+
+    cost_stage_p chosen = separate;
+    if (fused_cost < separate_cost) {
+        query_plan(query);
+        chosen = fused;
+    }
+    for (int s=0; s<query->stage_num; s++) {
+        query->stage_estimates[s] = chosen[s].total;
+    }
+
+    fprintf(stdout, "[QUERY]     Chose the %s plan\n", (chosen == fused) ? "fused" : "separate");
+    fflush(stdout);
+
+    return chosen == fused;
+}
+
+/**
+ * The plans of a query can only be switched while its windows are the same in both: a count based window 
+ * holds a number of input tuples in the fused plan but of selected ones in the separate one. The fused copy
+ * of a sink takes only selections as its patch, as what a forwarding projection passes on would not be the 
+ * tuples the separate plan gives the sink
+ **/
+static bool query_can_switch(query_p query) {
+    if (query->window->type != RANGE_BASE || query->stage_num == query->chain_num) {
+        return false;
+    }
+
+    for (int s=0; s<query->stage_num; s++) {
+        int first = query->stage_first[s];
+        int sink = query->stage_sink[s];
+        if (first == sink) {
+            continue;
+        }
+
+        for (int i=first; i<sink; i++) {
+            if (query->chain_callbacks[i]->type != OPERATOR_SELECT) {
+                return false;
+            }
+        }
+        if (!query->chain_callbacks[sink]->clone) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* The patches of the operators of a stage before its sink, one after another, or NULL if there are none */
+static char * query_generate_patch(query_p query, int first, int sink) {
+    if (first == sink) {
+        return NULL;
+    }
+
+    char * patch = (char *) malloc(1);
+    if (! patch) {
+        fprintf(stderr, "fatal error: out of memory\n");
+        exit(1);
+    }
+    *patch = '\0';
+
+    for (int i=first; i<sink; i++) {
+        char part [OPERATOR_PATCH_MAX_LENGTH] = "";
+        (* query->chain_callbacks[i]->generate_patch) (query->chain[i], part);
+
+        patch = (char *) realloc(patch, strlen(patch) + strlen(part) + 1);
+        if (! patch) {
+            fprintf(stderr, "fatal error: out of memory\n");
+            exit(1);
+        }
+        strcat(patch, part);
+    }
+
+    return patch;
+}
+
+/* Estimates plan p, the fused one with its selections forwarding to the copies of the sinks */
+static float query_model(query_p query, cost_calibration_p calibration, int p, cost_stage_t stages[]) {
+    if (p) {
+        return cost_estimate_plan(query, calibration, query->fused_stage_num, query->fused_first, query->fused_sink, 
+            true, stages);
+    }
+    return cost_estimate_plan(query, calibration, query->stage_num, query->stage_first, query->stage_sink, 
+        false, stages);
+}
+
+/* Estimates of the operators in plan p, which the monitor shows next to what they measure */
+static void query_estimate(query_p query, int p) {
+    cost_stage_t stages [QUERY_MAX_OPERATOR_NUM];
+    query_model(query, cost_calibrate(query->backend), p, stages);
+
+    if (!p) {
+        for (int s=0; s<query->stage_num; s++) {
+            query->stage_estimates[s] = stages[s].total;
+        }
+        return;
+    }
+
+    for (int s=0; s<query->fused_stage_num; s++) {
+        int first = query->fused_first[s];
+        int sink = query->fused_sink[s];
+        for (int i=first; i<sink; i++) {
+            query->stage_estimates[i] = stages[s].forward;
+        }
+        query->stage_estimates[sink] = stages[s].total - (sink - first) * stages[s].forward;
+    }
+}
+
+/* Sets up the fused copies of the sinks of an adaptive query, which runs the separate stages */
+static void query_setup_fused(query_p query) {
+    for (int s=0; s<query->fused_stage_num; s++) {
+        int first = query->fused_first[s];
+        int sink = query->fused_sink[s];
+        if (first == sink) {
+            continue;
+        }
+
+        operator_p callbacks = query->chain_callbacks[sink];
+        void * copy = (* callbacks->clone) (query->chain[sink]);
+        char * patch = query_generate_patch(query, first, sink);
+
+        if (query->backend != BACKEND_CPU) {
+            (* callbacks->setup) (copy, query->batch_size, query->window, patch);
+        }
+        if (query->backend != BACKEND_GPU) {
+            (* callbacks->cpu_setup) (copy, query->batch_size, query->window, patch);
+        }
+        free(patch);
+
+        query->fused[sink] = copy;
+        for (int i=first; i<sink; i++) {
+            query->forwards[i] = true;
+        }
+    }
+
+    query_estimate(query, query->is_fused);
 }
 
 void query_setup(query_p query) {
@@ -50,49 +335,103 @@ void query_setup(query_p query) {
         exit(1);
     }
 
-    if (query->is_merging) {
-        /* If merging the operator, all operators except for the last would be used to generated a patch 
-           function. The patch function would then be inserted into the code generated by the last operator */
+    query->chain_num = query->operator_num;
+    for (int i=0; i<query->operator_num; i++) {
+        query->chain[i] = query->operators[i];
+        query->chain_callbacks[i] = query->callbacks[i];
+    }
 
-        /* Check whether pipeline break locates at the end of operator queue and whether there are 
-           multiple pipeline breaker */
-        for (int i=0; i<query->operator_num; i++) {
-            operator_p op = query->callbacks[i];
-            if (op->type == OPERATOR_REDUCE) {
-                if (i != query->operator_num-1) {
-                    fprintf(stderr, "error: OpMerge currently does not support query with multiple pipeline \
-                        breakers or with one which is not at the end\n (%s)", __FUNCTION__);
-                    exit(1);
-                }
+    switch (query->planning) {
+    case QUERY_PLAN_FUSED:
+        query_plan(query);
+        break;
+    case QUERY_PLAN_COST:
+        query_choose_plan(query);
+        break;
+    case QUERY_PLAN_ADAPTIVE:
+        query->is_fused = query_choose_plan(query);
+        query_plan(query);
+        query->is_adaptive = query_can_switch(query);
+        if (query->is_adaptive) {
+            query->fused_stage_num = query->stage_num;
+            memcpy(query->fused_first, query->stage_first, sizeof(query->stage_first));
+            memcpy(query->fused_sink, query->stage_sink, sizeof(query->stage_sink));
+            query_plan_separate(query);
+        } else {
+            fprintf(stdout, "[QUERY]     The plans of this query cannot be switched at run time\n");
+            if (!query->is_fused) {
+                query_plan_separate(query);
             }
         }
+        break;
+    default:
+        query_plan_separate(query);
+        break;
+    }
+    query->is_merging = (query->stage_num < query->chain_num);
 
-        /* Merge operators apart from the last one and generate "patch" function */
-        char patch_func[10*1024] = "";
-        for (int i=0; i<query->operator_num - 1; i++) {
-            (* query->callbacks[i]->generate_patch) (query->operators[i], patch_func);
-        }
+    for (int s=0; s<query->stage_num; s++) {
+        int first = query->stage_first[s];
+        int sink = query->stage_sink[s];
 
-        /* Set up the last operator with the patch func */
-        int last_idx = query->operator_num-1;
-        (* query->callbacks[last_idx]->setup) (query->operators[last_idx], query->batch_size, query->window, patch_func);
+        /* The fused kernel reads the tuples before the first projection */
+        for (int i=first; i<sink; i++) {
+            if (query->chain_callbacks[i]->type == OPERATOR_PROJECT) {
+                projection_p project = (projection_p) query->chain[i];
+                (* query->chain_callbacks[sink]->set_input_schema) (query->chain[sink], project->input_schema);
+                break;
+            }
+        }
 
-        query->operators[0] = query->operators[last_idx];
-        query->callbacks[0] = query->callbacks[last_idx];
-        query->operator_num = 1;
-    } else {
-        /* If not merging, then set up the operator one by one */
+        /* Set up the sink with the patches; the host version compiles the same patch as C */
+        char * patch = query_generate_patch(query, first, sink);
 
         /* TODO: there is no checking of whether the operators[i] matches the callbacks[i] */
-        for (int i=0; i<query->operator_num; i++) {
-            (* query->callbacks[i]->setup) (query->operators[i], query->batch_size, query->window, NULL);
+        if (query->backend != BACKEND_CPU) {
+            (* query->chain_callbacks[sink]->setup) (query->chain[sink], query->batch_size, query->window, patch);
+        }
+        /* A hybrid query keeps both versions ready; they share the same output layout */
+        if (query->backend != BACKEND_GPU) {
+            (* query->chain_callbacks[sink]->cpu_setup) (query->chain[sink], query->batch_size, query->window, patch);
         }
+        free(patch);
+
+        query->operators[s] = query->chain[sink];
+        query->callbacks[s] = query->chain_callbacks[sink];
+    }
+    query->operator_num = query->stage_num;
+
+    if (query->is_adaptive) {
+        query_setup_fused(query);
+    }
+
+    if (query->planning != QUERY_PLAN_SEPARATE) {
+        query_print_plan(query);
+    }
+    if (query->is_adaptive) {
+        fprintf(stdout, "[QUERY]     Switches between these stages and the fused plan, starting with the %s plan\n",
+            query->is_fused ? "fused" : "separate");
+        fflush(stdout);
     }
 
     query->has_setup = true;
 }
 
-void query_process(query_p query, int oid, batch_p input, u_int8_t ** processed_outputs) {
+void query_print_plan(query_p query) {
+    fprintf(stdout, "[QUERY] Plan of %d operators in %d stages\n", query->chain_num, query->stage_num);
+
+    for (int s=0; s<query->stage_num; s++) {
+        fprintf(stdout, "[QUERY]     Stage %d:", s);
+        for (int i=query->stage_first[s]; i<=query->stage_sink[s]; i++) {
+            fprintf(stdout, " %s%s", query_operator_name(query->chain_callbacks[i]), 
+                (i < query->stage_sink[s]) ? " +" : "");
+        }
+        fprintf(stdout, "\n");
+    }
+    fflush(stdout);
+}
+
+void query_process(query_p query, int oid, enum operator_backends backend, batch_p input, u_int8_t ** processed_outputs, query_event_p event) {
 
     if (!query->has_setup) {
 
@@ -100,26 +439,136 @@ void query_process(query_p query, int oid, batch_p input, u_int8_t ** processed_
         exit(1);
     }
 
-    if (input->size != query->batch_size) {
+    /* A batch passed on from an upstream query may be shorter, but the device kernels are set up for whole batches */
+    if (input->size > query->batch_size || (backend == BACKEND_GPU && input->size != query->batch_size)) {
         fprintf(stderr, "error: input batch size (%d) does not match the set batch_size (%d) of the query (%s)\n",
             input->size, query->batch_size, __FUNCTION__);
         exit(1);        
     }
 
+    if (backend == BACKEND_HYBRID || (query->backend != BACKEND_HYBRID && backend != query->backend)) {
+        fprintf(stderr, "error: This query cannot be processed on the requested backend (%s)\n", __FUNCTION__);
+        exit(1);
+    }
+
     /* Execute */
-    (* query->callbacks[oid]->process) (query->operators[oid], 
-        input,
-        query->window,
-        processed_outputs,
-        NULL); // No passing event
+    if (backend == BACKEND_CPU) {
+        (* query->callbacks[oid]->cpu_process) (query_get_operator(query, oid, input), 
+            input,
+            query->window,
+            processed_outputs,
+            event);
+    } else {
+        (* query->callbacks[oid]->process) (query_get_operator(query, oid, input), 
+            input,
+            query->window,
+            processed_outputs,
+            event);
+    }
+}
+
+void * query_get_operator(query_p query, int oid, batch_p input) {
+    if (input->unselected && query->fused[oid]) {
+        return query->fused[oid];
+    }
+    return query->operators[oid];
+}
+
+u_int8_t ** query_get_output_buffer(query_p query, int oid, batch_p input, batch_p output) {
+    return (* query->callbacks[oid]->get_output_buffer) (query_get_operator(query, oid, input), output);
+}
+
+void query_process_output(query_p query, int oid, batch_p input, batch_p output) {
+    (* query->callbacks[oid]->process_output) (query_get_operator(query, oid, input), output);
+}
+
+bool query_forwards(query_p query, int oid) {
+    return query->forwards[oid] && query->is_fused;
 }
 
-u_int8_t ** query_get_output_buffer(query_p query, int oid, batch_p output) {
-    return (* query->callbacks[oid]->get_output_buffer) (query->operators[oid], output);
+void query_observe(query_p query, int oid, batch_p input, long seq) {
+    if (!query->is_adaptive || query->callbacks[oid]->type != OPERATOR_SELECT || seq % QUERY_ADAPT_INTERVAL != 0) {
+        return;
+    }
+
+    selection_observe((selection_p) query->operators[oid], input);
 }
 
-void query_process_output(query_p query, int oid, batch_p output) {
-    (* query->callbacks[oid]->process_output) (query->operators[oid], output);
+void query_record(query_p query, int oid, batch_p input, bool forwarded, long elapsed) {
+    if (!query->is_adaptive) {
+        return;
+    }
+
+    /* An operator outside the fused stages runs the same in both plans */
+    bool in_fused = query->forwards[oid] || query->fused[oid];
+    for (int p=0; p<2; p++) {
+        if (in_fused && p != (forwarded || (input->unselected && query->fused[oid]))) {
+            continue;
+        }
+
+        float average = query->measured[p][oid];
+        query->measured[p][oid] = (average < 0) ? elapsed : (7 * average + elapsed) / 8;
+    }
+}
+
+/**
+ * Microseconds of a batch of the query input in plan p from what its operators have measured, negative 
+ * if one of them has not. The selections a fused sink selects for are passed every tuple that reaches them
+ **/
+static float query_measure(query_p query, int p) {
+    float total = 0;
+    float reach = 1;
+    float deferred = 1;
+
+    for (int i=0; i<query->chain_num; i++) {
+        float measured = query->measured[p][i];
+        if (measured < 0) {
+            return -1;
+        }
+        total += reach * measured;
+
+        deferred *= cost_selectivity(query, i);
+        if (!p || !query->forwards[i]) {
+            reach *= deferred;
+            deferred = 1;
+        }
+    }
+
+    return total;
+}
+
+void query_adapt(query_p query) {
+    if (!query->is_adaptive || ++query->adapt_count % QUERY_ADAPT_INTERVAL != 0) {
+        return;
+    }
+
+    cost_calibration_p calibration = cost_calibrate(query->backend);
+    cost_stage_t stages [QUERY_MAX_OPERATOR_NUM];
+    float model [2];
+    model[0] = query_model(query, calibration, 0, stages);
+    model[1] = query_model(query, calibration, 1, stages);
+
+    /* A plan that has not run yet is taken to be as far off as the running one */
+    int running = query->is_fused;
+    float measured = query_measure(query, running);
+    if (measured > 0 && model[running] > 0) {
+        query->correction[running] = measured / model[running];
+    }
+
+    float predicted [2];
+    for (int p=0; p<2; p++) {
+        float correction = (query->correction[p] > 0) ? query->correction[p] : query->correction[running];
+        predicted[p] = model[p] * ((correction > 0) ? correction : 1);
+    }
+
+    if (predicted[!running] < QUERY_SWITCH_MARGIN * predicted[running]) {
+        query->is_fused = !running;
+        query_estimate(query, !running);
+
+        fprintf(stdout, "[QUERY] Switched to the %s plan: %.1f against %.1f us per batch\n",
+            running ? "separate" : "fused", predicted[!running], predicted[running]);
+        fflush(stdout);
+    }
 }
 
 int query_get_operator_num(query_p query) {
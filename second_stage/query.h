@@ -7,8 +7,20 @@
 #include "window.h"
 #include "operators/operator.h"
 
-/* TODO to support more than one operator */
-#define QUERY_MAX_OPERATOR_NUM 2
+#define QUERY_MAX_OPERATOR_NUM 8
+
+/* Batches of the query input between two decisions of an adaptive query, refer to query_adapt */
+#define QUERY_ADAPT_INTERVAL 16
+/* The other plan is switched to once it is estimated below this part of the running one */
+#define QUERY_SWITCH_MARGIN 0.8f
+
+/* How query_setup splits the chain into stages */
+enum query_plannings {
+    QUERY_PLAN_SEPARATE, /* Every operator is a stage */
+    QUERY_PLAN_FUSED,    /* Refer to query_plan */
+    QUERY_PLAN_COST,     /* Whichever of the two the cost model estimates cheaper, refer to cost_model.h */
+    QUERY_PLAN_ADAPTIVE  /* Starts as QUERY_PLAN_COST does and switches between the two at run time */
+};
 
 typedef struct query * query_p;
 typedef struct query {
@@ -22,22 +34,100 @@ typedef struct query {
     int operator_num;
     void * operators[QUERY_MAX_OPERATOR_NUM];
     operator_p callbacks[QUERY_MAX_OPERATOR_NUM];
-    bool is_merging;
+    bool is_merging; /* Once set up, whether any stage fuses operators */
+    enum query_plannings planning;
+
+    /**
+     * The plan, refer to query_plan: stage i runs the operators from stage_first[i] to stage_sink[i] of the 
+     * chain as added, fused into the kernel of the sink. Once set up, operators[i] is the sink of stage i 
+     * and the stages are connected by dispatchers as separate operators are
+     **/
+    int stage_num;
+    int stage_first [QUERY_MAX_OPERATOR_NUM];
+    int stage_sink [QUERY_MAX_OPERATOR_NUM];
+    int chain_num;
+    void * chain [QUERY_MAX_OPERATOR_NUM];
+    operator_p chain_callbacks [QUERY_MAX_OPERATOR_NUM];
+
+    /* Estimated microseconds of each stage for a batch of its input, negative unless the plan was costed */
+    float stage_estimates [QUERY_MAX_OPERATOR_NUM];
+
+    /**
+     * An adaptive query, refer to query_adapt, runs the stages of the separate plan and keeps the stages of
+     * the fused one in fused_first and fused_sink. fused[i] is a copy of operator i set up with the selections
+     * fused before it as its patch, NULL if operator i is not the sink of such a stage, and forwards[i] is 
+     * whether operator i is one of these selections. measured[p][i] is the moving average of operator i for a batch of its input while 
+     * the separate (p = 0) or the fused plan (p = 1) runs, and correction[p] the measured over the estimated
+     * cost of plan p; both are negative until measured
+     **/
+    bool is_adaptive;
+    volatile int is_fused;
+    int fused_stage_num;
+    int fused_first [QUERY_MAX_OPERATOR_NUM];
+    int fused_sink [QUERY_MAX_OPERATOR_NUM];
+    void * fused [QUERY_MAX_OPERATOR_NUM];
+    bool forwards [QUERY_MAX_OPERATOR_NUM];
+    int adapt_count;
+    volatile float measured [2][QUERY_MAX_OPERATOR_NUM];
+    float correction [2];
+
+    enum operator_backends backend;
 } query_t;
 
 query_p query(int id, int batch_size, window_p window, bool is_merging);
 
 void query_add_operator(query_p query, void * new_operator, operator_p operator_callbacks);
 
+/* Choose where the operators are executed; must be called before query_setup */
+void query_set_backend(query_p query, enum operator_backends backend);
+
+/* Choose how the chain is split into stages; must be called before query_setup */
+void query_set_planning(query_p query, enum query_plannings planning);
+
+/**
+ * Samples the selections that read the query input on a block of tuples of it, so that the cost model
+ * starts from their pass rates rather than from a guess; must be called before query_setup
+ **/
+void query_sample(query_p query, u_int8_t const * input, int tuples);
+
 void query_setup(query_p query);
 
-void query_process(query_p query, int oid, batch_p input, u_int8_t ** processed_outputs);
+/* Prints the stages of the plan of a query that has been setup */
+void query_print_plan(query_p query);
+
+/* backend is where this batch is processed, either BACKEND_GPU or BACKEND_CPU */
+void query_process(query_p query, int oid, enum operator_backends backend, batch_p input, u_int8_t ** processed_outputs,
+    query_event_p event);
 
-u_int8_t ** query_get_output_buffer(query_p query, int oid, batch_p output);
+/* The instance of operator oid that processes input: the fused copy for the tuples of a forwarding selection */
+void * query_get_operator(query_p query, int oid, batch_p input);
+
+u_int8_t ** query_get_output_buffer(query_p query, int oid, batch_p input, batch_p output);
 
 void query_free(query_p query);
 
-void query_process_output(query_p query, int oid, batch_p output);
+void query_process_output(query_p query, int oid, batch_p input, batch_p output);
+
+/**
+ * Whether operator oid passes the next batch of its input on as it is, for the fused copy of the sink after 
+ * it to select. That is the case for the selections before a fused sink while an adaptive query runs the 
+ * fused plan; a selection is idempotent, so a batch the separate plan has already selected may be passed on 
+ * as well, and the batches around a switch are processed right whichever plan takes them
+ **/
+bool query_forwards(query_p query, int oid);
+
+/* Samples the pass rate of a selection of an adaptive query on every QUERY_ADAPT_INTERVAL-th batch it takes */
+void query_observe(query_p query, int oid, batch_p input, long seq);
+
+/* Accounts the microseconds operator oid took for a batch to the plan it ran in */
+void query_record(query_p query, int oid, batch_p input, bool forwarded, long elapsed);
+
+/**
+ * Called for every batch of the query input. Every QUERY_ADAPT_INTERVAL batches an adaptive query estimates
+ * both plans from the pass rates its selections observe, scales the estimates by how far off they have been
+ * from what the operators measured, and switches to the other plan if it is clearly cheaper
+ **/
+void query_adapt(query_p query);
 
 int query_get_operator_num(query_p query);
 
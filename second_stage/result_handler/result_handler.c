@@ -9,11 +9,15 @@
 #include <sched.h>
 
 #include "dispatcher/dispatcher.h"
+#include "wait/wait.h"
 
 static task_p take_one_task(result_handler_p p);
 static void process_one_task (result_handler_p p, task_p t);
-static void reset_buffer(result_handler_p p);
-static u_int8_t * fill_buffer(result_handler_p p, batch_p data, long * time);
+static void reorder_one_task (result_handler_p p, task_p t);
+static void reset_buffer(result_handler_p p, int tuple_size);
+static u_int8_t * fill_buffer(result_handler_p p, batch_p data, int * from, int * len, long * time);
+static void assemble_windows(result_handler_p p, task_p t);
+static void append_output(result_handler_p p, batch_p output);
 
 static void * result_handler(void * args) {
 	result_handler_p p = (result_handler_p) args;
@@ -34,6 +38,8 @@ static void * result_handler(void * args) {
 
 	static int warned = 0;
     while (1) {
+		WAIT_POLL(WAIT_RESULT_HANDLER, p->size != 0);
+
 		pthread_mutex_lock(p->mutex);
 			while (p->size == 0) {
 				if (!warned) {
@@ -51,7 +57,7 @@ static void * result_handler(void * args) {
 		pthread_mutex_unlock(p->mutex);
 		pthread_cond_signal(p->took);
 
-		process_one_task(p, t);
+		reorder_one_task(p, t);
     }
 
 	return (args) ? NULL : args;
@@ -87,9 +93,22 @@ result_handler_p result_handler_init(event_manager_p event_manager, query_p quer
         p->tasks[i] = NULL;
     }
 
-	reset_buffer(p);
+	p->downstream_buffer = NULL;
+	p->accumulated = 0;
+	p->unselected = false;
+
+	p->partials = NULL;
+	p->partial_size = 0;
+	p->partial_head = 0;
+	p->partial_num = 0;
+	p->partial_capacity = 0;
+
+	p->output_position = 0;
 
-	p->previous = NULL;
+	p->next_seq = 0;
+	for (int i=0; i<RESULT_HANDLER_QUEUE_LIMIT; i++) {
+		p->reorder[i] = NULL;
+	}
 
 	p->manager = event_manager;
 
@@ -99,8 +118,7 @@ result_handler_p result_handler_init(event_manager_p event_manager, query_p quer
 		exit (1);
 	}
 	/* Wait until thread starts */
-	while (! p->start)
-		;
+	wait_until_set(&p->start);
 	return p;
 }
 
@@ -128,8 +146,14 @@ void result_handler_add_task (result_handler_p p, task_p t) {
 	pthread_cond_signal(p->added);
 }
 
-static void reset_buffer(result_handler_p p) {
-	p->downstream_buffer = (u_int8_t *) malloc(p->batch_size * 64 * sizeof(u_int8_t));
+/* A batch of the tuples of the upstream output schema, e.g. the wider results of a join */
+static void reset_buffer(result_handler_p p, int tuple_size) {
+	p->downstream_buffer = (u_int8_t *) malloc((long) p->batch_size * tuple_size * sizeof(u_int8_t));
+	if (! p->downstream_buffer) {
+		fprintf(stderr, "fatal error: out of memory\n");
+		exit(1);
+	}
+	p->buffer_tuple_size = tuple_size;
 	p->accumulated = 0;
 }
 
@@ -137,35 +161,42 @@ int min(int x, int y) {
 	return (x > y) ? y : x;
 }
 
-static u_int8_t * fill_buffer(result_handler_p p, batch_p data, long * time) {
+/**
+ * Materialises the output from tuple *from on. A host query takes it as it comes, at most batch_size tuples 
+ * at a time, while the device kernels are set up for whole batches, so a GPU query takes it once batch_size 
+ * tuples have been filled. Returns the buffer to pass on, of *len tuples, or NULL when there is none yet.
+ **/
+static u_int8_t * fill_buffer(result_handler_p p, batch_p data, int * from, int * len, long * time) {
 	u_int8_t * ret = NULL;
 
 	int tuple_size = data->tuple_size;
+	int to_copy = min(data->size - *from, p->batch_size - p->accumulated);
 
-	int data_size_b = data->size * tuple_size;
-	int accumulated_b = p->accumulated * tuple_size;
-	int buffer_size_b = p->batch_size * tuple_size;
-	
-	int spare_b = buffer_size_b - accumulated_b;
-	
-	int to_copy = min(data_size_b, spare_b);
-
-	int remain = data_size_b - to_copy;
+	if (p->accumulated == 0) {
+		if (! p->downstream_buffer || p->buffer_tuple_size != tuple_size) {
+			free(p->downstream_buffer);
+			reset_buffer(p, tuple_size);
+		}
+		p->buffer_timestamp = data->timestamp;
+	}
 
 	/* Materialisation */
-	memcpy(p->downstream_buffer + accumulated_b, data->buffer + data->start, to_copy);
+	memcpy(p->downstream_buffer + (long) p->accumulated * tuple_size, 
+		data->buffer + data->start + (long) *from * tuple_size, (long) to_copy * tuple_size);
+	p->accumulated += to_copy;
+	*from += to_copy;
+
+	bool whole = p->accumulated == p->batch_size;
+	bool partial = p->accumulated > 0 && ((dispatcher_p) p->downstream)->query->backend != BACKEND_GPU;
 
-	if (remain >= 0) {
+	if (whole || partial) {
 		ret = p->downstream_buffer;
+		*len = p->accumulated;
 		*time = p->buffer_timestamp;
 
-		reset_buffer(p);
-		p->accumulated = remain / tuple_size;
-		p->buffer_timestamp = data->timestamp;
-
-		memcpy(p->downstream_buffer, data->buffer + data->start + to_copy, remain);
-	} else {
-		p->accumulated += data->size;
+		/* The buffer is passed on with the batch */
+		p->downstream_buffer = NULL;
+		p->accumulated = 0;
 	}
 
 	return ret;
@@ -179,70 +210,233 @@ static task_p take_one_task(result_handler_p p) {
 	return t;
 }
 
+static void reorder_one_task (result_handler_p p, task_p t) {
+	if (t->seq != p->next_seq) {
+		/* Hold it until the earlier batches have been handled */
+		int slot = t->seq % RESULT_HANDLER_QUEUE_LIMIT;
+		if (p->reorder[slot]) {
+			fprintf(stderr, "error: too many tasks are waiting for an earlier batch (%s)\n", __FUNCTION__);
+			exit(1);
+		}
+		p->reorder[slot] = t;
+		return;
+	}
+
+	process_one_task(p, t);
+	__atomic_add_fetch(&p->next_seq, 1, __ATOMIC_RELEASE);
+
+	/* Release the held tasks that are now in order */
+	int slot = p->next_seq % RESULT_HANDLER_QUEUE_LIMIT;
+	while (p->reorder[slot]) {
+		t = p->reorder[slot];
+		p->reorder[slot] = NULL;
+
+		process_one_task(p, t);
+		__atomic_add_fetch(&p->next_seq, 1, __ATOMIC_RELEASE);
+
+		slot = p->next_seq % RESULT_HANDLER_QUEUE_LIMIT;
+	}
+}
+
 static void process_one_task (result_handler_p p, task_p t) {
 
 	/* Handle Outputs */
 	task_process_output(t);
 	if (task_has_downstream(t)) {
 		long time;
-
-		u_int8_t * data = fill_buffer(p, t->output, &time);
+		int tuple_size = t->output->tuple_size;
 
 		/* Log the end */
 		task_end(t);
 
-		if (data) {
-			dispatcher_insert((dispatcher_p) p->downstream, data, p->batch_size, time);
+		int from = 0;
+		int len;
+		u_int8_t * data;
+		while ((data = fill_buffer(p, t->output, &from, &len, &time))) {
+			/* A batch with any tuple that is still to be selected goes to the fused copy of the sink */
+			if (p->unselected || t->output->unselected) {
+				dispatcher_insert_unselected((dispatcher_p) p->downstream, data, len, tuple_size, time);
+			} else {
+				dispatcher_insert((dispatcher_p) p->downstream, data, len, tuple_size, time);
+			}
+			p->unselected = false;
 		}
+		p->unselected = p->unselected || (t->output->unselected && p->accumulated > 0);
+
 		task_free(t);
 	} else {
+		/* The results are final as soon as the task is, so it is not held for the next one */
+		if (t->query->callbacks[t->oid]->get_partial_size) {
+			assemble_windows(p, t);
+		} else {
+			append_output(p, t->output);
+		}
 
-		/* Assuming only tumbling windows*/
-		if (p->previous) {
-			long current_offset = 0;
+		/* Log the end */
+		task_end(t);
+		task_free(t);
+	}
+}
 
-			if (t->output->closing_windows > 0) {
-				/* Output opening windows of the previous with the closing windows */
-			}
+static u_int8_t * get_partial(result_handler_p p, int i) {
+	return p->partials + (long) ((p->partial_head + i) % p->partial_capacity) * p->partial_size;
+}
 
-			if (t->output->pending_windows > 0) {
-				/* Take the remained opending windows of the previous and merge it with
-				   the pending windows to produce new opending windows */
-			}
+/* A partial for the newest open window, growing the ring if it is full */
+static u_int8_t * push_partial(result_handler_p p) {
+	if (p->partial_num == p->partial_capacity) {
+		int capacity = (p->partial_capacity > 0) ? 2 * p->partial_capacity : 16;
+
+		u_int8_t * partials = (u_int8_t *) malloc((long) capacity * p->partial_size);
+		if (! partials) {
+			fprintf(stderr, "fatal error: out of memory\n");
+			exit(1);
+		}
+		for (int i=0; i<p->partial_num; i++) {
+			memcpy(partials + (long) i * p->partial_size, get_partial(p, i), p->partial_size);
+		}
+		free(p->partials);
+
+		p->partials = partials;
+		p->partial_head = 0;
+		p->partial_capacity = capacity;
+	}
+
+	p->partial_num++;
+	return get_partial(p, p->partial_num - 1);
+}
+
+static void pop_partial(result_handler_p p) {
+	p->partial_head = (p->partial_head + 1) % p->partial_capacity;
+	p->partial_num--;
+}
+
+/* Room for bytes in the output stream, which starts over from the beginning when it is full */
+static u_int8_t * reserve_output(result_handler_p p, long bytes) {
+	batch_p stream = (batch_p) p->output_stream;
+	long stream_bytes = stream->end - stream->start;
+
+	if (bytes > stream_bytes) {
+		fprintf(stderr, "error: the output stream is smaller than a result of %ld bytes (%s)\n", bytes, __FUNCTION__);
+		exit(1);
+	}
+
+	if (p->output_position + bytes > stream_bytes) {
+		p->output_position = 0;
+	}
+	return stream->buffer + stream->start + p->output_position;
+}
+
+static void write_window(result_handler_p p, operator_p op, void * operator, u_int8_t const * partial, int size) {
+	/* A window is written as at most as many bytes as its partial */
+	u_int8_t * output = reserve_output(p, size);
+
+	p->output_position += (* op->write_window) (operator, partial, size, output);
+}
+
+/**
+ * The fragments of the windows of a batch are, in order, closing, pending, complete and opening. The
+ * closing ones finish the oldest open windows and the pending ones are the open windows left, while
+ * the opening ones are open windows from now on.
+ **/
+static void assemble_windows(result_handler_p p, task_p t) {
+	operator_p op = t->query->callbacks[t->oid];
+	void * operator = query_get_operator(t->query, t->oid, t->batch);
+	batch_p output = t->output;
+
+	if (p->partial_size == 0) {
+		p->partial_size = (* op->get_partial_size) (operator);
+	}
+
+	/* The input of the task is still there to compute again what the kernels could not */
+	if (op->recover_output) {
+		(* op->recover_output) (operator, t->batch, output);
+	}
 
-			if (t->output->complete_windows > 0) {
-				/* Output */
-				u_int8_t * buffer_start = t->output->buffer + t->output->start;
+	/* A stream that starts over leaves its open windows unfinished */
+	if (t->batch->start_pointer == 0) {
+		p->partial_head = 0;
+		p->partial_num = 0;
+	}
 
-				int tuple_size = (* t->query->callbacks[t->oid]->get_output_schema_size) (t->query->operators[t->oid]);
-				int complete_windows = t->output->complete_windows;
+	int size;
+	for (int i=0; i<output->closing_windows; i++) {
+		u_int8_t * fragment = (* op->get_fragment) (operator, output, WINDOW_CLOSING, i, &size);
 
-				if (complete_windows > t->batch->size) {
-					// fprintf(stderr, "error: complete windows is %d\n", complete_windows);
-					// exit(1);
-				} else
-					memcpy(p->output_stream->buffer, buffer_start + current_offset, complete_windows * tuple_size);
+		if (p->partial_num > 0) {
+			u_int8_t * partial = get_partial(p, 0);
+			if (fragment) {
+				(* op->merge_partial) (operator, partial, fragment, size);
 			}
+			write_window(p, op, operator, partial, p->partial_size);
+			pop_partial(p);
+		} else if (fragment) {
+			/* It opened before the first batch of the stream this handler has seen */
+			write_window(p, op, operator, fragment, size);
+		}
+	}
 
-			if (!t->output->closing_windows && !t->output->pending_windows 
-				&& p->previous->output->opening_windows) {
-				
-				u_int8_t * buffer_start = p->previous->output->buffer + p->previous->output->start;
-				int opening_windows = p->previous->output->opening_windows;
-				int tuple_size = p->previous->output->tuple_size;
-				long offset = (p->previous->output->closing_windows + p->previous->output->pending_windows)
-					* tuple_size;
+	/* Any other window this handler knows of would have been pending */
+	if (p->partial_num > output->pending_windows) {
+		p->partial_num = output->pending_windows;
+	}
+
+	if (output->pending_windows > 0) {
+		u_int8_t * fragment = (* op->get_fragment) (operator, output, WINDOW_PENDING, 0, &size);
 
-				memcpy(p->output_stream->buffer, buffer_start + offset, opening_windows * tuple_size);
+		for (int i=0; i<output->pending_windows; i++) {
+			u_int8_t * partial;
+			if (i < p->partial_num) {
+				partial = get_partial(p, i);
+			} else {
+				partial = push_partial(p);
+				(* op->init_partial) (operator, partial);
 			}
 
-			/* Log the end */
-			task_end(p->previous);
-			task_free(p->previous);
+			if (fragment) {
+				(* op->merge_partial) (operator, partial, fragment, size);
+			}
+		}
+	}
 
-			p->previous = t;
-		} else {
-			p->previous = t;
+	for (int i=0; i<output->complete_windows; i++) {
+		u_int8_t * fragment = (* op->get_fragment) (operator, output, WINDOW_COMPLETE, i, &size);
+		if (fragment) {
+			write_window(p, op, operator, fragment, size);
 		}
 	}
+
+	for (int i=0; i<output->opening_windows; i++) {
+		u_int8_t * fragment = (* op->get_fragment) (operator, output, WINDOW_OPENING, i, &size);
+
+		/* Merged rather than copied, so that an operator can rehash what either backend wrote */
+		u_int8_t * partial = push_partial(p);
+		(* op->init_partial) (operator, partial);
+		if (fragment) {
+			(* op->merge_partial) (operator, partial, fragment, size);
+		}
+	}
+}
+
+/* The tuples of an operator without windows, as many at a time as fit before the stream wraps around */
+static void append_output(result_handler_p p, batch_p output) {
+	batch_p stream = (batch_p) p->output_stream;
+	long stream_bytes = stream->end - stream->start;
+
+	int tuple_size = output->tuple_size;
+	u_int8_t const * data = output->buffer + output->start;
+
+	long tuples = output->size;
+	while (tuples > 0) {
+		u_int8_t * out = reserve_output(p, tuple_size);
+
+		long fit = (stream_bytes - p->output_position) / tuple_size;
+		long n = (tuples < fit) ? tuples : fit;
+
+		memcpy(out, data, n * tuple_size);
+		p->output_position += n * tuple_size;
+
+		data += n * tuple_size;
+		tuples -= n;
+	}
 }
@@ -27,9 +27,25 @@ typedef struct result_handler {
 
     int accumulated;
     u_int8_t * downstream_buffer;
+    int buffer_tuple_size;
     long buffer_timestamp;
-
-    task_p previous;
+    bool unselected; /* Whether the downstream buffer holds tuples that are still to be selected */
+
+    /**
+     * Windows that opened in an earlier batch and have not closed yet, oldest first, in a ring of 
+     * partial_capacity partials of partial_size bytes (refer to assemble_windows)
+     **/
+    u_int8_t * partials;
+    int partial_size;
+    int partial_head;
+    int partial_num;
+    int partial_capacity;
+
+    long output_position; /* Bytes written to the output stream, which wraps around */
+
+    /* Tasks of a hybrid query may finish out of order, they are handled in batch order */
+    long next_seq;
+    task_p reorder [RESULT_HANDLER_QUEUE_LIMIT];
 
     volatile void * downstream;
     volatile batch_p output_stream;
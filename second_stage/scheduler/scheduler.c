@@ -2,18 +2,29 @@
 
 #include "scheduler.h"
 
+#include <errno.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <time.h>
 #include <sched.h>
 
 #include "dispatcher/dispatcher.h"
+#include "wait/wait.h"
 
 static pthread_t thr = NULL;
+static scheduler_p instance = NULL;
 
 static task_p scheduler_collect_task(scheduler_p p, task_p task);
 static void process_one_task (scheduler_p m, task_p t);
 static task_p take_one_task(scheduler_p p);
+static enum operator_backends choose_backend(scheduler_p p, task_p t);
+static void add_host_task(scheduler_p p, task_p t);
+static void update_estimate(scheduler_p p, int oid, enum operator_backends backend, long elapsed);
+static void hand_on_completed(scheduler_p p);
+static bool is_pipelined(scheduler_p p);
+static int wait_idle(scheduler_p p);
+static long pipelined_time(task_p t);
+static void flush_pipeline(scheduler_p p);
 
 static void * scheduler(void * args) {
 	scheduler_p p = (scheduler_p) args;
@@ -33,23 +44,78 @@ static void * scheduler(void * args) {
 	p->start = 1;
 
     while (1) {
+		WAIT_POLL(WAIT_SCHEDULER, p->queue_size != 0 || __atomic_load_n(&p->completed, __ATOMIC_RELAXED));
+
+		task_p t = NULL;
+		bool flushing = false;
         pthread_mutex_lock (p->mutex);
-			static int warned = 0;
-            while (p->queue_size == 0) {
-                pthread_cond_wait(p->added, p->mutex);
+            while (p->queue_size == 0 && ! __atomic_load_n(&p->completed, __ATOMIC_ACQUIRE)) {
+				if (! is_pipelined(p)) {
+					pthread_cond_wait(p->added, p->mutex);
+				} else if (p->flushing || wait_idle(p) == ETIMEDOUT) {
+					flushing = true;
+					break;
+				}
             }
 
-			task_p t = take_one_task(p);
+			if (p->queue_size != 0) {
+				t = take_one_task(p);
+			}
         pthread_mutex_unlock (p->mutex);
 		pthread_cond_signal(p->took);
 
-		process_one_task(p, t);
+		hand_on_completed(p);
+
+		if (t) {
+			process_one_task(p, t);
+		} else if (flushing) {
+			flush_pipeline(p);
+		}
     }
 
 	return (args) ? NULL : args;
 }
 
-scheduler_p scheduler_init(int pipeline_depth) {
+/* Runs the host tasks of a hybrid query next to the scheduler thread that drives the GPU */
+static void * host_lane(void * args) {
+	scheduler_p p = (scheduler_p) args;
+
+	/* Unblocks the thread (which runs scheduler_init) waiting for this thread to start */
+	p->host_start = 1;
+
+	while (1) {
+		WAIT_POLL(WAIT_SCHEDULER, p->host_size != 0);
+
+		pthread_mutex_lock (p->host_mutex);
+			while (p->host_size == 0) {
+				pthread_cond_wait(p->host_added, p->host_mutex);
+			}
+
+			task_p t = p->host_queue[p->host_head];
+			long cost = p->host_costs[p->host_head];
+			p->host_queue[p->host_head] = NULL;
+			p->host_head = (p->host_head + 1) % SCHEDULER_HOST_QUEUE_LIMIT;
+		pthread_mutex_unlock (p->host_mutex);
+
+		long start = event_get_mtime();
+		task_run(t, t);
+		update_estimate(p, t->oid, BACKEND_CPU, event_get_mtime() - start);
+
+		/* The running task counts as queued work until here */
+		pthread_mutex_lock (p->host_mutex);
+			p->host_size--;
+			p->host_backlog -= cost;
+		pthread_mutex_unlock (p->host_mutex);
+		pthread_cond_signal(p->host_took);
+
+		result_handler_p handler = dispatcher_get_handler((dispatcher_p) t->dispatcher);
+		result_handler_add_task(handler, t);
+	}
+
+	return (args) ? NULL : args;
+}
+
+scheduler_p scheduler_init(int pipeline_depth, bool is_hybrid) {
 
 	scheduler_p p = (scheduler_p) malloc (sizeof(scheduler_t));
 	if (! p) {
@@ -68,8 +134,17 @@ scheduler_p scheduler_init(int pipeline_depth) {
 
 	for (int i=0; i<SCHEDULER_MAX_PIPELINE_DEPTH; i++) {
 		p->pipeline[i] = NULL;
+		p->pipeline_order[i] = 0;
 	}
     p->pipeline_depth = pipeline_depth;
+	p->completed = NULL;
+	p->scheduled = 0;
+	p->flushing = false;
+
+	for (int i=0; i<QUERY_MAX_OPERATOR_NUM; i++) {
+		p->estimates[i][BACKEND_GPU] = -1;
+		p->estimates[i][BACKEND_CPU] = -1;
+	}
 
 	/* Initialise mutex and conditions */
 	p->mutex = (pthread_mutex_t *) malloc (sizeof(pthread_mutex_t));
@@ -81,14 +156,42 @@ scheduler_p scheduler_init(int pipeline_depth) {
 	p->took = (pthread_cond_t *) malloc (sizeof(pthread_cond_t));
 	pthread_cond_init (p->took, NULL);
 
+	/* Initialise the host lane */
+	p->is_hybrid = is_hybrid;
+	p->host_start = 0;
+	p->host_size = 0;
+	p->host_head = 0;
+	p->host_tail = 0;
+	p->host_backlog = 0;
+	for (int i=0; i<SCHEDULER_HOST_QUEUE_LIMIT; i++) {
+		p->host_queue[i] = NULL;
+	}
+	if (is_hybrid) {
+		p->host_mutex = (pthread_mutex_t *) malloc (sizeof(pthread_mutex_t));
+		pthread_mutex_init (p->host_mutex, NULL);
+
+		p->host_added = (pthread_cond_t *) malloc (sizeof(pthread_cond_t));
+		pthread_cond_init (p->host_added, NULL);
+
+		p->host_took = (pthread_cond_t *) malloc (sizeof(pthread_cond_t));
+		pthread_cond_init (p->host_took, NULL);
+
+		if (pthread_create(&p->host_thr, NULL, host_lane, (void *) p)) {
+			fprintf(stderr, "error: failed to create host lane thread\n");
+			exit (1);
+		}
+		wait_until_set(&p->host_start);
+	}
+
+	instance = p;
+
 	/* Initialise thread */
 	if (pthread_create(&thr, NULL, scheduler, (void *) p)) {
 		fprintf(stderr, "error: failed to create throughput monitor thread\n");
 		exit (1);
 	}
 	/* Wait until thread attaches itself to the JVM */
-	while (! p->start)
-		;
+	wait_until_set(&p->start);
 	return p;
 }
 
@@ -106,34 +209,159 @@ void scheduler_add_task (scheduler_p p, task_p t) {
     pthread_cond_signal (p->added);
 }
 
+void scheduler_complete_task (query_event_p event) {
+	task_p t = (task_p) event->task;
+
+	/* Submission returns at once, so the GPU is measured up to here */
+	t->gpu_time = event_get_mtime() - event->start;
+
+	task_p head = __atomic_load_n(&instance->completed, __ATOMIC_RELAXED);
+	do {
+		t->next_completed = head;
+	} while (! __atomic_compare_exchange_n(&instance->completed, &head, t, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+	/* The mutex is only held briefly by the others, it keeps the scheduler thread from missing the signal */
+	pthread_mutex_lock (instance->mutex);
+	pthread_cond_signal (instance->added);
+	pthread_mutex_unlock (instance->mutex);
+}
+
+/* Hands the tasks that scheduler_complete_task has queued on to their result handlers, oldest first */
+static void hand_on_completed(scheduler_p p) {
+	task_p t = __atomic_exchange_n(&p->completed, NULL, __ATOMIC_ACQUIRE);
+
+	task_p oldest = NULL;
+	while (t) {
+		task_p next = t->next_completed;
+		t->next_completed = oldest;
+		oldest = t;
+		t = next;
+	}
+
+	for (t = oldest; t; t = oldest) {
+		oldest = t->next_completed;
+		t->next_completed = NULL;
+
+		update_estimate(p, t->oid, BACKEND_GPU, t->gpu_time);
+
+		result_handler_p handler = dispatcher_get_handler((dispatcher_p) t->dispatcher);
+		result_handler_add_task(handler, t);
+	}
+}
+
+void scheduler_flush (scheduler_p p) {
+	pthread_mutex_lock (p->mutex);
+		p->flushing = true;
+	pthread_mutex_unlock (p->mutex);
+
+	pthread_cond_signal (p->added);
+}
+
 pthread_t scheduler_get_thread() {
 	return thr;
 }
 
 static task_p scheduler_collect_task(scheduler_p p, task_p task) {
+	/* Without a pipeline (host backend) a task is finished once it has run */
+	if (p->pipeline_depth == 0) {
+		return task;
+	}
+
 	task_p ret = p->pipeline[0];
 	for (int i = 0; i < p->pipeline_depth - 1; ++i) {
 		p->pipeline[i] = p->pipeline[i + 1];
+		p->pipeline_order[i] = p->pipeline_order[i + 1];
 	}
 	p->pipeline[p->pipeline_depth - 1] = task;
+	p->pipeline_order[p->pipeline_depth - 1] = p->scheduled;
 
 	return ret;
 }
 
+/* Whether the pipeline holds a task, only called on the scheduler thread */
+static bool is_pipelined(scheduler_p p) {
+	for (int i = 0; i < p->pipeline_depth; ++i) {
+		if (p->pipeline[i]) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Waits for a task for at most SCHEDULER_IDLE_TIMEOUT with the mutex held, refer to pthread_cond_timedwait */
+static int wait_idle(scheduler_p p) {
+	struct timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+
+	deadline.tv_nsec += SCHEDULER_IDLE_TIMEOUT * 1000L;
+	if (deadline.tv_nsec >= 1000000000L) {
+		deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+		deadline.tv_nsec %= 1000000000L;
+	}
+
+	return pthread_cond_timedwait(p->added, p->mutex, &deadline);
+}
+
+/* Collects every task in the pipeline, oldest first, as if as many empty tasks followed them */
+static void flush_pipeline(scheduler_p p) {
+	for (int i = 0; i < p->pipeline_depth; ++i) {
+		task_p processed = scheduler_collect_task(p, NULL);
+		task_collect(processed);
+
+		if (processed != NULL) {
+			update_estimate(p, processed->oid, BACKEND_GPU, pipelined_time(processed));
+
+			result_handler_p handler = dispatcher_get_handler((dispatcher_p) processed->dispatcher);
+			result_handler_add_task(handler, processed);
+		}
+	}
+}
+
 static void process_one_task (scheduler_p p, task_p t) {
+	if (p->is_hybrid) {
+		t->backend = choose_backend(p, t);
+
+		if (t->backend == BACKEND_CPU) {
+			p->scheduled++;
+			add_host_task(p, t);
+			return;
+		}
+	}
+
+	/* Without a pipeline, the GPU reports the task done by scheduler_complete_task */
+	if (p->pipeline_depth == 0 && t->backend == BACKEND_GPU) {
+		p->scheduled++;
+		task_run(t, t);
+		return;
+	}
+
     /* Handle task popping out from the pipeline */
 	task_p processed = scheduler_collect_task(p, t);
+	p->scheduled++;
 
 	/* Run the head task */
 	task_run(t, processed);
 
 	/* Transfer ownership of the task */
     if (processed != NULL) {
+		update_estimate(p, processed->oid, BACKEND_GPU, pipelined_time(processed));
+
 		result_handler_p handler = dispatcher_get_handler((dispatcher_p) processed->dispatcher);
 		result_handler_add_task(handler, processed);
     }
 }
 
+/**
+ * The device time of a task collected from the pipeline. Its outputs have only been read now, so
+ * if the device has not reported it, the time since it was run bounds it from above
+ **/
+static long pipelined_time(task_p t) {
+	if (t->event->device >= 0) {
+		return t->event->device;
+	}
+	return event_get_mtime() - t->event->start;
+}
+
 static task_p take_one_task(scheduler_p p) {
     task_p t = p->queue[p->queue_head];
 	p->queue[p->queue_head] = NULL;
@@ -142,4 +370,65 @@ static task_p take_one_task(scheduler_p p) {
     p->queue_head = (p->queue_head + 1) % SCHEDULER_QUEUE_LIMIT;
 
 	return t;
-}
\ No newline at end of file
+}
+
+static enum operator_backends choose_backend(scheduler_p p, task_p t) {
+	/* The device kernels are set up for whole batches */
+	if (t->batch->size < t->query->batch_size) {
+		return BACKEND_CPU;
+	}
+
+	/* Keep the GPU pipeline moving, see SCHEDULER_MAX_LAG */
+	for (int i=0; i<p->pipeline_depth; i++) {
+		if (p->pipeline[i]) {
+			if (p->scheduled - p->pipeline_order[i] >= SCHEDULER_MAX_LAG) {
+				return BACKEND_GPU;
+			}
+			break;
+		}
+	}
+
+	if (p->host_size >= SCHEDULER_HOST_QUEUE_LIMIT) {
+		return BACKEND_GPU;
+	}
+
+	/* Measure both backends first */
+	long gpu = p->estimates[t->oid][BACKEND_GPU];
+	long cpu = p->estimates[t->oid][BACKEND_CPU];
+	if (gpu < 0) {
+		return BACKEND_GPU;
+	}
+	if (cpu < 0) {
+		return BACKEND_CPU;
+	}
+
+	/* The scheduler thread is free to drive the GPU now, while a host task waits for the queued ones */
+	return (p->host_backlog + cpu < gpu) ? BACKEND_CPU : BACKEND_GPU;
+}
+
+static void add_host_task(scheduler_p p, task_p t) {
+	long cost = p->estimates[t->oid][BACKEND_CPU];
+	if (cost < 0) {
+		cost = 0;
+	}
+
+	pthread_mutex_lock (p->host_mutex);
+		while (p->host_size >= SCHEDULER_HOST_QUEUE_LIMIT) {
+			pthread_cond_wait(p->host_took, p->host_mutex);
+		}
+
+		p->host_size++;
+		p->host_backlog += cost;
+		p->host_queue[p->host_tail] = t;
+		p->host_costs[p->host_tail] = cost;
+		p->host_tail = (p->host_tail + 1) % SCHEDULER_HOST_QUEUE_LIMIT;
+	pthread_mutex_unlock (p->host_mutex);
+
+	pthread_cond_signal (p->host_added);
+}
+
+static void update_estimate(scheduler_p p, int oid, enum operator_backends backend, long elapsed) {
+	long old = p->estimates[oid][backend];
+
+	p->estimates[oid][backend] = (old < 0) ? elapsed : (7 * old + elapsed) / 8;
+}
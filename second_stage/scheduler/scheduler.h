@@ -3,6 +3,7 @@
 
 #include <pthread.h>
 #include <semaphore.h>
+#include <stdbool.h>
 
 #include "task.h"
 #include "monitor/event_manager.h"
@@ -11,6 +12,14 @@
 // Warning! Should be much larger than the allowed sum of concurrent tasks of all pipelines
 #define SCHEDULER_QUEUE_LIMIT 256
 
+/* Hybrid backend */
+#define SCHEDULER_HOST_QUEUE_LIMIT 8
+/* A task in the GPU pipeline is only collected when later tasks are sent to the GPU. Force a GPU task
+   once the oldest one has waited for this many tasks so that it does not hold back the ordered results */
+#define SCHEDULER_MAX_LAG 16
+/* Without tasks to force, the pipeline is collected once the scheduler has been idle for this long */
+#define SCHEDULER_IDLE_TIMEOUT 1000 // us
+
 typedef struct scheduler * scheduler_p;
 typedef struct scheduler {
     pthread_mutex_t * mutex;
@@ -19,26 +28,67 @@ typedef struct scheduler {
 
     volatile unsigned start;
 
-    int queue_size;
+    volatile int queue_size;
     volatile int queue_head;
     volatile int queue_tail;
     volatile task_p queue [SCHEDULER_QUEUE_LIMIT];
 
+    /* GPU tasks that event callbacks have completed, most recent first, for the scheduler thread to hand on */
+    task_p completed;
+
     /* A pipeline of intermediate result */
     int pipeline_depth;
     volatile int cur_output;
     volatile task_p pipeline [SCHEDULER_MAX_PIPELINE_DEPTH];
 
+    /* Scheduled order of the tasks in the pipeline */
+    long pipeline_order [SCHEDULER_MAX_PIPELINE_DEPTH];
+    long scheduled;
+
+    /* No more input is inserted, refer to scheduler_flush */
+    volatile bool flushing;
+
+    /* Host lane of the hybrid backend */
+    bool is_hybrid;
+    pthread_t host_thr;
+    pthread_mutex_t * host_mutex;
+    pthread_cond_t * host_added;
+    pthread_cond_t * host_took;
+    volatile unsigned host_start;
+
+    volatile int host_size;
+    int host_head;
+    int host_tail;
+    task_p host_queue [SCHEDULER_HOST_QUEUE_LIMIT];
+    long host_costs [SCHEDULER_HOST_QUEUE_LIMIT];
+    volatile long host_backlog; /* Predicted time of the queued host tasks (us) */
+
+    /* Moving average of the measured processing time per task of each operator on each backend (us), 
+       -1 until measured */
+    volatile long estimates [QUERY_MAX_OPERATOR_NUM][2];
+
     /* Accumulated data */
     volatile int event_num;
     volatile long processed_data;
     volatile long latency_sum;
 } scheduler_t;
 
-scheduler_p scheduler_init(int pipeline_depth);
+/* A hybrid scheduler runs every task either on the GPU pipeline or on a host lane, whichever is 
+   predicted to finish it first */
+scheduler_p scheduler_init(int pipeline_depth, bool is_hybrid);
 
 void scheduler_add_task (scheduler_p p, task_p t);
 
+/* Without a pipeline, a GPU task is handed on from here once its outputs have been read. Called on the
+   thread of the event callback, so it only queues the task for the scheduler thread and never waits */
+void scheduler_complete_task (query_event_p event);
+
+/**
+ * A task in the GPU pipeline is only collected when a later task is sent to the GPU. Once no more input
+ * is inserted, this has the scheduler thread collect the pipeline whenever it has run out of tasks
+ **/
+void scheduler_flush (scheduler_p p);
+
 pthread_t scheduler_get_thread();
 
 #endif
\ No newline at end of file
@@ -43,3 +43,11 @@ int schema_get_pad(schema_p schema, int vector) {
     return size_after_padding - schema->size;
 }
 
+int schema_get_attr_offset(schema_p schema, int attr) {
+    int offset = 0;
+    for (int i=0; i<attr && i<schema->attr_num; i++) {
+        offset += attr_types_get_size(schema->attr[i]);
+    }
+
+    return offset;
+}
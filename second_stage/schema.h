@@ -4,7 +4,7 @@
 #include <stdlib.h>
 
 /* TODO dynamically increase attr array length */
-#define MAX_ATTR_NUM 16
+#define MAX_ATTR_NUM 32
 
 enum attr_types {
     TYPE_INT,
@@ -27,5 +27,8 @@ void schema_add_attr(schema_p schema, enum attr_types attr);
 
 int schema_get_pad(schema_p schema, int vector);
 
+/* Byte offset of the attribute at index attr within a tuple */
+int schema_get_attr_offset(schema_p schema, int attr);
+
 
 #endif
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include <stdio.h>
 
 #include "dispatcher/dispatcher.h"
+#include "libgpu/gpu_agg.h"
 
 #define MAX_ID INT_MAX
 static int free_id = 0;
@@ -13,6 +14,7 @@ task_p task(query_p query, int oid, batch_p batch, void * dispatcher, event_mana
     task_p task = (task_p) malloc(sizeof(task_t));
 
     task->id = free_id++ % MAX_ID;
+    task->seq = 0;
 
     task->query = query;
     task->oid = oid;
@@ -22,16 +24,21 @@ task_p task(query_p query, int oid, batch_p batch, void * dispatcher, event_mana
 
     task->output = NULL;
 
+    /* A hybrid query is assigned a backend by the scheduler */
+    task->backend = (query->backend == BACKEND_CPU) ? BACKEND_CPU : BACKEND_GPU;
+    task->forwarded = false;
+
+    task->next_completed = NULL;
+    task->gpu_time = 0;
+
     task->manager = manager;
     task->create_time = event_get_mtime();
 
     return task;
 }
 
-void task_run(task_p t, task_p processed) {
-
+static void task_create_event(task_p t) {
     query_p query = t->query;
-    int tuple_size = 64;
 
     t->event = (query_event_p) malloc(sizeof(query_event_t));
     {
@@ -42,34 +49,86 @@ void task_run(task_p t, task_p processed) {
 
         int tuple_size = 64;
         t->event->tuple_size = tuple_size;
+        t->event->device = -1;
+
+        t->event->task = t;
     }
     event_set_insert(t->event, t->batch->timestamp);
     event_set_create(t->event, t->create_time);
 
     /* Log start time and create the event */
     event_set_start(t->event, event_get_mtime());
+}
+
+void task_run(task_p t, task_p processed) {
+
+    query_p query = t->query;
+    int tuple_size = 64;
+
+    task_create_event(t);
 
     int output_tuple_size = (* t->query->callbacks[t->oid]->get_output_schema_size) (t->query->operators[t->oid]);
 
-    u_int8_t * buffer = (u_int8_t *) malloc(1.5 * query->batch_size * tuple_size);
-    t->output = batch(1.5 * query->batch_size, 0, buffer, 1.5 * query->batch_size, tuple_size);
+    /* A join result holds both of its tuples, which may be wider than the default */
+    if (output_tuple_size > tuple_size) {
+        tuple_size = output_tuple_size;
+    }
+
+    /* A join output holds as many results as it is set to */
+    long buffer_size = 1.5 * query->batch_size;
+    operator_p op = t->query->callbacks[t->oid];
+    if (op->get_output_size) {
+        long size = ((* op->get_output_size) (t->query->operators[t->oid]) + tuple_size - 1) / tuple_size;
+        if (size > buffer_size) {
+            buffer_size = size;
+        }
+    }
+
+    u_int8_t * buffer = (u_int8_t *) malloc(buffer_size * tuple_size);
+    t->output = batch(buffer_size, 0, buffer, buffer_size, tuple_size);
 
     if (processed) {
-        u_int8_t ** outputs = query_get_output_buffer(processed->query, processed->oid, processed->output);
+        u_int8_t ** outputs = query_get_output_buffer(processed->query, processed->oid, processed->batch, processed->output);
 
-        query_process(t->query, t->oid, t->batch, outputs);
+        query_process(t->query, t->oid, t->backend, t->batch, outputs, t->event);
         
         free(outputs);
     } else {
-        query_process(t->query, t->oid, t->batch, NULL);
+        query_process(t->query, t->oid, t->backend, t->batch, NULL, t->event);
+    }
+
+}
+
+void task_collect(task_p processed) {
+    if (processed) {
+        u_int8_t ** outputs = query_get_output_buffer(processed->query, processed->oid, processed->batch, processed->output);
+
+        gpu_collect((void **) outputs, sizeof(u_int8_t));
+
+        free(outputs);
+    } else {
+        gpu_collect(NULL, sizeof(u_int8_t));
     }
+}
+
+void task_forward(task_p t) {
+    batch_p input = t->batch;
 
+    task_create_event(t);
+
+    t->output = batch(input->buffer_size, 0, input->buffer, input->buffer_size, input->tuple_size);
+    t->output->size = input->size;
+    t->output->start = input->start;
+    t->output->end = input->end;
+    t->output->timestamp = input->timestamp;
+    t->output->unselected = true;
 }
 
 void task_end(task_p t) {
     dispatcher_close_one_task((dispatcher_p) t->dispatcher, t);
 
     event_set_end(t->event, event_get_mtime());
+    query_record(t->query, t->oid, t->batch, t->forwarded, t->event->end - t->event->start);
     event_manager_add_event(t->manager, t->event);
     t->event = NULL;
 }
@@ -83,8 +142,16 @@ bool task_has_downstream(task_p t) {
 }
 
 void task_process_output(task_p t) {
-    /* Get output batch ready for being an input */
-    query_process_output(t->query, t->oid, t->output);
+    if (t->forwarded) {
+        return;
+    }
+
+    /* Get output batch ready for being an input; an operator with an output tuple per input tuple keeps this size */
+    t->output->size = t->batch->size;
+    query_process_output(t->query, t->oid, t->batch, t->output);
+
+    /* Only the fused copy of a sink selects the tuples the selections before it have passed on */
+    t->output->unselected = t->batch->unselected && !t->query->fused[t->oid];
 }
 
 void task_free(task_p t) {
@@ -94,7 +161,10 @@ void task_free(task_p t) {
     } else {
         batch_free(t->batch);
     }
-    if (t->output) {
+    /* A forwarded output is the buffer of the input */
+    if (t->output && t->forwarded) {
+        batch_free(t->output);
+    } else if (t->output) {
         batch_free_all(t->output);
     }
     free(t);
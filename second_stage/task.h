@@ -10,6 +10,7 @@
 typedef struct task * task_p;
 typedef struct task {
     int id;
+    long seq; /* Position of the batch in the stream of its operator */
 
     query_p query;
     int oid;
@@ -19,9 +20,16 @@ typedef struct task {
 
     batch_p output;
 
+    enum operator_backends backend; /* Where this task runs */
+    bool forwarded; /* Passes its batch on as its output instead of running, refer to query_forwards */
+
     query_event_p event;
     event_manager_p manager;
 
+    /* A GPU task completed by an event callback, refer to scheduler_complete_task */
+    struct task * next_completed;
+    long gpu_time; /* us */
+
     long create_time;
 } task_t;
 
@@ -29,6 +37,12 @@ task_p task(query_p query, int oid, batch_p batch, void * dispatcher, event_mana
 
 void task_run(task_p t, task_p processed);
 
+/* Reads the outputs of processed, popped from the GPU pipeline without a task to run after it */
+void task_collect(task_p processed);
+
+/* Completes a forwarded task at once with its batch as its output */
+void task_forward(task_p t);
+
 void task_end(task_p t);
 
 bool task_has_downstream(task_p t);
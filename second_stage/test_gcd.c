@@ -3,6 +3,7 @@
  */
 
 #include <limits.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
@@ -15,12 +16,26 @@
 #include "query.h"
 #include "tuple.h"
 #include "cirbuf/circular_buffer.h"
+#include "operators/projection.h"
 #include "operators/selection.h"
 #include "operators/reduction.h"
 #include "operators/aggregation.h"
+#include "operators/join.h"
+#include "libcpu/cpu_agg.h"
 
 #define GCD_LINE_NUM 144370688 // maximum lines for input txts
 
+/**
+ * The ids are not in the data set files and are generated. The tasks of a job come in pairs, of the few 
+ * long-running jobs over the first GCD_JOB_WARMUP lines and then of the jobs started once every 
+ * GCD_JOB_RAMP lines, and run on one of GCD_MACHINE_NUM machines
+ **/
+#define GCD_JOB_BASE 6000000000L
+#define GCD_JOB_WARMUP (16 * 1024)
+#define GCD_JOB_WARMUP_NUM 4
+#define GCD_JOB_RAMP 16
+#define GCD_MACHINE_NUM 64
+
 
 /* Input data of interest from files */
 void read_input_buffers(cbuf_handle_t cbufs [], int buffer_num, int batch_size);
@@ -28,6 +43,57 @@ void read_input_buffers(cbuf_handle_t cbufs [], int buffer_num, int batch_size);
 /* Print out n tuples for debug */
 void print_tuples(cbuf_handle_t cbufs [], int n);
 
+#define CHECK_TOLERANCE 1e-3
+
+/* A naive evaluation of a query over its windows, which its output is checked against with -d */
+typedef struct reference {
+    int range;
+    int slide;
+    bool (* selectf) (tuple_t const * tuple);
+    float (* valuef) (tuple_t const * tuple);
+    long (* keyf) (tuple_t const * tuple); /* NULL without group-by */
+    enum aggregation_types type;
+} reference_t;
+
+/* A group of a window, of the reference or as written to the output stream */
+typedef struct check_group {
+    long key;
+    long t;
+    double value;
+    int count; /* -1 for an aggregation, whose output has no count */
+} check_group_t;
+
+/**
+ * Compare the windows written to the output stream with the reference over the buffers inserted. Window 
+ * k is [k * slide, k * slide + range), the windows are written in order and the groups of a window one 
+ * after another. The windows after the last one written may still be open
+ **/
+void check_windows(reference_t const * reference, application_p app, schema_p output_schema, int work_load);
+
+/**
+ * Compare the joined tuples written to the output stream with a scan of the build tuples, which are in 
+ * timestamp order. The results of a probe tuple are written one after another, in the order of the probe 
+ * tuples, and in any order among them
+ **/
+void check_join(join_p join, bool (* selectf) (tuple_t const * tuple), u_int8_t const * build, int build_num, 
+    application_p app, int work_load);
+
+/* Run a host selection on the first input buffer with and without AVX2, which must select the same tuples */
+void check_selection(selection_p select, application_p app);
+
+static bool select_all(tuple_t const * tuple) { return true; }
+static bool select_category(tuple_t const * tuple) { return tuple->category == 0; }
+static bool select_event_type_0(tuple_t const * tuple) { return tuple->event_type == 0; }
+static bool select_event_type_1(tuple_t const * tuple) { return tuple->event_type == 1; }
+static bool select_load(tuple_t const * tuple) { return tuple->event_type == 0 && tuple->cpu * tuple->priority > 0; }
+
+static float value_cpu(tuple_t const * tuple) { return tuple->cpu; }
+static float value_load(tuple_t const * tuple) { return tuple->cpu * tuple->priority; }
+
+static long key_category(tuple_t const * tuple) { return tuple->category; }
+static long key_job_id(tuple_t const * tuple) { return tuple->job_id; }
+static long key_machine_id(tuple_t const * tuple) { return tuple->machine_id; }
+
 void renew_timestamp(int buffer_num, u_int8_t * buffers[], int batch_size) {
     long time_step = buffer_num * batch_size;
 
@@ -43,8 +109,9 @@ void renew_timestamp(int buffer_num, u_int8_t * buffers[], int batch_size) {
 
 void run_processing_gpu(
     u_int8_t * buffers [], int buffer_size, int buffer_num,
-    u_int8_t * result, 
-    enum test_cases mode, int work_load, int pipeline_depth, bool is_merging, bool is_debug) {
+    u_int8_t * result, long result_size,
+    enum test_cases mode, int work_load, int pipeline_depth, bool is_merging, bool is_costing, bool is_adapting, bool is_debug,
+    enum operator_backends backend, int thread_num) {
     
     /* Construct schemas */
     schema_p schema1 = schema();
@@ -63,6 +130,7 @@ void run_processing_gpu(
 
     /* simplified query creation */
     switch (mode) {
+        case CPU: /* Query 1 on the host backend */
         case QUERY1:
             /**
              * Query 1:
@@ -96,7 +164,7 @@ void run_processing_gpu(
              * 
              * Query 1 - variant:
              *     select timestamp, category, sum(cpu) as totalCpu
-             *     from TaskEvents [range 1024 slide 1024]
+             *     from TaskEvents [range 60 slide 1]
              *     where category == 0
              * 
              * Output becomes
@@ -126,20 +194,34 @@ void run_processing_gpu(
                 reduction_p reduce1 = reduction(schema1, ref_num, cols, exps);
 
                 /* Create a query */
-                window_p window1 = window(60, 60, RANGE_BASE);
+                window_p window1 = window(60, 1, RANGE_BASE);
 
                 int batch_size = buffer_size;
                 query_p query1 = query(0, batch_size, window1, is_merging);
+                query_set_backend(query1, backend);
+                if (is_adapting) {
+                    query_set_planning(query1, QUERY_PLAN_ADAPTIVE);
+                } else if (is_costing) {
+                    query_set_planning(query1, QUERY_PLAN_COST);
+                }
 
                 query_add_operator(query1, (void *) select1, select1->operator);
                 query_add_operator(query1, (void *) reduce1, reduce1->operator);
 
                 application_p app = application(
-                    pipeline_depth, 
+                    pipeline_depth, thread_num,
                     query1,
                     buffers, buffer_size, buffer_num,
-                    result);
+                    result, result_size);
                 application_run(app, work_load);
+
+                if (is_debug) {
+                    reference_t reference = {60, 1, select_category, value_cpu, NULL, SUM};
+                    check_windows(&reference, app, reduce1->output_schema, work_load);
+                    if (backend != BACKEND_GPU) {
+                        check_selection(select1, app);
+                    }
+                }
             }
             break;
         case QUERY2:
@@ -167,10 +249,12 @@ void run_processing_gpu(
              * 
              * query:
              *     select timestamp, jobId, avg(cpu) as avgCpu
-             *     from TaskEvents [range 60 slide 1]
+             *     from TaskEvents [range 1024 slide 256]
              *     where eventType == 1
              *     group by jobId
              * 
+             * The jobs are many, so the batches are aggregated in partitions, or sorted for the larger ones. 
+             * A batch of the warm-up sizes the tables for its few jobs, and the later ones grow them
              **/
             fprintf(stdout, "========== Running query2 of google cluster dataset ===========\n");
             {
@@ -196,20 +280,34 @@ void run_processing_gpu(
                 aggregation_p aggregate1 = aggregation(schema1, ref_num, cols, exps, group_num, groups);
 
                 /* Create a query */
-                window_p window1 = window(1024, 1024, RANGE_BASE);
+                window_p window1 = window(1024, 256, RANGE_BASE);
 
                 int batch_size = buffer_size;
                 query_p query1 = query(0, batch_size, window1, is_merging);
+                query_set_backend(query1, backend);
+                if (is_adapting) {
+                    query_set_planning(query1, QUERY_PLAN_ADAPTIVE);
+                } else if (is_costing) {
+                    query_set_planning(query1, QUERY_PLAN_COST);
+                }
 
                 query_add_operator(query1, (void *) select1, select1->operator);
                 query_add_operator(query1, (void *) aggregate1, aggregate1->operator);
 
                 application_p app = application(
-                    pipeline_depth, 
+                    pipeline_depth, thread_num,
                     query1,
                     buffers, buffer_size, buffer_num,
-                    result);
+                    result, result_size);
                 application_run(app, work_load);
+
+                if (is_debug) {
+                    reference_t reference = {1024, 256, select_event_type_1, value_cpu, key_job_id, AVG};
+                    check_windows(&reference, app, aggregate1->output_schema, work_load);
+                    if (backend != BACKEND_GPU) {
+                        check_selection(select1, app);
+                    }
+                }
             }
             break;
         case AGGREGATION:
@@ -230,43 +328,302 @@ void run_processing_gpu(
              *     float disk;
              *     int constraints;
              * 
-             * output: CPUusagePerCategory 
+             * output: CPUusagePerMachine 
              *     long timestamp 
-             *     int category
+             *     long machine_id
              *     float totalCpu
              * 
              * query:
-             *     select timestamp, category, sum(cpu) as totalCpu
-             *     from TaskEvents [range 60 slide 1]
-             *     group by category
+             *     select timestamp, machineId, sum(cpu) as totalCpu
+             *     from TaskEvents [range 600 slide 60]
+             *     group by machineId
              * 
+             * The machine ids are declared to be within [0, GCD_MACHINE_NUM), so they are indexed directly
              **/
             fprintf(stdout, "========== Running aggregation of google cluster dataset ===========\n");
             {
-                /* Construct an aggregation: sum cpu, group by column 6 (category) */
+                /* Construct an aggregation: sum cpu, group by column 3 (machine_id) */
                 int ref_num = 1;
                 int cols [1] = {8};
                 enum aggregation_types exps [1] = {SUM};
 
                 int group_num = 1;
-                int groups[1] = {6};
+                int groups[1] = {3};
 
                 aggregation_p aggregate1 = aggregation(schema1, ref_num, cols, exps, group_num, groups);
+                aggregation_set_key_bounds(aggregate1, 0, GCD_MACHINE_NUM - 1);
+
+                /* Create a query */
+                window_p window1 = window(600, 60, RANGE_BASE);
+
+                int batch_size = buffer_size;
+                query_p query1 = query(0, batch_size, window1, is_merging);
+                query_set_backend(query1, backend);
+                if (is_adapting) {
+                    query_set_planning(query1, QUERY_PLAN_ADAPTIVE);
+                } else if (is_costing) {
+                    query_set_planning(query1, QUERY_PLAN_COST);
+                }
+
+                query_add_operator(query1, (void *) aggregate1, aggregate1->operator);
+
+                application_p app = application(
+                    pipeline_depth, thread_num,
+                    query1,
+                    buffers, buffer_size, buffer_num,
+                    result, result_size);
+                application_run(app, work_load);
+
+                if (is_debug) {
+                    reference_t reference = {600, 60, select_all, value_cpu, key_machine_id, SUM};
+                    check_windows(&reference, app, aggregate1->output_schema, work_load);
+                }
+            }
+            break;
+        case PROJECTION:
+            /**
+             * Query 1 over narrowed tuples:
+             * 
+             * query:
+             *     select timestamp, sum(cpu * priority) as totalLoad
+             *     from (select timestamp, cpu * priority, category from TaskEvents) [range 60 slide 60]
+             *     where category == 0
+             * 
+             * The projection turns the 64-byte tuples into 16-byte ones. Only the event type, category, 
+             * priority and cpu are loaded from the data set, so the expressions stay within them
+             **/
+            fprintf(stdout, "========== Running projected query1 of google cluster dataset ===========\n");
+            {
+                /* Construct a projection: cpu * priority, category */
+                int expression_num = 2;
+                projection_expression_t expressions [2] = {
+                    {PROJECT_MUL, 8, 7},
+                    {PROJECT_COLUMN, 6, 0}
+                };
+
+                projection_p project1 = projection(schema1, expression_num, expressions);
+
+                /* Construct a select on the projected tuples: where column 2 (category) == 0 */
+                int col1 = 2;
+
+                enum comparor com1 = EQUAL;
+
+                int i1 = 0;
+                ref_value_p val1 = ref_value();
+                val1->i = &i1;
+
+                selection_p select1 = selection(project1->output_schema, col1, val1, com1);
+
+                /* Construct a reduce: sum column 1 (cpu * priority) */
+                int ref_num = 1;
+                int cols [1] = {1};
+                enum aggregation_types exps [1] = {SUM};
+
+                reduction_p reduce1 = reduction(project1->output_schema, ref_num, cols, exps);
+
+                /* Create a query */
+                window_p window1 = window(60, 60, RANGE_BASE);
+
+                int batch_size = buffer_size;
+                query_p query1 = query(0, batch_size, window1, is_merging);
+                query_set_backend(query1, backend);
+                if (is_adapting) {
+                    query_set_planning(query1, QUERY_PLAN_ADAPTIVE);
+                } else if (is_costing) {
+                    query_set_planning(query1, QUERY_PLAN_COST);
+                }
+
+                query_add_operator(query1, (void *) project1, project1->operator);
+                query_add_operator(query1, (void *) select1, select1->operator);
+                query_add_operator(query1, (void *) reduce1, reduce1->operator);
+
+                application_p app = application(
+                    pipeline_depth, thread_num,
+                    query1,
+                    buffers, buffer_size, buffer_num,
+                    result, result_size);
+                application_run(app, work_load);
+
+                if (is_debug) {
+                    reference_t reference = {60, 60, select_category, value_load, NULL, SUM};
+                    check_windows(&reference, app, reduce1->output_schema, work_load);
+                }
+            }
+            break;
+        case JOIN:
+            /**
+             * Task events joined with the events of the machine they run on:
+             * 
+             * input: MachineEvents
+             *     long  time_stamp;
+             *     long  machine_id;
+             *     float cpu;
+             *     float ram;
+             * 
+             * query:
+             *     select *
+             *     from TaskEvents [range 60], MachineEvents [range 60]
+             *     where TaskEvents.machine_id == MachineEvents.machine_id and TaskEvents.event_type == 0
+             * 
+             * Every machine reports three times per window, so a task event joins with the latest three 
+             * reports of its machine. The machine events of the whole data set are inserted before the run 
+             * as the replayed buffers start over from timestamp 0, so only the first pass has join results
+             **/
+            fprintf(stdout, "========== Running join of google cluster dataset ===========\n");
+            {
+                schema_p schema2 = schema();
+                schema_add_attr(schema2, TYPE_LONG);  /* time_stamp */
+                schema_add_attr(schema2, TYPE_LONG);  /* machine_id */
+                schema_add_attr(schema2, TYPE_FLOAT); /* cpu */
+                schema_add_attr(schema2, TYPE_FLOAT); /* ram */
+
+                /* Construct a select: where column 5 (event_type) == 0 */
+                int col1 = 5;
+
+                enum comparor com1 = EQUAL;
+
+                int i1 = 0;
+                ref_value_p val1 = ref_value();
+                val1->i = &i1;
+
+                selection_p select1 = selection(schema1, col1, val1, com1);
+
+                /* Construct a join: column 3 (machine_id) with column 1 of the machine events */
+                int machine_num = GCD_MACHINE_NUM;
+                int period = 60;
+                int reports = 3;
+                long tuples = (long) buffer_size * buffer_num;
+                int event_num = (tuples / (period / reports) + 1) * machine_num;
+
+                join_p join1 = join(schema1, 3, schema2, 1, event_num);
+                join_set_results(join1, reports);
+
+                /* Synthesize the machine events */
+                int machine_tuple_size = schema2->size;
+                u_int8_t * machine_events = (u_int8_t *) malloc((long) event_num * machine_tuple_size);
+                for (int i=0; i<event_num; i++) {
+                    u_int8_t * tuple = machine_events + (long) i * machine_tuple_size;
+                    *((long *) (tuple +  0)) = (long) (i / machine_num) * (period / reports);
+                    *((long *) (tuple +  8)) = i % machine_num;
+                    *((float *) (tuple + 16)) = (float) (i % 100) / 100;
+                    *((float *) (tuple + 20)) = (float) (i % 10) / 10;
+                }
+                batch_p machine_batch = batch(event_num, 0, machine_events, event_num, machine_tuple_size);
+                join_insert(join1, machine_batch);
+                batch_free(machine_batch);
+
+                /* Create a query */
+                window_p window1 = window(period, period, RANGE_BASE);
+
+                int batch_size = buffer_size;
+                query_p query1 = query(0, batch_size, window1, is_merging);
+                query_set_backend(query1, backend);
+                if (is_adapting) {
+                    query_set_planning(query1, QUERY_PLAN_ADAPTIVE);
+                } else if (is_costing) {
+                    query_set_planning(query1, QUERY_PLAN_COST);
+                }
+
+                query_add_operator(query1, (void *) select1, select1->operator);
+                query_add_operator(query1, (void *) join1, join1->operator);
+
+                application_p app = application(
+                    pipeline_depth, thread_num,
+                    query1,
+                    buffers, buffer_size, buffer_num,
+                    result, result_size);
+                application_run(app, work_load);
+
+                if (is_debug) {
+                    check_join(join1, select_event_type_0, machine_events, event_num, app, work_load);
+                    if (backend != BACKEND_GPU) {
+                        check_selection(select1, app);
+                    }
+                }
+                free(machine_events);
+            }
+            break;
+        case CHAIN:
+            /**
+             * A chain of operators, planned into stages at the pipeline breakers:
+             * 
+             * query:
+             *     select timestamp, category, sum(load) as totalLoad
+             *     from (select timestamp, cpu * priority as load, category from TaskEvents where eventType == 0) 
+             *         [range 1024 slide 1024]
+             *     where load > 0
+             *     group by category
+             * 
+             * The projection is not fused into an aggregation, so with -f the plan is the first selection, 
+             * the projection, and the second selection fused into the aggregation. The few categories are 
+             * hashed into the tables of the work groups
+             **/
+            fprintf(stdout, "========== Running a chain of operators of google cluster dataset ===========\n");
+            {
+                /* Construct a select: where column 5 (event_type) == 0 */
+                int i1 = 0;
+                ref_value_p val1 = ref_value();
+                val1->i = &i1;
+
+                selection_p select1 = selection(schema1, 5, val1, EQUAL);
+
+                /* Construct a projection: cpu * priority, category */
+                int expression_num = 2;
+                projection_expression_t expressions [2] = {
+                    {PROJECT_MUL, 8, 7},
+                    {PROJECT_COLUMN, 6, 0}
+                };
+
+                projection_p project1 = projection(schema1, expression_num, expressions);
+
+                /* Construct a select on the projected tuples: where column 1 (load) > 0 */
+                float f2 = 0;
+                ref_value_p val2 = ref_value();
+                val2->f = &f2;
+
+                selection_p select2 = selection(project1->output_schema, 1, val2, GREATER);
+
+                /* Construct an aggregation: sum column 1 (load), group by column 2 (category) */
+                int ref_num = 1;
+                int cols [1] = {1};
+                enum aggregation_types exps [1] = {SUM};
+
+                int group_num = 1;
+                int groups[1] = {2};
+
+                aggregation_p aggregate1 = aggregation(project1->output_schema, ref_num, cols, exps, group_num, groups);
 
                 /* Create a query */
                 window_p window1 = window(1024, 1024, RANGE_BASE);
 
                 int batch_size = buffer_size;
                 query_p query1 = query(0, batch_size, window1, is_merging);
+                query_set_backend(query1, backend);
+                if (is_adapting) {
+                    query_set_planning(query1, QUERY_PLAN_ADAPTIVE);
+                } else if (is_costing) {
+                    query_set_planning(query1, QUERY_PLAN_COST);
+                }
 
+                query_add_operator(query1, (void *) select1, select1->operator);
+                query_add_operator(query1, (void *) project1, project1->operator);
+                query_add_operator(query1, (void *) select2, select2->operator);
                 query_add_operator(query1, (void *) aggregate1, aggregate1->operator);
 
                 application_p app = application(
-                    pipeline_depth, 
+                    pipeline_depth, thread_num,
                     query1,
                     buffers, buffer_size, buffer_num,
-                    result);
+                    result, result_size);
                 application_run(app, work_load);
+
+                if (is_debug) {
+                    reference_t reference = {1024, 1024, select_load, value_load, key_category, SUM};
+                    check_windows(&reference, app, aggregate1->output_schema, work_load);
+                    if (backend != BACKEND_GPU) {
+                        check_selection(select1, app);
+                    }
+                }
             }
             break;
         default:
@@ -299,6 +656,360 @@ void print_tuples(cbuf_handle_t cbufs [], int n) {
     printf("       ......\n");
 }
 
+static tuple_t const * get_tuple(application_p app, long i) {
+    return &((input_t const *) app->buffers[i / app->buffer_size])[i % app->buffer_size].tuple;
+}
+
+static int compare_groups(void const * a, void const * b) {
+    long x = ((check_group_t const *) a)->key;
+    long y = ((check_group_t const *) b)->key;
+    return (x > y) - (x < y);
+}
+
+/* The groups of window k, sorted by key, from tuple *first on (the first one of the window, which it moves to) */
+static int reference_window(reference_t const * reference, application_p app, long tuple_num, long k, 
+    long * first, check_group_t * groups) {
+
+    long start = k * reference->slide;
+    while (*first < tuple_num && get_tuple(app, *first)->time_stamp < start) {
+        (*first)++;
+    }
+
+    int n = 0;
+    for (long i=*first; i<tuple_num; i++) {
+        tuple_t const * tuple = get_tuple(app, i);
+        if (tuple->time_stamp >= start + reference->range) {
+            break;
+        }
+        if (! (* reference->selectf) (tuple)) {
+            continue;
+        }
+
+        groups[n].key = reference->keyf ? (* reference->keyf) (tuple) : 0;
+        groups[n].t = tuple->time_stamp;
+        groups[n].value = (* reference->valuef) (tuple);
+        groups[n].count = 1;
+        n++;
+    }
+
+    qsort(groups, n, sizeof(check_group_t), compare_groups);
+
+    int group_num = 0;
+    for (int i=0; i<n; i++) {
+        if (group_num > 0 && groups[group_num - 1].key == groups[i].key) {
+            groups[group_num - 1].value += groups[i].value;
+            groups[group_num - 1].count++;
+        } else {
+            groups[group_num++] = groups[i];
+        }
+    }
+
+    if (reference->type == AVG) {
+        for (int g=0; g<group_num; g++) {
+            groups[g].value /= groups[g].count;
+        }
+    }
+
+    return group_num;
+}
+
+void check_windows(reference_t const * reference, application_p app, schema_p output_schema, int work_load) {
+    if (work_load > app->buffer_num) {
+        printf("[MAIN] the results are only checked within one pass over the input buffers\n");
+        return;
+    }
+
+    long tuple_num = (long) work_load * app->buffer_size;
+    for (long i=1; i<tuple_num; i++) {
+        if (get_tuple(app, i)->time_stamp < get_tuple(app, i - 1)->time_stamp) {
+            fprintf(stderr, "error: the check needs the input in timestamp order (%s)\n", __FUNCTION__);
+            exit(1);
+        }
+    }
+    long window_num = get_tuple(app, tuple_num - 1)->time_stamp / reference->slide + 1;
+
+    /* A window has at most as many groups as tuples */
+    long window_capacity = 0;
+    for (long k=0, first=0; k<window_num; k++) {
+        long start = k * reference->slide;
+        while (first < tuple_num && get_tuple(app, first)->time_stamp < start) {
+            first++;
+        }
+
+        long i = first;
+        while (i < tuple_num && get_tuple(app, i)->time_stamp < start + reference->range) {
+            i++;
+        }
+        if (i - first > window_capacity) {
+            window_capacity = i - first;
+        }
+    }
+
+    check_group_t * groups = (check_group_t *) malloc((window_capacity + 1) * sizeof(check_group_t));
+    if (!groups) {
+        fprintf(stderr, "fatal error: out of memory\n");
+        exit(1);
+    }
+
+    /* The output stream wraps around if it cannot hold every result */
+    int tuple_size = output_schema->size;
+    long expected_num = 0;
+    for (long k=0, first=0; k<window_num; k++) {
+        expected_num += reference_window(reference, app, tuple_num, k, &first, groups);
+    }
+    if (expected_num * tuple_size > app->output->end - app->output->start) {
+        printf("[MAIN] the results are not checked as they do not fit in the output stream\n");
+        free(groups);
+        return;
+    }
+
+    result_handler_p handler = app->dispatchers[app->query->operator_num - 1]->handler;
+    long result_num = handler->output_position / tuple_size;
+
+    /* timestamp, value and then the count of a reduction or the group-by attribute of an aggregation */
+    int value_offset = schema_get_attr_offset(output_schema, 1);
+    int last_offset = schema_get_attr_offset(output_schema, 2);
+
+    check_group_t * results = (check_group_t *) malloc((result_num + 1) * sizeof(check_group_t));
+    if (!results) {
+        fprintf(stderr, "fatal error: out of memory\n");
+        exit(1);
+    }
+    for (long r=0; r<result_num; r++) {
+        u_int8_t const * result = app->output->buffer + app->output->start + r * tuple_size;
+
+        results[r].t = *((long const *) result);
+        results[r].value = *((float const *) (result + value_offset));
+        if (reference->keyf) {
+            results[r].key = (output_schema->attr[2] == TYPE_LONG) ? 
+                *((long const *) (result + last_offset)) : *((int const *) (result + last_offset));
+            results[r].count = -1;
+        } else {
+            results[r].key = 0;
+            results[r].count = *((int const *) (result + last_offset));
+        }
+    }
+
+    long r = 0;
+    int wrong = 0;
+    long checked_windows = 0;
+    for (long k=0, first=0; k<window_num && r<result_num; k++) {
+        int group_num = reference_window(reference, app, tuple_num, k, &first, groups);
+        if (group_num == 0) {
+            continue;
+        }
+
+        if (r + group_num > result_num) {
+            printf("[MAIN] window %ld has %ld of %d groups written\n", k, result_num - r, group_num);
+            wrong++;
+            r = result_num;
+            break;
+        }
+
+        check_group_t * written = results + r;
+        qsort(written, group_num, sizeof(check_group_t), compare_groups);
+        r += group_num;
+        checked_windows++;
+
+        long start = k * reference->slide;
+        for (int g=0; g<group_num; g++) {
+            bool is_same = written[g].key == groups[g].key &&
+                written[g].t >= start && written[g].t < start + reference->range &&
+                (written[g].count < 0 || written[g].count == groups[g].count) &&
+                fabs(written[g].value - groups[g].value) <= CHECK_TOLERANCE * fmax(1, fabs(groups[g].value));
+            if (!is_same) {
+                if (wrong < 8) {
+                    printf("[MAIN] window %ld group %ld has %f (%d tuples, at %ld) instead of group %ld with %f (%d tuples)\n", 
+                        k, written[g].key, written[g].value, written[g].count, written[g].t, 
+                        groups[g].key, groups[g].value, groups[g].count);
+                }
+                wrong++;
+            }
+        }
+    }
+    if (r < result_num) {
+        printf("[MAIN] %ld results are after the last window\n", result_num - r);
+        wrong++;
+    }
+
+    printf("[MAIN] checked %ld results of %ld windows against the reference: %d wrong\n", 
+        result_num, checked_windows, wrong);
+
+    free(groups);
+    free(results);
+
+    if (wrong > 0) {
+        fprintf(stderr, "error: the results differ from the reference (%s)\n", __FUNCTION__);
+        exit(1);
+    }
+}
+
+/* The first build tuple after timestamp t */
+static int build_upper_bound(u_int8_t const * build, int build_num, int tuple_size, long t) {
+    int lo = 0, hi = build_num;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (*((long const *) (build + (long) mid * tuple_size)) <= t) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+void check_join(join_p join, bool (* selectf) (tuple_t const * tuple), u_int8_t const * build, int build_num, 
+    application_p app, int work_load) {
+    if (work_load > app->buffer_num) {
+        printf("[MAIN] the results are only checked within one pass over the input buffers\n");
+        return;
+    }
+
+    int probe_size = join->input_schema->size;
+    int build_size = join->build_schema->size;
+    int key_offset = schema_get_attr_offset(join->build_schema, join->build_key);
+    int tuple_size = join->output_schema->size;
+
+    long tuple_num = (long) work_load * app->buffer_size;
+    long expected_num = 0;
+    for (long i=0; i<tuple_num; i++) {
+        tuple_t const * probe = get_tuple(app, i);
+        if (!selectf(probe)) {
+            continue;
+        }
+        int last = build_upper_bound(build, build_num, build_size, probe->time_stamp);
+        for (int j = build_upper_bound(build, build_num, build_size, probe->time_stamp - join->window_size); j < last; j++) {
+            expected_num += *((long const *) (build + (long) j * build_size + key_offset)) == probe->machine_id;
+        }
+    }
+    if (expected_num * tuple_size > app->output->end - app->output->start) {
+        printf("[MAIN] the results are not checked as they do not fit in the output stream\n");
+        return;
+    }
+
+    result_handler_p handler = app->dispatchers[app->query->operator_num - 1]->handler;
+    long result_num = handler->output_position / tuple_size;
+    u_int8_t const * results = app->output->buffer + app->output->start;
+
+    long r = 0;
+    int wrong = 0;
+    for (long i=0; i<tuple_num && r<result_num; i++) {
+        tuple_t const * probe = get_tuple(app, i);
+        if (!selectf(probe)) {
+            continue;
+        }
+
+        int last = build_upper_bound(build, build_num, build_size, probe->time_stamp);
+        int first = build_upper_bound(build, build_num, build_size, probe->time_stamp - join->window_size);
+        int match_num = 0;
+        for (int j=first; j<last; j++) {
+            match_num += *((long const *) (build + (long) j * build_size + key_offset)) == probe->machine_id;
+        }
+        if (r + match_num > result_num) {
+            printf("[MAIN] tuple %ld has %ld of %d results written\n", i, result_num - r, match_num);
+            wrong++;
+            r = result_num;
+            break;
+        }
+
+        /* Every match is one of the results of the tuple */
+        for (int j=first; j<last; j++) {
+            u_int8_t const * b = build + (long) j * build_size;
+            if (*((long const *) (b + key_offset)) != probe->machine_id) {
+                continue;
+            }
+
+            bool is_found = false;
+            for (long k=r; k<r+match_num && !is_found; k++) {
+                u_int8_t const * result = results + k * tuple_size;
+                is_found = memcmp(result, probe, probe_size) == 0 && memcmp(result + probe_size, b, build_size) == 0;
+            }
+            if (!is_found) {
+                if (wrong < 8) {
+                    printf("[MAIN] tuple %ld at %ld misses its result with the build tuple at %ld\n", 
+                        i, probe->time_stamp, *((long const *) b));
+                }
+                wrong++;
+            }
+        }
+        r += match_num;
+    }
+    if (r < result_num) {
+        printf("[MAIN] %ld results are after the last tuple\n", result_num - r);
+        wrong++;
+    }
+
+    printf("[MAIN] checked %ld join results against the reference: %d wrong\n", result_num, wrong);
+
+    if (wrong > 0) {
+        fprintf(stderr, "error: the results differ from the reference (%s)\n", __FUNCTION__);
+        exit(1);
+    }
+}
+
+void check_selection(selection_p select, application_p app) {
+    if (!cpu_supports_avx2()) {
+        printf("[MAIN] AVX2 is not supported and the selection is not checked\n");
+        return;
+    }
+
+    int tuples = app->buffer_size;
+    int tuple_size = select->input_schema->size;
+
+    selection_cpu_setup(select, tuples, app->query->window, NULL);
+    int partition_num = select->threads[0] / select->threads_per_group[0];
+
+    batch_p input = batch(tuples, 0, app->buffers[0], tuples, tuple_size);
+
+    /* 0 is vectorised and 1 is scalar */
+    u_int8_t * outputs [2][3];
+    for (int v=0; v<2; v++) {
+        outputs[v][0] = (u_int8_t *) malloc((long) tuples * sizeof(int));
+        outputs[v][1] = (u_int8_t *) malloc((long) partition_num * sizeof(int));
+        outputs[v][2] = (u_int8_t *) malloc((long) tuples * tuple_size);
+        if (!outputs[v][0] || !outputs[v][1] || !outputs[v][2]) {
+            fprintf(stderr, "fatal error: out of memory\n");
+            exit(1);
+        }
+
+        cpu_set_avx2(v == 0);
+        selection_cpu_process(select, input, app->query->window, outputs[v], NULL);
+    }
+    cpu_set_avx2(1);
+
+    int const * flags [2] = {(int const *) outputs[0][0], (int const *) outputs[1][0]};
+    int const * partitions [2] = {(int const *) outputs[0][1], (int const *) outputs[1][1]};
+
+    int wrong = 0;
+    for (int i=0; i<tuples; i++) {
+        wrong += (flags[0][i] != 0) != (flags[1][i] != 0);
+    }
+
+    long selected = 0;
+    for (int p=0; p<partition_num; p++) {
+        wrong += partitions[0][p] != partitions[1][p];
+        selected += partitions[1][p];
+    }
+    if (wrong == 0 && memcmp(outputs[0][2], outputs[1][2], selected * tuple_size) != 0) {
+        wrong++;
+    }
+
+    printf("[MAIN] checked the AVX2 selection against the scalar one: %ld of %d tuples selected, %d differ\n", 
+        selected, tuples, wrong);
+
+    for (int v=0; v<2; v++) {
+        for (int i=0; i<3; i++) {
+            free(outputs[v][i]);
+        }
+    }
+    batch_free(input);
+
+    if (wrong > 0) {
+        fprintf(stderr, "error: the AVX2 selection differs from the scalar one (%s)\n", __FUNCTION__);
+        exit(1);
+    }
+}
+
 void read_input_buffers(cbuf_handle_t cbufs [], int buffer_num, int tuple_per_insert) {
     // int extraBytes = 5120 * TUPLE_SIZE; // for?
 
@@ -347,10 +1058,17 @@ void read_input_buffers(cbuf_handle_t cbufs [], int buffer_num, int tuple_per_in
 
         input_t tuple;
         tuple.tuple.time_stamp = line_num;
-        tuple.tuple.job_id = 0;
-        tuple.tuple.task_id = 0;
-        tuple.tuple.machine_id = 0;
+        long job_num = GCD_JOB_WARMUP_NUM;
+        if (line_num >= GCD_JOB_WARMUP) {
+            job_num += (line_num - GCD_JOB_WARMUP) / GCD_JOB_RAMP;
+        }
+        tuple.tuple.job_id = GCD_JOB_BASE + (long) (((u_int64_t) (line_num / 2) * 2654435761UL) % job_num);
+        tuple.tuple.task_id = line_num % 2;
+        tuple.tuple.machine_id = (long) ((((u_int64_t) line_num * 2654435761UL) >> 16) % GCD_MACHINE_NUM);
         tuple.tuple.user_id = 0;
+        tuple.tuple.ram = 0;
+        tuple.tuple.disk = 0;
+        tuple.tuple.constraints = 0;
 
         /* Load file into memory */
         for (int i = 0; i < 4; i++) {
@@ -418,17 +1136,26 @@ int main(int argc, char * argv[]) {
 
     /* Arguments */
     bool is_merging = false;
+    bool is_costing = false;
+    bool is_adapting = false;
     bool is_debug = false;
     int work_load = -1; // default to be 64MB
     int batch_size = 32; // default to be 32MB per batch
     int buffer_num = 1;
-    int pipeline_depth = 2;
+    int pipeline_depth = 2; // -p 0: results are read back per batch and completions are event-driven
+    bool is_cpu = false;
+    bool is_hybrid = false;
+    int thread_num = 1;
     int tuple_per_insert = batch_size * ((1024 * 1024) / TUPLE_SIZE);
     enum test_cases mode = QUERY1;
 
     parse_arguments(argc, argv, 
         &mode, &work_load, &batch_size, &buffer_num, &pipeline_depth,
-        &is_merging, &is_debug);
+        &is_merging, &is_costing, &is_adapting, &is_debug, &is_cpu, &is_hybrid, &thread_num);
+
+    if (mode == CPU) {
+        is_cpu = true;
+    }
 
     if (work_load == -1) {
         work_load = batch_size;
@@ -469,14 +1196,23 @@ int main(int argc, char * argv[]) {
 
     print_tuples(cbufs, 32);
 
-    /* Create output buffers */
-    u_int8_t * result = (u_int8_t *) malloc( 4 * batch_size * TUPLE_SIZE * sizeof(u_int8_t));
+    /* Create output buffers, the output stream wraps around at the end */
+    long result_size = 6L * batch_size * TUPLE_SIZE;
+    if (is_debug && work_load > 1) {
+        /* Large enough for the results of the test queries not to wrap around, so that all are checked */
+        long checked_size = 2L * work_load * batch_size * TUPLE_SIZE;
+        if (checked_size > result_size) {
+            result_size = checked_size;
+        }
+    }
+    u_int8_t * result = (u_int8_t *) malloc(result_size * sizeof(u_int8_t));
 
     /* Start processing */
     run_processing_gpu(
         buffers, batch_size, buffer_num, /* input */
-        result, /* output */
-        mode, work_load, pipeline_depth, is_merging, is_debug);  /* configs */
+        result, result_size, /* output */
+        mode, work_load, pipeline_depth, is_merging, is_costing, is_adapting, is_debug,   /* configs */
+        is_cpu ? BACKEND_CPU : (is_hybrid ? BACKEND_HYBRID : BACKEND_GPU), thread_num);
 
     /* Clear up */
     /* Temperory using 1 buffer */
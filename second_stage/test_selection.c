@@ -330,6 +330,8 @@ int main(int argc, char * argv[]) {
 
     /* Arguments */
     bool is_merging = false;
+    bool is_costing = false;
+    bool is_adapting = false;
     bool is_debug = false;
     int work_load = 32; // default to be 32MB
     int batch_size = 32; // default to be 32MB per batch
@@ -338,9 +340,13 @@ int main(int argc, char * argv[]) {
     int tuple_per_insert = batch_size * ((1024 * 1024) / TUPLE_SIZE);
     enum test_cases mode = QUERY1;
 
+    bool is_cpu = false;
+    bool is_hybrid = false;
+    int thread_num = 1;
+
     parse_arguments(argc, argv, 
         &mode, &work_load, &batch_size, &buffer_num, &pipeline_num,
-        &is_merging, &is_debug);
+        &is_merging, &is_costing, &is_adapting, &is_debug, &is_cpu, &is_hybrid, &thread_num);
 
     if (work_load < batch_size) {
         printf("Reset batch size to be %d\n", work_load);
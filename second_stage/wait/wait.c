@@ -0,0 +1,47 @@
+#include "wait.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static wait_strategy_t strategies [WAIT_STAGE_NUM];
+
+static char const * stage_names [WAIT_STAGE_NUM] = {
+    "dispatcher",
+    "scheduler",
+    "result_handler",
+    "event_manager"
+};
+
+void wait_set_strategy(enum wait_stages stage, int spins, int yields) {
+    strategies[stage].spins = spins;
+    strategies[stage].yields = yields;
+}
+
+wait_strategy_p wait_get_strategy(enum wait_stages stage) {
+    return &strategies[stage];
+}
+
+int wait_parse_strategy(char const * arg) {
+    int spins, yields;
+
+    char const * eq = strchr(arg, '=');
+    char const * values = (eq) ? eq + 1 : arg;
+    if (sscanf(values, "%d:%d", &spins, &yields) != 2 || spins < 0 || yields < 0) {
+        return -1;
+    }
+
+    if (! eq) {
+        for (int i=0; i<WAIT_STAGE_NUM; i++) {
+            wait_set_strategy(i, spins, yields);
+        }
+        return 0;
+    }
+
+    for (int i=0; i<WAIT_STAGE_NUM; i++) {
+        if (strlen(stage_names[i]) == (size_t) (eq - arg) && strncmp(arg, stage_names[i], eq - arg) == 0) {
+            wait_set_strategy(i, spins, yields);
+            return 0;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,62 @@
+#ifndef __WAIT_H_
+#define __WAIT_H_
+
+#include <sched.h>
+
+/**
+ * A thread waiting for work first spins, then yields its core, and only then parks on its condition 
+ * variable. Spinning hands work over in microseconds at the cost of a busy core, parking saves the 
+ * core at the cost of a futex wake-up and a context switch per hand-over.
+ **/
+typedef struct wait_strategy * wait_strategy_p;
+typedef struct wait_strategy {
+    int spins;  /* Polls with a pause in between */
+    int yields; /* Polls with a sched_yield in between */
+} wait_strategy_t;
+
+enum wait_stages {
+    WAIT_DISPATCHER,
+    WAIT_SCHEDULER,
+    WAIT_RESULT_HANDLER,
+    WAIT_EVENT_MANAGER,
+    WAIT_STAGE_NUM
+};
+
+/* By default every stage parks at once */
+void wait_set_strategy(enum wait_stages stage, int spins, int yields);
+
+wait_strategy_p wait_get_strategy(enum wait_stages stage);
+
+/* Parses "stage=spins:yields" or "spins:yields" for all stages; returns -1 if malformed */
+int wait_parse_strategy(char const * arg);
+
+static inline void wait_pause() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__ ("yield");
+#endif
+}
+
+/**
+ * Polls condition without holding the lock, as long as the strategy of stage allows. The caller 
+ * then takes the lock and parks on its condition variable as usual if the condition is still false
+ **/
+#define WAIT_POLL(stage, condition) \
+    do { \
+        wait_strategy_p __strategy = wait_get_strategy(stage); \
+        for (int __i = 0; __i < __strategy->spins && !(condition); __i++) \
+            wait_pause(); \
+        for (int __i = 0; __i < __strategy->yields && !(condition); __i++) \
+            sched_yield(); \
+    } while (0)
+
+/* Start-up handshake: waits for a new thread to set flag */
+static inline void wait_until_set(volatile unsigned * flag) {
+    while (! *flag) {
+        wait_pause();
+        sched_yield();
+    }
+}
+
+#endif
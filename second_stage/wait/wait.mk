@@ -0,0 +1,9 @@
+WA_OBJDIR=$(OBJDIR)/wait
+$(WA_OBJDIR): ; mkdir -p $@
+
+WA_DEPDIR=$(DEPDIR)/wait
+$(WA_DEPDIR): ; mkdir -p $@
+
+SRCS += wait/wait.c
+
+LIBDIR += $(WA_OBJDIR) $(WA_DEPDIR)
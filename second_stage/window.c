@@ -20,3 +20,14 @@ window_p window(int size, int slide, enum window_types type) {
 
     return p;
 }
+
+long window_get_first_open(window_p window, long previous_pane_id) {
+    long panes_per_window = window->size / window->pane_size;
+    long panes_per_slide = window->slide / window->pane_size;
+
+    /* Window w takes panes [w * panes_per_slide, w * panes_per_slide + panes_per_window) */
+    if (previous_pane_id < panes_per_window) {
+        return 0;
+    }
+    return (previous_pane_id - panes_per_window) / panes_per_slide + 1;
+}
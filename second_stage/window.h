@@ -8,6 +8,18 @@ enum window_types {
     COUNTER_BASE
 };
 
+/**
+ * What part of a window a batch holds, in the order of the window counts of an output: one that
+ * opened in an earlier batch and closes in this one, one that spans the whole batch, one that opens
+ * and closes in it, and one that opens in it and closes in a later batch
+ **/
+enum window_kinds {
+    WINDOW_CLOSING,
+    WINDOW_PENDING,
+    WINDOW_COMPLETE,
+    WINDOW_OPENING
+};
+
 typedef struct window * window_p;
 typedef struct window {
     int size;
@@ -19,4 +31,10 @@ typedef struct window {
 
 window_p window(int size, int slide, enum window_types type);
 
+/**
+ * The first window that is still open after pane previous_pane_id, which is the first window that 
+ * closes in the next batch if any does. Windows of a batch are numbered from it.
+ **/
+long window_get_first_open(window_p window, long previous_pane_id);
+
 #endif
\ No newline at end of file